@@ -1,5 +1,7 @@
 #include "Executable.h"
 
+#include <algorithm>
+
 BytecodeStream::iterator BytecodeStream::begin()
 {
 	return m_bytecode.begin();
@@ -126,10 +128,31 @@ const MidoriValue& MidoriExecutable::GetConstant(int index) const
 
 int MidoriExecutable::AddConstant(MidoriValue&& value)
 {
+	if (MidoriTraceable* traceable = value.GetTraceable())
+	{
+		AddConstantRoot(traceable);
+	}
+
 	m_constants.emplace_back(std::move(value));
 	return static_cast<int>(m_constants.size()) - 1;
 }
 
+int MidoriExecutable::AddTextConstant(MidoriText&& text)
+{
+	std::unordered_map<MidoriText, int>::const_iterator it = m_text_constants.find(text);
+	if (it != m_text_constants.cend())
+	{
+		return it->second;
+	}
+
+	MidoriTraceable* traceable = MidoriTraceable::AllocateTraceable(std::move(text));
+	m_text_constants.emplace(traceable->GetText(), static_cast<int>(m_constants.size()));
+#ifdef MIDORI_TEXT_INTERNING
+	m_heap.m_interned_texts.emplace(traceable->GetText(), traceable);
+#endif
+	return AddConstant(traceable);
+}
+
 int MidoriExecutable::AddGlobalVariable(MidoriText&& name)
 {
 	m_globals.emplace_back(std::move(name));
@@ -141,9 +164,43 @@ const MidoriText& MidoriExecutable::GetGlobalVariable(int index) const
 	return m_globals[static_cast<size_t>(index)];
 }
 
+void MidoriExecutable::AddForeignGlobalVariable(int global_index, int arity)
+{
+	m_foreign_global_arities[global_index] = arity;
+}
+
+std::optional<int> MidoriExecutable::GetForeignGlobalVariableArity(int global_index) const
+{
+	std::unordered_map<int, int>::const_iterator it = m_foreign_global_arities.find(global_index);
+	if (it == m_foreign_global_arities.cend())
+	{
+		return std::nullopt;
+	}
+
+	return it->second;
+}
+
+int MidoriExecutable::AddForeignFunction(MidoriText&& name)
+{
+	ForeignFunctionNames::const_iterator it = std::ranges::find(m_foreign_functions, name);
+	if (it != m_foreign_functions.cend())
+	{
+		return static_cast<int>(std::distance(m_foreign_functions.cbegin(), it));
+	}
+
+	m_foreign_functions.emplace_back(std::move(name));
+	return static_cast<int>(m_foreign_functions.size()) - 1;
+}
+
+const MidoriText& MidoriExecutable::GetForeignFunction(int index) const
+{
+	return m_foreign_functions[static_cast<size_t>(index)];
+}
+
 void MidoriExecutable::AddConstantRoot(MidoriTraceable* root)
 {
 	m_constant_roots.emplace(root);
+	m_heap.m_static_bytes_allocated += root->GetSize();
 }
 
 void MidoriExecutable::AttachProcedures(Procedures&& bytecode)
@@ -151,6 +208,11 @@ void MidoriExecutable::AttachProcedures(Procedures&& bytecode)
 	m_procedures = std::move(bytecode);
 }
 
+void MidoriExecutable::AttachProcedureArities(std::vector<int>&& procedure_arities)
+{
+	m_procedure_arities = std::move(procedure_arities);
+}
+
 #ifdef DEBUG
 void MidoriExecutable::AttachProcedureNames(std::vector<MidoriText>&& procedure_names)
 {
@@ -173,6 +235,11 @@ const MidoriTraceable::GarbageCollectionRoots& MidoriExecutable::GetConstantRoot
 	return m_constant_roots;
 }
 
+MidoriHeap& MidoriExecutable::GetHeap()
+{
+	return m_heap;
+}
+
 OpCode MidoriExecutable::ReadByteCode(int instr_index, int proc_index) const
 {
 	return m_procedures[static_cast<size_t>(proc_index)].ReadByteCode(instr_index);
@@ -188,7 +255,17 @@ int MidoriExecutable::GetProcedureCount() const
 	return static_cast<int>(m_procedures.size());
 }
 
+int MidoriExecutable::GetProcedureArity(int proc_index) const
+{
+	return m_procedure_arities[static_cast<size_t>(proc_index)];
+}
+
 int MidoriExecutable::GetGlobalVariableCount() const
 {
 	return static_cast<int>(m_globals.size());
 }
+
+int MidoriExecutable::GetForeignFunctionCount() const
+{
+	return static_cast<int>(m_foreign_functions.size());
+}
@@ -20,6 +20,14 @@ enum class OpCode : uint8_t
 	CREATE_ARRAY,
 	GET_ARRAY,
 	SET_ARRAY,
+	GET_ARRAY_ELEMENT,
+	SET_ARRAY_ELEMENT,
+	GET_ARRAY_ELEMENT_INTEGER,
+	GET_ARRAY_ELEMENT_FRACTION,
+	GET_ARRAY_ELEMENT_BOOL,
+	SET_ARRAY_ELEMENT_INTEGER,
+	SET_ARRAY_ELEMENT_FRACTION,
+	SET_ARRAY_ELEMENT_BOOL,
 	DUP_ARRAY,
 	ADD_BACK_ARRAY,
 	ADD_FRONT_ARRAY,
@@ -96,15 +104,27 @@ enum class OpCode : uint8_t
 	IF_FRACTION_NOT_EQUAL,
 
 	// Switch
-	LOAD_TAG,
+	SWITCH_TABLE,
 	SET_TAG,
 
 	// Callable
 	CALL_FOREIGN,
+	CALL_FOREIGN_INDEXED,
 	CALL_DEFINED,
+	CALL_GLOBAL,
+	CALL_LOCAL,
+	CALL_CELL,
+	CALL_DIRECT,
+	TAIL_CALL,
 	CONSTRUCT_STRUCT,
 	CONSTRUCT_UNION,
 
+	// Generator Operations
+	CREATE_GENERATOR,
+	RESUME_GENERATOR,
+	YIELD,
+	FINISH_GENERATOR,
+
 	// Variable Operations
 	ALLOCATE_CLOSURE,
 	CONSTRUCT_CLOSURE,
@@ -120,6 +140,32 @@ enum class OpCode : uint8_t
 	GET_MEMBER,
 	SET_MEMBER,
 
+	// Register Operations (R: frame slot, I: 32-bit immediate)
+	ADD_INTEGER_RR,
+	ADD_INTEGER_RI,
+	SUBTRACT_INTEGER_RR,
+	SUBTRACT_INTEGER_RI,
+	MULTIPLY_INTEGER_RR,
+	MULTIPLY_INTEGER_RI,
+	MODULO_INTEGER_RR,
+	MODULO_INTEGER_RI,
+	ADD_INTEGER_RRR,
+	ADD_INTEGER_RRI,
+	SUBTRACT_INTEGER_RRR,
+	SUBTRACT_INTEGER_RRI,
+	IF_INTEGER_LESS_RR,
+	IF_INTEGER_LESS_RI,
+	IF_INTEGER_LESS_EQUAL_RR,
+	IF_INTEGER_LESS_EQUAL_RI,
+	IF_INTEGER_GREATER_RR,
+	IF_INTEGER_GREATER_RI,
+	IF_INTEGER_GREATER_EQUAL_RR,
+	IF_INTEGER_GREATER_EQUAL_RI,
+	IF_INTEGER_EQUAL_RR,
+	IF_INTEGER_EQUAL_RI,
+	IF_INTEGER_NOT_EQUAL_RR,
+	IF_INTEGER_NOT_EQUAL_RI,
+
 	// Stack Operations
 	POP,
 	DUP,
@@ -178,6 +224,7 @@ class MidoriExecutable
 public:
 	using StaticData = std::vector<MidoriValue>;
 	using GlobalNames = std::vector<MidoriText>;
+	using ForeignFunctionNames = std::vector<MidoriText>;
 	using Procedures = std::vector<BytecodeStream>;
 
 #ifdef DEBUG
@@ -185,24 +232,44 @@ public:
 #endif
 
 private:
+	MidoriHeap m_heap; // holds the constants, and everything the program allocates once it runs
 	MidoriTraceable::GarbageCollectionRoots m_constant_roots;
 	StaticData m_constants;
+	std::unordered_map<MidoriText, int> m_text_constants; // equal text literals share a constant
 	GlobalNames m_globals;
+	ForeignFunctionNames m_foreign_functions; // resolved once by the virtual machine before execution starts
 	Procedures m_procedures;
+	std::vector<int> m_procedure_arities; // indexed like the procedures
+	std::unordered_map<int, int> m_foreign_global_arities; // global index -> arity of the foreign function it holds
 
 public:
 	const MidoriValue& GetConstant(int index) const;
 
+	// roots the traceable a constant points to
 	int AddConstant(MidoriValue&& value);
 
+	// equal text literals share one constant, the text is only allocated the first time
+	int AddTextConstant(MidoriText&& text);
+
 	int AddGlobalVariable(MidoriText&& name);
 
 	const MidoriText& GetGlobalVariable(int index) const;
 
-	void AddConstantRoot(MidoriTraceable* root);
+	// the value of such a global is the index of its foreign function, not a closure
+	void AddForeignGlobalVariable(int global_index, int arity);
+
+	// std::nullopt if the global does not hold a foreign function
+	std::optional<int> GetForeignGlobalVariableArity(int global_index) const;
+
+	// foreign functions are identified by their index in the foreign function table at runtime
+	int AddForeignFunction(MidoriText&& name);
+
+	const MidoriText& GetForeignFunction(int index) const;
 
 	void AttachProcedures(Procedures&& bytecode);
 
+	void AttachProcedureArities(std::vector<int>&& procedure_arities);
+
 #ifdef DEBUG
 	void AttachProcedureNames(std::vector<MidoriText>&& procedure_names);
 #endif
@@ -213,11 +280,20 @@ public:
 
 	const MidoriTraceable::GarbageCollectionRoots& GetConstantRoots();
 
+	MidoriHeap& GetHeap();
+
 	OpCode ReadByteCode(int instr_index, int proc_index) const;
 
 	int GetByteCodeSize(int proc_index) const;
 
 	int GetProcedureCount() const;
 
+	int GetProcedureArity(int proc_index) const;
+
 	int GetGlobalVariableCount() const;
+
+	int GetForeignFunctionCount() const;
+
+private:
+	void AddConstantRoot(MidoriTraceable* root);
 };
\ No newline at end of file
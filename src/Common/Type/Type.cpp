@@ -2,32 +2,43 @@
 
 #include <algorithm>
 
-std::unordered_map<std::string, MidoriType> MidoriTypeUtil::s_types_by_name =
+MidoriTypeUtil::TypeTable::TypeTable() : m_enclosing_table(s_current_table)
 {
 	// built-in types
-	{"Int"s, MidoriType(IntegerType())},
-	{"Frac"s, MidoriType(FractionType())},
-	{"Text"s, MidoriType(TextType())},
-	{"Bool"s, MidoriType(BoolType())},
-	{"Unit"s, MidoriType(UnitType())},
-};
-
-std::unordered_map<const MidoriType*, std::string> MidoriTypeUtil::s_names_by_type =
-{
-	// built-in types 
-	{&s_types_by_name["Int"s], "Int"s},
-	{&s_types_by_name["Frac"s], "Frac"s},
-	{&s_types_by_name["Text"s], "Text"s},
-	{&s_types_by_name["Bool"s], "Bool"s},
-	{&s_types_by_name["Unit"s], "Unit"s},
-};
+	m_types_by_name.emplace("Int"s, MidoriType(IntegerType()));
+	m_types_by_name.emplace("Frac"s, MidoriType(FractionType()));
+	m_types_by_name.emplace("Text"s, MidoriType(TextType()));
+	m_types_by_name.emplace("Bool"s, MidoriType(BoolType()));
+	m_types_by_name.emplace("Unit"s, MidoriType(UnitType()));
+	for (const auto& [name, type] : m_types_by_name)
+	{
+		m_names_by_type.emplace(&type, name);
+	}
+
+	s_current_table = this;
+}
+
+MidoriTypeUtil::TypeTable::~TypeTable()
+{
+	s_current_table = m_enclosing_table;
+}
+
+std::unordered_map<std::string, MidoriType>& MidoriTypeUtil::GetTypesByName()
+{
+	return s_current_table->m_types_by_name;
+}
+
+std::unordered_map<const MidoriType*, std::string>& MidoriTypeUtil::GetNamesByType()
+{
+	return s_current_table->m_names_by_type;
+}
 
 const MidoriType* MidoriTypeUtil::InsertType(const std::string& name, MidoriType&& type)
 {
-	s_types_by_name.emplace(name, std::move(type));
-	s_names_by_type.emplace(&s_types_by_name[name], name);
+	GetTypesByName().emplace(name, std::move(type));
+	GetNamesByType().emplace(&GetTypesByName()[name], name);
 
-	return &s_types_by_name[name];
+	return &GetTypesByName()[name];
 }
 
 const MidoriType* MidoriTypeUtil::InsertUnionType(const std::string& name)
@@ -44,9 +55,9 @@ const MidoriType* MidoriTypeUtil::InsertArrayType(const MidoriType* element_type
 {
 	std::string array_type_name = "Array["s + GetTypeName(element_type) + "]"s;
 
-	if (s_types_by_name.contains(array_type_name))
+	if (GetTypesByName().contains(array_type_name))
 	{
-		return &s_types_by_name[array_type_name];
+		return &GetTypesByName()[array_type_name];
 	}
 	else
 	{
@@ -54,6 +65,20 @@ const MidoriType* MidoriTypeUtil::InsertArrayType(const MidoriType* element_type
 	}
 }
 
+const MidoriType* MidoriTypeUtil::InsertGeneratorType(const MidoriType* element_type)
+{
+	std::string generator_type_name = "Generator["s + GetTypeName(element_type) + "]"s;
+
+	if (GetTypesByName().contains(generator_type_name))
+	{
+		return &GetTypesByName()[generator_type_name];
+	}
+	else
+	{
+		return InsertType(generator_type_name, MidoriType(GeneratorType{ element_type }));
+	}
+}
+
 const MidoriType* MidoriTypeUtil::InsertFunctionType(const std::vector<const MidoriType*>& param_types, const MidoriType* return_type, bool is_foreign)
 {
 	std::string function_type_name = is_foreign ? "FFI ("s : "("s;
@@ -74,9 +99,9 @@ const MidoriType* MidoriTypeUtil::InsertFunctionType(const std::vector<const Mid
 	function_type_name.append("->"s);
 	function_type_name.append(GetTypeName(return_type));
 
-	if (s_types_by_name.contains(function_type_name))
+	if (GetTypesByName().contains(function_type_name))
 	{
-		return &s_types_by_name[function_type_name];
+		return &GetTypesByName()[function_type_name];
 	}
 	else
 	{
@@ -86,12 +111,12 @@ const MidoriType* MidoriTypeUtil::InsertFunctionType(const std::vector<const Mid
 
 const MidoriType* MidoriTypeUtil::GetType(const std::string& name)
 {
-	return &s_types_by_name[name];
+	return &GetTypesByName()[name];
 }
 
 const std::string& MidoriTypeUtil::GetTypeName(const MidoriType* type)
 {
-	return s_names_by_type[type];
+	return GetNamesByType()[type];
 }
 
 bool MidoriTypeUtil::IsFractionType(const MidoriType* type)
@@ -154,6 +179,16 @@ const ArrayType& MidoriTypeUtil::GetArrayType(const MidoriType* type)
 	return std::get<ArrayType>(*type);
 }
 
+bool MidoriTypeUtil::IsGeneratorType(const MidoriType* type)
+{
+	return std::holds_alternative<GeneratorType>(*type);
+}
+
+const GeneratorType& MidoriTypeUtil::GetGeneratorType(const MidoriType* type)
+{
+	return std::get<GeneratorType>(*type);
+}
+
 bool MidoriTypeUtil::IsFunctionType(const MidoriType* type)
 {
 	return std::holds_alternative<FunctionType>(*type);
@@ -19,17 +19,23 @@ struct BoolType
 struct UnitType
 {};
 struct ArrayType;
+struct GeneratorType;
 struct FunctionType;
 struct StructType;
 struct UnionType;
 
-using MidoriType = std::variant<FractionType, TextType, BoolType, UnitType, ArrayType, FunctionType, IntegerType, StructType, UnionType>;
+using MidoriType = std::variant<FractionType, TextType, BoolType, UnitType, ArrayType, GeneratorType, FunctionType, IntegerType, StructType, UnionType>;
 
 struct ArrayType
 {
 	const MidoriType* m_element_type;
 };
 
+struct GeneratorType
+{
+	const MidoriType* m_element_type;
+};
+
 struct FunctionType
 {
 	std::vector<const MidoriType*> m_param_types;
@@ -116,6 +122,16 @@ inline bool operator!=(const ArrayType& lhs, const ArrayType& rhs)
 	return !(lhs == rhs);
 }
 
+inline bool operator==(const GeneratorType& lhs, const GeneratorType& rhs)
+{
+	return *lhs.m_element_type == *rhs.m_element_type;
+}
+
+inline bool operator!=(const GeneratorType& lhs, const GeneratorType& rhs)
+{
+	return !(lhs == rhs);
+}
+
 inline bool operator==(const FunctionType& lhs, const FunctionType& rhs)
 {
 	if (lhs.m_param_types.size() != rhs.m_param_types.size())
@@ -184,11 +200,36 @@ inline bool operator!=(const MidoriType& lhs, const MidoriType& rhs)
 
 class MidoriTypeUtil
 {
+public:
+
+	// The types of one compilation. A table is the current one of the thread that creates it until it is destroyed,
+	// so compilations on different threads never share type state.
+	class TypeTable
+	{
+	public:
+		TypeTable();
+
+		~TypeTable();
+
+		TypeTable(const TypeTable&) = delete;
+
+		TypeTable& operator=(const TypeTable&) = delete;
+
+	private:
+		friend class MidoriTypeUtil;
+
+		std::unordered_map<std::string, MidoriType> m_types_by_name;
+		std::unordered_map<const MidoriType*, std::string> m_names_by_type;
+		TypeTable* m_enclosing_table;
+	};
+
 private:
 
-	static std::unordered_map<std::string, MidoriType> s_types_by_name;
+	static inline thread_local TypeTable* s_current_table = nullptr;
+
+	static std::unordered_map<std::string, MidoriType>& GetTypesByName();
 
-	static std::unordered_map<const MidoriType*, std::string> s_names_by_type;
+	static std::unordered_map<const MidoriType*, std::string>& GetNamesByType();
 
 	static const MidoriType* InsertType(const std::string& name, MidoriType&& type);
 
@@ -200,6 +241,8 @@ public:
 
 	static const MidoriType* InsertArrayType(const MidoriType* element_type);
 
+	static const MidoriType* InsertGeneratorType(const MidoriType* element_type);
+
 	static const MidoriType* InsertFunctionType(const std::vector<const MidoriType*>& param_types, const MidoriType* return_type, bool is_foreign = false);
 
 	static const MidoriType* GetType(const std::string& name);
@@ -230,6 +273,10 @@ public:
 
 	static const ArrayType& GetArrayType(const MidoriType* type);
 
+	static bool IsGeneratorType(const MidoriType* type);
+
+	static const GeneratorType& GetGeneratorType(const MidoriType* type);
+
 	static bool IsFunctionType(const MidoriType* type);
 
 	static const FunctionType& GetFunctionType(const MidoriType* type);
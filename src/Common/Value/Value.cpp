@@ -2,8 +2,13 @@
 #include "Common/Printer/Printer.h"
 
 #include <algorithm>
+#include <bit>
+#include <cstring>
 #include <execution>
+#include <memory>
 #include <ranges>
+#include <string_view>
+#include <utility>
 
 namespace
 {
@@ -54,6 +59,121 @@ namespace
 	}
 }
 
+#ifdef MIDORI_NAN_BOXING
+MidoriValue::MidoriValue(MidoriFraction d) noexcept : m_bits(std::bit_cast<uint64_t>(d))
+{
+	// only NaNs reach into the boxed range, they keep their sign
+	if (m_bits >= s_boxed_begin)
+	{
+		m_bits = s_negative_nan;
+	}
+}
+
+MidoriValue::MidoriValue(MidoriInteger l) noexcept
+{
+	constexpr int unused_bits = 64 - s_inline_integer_bits;
+	if (static_cast<MidoriInteger>(static_cast<uint64_t>(l) << unused_bits) >> unused_bits == l) [[likely]]
+	{
+		m_bits = s_inline_integer_tag | (static_cast<uint64_t>(l) & s_inline_integer_payload_mask);
+	}
+	else
+	{
+		m_bits = s_boxed_integer_tag | reinterpret_cast<uint64_t>(MidoriTraceable::AllocateTraceable(l));
+	}
+}
+
+MidoriValue::MidoriValue(MidoriBool b) noexcept : m_bits(s_bool_tag | static_cast<uint64_t>(b))
+{}
+
+MidoriValue::MidoriValue(MidoriTraceable* o) noexcept : m_bits(s_pointer_tag | reinterpret_cast<uint64_t>(o))
+{}
+
+MidoriFraction MidoriValue::GetFraction() const
+{
+	return std::bit_cast<MidoriFraction>(m_bits);
+}
+
+bool MidoriValue::IsFraction() const
+{
+	return m_bits < s_boxed_begin;
+}
+
+MidoriInteger MidoriValue::GetInteger() const
+{
+	if (m_bits >= s_inline_integer_tag) [[likely]]
+	{
+		// sign extends the payload
+		return static_cast<MidoriInteger>(m_bits << (64 - s_inline_integer_bits)) >> (64 - s_inline_integer_bits);
+	}
+
+	return reinterpret_cast<const MidoriTraceable*>(m_bits & ~s_tag_mask)->GetInteger();
+}
+
+bool MidoriValue::IsInteger() const
+{
+	return (m_bits & s_integer_tag_mask) == s_integer_tag_mask;
+}
+
+MidoriUnit MidoriValue::GetUnit() const
+{
+	return MidoriUnit{};
+}
+
+bool MidoriValue::IsUnit() const
+{
+	return m_bits == s_unit_tag;
+}
+
+MidoriBool MidoriValue::GetBool() const
+{
+	return (m_bits & 1u) != 0u;
+}
+
+bool MidoriValue::IsBool() const
+{
+	return (m_bits & s_tag_mask) == s_bool_tag;
+}
+
+MidoriTraceable* MidoriValue::GetPointer() const
+{
+	return reinterpret_cast<MidoriTraceable*>(m_bits & ~s_tag_mask);
+}
+
+bool MidoriValue::IsPointer() const
+{
+	return (m_bits & s_tag_mask) == s_pointer_tag;
+}
+
+MidoriTraceable* MidoriValue::GetTraceable() const
+{
+	uint64_t tag = m_bits & s_tag_mask;
+	return tag == s_pointer_tag || tag == s_boxed_integer_tag ? reinterpret_cast<MidoriTraceable*>(m_bits & ~s_tag_mask) : nullptr;
+}
+
+MidoriText MidoriValue::ToText() const
+{
+	if (IsFraction())
+	{
+		return MidoriText::FromFraction(GetFraction());
+	}
+	else if (IsInteger())
+	{
+		return MidoriText::FromInteger(GetInteger());
+	}
+	else if (IsUnit())
+	{
+		return MidoriText("()");
+	}
+	else if (IsBool())
+	{
+		return GetBool() ? MidoriText("true") : MidoriText("false");
+	}
+	else
+	{
+		return GetPointer()->ToText();
+	}
+}
+#else
 MidoriValue::MidoriValueUnion::MidoriValueUnion(MidoriFraction d) noexcept : m_fraction(d)
 {}
 
@@ -131,6 +251,11 @@ bool MidoriValue::IsPointer() const
 	return m_type_tag == MidoriValueTypeTag::Pointer;
 }
 
+MidoriTraceable* MidoriValue::GetTraceable() const
+{
+	return IsPointer() ? m_value.m_pointer : nullptr;
+}
+
 MidoriText MidoriValue::ToText() const
 {
 	switch (m_type_tag)
@@ -149,103 +274,149 @@ MidoriText MidoriValue::ToText() const
 		return MidoriText("Unknown MidoriValue"); // Unreachable
 	}
 }
+#endif
 
-MidoriTraceable::MidoriTraceable(MidoriText&& str) noexcept : m_value(std::move(str))
+MidoriTraceable::MidoriTraceable(MidoriText&& str) noexcept : m_kind(Kind::Text), m_text(std::move(str))
 {}
 
-MidoriTraceable::MidoriTraceable(MidoriArray&& array) noexcept : m_value(std::move(array))
+MidoriTraceable::MidoriTraceable(MidoriArray&& array) noexcept : m_kind(Kind::Array), m_array(std::move(array))
 {}
 
-MidoriTraceable::MidoriTraceable(MidoriCellValue&& cell_value) noexcept : m_value(std::move(cell_value))
+MidoriTraceable::MidoriTraceable(MidoriCellValue&& cell_value) noexcept : m_kind(Kind::CellValue), m_cell_value(std::move(cell_value))
 {}
 
-MidoriTraceable::MidoriTraceable(MidoriClosure&& closure) noexcept : m_value(std::move(closure))
+MidoriTraceable::MidoriTraceable(MidoriClosure&& closure) noexcept : m_kind(Kind::Closure), m_closure(std::move(closure))
 {}
 
-MidoriTraceable::MidoriTraceable(MidoriStruct&& midori_struct)noexcept : m_value(std::move(midori_struct))
+MidoriTraceable::MidoriTraceable(MidoriGenerator&& generator) noexcept : m_kind(Kind::Generator), m_generator(std::move(generator))
 {}
 
-MidoriTraceable::MidoriTraceable(MidoriUnion&& midori_union) noexcept : m_value(std::move(midori_union))
+MidoriTraceable::MidoriTraceable(MidoriStruct&& midori_struct) noexcept : m_kind(Kind::Struct), m_struct(midori_struct)
+{
+	std::uninitialized_default_construct_n(GetMembers(), m_struct.m_size);
+}
+
+MidoriTraceable::MidoriTraceable(MidoriUnion&& midori_union) noexcept : m_kind(Kind::Union), m_union(midori_union)
+{
+	std::uninitialized_default_construct_n(GetMembers(), m_union.m_size);
+}
+
+#ifdef MIDORI_NAN_BOXING
+MidoriTraceable::MidoriTraceable(MidoriInteger integer) noexcept : m_kind(Kind::Integer), m_integer(integer)
 {}
+#endif
+
+MidoriTraceable::~MidoriTraceable()
+{
+	// the members of structs and unions are trivially destructible
+	switch (m_kind)
+	{
+	case Kind::Text:
+		std::destroy_at(&m_text);
+		break;
+	case Kind::Array:
+		std::destroy_at(&m_array);
+		break;
+	case Kind::CellValue:
+		std::destroy_at(&m_cell_value);
+		break;
+	case Kind::Closure:
+		std::destroy_at(&m_closure);
+		break;
+	case Kind::Generator:
+		std::destroy_at(&m_generator);
+		break;
+	default:
+		break;
+	}
+}
 
 MidoriText MidoriTraceable::ToText()
 {
-	return std::visit([](auto&& arg) -> MidoriText
+	switch (m_kind)
+	{
+	case Kind::Text:
+		return ConvertToQuotedText(m_text);
+	case Kind::Array:
+	{
+		if (m_array.GetLength() == 0)
 		{
-			using T = std::decay_t<decltype(arg)>;
-			if constexpr (std::is_same_v<T, MidoriText>)
-			{
-				return ConvertToQuotedText(arg);
-			}
-			else if constexpr (std::is_same_v<T, MidoriArray>)
-			{
-				if (arg.GetLength() == 0)
-				{
-					return MidoriText("[]");
-				}
-
-				MidoriText result("[");
-				for (int idx : std::views::iota(0, arg.GetLength()))
-				{
-					result.Append(arg[idx].ToText()).Append(", ");
-				}
-				result.Pop().Pop().Append("]");
-				return result;
-			}
-			else if constexpr (std::is_same_v<T, MidoriCellValue>)
-			{
-				if (arg.m_is_on_heap)
-				{
-					return MidoriText("Cell(").Append(arg.m_heap_value.ToText()).Append(")");
-				}
-				else
-				{
-					return MidoriText("Cell(").Append(arg.m_stack_value_ref->ToText()).Append(")");
-				}
-			}
-			else if constexpr (std::is_same_v<T, MidoriClosure>)
-			{
-				char buffer[64];
-				std::snprintf(buffer, sizeof(buffer), "<closure at: %p>", (void*)std::addressof(arg));
+			return MidoriText("[]");
+		}
 
-				return MidoriText(buffer);
-			}
-			else if constexpr (std::is_same_v<T, MidoriUnion>)
-			{
-				if (arg.m_values.GetLength() == 0)
-				{
-					return MidoriText("Union{}");
-				}
-
-				MidoriText union_val("Union{");
-				union_val.Append("{");
-
-				for (int idx : std::views::iota(0, arg.m_values.GetLength()))
-				{
-					union_val.Append(arg.m_values[idx].ToText()).Append(", ");
-				}
-				return union_val.Pop().Pop().Append("}");
-			}
-			else if constexpr (std::is_same_v<T, MidoriStruct>)
-			{
-				if (arg.m_values.GetLength() == 0)
-				{
-					return MidoriText("Struct{}");
-				}
-
-				MidoriText struct_val("Struct{");
-				struct_val.Append("{");
-				for (int idx : std::views::iota(0, arg.m_values.GetLength()))
-				{
-					struct_val.Append(arg.m_values[idx].ToText()).Append(", ");
-				}
-				return struct_val.Pop().Pop().Append("}");
-			}
-			else
-			{
-				return MidoriText("Unknown MidoriTraceable");
-			}
-		}, m_value);
+		MidoriText result("[");
+		for (int idx : std::views::iota(0, m_array.GetLength()))
+		{
+			result.Append(m_array.Get(idx).ToText()).Append(", ");
+		}
+		result.Pop().Pop().Append("]");
+		return result;
+	}
+	case Kind::CellValue:
+	{
+		if (m_cell_value.m_is_on_heap)
+		{
+			return MidoriText("Cell(").Append(m_cell_value.m_heap_value.ToText()).Append(")");
+		}
+		else
+		{
+			return MidoriText("Cell(").Append(m_cell_value.m_stack_value_ref->ToText()).Append(")");
+		}
+	}
+	case Kind::Closure:
+	{
+		char buffer[64];
+		std::snprintf(buffer, sizeof(buffer), "<closure at: %p>", (void*)std::addressof(m_closure));
+
+		return MidoriText(buffer);
+	}
+	case Kind::Generator:
+	{
+		char buffer[64];
+		std::snprintf(buffer, sizeof(buffer), "<generator at: %p>", (void*)std::addressof(m_generator));
+
+		return MidoriText(buffer);
+	}
+	case Kind::Union:
+	{
+		if (m_union.m_size == 0)
+		{
+			return MidoriText("Union{}");
+		}
+
+		MidoriText union_val("Union{");
+		union_val.Append("{");
+
+		MidoriValue* members = GetMembers();
+		for (int idx : std::views::iota(0, m_union.m_size))
+		{
+			union_val.Append(members[idx].ToText()).Append(", ");
+		}
+		return union_val.Pop().Pop().Append("}");
+	}
+	case Kind::Struct:
+	{
+		if (m_struct.m_size == 0)
+		{
+			return MidoriText("Struct{}");
+		}
+
+		MidoriText struct_val("Struct{");
+		struct_val.Append("{");
+		MidoriValue* members = GetMembers();
+		for (int idx : std::views::iota(0, m_struct.m_size))
+		{
+			struct_val.Append(members[idx].ToText()).Append(", ");
+		}
+		return struct_val.Pop().Pop().Append("}");
+	}
+#ifdef MIDORI_NAN_BOXING
+	case Kind::Integer:
+		return MidoriText::FromInteger(m_integer);
+#endif
+	default:
+		return MidoriText("Unknown MidoriTraceable");
+	}
 }
 
 MidoriValue& MidoriCellValue::GetValue()
@@ -255,67 +426,99 @@ MidoriValue& MidoriCellValue::GetValue()
 
 bool MidoriTraceable::IsText() const
 {
-	return std::holds_alternative<MidoriText>(m_value);
+	return m_kind == Kind::Text;
 }
 
 MidoriText& MidoriTraceable::GetText()
 {
-	return std::get<MidoriText>(m_value);
+	return m_text;
 }
 
 bool MidoriTraceable::IsArray() const
 {
-	return std::holds_alternative<MidoriArray>(m_value);
+	return m_kind == Kind::Array;
 }
 
 MidoriArray& MidoriTraceable::GetArray()
 {
-	return std::get<MidoriArray>(m_value);
+	return m_array;
 }
 
 bool MidoriTraceable::IsCellValue() const
 {
-	return std::holds_alternative<MidoriCellValue>(m_value);
+	return m_kind == Kind::CellValue;
 }
 
 MidoriCellValue& MidoriTraceable::GetCellValue()
 {
-	return std::get<MidoriCellValue>(m_value);
+	return m_cell_value;
 }
 
 bool MidoriTraceable::IsClosure() const
 {
-	return std::holds_alternative<MidoriClosure>(m_value);
+	return m_kind == Kind::Closure;
 }
 
 MidoriClosure& MidoriTraceable::GetClosure()
 {
-	return std::get<MidoriClosure>(m_value);
+	return m_closure;
+}
+
+bool MidoriTraceable::IsGenerator() const
+{
+	return m_kind == Kind::Generator;
+}
+
+MidoriGenerator& MidoriTraceable::GetGenerator()
+{
+	return m_generator;
 }
 
 bool MidoriTraceable::IsStruct() const
 {
-	return std::holds_alternative<MidoriStruct>(m_value);
+	return m_kind == Kind::Struct;
 }
 
 MidoriStruct& MidoriTraceable::GetStruct()
 {
-	return std::get<MidoriStruct>(m_value);
+	return m_struct;
 }
 
 bool MidoriTraceable::IsUnion() const
 {
-	return std::holds_alternative<MidoriUnion>(m_value);
+	return m_kind == Kind::Union;
 }
 
 MidoriUnion& MidoriTraceable::GetUnion()
 {
-	return std::get<MidoriUnion>(m_value);
+	return m_union;
+}
+
+#ifdef MIDORI_NAN_BOXING
+bool MidoriTraceable::IsInteger() const
+{
+	return m_kind == Kind::Integer;
+}
+
+MidoriInteger MidoriTraceable::GetInteger() const
+{
+	return m_integer;
+}
+#endif
+
+MidoriValue* MidoriTraceable::GetMembers()
+{
+	return reinterpret_cast<MidoriValue*>(this + 1);
+}
+
+MidoriTraceable::Kind MidoriTraceable::GetKind() const
+{
+	return m_kind;
 }
 
 size_t MidoriTraceable::GetSize() const
 {
-	return m_size;
+	return static_cast<size_t>(m_size);
 }
 
 void MidoriTraceable::Mark()
@@ -333,119 +536,191 @@ bool MidoriTraceable::Marked() const
 	return m_is_marked;
 }
 
+MidoriHeap::MidoriHeap(MidoriHeap&& other) noexcept
+	: m_traceables(std::exchange(other.m_traceables, nullptr))
+	, m_traceable_count(std::exchange(other.m_traceable_count, 0u))
+	, m_total_bytes_allocated(std::exchange(other.m_total_bytes_allocated, 0u))
+	, m_static_bytes_allocated(std::exchange(other.m_static_bytes_allocated, 0u))
+#ifdef MIDORI_TEXT_INTERNING
+	, m_interned_texts(std::move(other.m_interned_texts))
+#endif
+{}
+
+MidoriHeap& MidoriHeap::operator=(MidoriHeap&& other) noexcept
+{
+	if (this != &other)
+	{
+		FreeAll();
+		m_traceables = std::exchange(other.m_traceables, nullptr);
+		m_traceable_count = std::exchange(other.m_traceable_count, 0u);
+		m_total_bytes_allocated = std::exchange(other.m_total_bytes_allocated, 0u);
+		m_static_bytes_allocated = std::exchange(other.m_static_bytes_allocated, 0u);
+#ifdef MIDORI_TEXT_INTERNING
+		m_interned_texts = std::move(other.m_interned_texts);
+#endif
+	}
+	return *this;
+}
+
+MidoriHeap::~MidoriHeap()
+{
+	FreeAll();
+}
+
+void MidoriHeap::FreeAll() noexcept
+{
+	// sequential, texts share buffers whose reference counts are not synchronized
+	MidoriTraceable* traceable_ptr = m_traceables;
+	while (traceable_ptr != nullptr)
+	{
+		MidoriTraceable* next = traceable_ptr->m_next_traceable;
+#ifdef DEBUG
+		Printer::Print<Printer::Color::MAGENTA>(std::format("Deleting traceable pointer: {:p}\n", static_cast<void*>(traceable_ptr)));
+#endif
+		delete traceable_ptr;
+		traceable_ptr = next;
+	}
+	m_traceables = nullptr;
+	m_traceable_count = 0u;
+#ifdef MIDORI_TEXT_INTERNING
+	m_interned_texts.clear();
+#endif
+	m_total_bytes_allocated = 0u;
+	m_static_bytes_allocated = 0u;
+}
+
+#ifdef MIDORI_TEXT_INTERNING
+MidoriTraceable* MidoriHeap::InternText(MidoriText&& text)
+{
+	if (text.GetLength() > s_max_interned_text_length)
+	{
+		// hashing a long text costs more than the comparisons it could save
+		return MidoriTraceable::AllocateTraceable(std::move(text));
+	}
+
+	std::unordered_map<MidoriText, MidoriTraceable*>::const_iterator it = m_interned_texts.find(text);
+	if (it != m_interned_texts.cend())
+	{
+		return it->second;
+	}
+
+	MidoriTraceable* traceable = MidoriTraceable::AllocateTraceable(MidoriText(text));
+	m_interned_texts.emplace(std::move(text), traceable);
+	return traceable;
+}
+#endif
+
 void* MidoriTraceable::operator new(size_t size) noexcept
 {
-	void* object = ::operator new(size);
-	MidoriTraceable* traceable = static_cast<MidoriTraceable*>(object);
+	return ::operator new(size);
+}
 
-	traceable->m_size = size;
-	s_total_bytes_allocated += size;
-	s_traceables.emplace_back(traceable);
+void* MidoriTraceable::operator new(size_t size, int member_count) noexcept
+{
+	return operator new(size + static_cast<size_t>(member_count) * sizeof(MidoriValue));
+}
 
-	return static_cast<void*>(traceable);
+void MidoriTraceable::operator delete(void* object) noexcept
+{
+	// the heap that tracked the traceable accounts for the freed bytes
+	::operator delete(object);
 }
 
-void MidoriTraceable::operator delete(void* object, size_t size) noexcept
+MidoriTraceable* MidoriTraceable::Track(MidoriTraceable* traceable, size_t size) noexcept
 {
-	MidoriTraceable* traceable = static_cast<MidoriTraceable*>(object);
-	s_total_bytes_allocated -= traceable->m_size;
+	traceable->m_size = static_cast<uint32_t>(size);
+	MidoriHeap& heap = MidoriHeap::GetCurrent();
+	heap.m_total_bytes_allocated += size;
+	traceable->m_next_traceable = heap.m_traceables;
+	heap.m_traceables = traceable;
+	heap.m_traceable_count += 1u;
 
-	::operator delete(object, size);
+	return traceable;
 }
 
-void MidoriTraceable::Trace()
+void MidoriTraceable::Trace(MarkWorklist& worklist)
 {
-	if (Marked())
-	{
-		return;
-	}
 #ifdef DEBUG
 	Printer::Print<Printer::Color::GREEN>(std::format("Marking traceable pointer: {:p}, value: {}\n", static_cast<void*>(this), ToText().GetCString()));
 #endif
-	Mark();
-
-	if (IsArray())
-	{
-		MidoriArray& arr = GetArray();
-		for (int idx : std::views::iota(0, arr.GetLength()))
+	const auto mark_value = [&worklist](const MidoriValue& value) -> void
 		{
-			MidoriValue& value = arr[idx];
-			if (value.IsPointer())
+			MidoriTraceable* traceable = value.GetTraceable();
+			if (traceable != nullptr && !traceable->Marked())
 			{
-				value.GetPointer()->Trace();
+				traceable->Mark();
+				worklist.emplace_back(traceable);
 			}
-		}
+		};
+	const auto mark_values = [&mark_value](const MidoriArray& arr) -> void
+		{
+			// packed elements are never pointers
+			if (arr.GetPacking() != MidoriArray::Packing::Values)
+			{
+				return;
+			}
+
+			for (int idx : std::views::iota(0, arr.GetLength()))
+			{
+				mark_value(arr[idx]);
+			}
+		};
+
+	if (IsArray())
+	{
+		mark_values(GetArray());
 	}
 	else if (IsClosure())
 	{
-		MidoriArray& cell_values = GetClosure().m_cell_values;
-		for (int i = 0; i < cell_values.GetLength(); i += 1)
-		{
-			MidoriValue& val = cell_values[i];
-			val.GetPointer()->Trace();
-		}
+		mark_values(GetClosure().m_cell_values);
 	}
 	else if (IsCellValue())
 	{
-		MidoriValue& cell_value = GetCellValue().GetValue();
-		if (cell_value.IsPointer())
-		{
-			cell_value.GetPointer()->Trace();
-		}
+		mark_value(GetCellValue().GetValue());
 	}
-	else if (IsStruct())
+	else if (IsGenerator())
 	{
-		MidoriArray& arr = GetStruct().m_values;
-		for (int idx : std::views::iota(0, arr.GetLength()))
+		MidoriGenerator& generator = GetGenerator();
+		for (MidoriValue& value : generator.m_frame_values)
 		{
-			MidoriValue& value = arr[idx];
-			if (value.IsPointer())
-			{
-				value.GetPointer()->Trace();
-			}
+			mark_value(value);
+		}
+		if (generator.m_closure != nullptr && !generator.m_closure->Marked())
+		{
+			generator.m_closure->Mark();
+			worklist.emplace_back(generator.m_closure);
 		}
 	}
-	else if (IsUnion())
+	else if (IsStruct() || IsUnion())
 	{
-		MidoriArray& arr = GetUnion().m_values;
-
-		for (int idx : std::views::iota(0, arr.GetLength()))
+		MidoriValue* members = GetMembers();
+		int member_count = IsStruct() ? m_struct.m_size : m_union.m_size;
+		for (int idx : std::views::iota(0, member_count))
 		{
-			MidoriValue& value = arr[idx];
-			if (value.IsPointer())
-			{
-				value.GetPointer()->Trace();
-			}
+			mark_value(members[idx]);
 		}
 	}
 }
 
-MidoriArray::MidoriArray(int size)
+MidoriArray::MidoriArray(int size, Packing packing) : m_packing(packing)
 {
-	m_size = size < 0 ? s_initial_capacity : size;
-	m_end = m_size;
-
-	m_data = static_cast<MidoriValue*>(std::malloc(static_cast<size_t>(size) * sizeof(MidoriValue)));
-	if (!m_data)
-	{
-		throw std::bad_alloc();
-	}
+	int capacity = size < 0 ? s_initial_capacity : size;
+	m_storage = AllocateStorage(capacity, GetElementSize());
+	m_end = capacity;
 }
 
-MidoriArray::MidoriArray(const MidoriArray& other) : m_size(other.m_size), m_end(other.m_end)
+MidoriArray::MidoriArray(const MidoriArray& other) : m_storage(other.m_storage), m_begin(other.m_begin), m_end(other.m_end), m_packing(other.m_packing)
 {
-	m_data = static_cast<MidoriValue*>(std::malloc(static_cast<size_t>(other.m_size) * sizeof(MidoriValue)));
-	if (!m_data)
+	if (m_storage != nullptr)
 	{
-		throw std::bad_alloc();
+		m_storage->m_reference_count += 1;
 	}
-	std::memcpy(m_data, other.m_data, static_cast<size_t>(other.m_size) * sizeof(MidoriValue));
 }
 
-MidoriArray::MidoriArray(MidoriArray&& other) noexcept : m_data(other.m_data), m_size(other.m_size), m_end(other.m_end)
+MidoriArray::MidoriArray(MidoriArray&& other) noexcept : m_storage(other.m_storage), m_begin(other.m_begin), m_end(other.m_end), m_packing(other.m_packing)
 {
-	other.m_data = nullptr;
-	other.m_size = 0;
+	other.m_storage = nullptr;
+	other.m_begin = 0;
 	other.m_end = 0;
 }
 
@@ -453,17 +728,16 @@ MidoriArray& MidoriArray::operator=(const MidoriArray& other)
 {
 	if (this != &other)
 	{
-		MidoriValue* new_data = static_cast<MidoriValue*>(std::malloc(static_cast<size_t>(other.m_size) * sizeof(MidoriValue)));
-		if (!new_data)
+		if (other.m_storage != nullptr)
 		{
-			throw std::bad_alloc();
+			other.m_storage->m_reference_count += 1;
 		}
-		std::memcpy(new_data, other.m_data, static_cast<size_t>(other.m_size) * sizeof(MidoriValue));
 
-		std::free(m_data);
-		m_data = new_data;
-		m_size = other.m_size;
+		Release();
+		m_storage = other.m_storage;
+		m_begin = other.m_begin;
 		m_end = other.m_end;
+		m_packing = other.m_packing;
 	}
 	return *this;
 }
@@ -472,13 +746,14 @@ MidoriArray& MidoriArray::operator=(MidoriArray&& other) noexcept
 {
 	if (this != &other)
 	{
-		std::free(m_data);
-		m_data = other.m_data;
-		m_size = other.m_size;
+		Release();
+		m_storage = other.m_storage;
+		m_begin = other.m_begin;
 		m_end = other.m_end;
+		m_packing = other.m_packing;
 
-		other.m_data = nullptr;
-		other.m_size = 0;
+		other.m_storage = nullptr;
+		other.m_begin = 0;
 		other.m_end = 0;
 	}
 	return *this;
@@ -486,40 +761,108 @@ MidoriArray& MidoriArray::operator=(MidoriArray&& other) noexcept
 
 MidoriArray::~MidoriArray()
 {
-	std::free(m_data);
+	Release();
+}
+
+const MidoriValue& MidoriArray::operator[](int index) const
+{
+	return reinterpret_cast<const MidoriValue*>(GetData(m_storage))[static_cast<size_t>(m_begin + index)];
 }
 
 MidoriValue& MidoriArray::operator[](int index)
 {
-	return m_data[static_cast<size_t>(index)];
+	Unshare();
+	return reinterpret_cast<MidoriValue*>(GetData(m_storage))[static_cast<size_t>(m_begin + index)];
+}
+
+MidoriValue MidoriArray::Get(int index) const
+{
+	switch (m_packing)
+	{
+	case Packing::Integers:
+		return MidoriValue(GetPacked<MidoriInteger>(index));
+	case Packing::Fractions:
+		return MidoriValue(GetPacked<MidoriFraction>(index));
+	case Packing::Bools:
+		return MidoriValue(GetPacked<MidoriBool>(index));
+	default:
+		return (*this)[index];
+	}
+}
+
+void MidoriArray::Set(int index, const MidoriValue& value)
+{
+	Unshare();
+	Store(m_begin + index, value);
+}
+
+void MidoriArray::Store(int slot, const MidoriValue& value) noexcept
+{
+	char* data = GetData(m_storage);
+	switch (m_packing)
+	{
+	case Packing::Integers:
+		reinterpret_cast<MidoriInteger*>(data)[slot] = value.GetInteger();
+		break;
+	case Packing::Fractions:
+		reinterpret_cast<MidoriFraction*>(data)[slot] = value.GetFraction();
+		break;
+	case Packing::Bools:
+		reinterpret_cast<MidoriBool*>(data)[slot] = value.GetBool();
+		break;
+	default:
+		reinterpret_cast<MidoriValue*>(data)[slot] = value;
+		break;
+	}
 }
 
 void MidoriArray::Expand()
 {
-	size_t new_size = m_size == 0u
+	int capacity = GetCapacity();
+	int new_capacity = capacity == 0
 		? s_initial_capacity
-		: static_cast<size_t>(m_size) * 2u;
-	MidoriValue* new_data = static_cast<MidoriValue*>(std::realloc(m_data, new_size * sizeof(MidoriValue)));
-	if (!new_data)
+		: capacity * 2;
+	Storage* new_storage = static_cast<Storage*>(std::realloc(m_storage, sizeof(Storage) + static_cast<size_t>(new_capacity) * GetElementSize()));
+	if (!new_storage)
 	{
 		throw std::bad_alloc();
 	}
-	m_data = new_data;
-	m_size = static_cast<int>(new_size);
+	if (m_storage == nullptr)
+	{
+		new_storage->m_reference_count = 1;
+	}
+	new_storage->m_capacity = new_capacity;
+	m_storage = new_storage;
+}
+
+void MidoriArray::ExpandFront()
+{
+	int old_capacity = GetCapacity();
+	Expand();
+
+	// the slots gained at the back move to the front
+	int gained = GetCapacity() - old_capacity;
+	size_t element_size = GetElementSize();
+	char* data = GetData(m_storage);
+	std::memmove(data + static_cast<size_t>(m_begin + gained) * element_size, data + static_cast<size_t>(m_begin) * element_size, static_cast<size_t>(GetLength()) * element_size);
+	m_begin += gained;
+	m_end += gained;
 }
 
 std::optional<MidoriValue> MidoriArray::Pop()
 {
-	if (m_end > 0)
+	if (GetLength() > 0)
 	{
+		// a shared storage keeps the element for the other arrays, only this view shrinks
+		MidoriValue value = Get(GetLength() - 1);
 		m_end -= 1;
 
-		if (m_end < m_size / 2)
+		if (m_storage->m_reference_count == 1 && GetLength() < GetCapacity() / 4)
 		{
 			Shrink();
 		}
 
-		return std::optional<MidoriValue>(m_data[m_end]);
+		return std::optional<MidoriValue>(value);
 	}
 	else
 	{
@@ -527,112 +870,248 @@ std::optional<MidoriValue> MidoriArray::Pop()
 	}
 }
 
-void MidoriArray::AddFront(const MidoriValue& value)
+std::optional<MidoriValue> MidoriArray::PopFront()
 {
-		if (m_end >= m_size)
-		{
-			Expand();
-		}
+	if (GetLength() > 0)
+	{
+		MidoriValue value = Get(0);
+		m_begin += 1;
 
-		for (int i = m_end; i > 0; i -= 1)
+		if (m_storage->m_reference_count == 1 && GetLength() < GetCapacity() / 4)
 		{
-			size_t idx = static_cast<size_t>(i);
-			m_data[idx] = m_data[idx - 1u];
+			Shrink();
 		}
 
-		m_data[0u] = value;
-		m_end += 1;
+		return std::optional<MidoriValue>(value);
+	}
+	else
+	{
+		return std::nullopt;
+	}
+}
+
+void MidoriArray::AddFront(const MidoriValue& value)
+{
+	Unshare();
+	if (m_begin == 0)
+	{
+		ExpandFront();
+	}
+
+	m_begin -= 1;
+	Store(m_begin, value);
 }
 
 void MidoriArray::Shrink()
 {
-	size_t new_size = static_cast<size_t>(m_size) / 2u;
-	MidoriValue* new_data = static_cast<MidoriValue*>(std::realloc(m_data, new_size * sizeof(MidoriValue)));
-	if (!new_data)
+	int length = GetLength();
+	size_t element_size = GetElementSize();
+	char* data = GetData(m_storage);
+	std::memmove(data, data + static_cast<size_t>(m_begin) * element_size, static_cast<size_t>(length) * element_size);
+	m_begin = 0;
+	m_end = length;
+
+	int new_capacity = GetCapacity() / 2;
+	Storage* new_storage = static_cast<Storage*>(std::realloc(m_storage, sizeof(Storage) + static_cast<size_t>(new_capacity) * element_size));
+	if (!new_storage)
 	{
 		throw std::bad_alloc();
 	}
-	m_data = new_data;
-	m_size = static_cast<int>(new_size);
+	new_storage->m_capacity = new_capacity;
+	m_storage = new_storage;
 }
 
 void MidoriArray::AddBack(const MidoriValue& value)
 {
-	if (m_end >= m_size)
+	Unshare();
+	if (m_end >= GetCapacity())
 	{
 		Expand();
 	}
 
-	m_data[m_end] = value;
+	Store(m_end, value);
 	m_end += 1;
 }
 
 int MidoriArray::GetLength() const
 {
-	return m_end;
+	return m_end - m_begin;
+}
+
+MidoriArray::Packing MidoriArray::GetPacking() const noexcept
+{
+	return m_packing;
+}
+
+void MidoriArray::Reserve(int capacity)
+{
+	if (m_storage != nullptr && m_storage->m_reference_count == 1 && m_begin + capacity <= m_storage->m_capacity)
+	{
+		return;
+	}
+
+	int length = GetLength();
+	Storage* storage = AllocateStorage(std::max(capacity, length), GetElementSize());
+	if (length > 0)
+	{
+		std::memcpy(GetData(storage), GetElements(), static_cast<size_t>(length) * GetElementSize());
+	}
+	Release();
+	m_storage = storage;
+	m_begin = 0;
+	m_end = length;
 }
 
 MidoriArray MidoriArray::Concatenate(const MidoriArray& a, const MidoriArray& b)
 {
-	MidoriArray result(a.GetLength() + b.GetLength());
-	std::memcpy(result.m_data, a.m_data, static_cast<size_t>(a.GetLength()) * sizeof(MidoriValue));
-	std::memcpy(result.m_data + a.GetLength(), b.m_data, static_cast<size_t>(b.GetLength()) * sizeof(MidoriValue));
-	result.m_end = a.GetLength() + b.GetLength();
+	// concatenating with an empty array copies nothing until either result is written to
+	if (b.GetLength() == 0)
+	{
+		return a;
+	}
+	else if (a.GetLength() == 0)
+	{
+		return b;
+	}
+
+	// both arrays have the same element type, hence the same packing
+	size_t element_size = a.GetElementSize();
+	MidoriArray result(a.GetLength() + b.GetLength(), a.m_packing);
+	char* data = GetData(result.m_storage);
+	std::memcpy(data, a.GetElements(), static_cast<size_t>(a.GetLength()) * element_size);
+	std::memcpy(data + static_cast<size_t>(a.GetLength()) * element_size, b.GetElements(), static_cast<size_t>(b.GetLength()) * element_size);
 	return result;
 }
 
-MidoriText::MidoriText(const char* str) : m_size(static_cast<int>(std::strlen(str))), m_capacity(m_size + 1)
+MidoriArray MidoriArray::Repeat(const MidoriArray& arr, int count)
 {
-	m_data = static_cast<char*>(std::malloc(static_cast<size_t>(m_capacity)));
-	if (!m_data)
+	if (count == 1)
 	{
-		throw std::bad_alloc();
+		// the copy shares the elements until either array is written to
+		return arr;
+	}
+
+	size_t length_in_bytes = static_cast<size_t>(arr.GetLength()) * arr.GetElementSize();
+	MidoriArray result(arr.GetLength() * count, arr.m_packing);
+	char* data = GetData(result.m_storage);
+	for (int i = 0; i < count; i += 1)
+	{
+		std::memcpy(data + static_cast<size_t>(i) * length_in_bytes, arr.GetElements(), length_in_bytes);
 	}
-	std::memcpy(m_data, str, static_cast<size_t>(m_size + 1));
+	return result;
 }
 
-MidoriText::MidoriText(const MidoriText& other) : m_size(other.m_size), m_capacity(other.m_capacity)
+MidoriArray::Storage* MidoriArray::AllocateStorage(int capacity, size_t element_size)
 {
-	m_data = static_cast<char*>(std::malloc(m_capacity));
-	if (!m_data)
+	Storage* storage = static_cast<Storage*>(std::malloc(sizeof(Storage) + static_cast<size_t>(capacity) * element_size));
+	if (!storage)
 	{
 		throw std::bad_alloc();
 	}
-	std::memcpy(m_data, other.m_data, static_cast<size_t>(m_size + 1));
+	storage->m_reference_count = 1;
+	storage->m_capacity = capacity;
+	return storage;
 }
 
-MidoriText::MidoriText(MidoriText&& other) noexcept : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity)
+char* MidoriArray::GetData(Storage* storage) noexcept
 {
-	other.m_data = nullptr;
-	other.m_size = 0;
-	other.m_capacity = 0;
+	return reinterpret_cast<char*>(storage + 1);
 }
 
-MidoriText::MidoriText(int size) : m_size(size), m_capacity(size + 1)
+size_t MidoriArray::GetElementSize() const noexcept
 {
-	m_data = static_cast<char*>(std::malloc(m_capacity));
-	if (!m_data)
+	switch (m_packing)
 	{
-		throw std::bad_alloc();
+	case Packing::Integers:
+		return sizeof(MidoriInteger);
+	case Packing::Fractions:
+		return sizeof(MidoriFraction);
+	case Packing::Bools:
+		return sizeof(MidoriBool);
+	default:
+		return sizeof(MidoriValue);
+	}
+}
+
+const char* MidoriArray::GetElements() const noexcept
+{
+	return m_storage == nullptr ? nullptr : GetData(m_storage) + static_cast<size_t>(m_begin) * GetElementSize();
+}
+
+int MidoriArray::GetCapacity() const noexcept
+{
+	return m_storage == nullptr ? 0 : m_storage->m_capacity;
+}
+
+void MidoriArray::Release() noexcept
+{
+	if (m_storage != nullptr && --m_storage->m_reference_count == 0)
+	{
+		std::free(m_storage);
 	}
-	m_data[size] = '\0';
+}
+
+void MidoriArray::Unshare()
+{
+	if (m_storage != nullptr && m_storage->m_reference_count > 1) [[unlikely]]
+		{
+			size_t element_size = GetElementSize();
+			Storage* copy = AllocateStorage(m_storage->m_capacity, element_size);
+			std::memcpy(GetData(copy) + static_cast<size_t>(m_begin) * element_size, GetElements(), static_cast<size_t>(GetLength()) * element_size);
+			m_storage->m_reference_count -= 1;
+			m_storage = copy;
+		}
+}
+
+MidoriText::MidoriText(const char* str) : m_size(static_cast<int>(std::strlen(str)))
+{
+	if (IsInline())
+	{
+		std::memcpy(m_inline, str, static_cast<size_t>(m_size + 1));
+	}
+	else
+	{
+		m_buffer = AllocateBuffer(m_size);
+		std::memcpy(GetData(m_buffer), str, static_cast<size_t>(m_size + 1));
+		m_buffer->m_size = m_size;
+	}
+}
+
+MidoriText::MidoriText(const MidoriText& other) : m_size(other.m_size), m_hash(other.m_hash)
+{
+	if (IsInline())
+	{
+		std::memcpy(m_inline, other.m_inline, sizeof(m_inline));
+	}
+	else
+	{
+		m_buffer = other.m_buffer;
+		m_buffer->m_reference_count += 1;
+	}
+}
+
+MidoriText::MidoriText(MidoriText&& other) noexcept : m_size(other.m_size), m_hash(other.m_hash)
+{
+	std::memcpy(m_inline, other.m_inline, sizeof(m_inline));
+
+	other.m_inline[0] = '\0';
+	other.m_size = 0;
+	other.m_hash = 0u;
 }
 
 MidoriText& MidoriText::operator=(const MidoriText& other)
 {
 	if (this != &other)
 	{
-		char* new_data = static_cast<char*>(std::malloc(other.m_capacity));
-		if (!new_data)
+		if (!other.IsInline())
 		{
-			throw std::bad_alloc();
+			other.m_buffer->m_reference_count += 1;
 		}
-		std::memcpy(new_data, other.m_data, static_cast<size_t>(other.m_size + 1));
 
-		std::free(m_data);
-		m_data = new_data;
+		Release();
+		std::memcpy(m_inline, other.m_inline, sizeof(m_inline));
 		m_size = other.m_size;
-		m_capacity = other.m_capacity;
+		m_hash = other.m_hash;
 	}
 	return *this;
 }
@@ -641,21 +1120,21 @@ MidoriText& MidoriText::operator=(MidoriText&& other) noexcept
 {
 	if (this != &other)
 	{
-		std::free(m_data);
-		m_data = other.m_data;
+		Release();
+		std::memcpy(m_inline, other.m_inline, sizeof(m_inline));
 		m_size = other.m_size;
-		m_capacity = other.m_capacity;
+		m_hash = other.m_hash;
 
-		other.m_data = nullptr;
+		other.m_inline[0] = '\0';
 		other.m_size = 0;
-		other.m_capacity = 0;
+		other.m_hash = 0u;
 	}
 	return *this;
 }
 
 MidoriText::~MidoriText()
 {
-	std::free(m_data);
+	Release();
 }
 
 int MidoriText::GetLength() const noexcept
@@ -663,59 +1142,100 @@ int MidoriText::GetLength() const noexcept
 	return m_size;
 }
 
-const char* MidoriText::GetCString() const noexcept
+size_t MidoriText::GetHash() const noexcept
+{
+	if (m_hash == 0u)
+	{
+		size_t hash = std::hash<std::string_view>{}(std::string_view(GetChars(), static_cast<size_t>(m_size)));
+		m_hash = hash == 0u ? 1u : hash;
+	}
+	return m_hash;
+}
+
+const char* MidoriText::GetCString() const
 {
-	return m_data;
+	if (IsInline())
+	{
+		return m_inline;
+	}
+
+	if (m_size != m_buffer->m_size) [[unlikely]]
+		{
+			if (m_buffer->m_reference_count == 1)
+			{
+				m_buffer->m_size = m_size;
+				GetData(m_buffer)[m_size] = '\0';
+			}
+			else
+			{
+				Buffer* flattened = AllocateBuffer(m_size);
+				std::memcpy(GetData(flattened), GetData(m_buffer), static_cast<size_t>(m_size));
+				GetData(flattened)[m_size] = '\0';
+				flattened->m_size = m_size;
+
+				m_buffer->m_reference_count -= 1;
+				m_buffer = flattened;
+			}
+		}
+
+	return GetData(m_buffer);
 }
 
 MidoriText& MidoriText::Pop()
 {
-	if (m_size > 0)
+	if (m_size == s_inline_capacity + 1)
+	{
+		// the text fits inline again
+		MidoriText popped(*this);
+		Release();
+		std::memcpy(m_inline, popped.GetChars(), static_cast<size_t>(s_inline_capacity));
+		m_inline[s_inline_capacity] = '\0';
+		m_size = s_inline_capacity;
+	}
+	else if (IsInline())
 	{
-		m_data[m_size - 1] = '\0';
+		if (m_size > 0)
+		{
+			m_size -= 1;
+			m_inline[m_size] = '\0';
+		}
+	}
+	else
+	{
+		// the popped character stays in the buffer for the longer texts that may share it
 		m_size -= 1;
 	}
+	m_hash = 0u;
 	return *this;
 }
 
 MidoriText& MidoriText::Append(const char* str)
 {
 	int str_len = static_cast<int>(std::strlen(str));
-	if (m_size + str_len + 1 > m_capacity)
-	{
-		Expand(m_size + str_len + 1);
-	}
-	std::memcpy(m_data + m_size, str, static_cast<size_t>(str_len + 1));
-	m_size += str_len;
+	std::memcpy(Reserve(m_size + str_len) + m_size, str, static_cast<size_t>(str_len));
+	SetSize(m_size + str_len);
 	return *this;
 }
 
 MidoriText& MidoriText::Append(char c)
 {
-	if (m_size + 2 > m_capacity)
-	{
-		Expand(m_size + 2);
-	}
-	m_data[m_size] = c;
-	m_data[m_size + 1] = '\0';
-	m_size += 1;
+	Reserve(m_size + 1)[m_size] = c;
+	SetSize(m_size + 1);
 	return *this;
 }
 
 MidoriText& MidoriText::Append(const MidoriText& other)
 {
-	if (m_size + other.m_size + 1 > m_capacity)
-	{
-		Expand(m_size + other.m_size + 1);
-	}
-	std::memcpy(m_data + m_size, other.m_data, static_cast<size_t>(other.m_size + 1));
-	m_size += other.m_size;
+	// other may share the buffer that Reserve replaces
+	MidoriText appended(other);
+	std::memcpy(Reserve(m_size + appended.m_size) + m_size, appended.GetChars(), static_cast<size_t>(appended.m_size));
+	SetSize(m_size + appended.m_size);
 	return *this;
 }
 
 char MidoriText::operator[](int index) const
 {
-	return m_data[static_cast<size_t>(index)];
+	return GetChars()[static_cast<size_t>(index)];
 }
 
 bool MidoriText::operator==(const MidoriText& other) const
@@ -724,9 +1244,17 @@ bool MidoriText::operator==(const MidoriText& other) const
 	{
 		return false;
 	}
+	else if (!IsInline() && m_buffer == other.m_buffer)
+	{
+		return true;
+	}
+	else if (m_hash != 0u && other.m_hash != 0u && m_hash != other.m_hash)
+	{
+		return false;
+	}
 	else
 	{
-		return std::strcmp(m_data, other.m_data) == 0;
+		return std::memcmp(GetChars(), other.GetChars(), static_cast<size_t>(m_size)) == 0;
 	}
 }
 
@@ -737,12 +1265,12 @@ bool MidoriText::operator!=(const MidoriText& other) const
 
 MidoriInteger MidoriText::ToInteger() const
 {
-	return std::atoll(m_data);
+	return std::atoll(GetCString());
 }
 
 MidoriFraction MidoriText::ToFraction() const
 {
-	return std::atof(m_data);
+	return std::atof(GetCString());
 }
 
 MidoriText MidoriText::FromInteger(MidoriInteger value)
@@ -763,20 +1291,122 @@ MidoriText MidoriText::FromFraction(MidoriFraction value)
 
 MidoriText MidoriText::Concatenate(const MidoriText& a, const MidoriText& b)
 {
-	MidoriText output(a.m_size + b.m_size + 1);
-	std::memcpy(output.m_data, a.m_data, static_cast<size_t>(a.m_size));
-	std::memcpy(output.m_data + a.m_size, b.m_data, static_cast<size_t>(b.m_size + 1));
-	output.m_size = a.m_size + b.m_size;
+	MidoriText output;
+	int size = a.m_size + b.m_size;
+	char* data = output.m_inline;
+
+	if (size <= s_inline_capacity)
+	{
+		std::memcpy(data, a.GetChars(), static_cast<size_t>(a.m_size));
+	}
+	else if (!a.IsInline() && a.m_size == a.m_buffer->m_size && size <= a.m_buffer->m_capacity)
+	{
+		// a reaches the end of its buffer, b goes right after it and the result shares the buffer with a
+		output.m_buffer = a.m_buffer;
+		output.m_buffer->m_reference_count += 1;
+		data = GetData(output.m_buffer);
+	}
+	else
+	{
+		// the spare room lets the next concatenation onto the result happen in place
+		output.m_buffer = AllocateBuffer(std::max(size, 2 * a.m_size));
+		data = GetData(output.m_buffer);
+		std::memcpy(data, a.GetChars(), static_cast<size_t>(a.m_size));
+	}
+
+	std::memcpy(data + a.m_size, b.GetChars(), static_cast<size_t>(b.m_size));
+	output.SetSize(size);
 	return output;
 }
 
-void MidoriText::Expand(int new_size)
+MidoriText::Buffer* MidoriText::AllocateBuffer(int capacity)
 {
-	char* new_data = static_cast<char*>(std::realloc(m_data, static_cast<size_t>(new_size)));
-	if (!new_data)
+	Buffer* buffer = static_cast<Buffer*>(std::malloc(sizeof(Buffer) + static_cast<size_t>(capacity) + 1u));
+	if (!buffer)
 	{
 		throw std::bad_alloc();
 	}
-	m_data = new_data;
-	m_capacity = static_cast<int>(new_size);
+	buffer->m_reference_count = 1;
+	buffer->m_size = 0;
+	buffer->m_capacity = capacity;
+	GetData(buffer)[0] = '\0';
+	return buffer;
+}
+
+char* MidoriText::GetData(Buffer* buffer) noexcept
+{
+	return reinterpret_cast<char*>(buffer + 1);
+}
+
+bool MidoriText::IsInline() const noexcept
+{
+	return m_size <= s_inline_capacity;
+}
+
+const char* MidoriText::GetChars() const noexcept
+{
+	return IsInline() ? m_inline : GetData(m_buffer);
+}
+
+void MidoriText::Release() noexcept
+{
+	if (!IsInline() && --m_buffer->m_reference_count == 0)
+	{
+		std::free(m_buffer);
+	}
+}
+
+char* MidoriText::Reserve(int new_size)
+{
+	if (new_size <= s_inline_capacity)
+	{
+		return m_inline;
+	}
+	else if (IsInline())
+	{
+		Buffer* buffer = AllocateBuffer(std::max(new_size, 2 * m_size));
+		std::memcpy(GetData(buffer), m_inline, static_cast<size_t>(m_size));
+		buffer->m_size = m_size;
+		m_buffer = buffer;
+	}
+	else if (m_buffer->m_reference_count == 1)
+	{
+		// nothing else can read past our end
+		m_buffer->m_size = m_size;
+		if (new_size > m_buffer->m_capacity)
+		{
+			int capacity = std::max(new_size, 2 * m_size);
+			Buffer* grown = static_cast<Buffer*>(std::realloc(m_buffer, sizeof(Buffer) + static_cast<size_t>(capacity) + 1u));
+			if (!grown)
+			{
+				throw std::bad_alloc();
+			}
+			grown->m_capacity = capacity;
+			m_buffer = grown;
+		}
+	}
+	else if (m_size != m_buffer->m_size || new_size > m_buffer->m_capacity)
+	{
+		Buffer* unshared = AllocateBuffer(std::max(new_size, 2 * m_size));
+		std::memcpy(GetData(unshared), GetData(m_buffer), static_cast<size_t>(m_size));
+		unshared->m_size = m_size;
+		Release();
+		m_buffer = unshared;
+	}
+	return GetData(m_buffer);
+}
+
+void MidoriText::SetSize(int new_size) noexcept
+{
+	m_size = new_size;
+	m_hash = 0u;
+	if (IsInline())
+	{
+		m_inline[new_size] = '\0';
+	}
+	else
+	{
+		m_buffer->m_size = new_size;
+		GetData(m_buffer)[new_size] = '\0';
+	}
 }
\ No newline at end of file
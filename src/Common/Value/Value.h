@@ -1,13 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
-#include <list>
+#include <type_traits>
 #include <variant>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <optional>
 
 class MidoriTraceable;
 class MidoriText;
+enum class OpCode : uint8_t;
 
 using MidoriInteger = int64_t;
 using MidoriFraction = double;
@@ -16,7 +20,29 @@ using MidoriBool = bool;
 
 class MidoriValue
 {
+	// generated machine code reads and writes values in place
+	friend class JitCompiler;
+	friend class TraceCompiler;
+
 private:
+#ifdef MIDORI_NAN_BOXING
+	// Fractions are stored as they are. Every other value lives in the payload of a negative quiet NaN that
+	// arithmetic never produces, NaN results that would collide with it become the default negative quiet NaN.
+	// Integers that fit in 49 bits are stored inline, the others in a traceable the value points to.
+	static constexpr uint64_t s_boxed_begin = 0xFFF9'0000'0000'0000u;
+	static constexpr uint64_t s_pointer_tag = 0xFFF9'0000'0000'0000u;
+	static constexpr uint64_t s_unit_tag = 0xFFFA'0000'0000'0000u;
+	static constexpr uint64_t s_bool_tag = 0xFFFB'0000'0000'0000u;
+	static constexpr uint64_t s_integer_tag_mask = 0xFFFC'0000'0000'0000u; // matches the tags 0xFFFC to 0xFFFF of both integer encodings
+	static constexpr uint64_t s_boxed_integer_tag = 0xFFFC'0000'0000'0000u;
+	static constexpr uint64_t s_inline_integer_tag = 0xFFFE'0000'0000'0000u;
+	static constexpr uint64_t s_tag_mask = 0xFFFF'0000'0000'0000u;
+	static constexpr uint64_t s_negative_nan = 0xFFF8'0000'0000'0000u;
+	static constexpr int s_inline_integer_bits = 49;
+	static constexpr uint64_t s_inline_integer_payload_mask = (uint64_t{ 1u } << s_inline_integer_bits) - 1u;
+
+	uint64_t m_bits{ s_unit_tag };
+#else
 	union MidoriValueUnion
 	{
 		MidoriFraction m_fraction;
@@ -46,6 +72,7 @@ private:
 
 	MidoriValueUnion m_value{ MidoriUnit{} };
 	MidoriValueTypeTag m_type_tag{ MidoriValueTypeTag::Unit };
+#endif
 
 public:
 
@@ -53,6 +80,8 @@ public:
 
 	MidoriValue(MidoriFraction d) noexcept;
 
+	// with MIDORI_NAN_BOXING an integer too wide to be inlined is allocated on the current heap, so one must be current,
+	// and the caller is responsible for triggering garbage collection afterwards
 	MidoriValue(MidoriInteger l) noexcept;
 
 	MidoriValue(MidoriBool b) noexcept;
@@ -87,6 +116,9 @@ public:
 
 	bool IsPointer() const;
 
+	// the traceable the value keeps alive, nullptr if there is none
+	MidoriTraceable* GetTraceable() const;
+
 	MidoriText ToText() const;
 };
 
@@ -102,9 +134,26 @@ concept MidoriNumeric = std::same_as<T, MidoriFraction> || std::same_as<T, Midor
 class MidoriText
 {
 private:
-	char* m_data{ nullptr };
+	// Texts of up to s_inline_capacity characters are stored inline. Longer ones live in a reference counted
+	// buffer that the texts concatenated from them share. Characters past the end of a text belong to longer
+	// texts over the same buffer, so only the text that reaches the end of the buffer appends in place.
+	// This keeps repeated concatenation onto a text linear.
+	static constexpr int s_inline_capacity = 31; // not counting the '\0', the most that fit without making traceables larger
+
+	struct Buffer
+	{
+		int m_reference_count;
+		int m_size; // the length of the longest text over the buffer, followed by '\0'
+		int m_capacity; // not counting the '\0'
+	};
+
+	union
+	{
+		mutable Buffer* m_buffer;
+		char m_inline[s_inline_capacity + 1]{};
+	};
 	int m_size{ 0 };
-	int m_capacity{ 0 };
+	mutable size_t m_hash{ 0u }; // 0 until the hash is needed
 
 public:
 	MidoriText() = default;
@@ -123,7 +172,11 @@ public:
 
 	int GetLength() const noexcept;
 
-	const char* GetCString() const noexcept;
+	size_t GetHash() const noexcept;
+
+	// copies the text into a buffer of its own if a longer text has been appended onto its end,
+	// the result is valid until the text is appended to
+	const char* GetCString() const;
 
 	MidoriText& Pop();
 
@@ -135,6 +188,7 @@ public:
 
 	char operator[](int index) const;
 
+	// texts over the same buffer or with different hashes are told apart without looking at their characters
 	bool operator==(const MidoriText& other) const;
 
 	bool operator!=(const MidoriText& other) const;
@@ -150,23 +204,66 @@ public:
 	static MidoriText Concatenate(const MidoriText& a, const MidoriText& b);
 
 private:
-	MidoriText(int size);
+	static Buffer* AllocateBuffer(int capacity);
+
+	static char* GetData(Buffer* buffer) noexcept;
+
+	bool IsInline() const noexcept;
+
+	// the characters without the guarantee of a '\0' after them
+	const char* GetChars() const noexcept;
+
+	void Release() noexcept;
 
-	void Expand(int new_size);
+	// Where the characters go once the text has grown to new_size, which must be set with SetSize right after.
+	// A text over a buffer becomes the only one over the end of it.
+	char* Reserve(int new_size);
+
+	void SetSize(int new_size) noexcept;
+};
+
+template<>
+struct std::hash<MidoriText>
+{
+	size_t operator()(const MidoriText& text) const noexcept
+	{
+		return text.GetHash();
+	}
 };
 
+// The elements occupy [m_begin, m_end) of a reference counted storage that copies of the array share until
+// one of them is written to. The free slots on either side let both ends grow in amortized constant time,
+// and the storage halves once it is less than a quarter full.
+// Arrays of Int, Frac and Bool pack their elements unboxed, so they take 8, 8 and 1 byte an element and
+// hold no pointers for the collector to scan.
 class MidoriArray
 {
+public:
+	enum class Packing : uint8_t
+	{
+		Values,
+		Integers,
+		Fractions,
+		Bools
+	};
+
 private:
+	struct Storage
+	{
+		int m_reference_count;
+		int m_capacity;
+	};
+
 	inline static constexpr int s_initial_capacity = 8;
-	MidoriValue* m_data{ nullptr };
-	int m_size{ 0 };
+	Storage* m_storage{ nullptr };
+	int m_begin{ 0 };
 	int m_end{ 0 };
+	Packing m_packing{ Packing::Values };
 
 public:
 	MidoriArray() = default;
 
-	MidoriArray(int size);
+	MidoriArray(int size, Packing packing = Packing::Values);
 
 	MidoriArray(const MidoriArray& other);
 
@@ -178,21 +275,76 @@ public:
 
 	~MidoriArray();
 
+	// the element access of arrays that are not packed
+	const MidoriValue& operator[](int index) const;
+
+	// copies a shared storage first, reads that should not copy go through a const array
 	MidoriValue& operator[](int index);
 
+	// boxes the element of an array of any packing
+	MidoriValue Get(int index) const;
+
+	void Set(int index, const MidoriValue& value);
+
+	// T is the type of the unboxed elements, MidoriInteger, MidoriFraction or MidoriBool
+	template<typename T>
+	T GetPacked(int index) const
+	{
+		return reinterpret_cast<const T*>(GetData(m_storage))[static_cast<size_t>(m_begin + index)];
+	}
+
+	template<typename T>
+	void SetPacked(int index, T value)
+	{
+		Unshare();
+		reinterpret_cast<T*>(GetData(m_storage))[static_cast<size_t>(m_begin + index)] = value;
+	}
+
 	void AddBack(const MidoriValue& value);
 
 	void AddFront(const MidoriValue& value);
 
 	std::optional<MidoriValue> Pop();
 
+	std::optional<MidoriValue> PopFront();
+
 	int GetLength() const;
 
+	Packing GetPacking() const noexcept;
+
+	// makes room for capacity elements in a storage of its own, so appending up to there neither copies nor grows
+	void Reserve(int capacity);
+
 	static MidoriArray Concatenate(const MidoriArray& a, const MidoriArray& b);
 
+	// the elements of arr count times over
+	static MidoriArray Repeat(const MidoriArray& arr, int count);
+
 private:
+	static Storage* AllocateStorage(int capacity, size_t element_size);
+
+	static char* GetData(Storage* storage) noexcept;
+
+	size_t GetElementSize() const noexcept;
+
+	// nullptr for an array that never had storage
+	const char* GetElements() const noexcept;
+
+	int GetCapacity() const noexcept;
+
+	void Release() noexcept;
+
+	// gives the array a storage of its own if other arrays share it
+	void Unshare();
+
+	// unboxes the value into the slot
+	void Store(int slot, const MidoriValue& value) noexcept;
+
 	void Expand();
 
+	// doubles the storage and moves the elements to its back half
+	void ExpandFront();
+
 	void Shrink();
 };
 
@@ -213,34 +365,146 @@ struct MidoriClosure
 	int m_proc_index;
 };
 
+// the suspended frame of a generator: its slice of the value stack and where it resumes
+struct MidoriGenerator
+{
+	std::vector<MidoriValue> m_frame_values;
+	MidoriTraceable* m_closure = nullptr; // nullptr if the generator was called directly
+	const OpCode* m_resume_address = nullptr;
+	int m_proc_index = 0;
+	bool m_is_running = false;
+	bool m_is_finished = false;
+};
+
+// the members of structs and unions follow the traceable in the same allocation, see MidoriTraceable::GetMembers
 struct MidoriStruct
 {
-	MidoriArray m_values{};
+	int m_size{ 0 };
 };
 
 struct MidoriUnion
 {
-	MidoriArray m_values{};
+	int m_size{ 0 };
 	int m_index{ 0 };
 };
 
+// Every traceable is tracked by the heap that is current on the allocating thread.
+// Each executable owns a heap, so virtual machines on different threads never share allocation state.
+class MidoriHeap
+{
+public:
+	MidoriTraceable* m_traceables = nullptr; // linked through the traceables themselves, most recent first
+	size_t m_traceable_count = 0u;
+	size_t m_total_bytes_allocated = 0u;
+	size_t m_static_bytes_allocated = 0u;
+#ifdef MIDORI_TEXT_INTERNING
+	static constexpr int s_max_interned_text_length = 64;
+
+	// does not keep its texts alive, the collector removes the texts it frees
+	std::unordered_map<MidoriText, MidoriTraceable*> m_interned_texts;
+#endif
+
+	// makes a heap the current one of this thread until the scope ends
+	class Scope
+	{
+	public:
+		explicit Scope(MidoriHeap& heap) noexcept : m_enclosing_heap(s_current_heap)
+		{
+			s_current_heap = &heap;
+		}
+
+		~Scope()
+		{
+			s_current_heap = m_enclosing_heap;
+		}
+
+		Scope(const Scope&) = delete;
+
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		MidoriHeap* m_enclosing_heap;
+	};
+
+	MidoriHeap() = default;
+
+	MidoriHeap(MidoriHeap&& other) noexcept;
+
+	MidoriHeap& operator=(MidoriHeap&& other) noexcept;
+
+	// an executable that never runs, or a compilation that fails, still frees its constants here
+	~MidoriHeap();
+
+	// two heaps tracking the same traceable would free it twice
+	MidoriHeap(const MidoriHeap&) = delete;
+
+	MidoriHeap& operator=(const MidoriHeap&) = delete;
+
+	static MidoriHeap& GetCurrent()
+	{
+		return *s_current_heap;
+	}
+
+	// frees every traceable the heap tracks, whether or not it is still reachable
+	void FreeAll() noexcept;
+
+#ifdef MIDORI_TEXT_INTERNING
+	// the text already allocated with the same characters if there is one, long texts are never interned
+	MidoriTraceable* InternText(MidoriText&& text);
+#endif
+
+private:
+	static inline thread_local MidoriHeap* s_current_heap = nullptr;
+};
+
+// A traceable is a compact header followed by one of the payloads, the members of a struct or union come right
+// after it in the same allocation.
 class MidoriTraceable
 {
+	friend class MidoriHeap;
+	friend class GarbageCollector;
+
 public:
 	// Garbage collection utilities
 	using GarbageCollectionRoots = std::unordered_set<MidoriTraceable*>;
-	static inline size_t s_total_bytes_allocated;
-	static inline size_t s_static_bytes_allocated;
-	static inline std::list<MidoriTraceable*> s_traceables;
+	using MarkWorklist = std::vector<MidoriTraceable*>;
+
+	enum class Kind : uint8_t
+	{
+		Text,
+		Array,
+		Struct,
+		Union,
+		CellValue,
+		Closure,
+		Generator,
+#ifdef MIDORI_NAN_BOXING
+		Integer
+#endif
+	};
 
 private:
-	std::variant<MidoriText, MidoriArray, MidoriStruct, MidoriUnion, MidoriCellValue, MidoriClosure> m_value;
-	size_t m_size;
+	MidoriTraceable* m_next_traceable = nullptr; // the next one tracked by the same heap
+	uint32_t m_size = 0u;
+	Kind m_kind;
 	bool m_is_marked = false;
+	union
+	{
+		MidoriText m_text;
+		MidoriArray m_array;
+		MidoriStruct m_struct;
+		MidoriUnion m_union;
+		MidoriCellValue m_cell_value;
+		MidoriClosure m_closure;
+		MidoriGenerator m_generator;
+#ifdef MIDORI_NAN_BOXING
+		MidoriInteger m_integer; // too wide to be stored inline in a value
+#endif
+	};
 
 public:
 
-	~MidoriTraceable() = default;
+	~MidoriTraceable();
 
 	MidoriText& GetText();
 
@@ -258,6 +522,10 @@ public:
 
 	MidoriClosure& GetClosure();
 
+	bool IsGenerator() const;
+
+	MidoriGenerator& GetGenerator();
+
 	bool IsStruct() const;
 
 	MidoriStruct& GetStruct();
@@ -266,6 +534,17 @@ public:
 
 	MidoriUnion& GetUnion();
 
+#ifdef MIDORI_NAN_BOXING
+	bool IsInteger() const;
+
+	MidoriInteger GetInteger() const;
+#endif
+
+	// the members of a struct or union
+	MidoriValue* GetMembers();
+
+	Kind GetKind() const;
+
 	size_t GetSize() const;
 
 	void Mark();
@@ -276,19 +555,36 @@ public:
 
 	static void* operator new(size_t size) noexcept;
 
-	static void operator delete(void* object, size_t size) noexcept;
+	// leaves room for the members of a struct or union after the traceable
+	static void* operator new(size_t size, int member_count) noexcept;
+
+	static void operator delete(void* object) noexcept;
 
 	MidoriText ToText();
 
-	void Trace();
+	// marks the unmarked traceables this one refers to and queues them on the worklist
+	void Trace(MarkWorklist& worklist);
 
 	template<typename T>
 	static MidoriTraceable* AllocateTraceable(T&& arg)
 	{
-		return new MidoriTraceable(std::forward<T>(arg));
+		using Payload = std::decay_t<T>;
+		if constexpr (std::is_same_v<Payload, MidoriStruct> || std::is_same_v<Payload, MidoriUnion>)
+		{
+			int member_count = arg.m_size;
+			MidoriTraceable* traceable = new(member_count) MidoriTraceable(std::forward<T>(arg));
+			return Track(traceable, sizeof(MidoriTraceable) + static_cast<size_t>(member_count) * sizeof(MidoriValue));
+		}
+		else
+		{
+			return Track(new MidoriTraceable(std::forward<T>(arg)), sizeof(MidoriTraceable));
+		}
 	}
 
 private:
+	// records the size of a constructed traceable and links it into the current heap
+	static MidoriTraceable* Track(MidoriTraceable* traceable, size_t size) noexcept;
+
 	MidoriTraceable() = delete;
 
 	MidoriTraceable(const MidoriTraceable& other) = delete;
@@ -307,7 +603,14 @@ private:
 
 	MidoriTraceable(MidoriClosure&& closure) noexcept;
 
+	MidoriTraceable(MidoriGenerator&& generator) noexcept;
+
+	// the members start out as units
 	MidoriTraceable(MidoriStruct&& midori_struct) noexcept;
 
 	MidoriTraceable(MidoriUnion&& midori_union) noexcept;
+
+#ifdef MIDORI_NAN_BOXING
+	MidoriTraceable(MidoriInteger integer) noexcept;
+#endif
 };
\ No newline at end of file
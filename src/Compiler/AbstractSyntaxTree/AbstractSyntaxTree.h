@@ -39,16 +39,18 @@ struct Define;
 struct If;
 struct While;
 struct For;
+struct ForEach;
 struct Break;
 struct Continue;
 struct Return;
+struct Yield;
 struct Foreign;
 struct Struct;
 struct Union;
 struct Switch;
 struct Namespace;
 
-using MidoriStatement = std::variant<Block, Simple, Define, If, While, For, Break, Continue, Return, Foreign, Struct, Union, Switch, Namespace>;
+using MidoriStatement = std::variant<Block, Simple, Define, If, While, For, ForEach, Break, Continue, Return, Yield, Foreign, Struct, Union, Switch, Namespace>;
 using MidoriProgramTree = std::vector<std::unique_ptr<MidoriStatement>>;
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -155,6 +157,7 @@ struct Call
 	std::unique_ptr<MidoriExpression> m_callee;
 	std::vector<std::unique_ptr<MidoriExpression>> m_arguments;
 	bool m_is_foreign = false;
+	bool m_is_tail_call = false;
 };
 
 struct Closure
@@ -165,6 +168,7 @@ struct Closure
 	std::unique_ptr<MidoriStatement> m_body;
 	const MidoriType* m_return_type;
 	int m_captured_count = 0;
+	bool m_is_generator = false; // the body yields: calling the closure returns a suspended generator
 };
 
 struct Construct
@@ -211,6 +215,7 @@ struct Array
 {
 	Token m_op;
 	std::vector<std::unique_ptr<MidoriExpression>> m_elems;
+	const MidoriType* m_type = nullptr;
 };
 
 struct ArrayGet
@@ -218,6 +223,7 @@ struct ArrayGet
 	Token m_op;
 	std::unique_ptr<MidoriExpression> m_arr_var;
 	std::vector<std::unique_ptr<MidoriExpression>> m_indices;
+	const MidoriType* m_type = nullptr; // of the element
 };
 
 struct ArraySet
@@ -226,6 +232,7 @@ struct ArraySet
 	std::unique_ptr<MidoriExpression> m_arr_var;
 	std::vector<std::unique_ptr<MidoriExpression>> m_indices;
 	std::unique_ptr<MidoriExpression> m_value;
+	const MidoriType* m_type = nullptr; // of the element
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -250,6 +257,7 @@ struct Define
 	std::unique_ptr<MidoriExpression> m_value;
 	std::optional<const MidoriType*> m_annotated_type;
 	std::optional<int> m_local_index;
+	bool m_is_fixed;
 };
 
 struct If
@@ -267,6 +275,7 @@ struct While
 	Token m_while_keyword;
 	std::unique_ptr<MidoriExpression> m_condition;
 	std::unique_ptr<MidoriStatement> m_body;
+	ConditionOperandType m_condition_operand_type = ConditionOperandType::OTHER;
 };
 
 struct For
@@ -277,6 +286,16 @@ struct For
 	std::optional<std::unique_ptr<MidoriStatement>> m_condition_intializer;
 	std::unique_ptr<MidoriStatement> m_body;
 	int m_control_block_local_count = 0;
+	ConditionOperandType m_condition_operand_type = ConditionOperandType::OTHER;
+};
+
+// for (fixed x in generator) resumes the generator until it finishes, the generator and x are the loop's two locals
+struct ForEach
+{
+	Token m_for_keyword;
+	Token m_name;
+	std::unique_ptr<MidoriExpression> m_generator;
+	std::unique_ptr<MidoriStatement> m_body;
 };
 
 struct Break
@@ -297,6 +316,12 @@ struct Return
 	std::unique_ptr<MidoriExpression> m_value;
 };
 
+struct Yield
+{
+	Token m_keyword;
+	std::unique_ptr<MidoriExpression> m_value;
+};
+
 struct Foreign
 {
 	Token m_function_name;
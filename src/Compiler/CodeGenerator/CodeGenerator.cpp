@@ -43,6 +43,7 @@ void CodeGenerator::EmitNumericConstant(MidoriInteger val, int line, bool is_int
 	int byte6 = (val >> 40) & 0xff;
 	int byte7 = (val >> 48) & 0xff;
 	int byte8 = (val >> 56) & 0xff;
+	int position = m_procedures[m_current_procedure_index].GetByteCodeSize();
 
 	if (is_integer)
 	{
@@ -60,6 +61,11 @@ void CodeGenerator::EmitNumericConstant(MidoriInteger val, int line, bool is_int
 	EmitByte(static_cast<OpCode>(byte6), line);
 	EmitByte(static_cast<OpCode>(byte7), line);
 	EmitByte(static_cast<OpCode>(byte8), line);
+
+	if (is_integer)
+	{
+		RecordLoad(OpCode::INTEGER_CONSTANT, val, position, line);
+	}
 }
 
 void CodeGenerator::EmitConstant(MidoriValue&& value, int line)
@@ -78,15 +84,11 @@ void CodeGenerator::EmitConstant(MidoriValue&& value, int line)
 		return;
 	}
 
-	if (value.IsPointer())
-	{
-		MidoriTraceable* traceable = static_cast<MidoriTraceable*>(value.GetPointer());
-		m_executable.AddConstantRoot(traceable);
-		MidoriTraceable::s_static_bytes_allocated += traceable->GetSize();
-	}
-
-	int index = m_executable.AddConstant(std::move(value));
+	EmitConstantLoad(m_executable.AddConstant(std::move(value)), line);
+}
 
+void CodeGenerator::EmitConstantLoad(int index, int line)
+{
 	if (index <= MAX_SIZE_OP_CONSTANT) // 1 byte
 	{
 		EmitByte(OpCode::LOAD_CONSTANT, line);
@@ -112,8 +114,13 @@ void CodeGenerator::EmitVariable(int variable_index, OpCode op, int line)
 {
 	if (variable_index <= MAX_LOCAL_VARIABLES)
 	{
+		int position = m_procedures[m_current_procedure_index].GetByteCodeSize();
 		EmitByte(op, line);
 		EmitByte(static_cast<OpCode>(variable_index), line);
+		if (op == OpCode::GET_LOCAL || op == OpCode::GET_GLOBAL || op == OpCode::GET_CELL)
+		{
+			RecordLoad(op, variable_index, position, line);
+		}
 		return;
 	}
 
@@ -122,14 +129,59 @@ void CodeGenerator::EmitVariable(int variable_index, OpCode op, int line)
 
 int CodeGenerator::EmitJump(OpCode op, int line)
 {
+	if (std::optional<int> fused_jump = TryEmitConditionalJumpSuperinstruction(op, line); fused_jump.has_value())
+	{
+		return fused_jump.value();
+	}
+
 	EmitByte(op, line);
+	return EmitJumpOffset(line);
+}
+
+int CodeGenerator::EmitJumpOffset(int line)
+{
 	EmitByte(static_cast<OpCode>(0xff), line);
 	EmitByte(static_cast<OpCode>(0xff), line);
 	return m_procedures[m_current_procedure_index].GetByteCodeSize() - 2;
 }
 
+std::optional<int> CodeGenerator::EmitIntegerConditionalJump(int line)
+{
+	OpCode jump_op;
+	switch (m_last_opcode)
+	{
+	case OpCode::LESS_INTEGER:
+		jump_op = OpCode::IF_INTEGER_LESS;
+		break;
+	case OpCode::LESS_EQUAL_INTEGER:
+		jump_op = OpCode::IF_INTEGER_LESS_EQUAL;
+		break;
+	case OpCode::GREATER_INTEGER:
+		jump_op = OpCode::IF_INTEGER_GREATER;
+		break;
+	case OpCode::GREATER_EQUAL_INTEGER:
+		jump_op = OpCode::IF_INTEGER_GREATER_EQUAL;
+		break;
+	case OpCode::EQUAL_INTEGER:
+		jump_op = OpCode::IF_INTEGER_EQUAL;
+		break;
+	case OpCode::NOT_EQUAL_INTEGER:
+		jump_op = OpCode::IF_INTEGER_NOT_EQUAL;
+		break;
+	default:
+		return std::nullopt;
+	}
+
+	// the comparison is folded into the jump
+	PopByte(line);
+	return EmitJump(jump_op, line);
+}
+
 void CodeGenerator::PatchJump(int offset, int line)
 {
+	// the patched location becomes a jump target, so no superinstruction may span it
+	ForgetLoads();
+
 	int jump = m_procedures[m_current_procedure_index].GetByteCodeSize() - offset - 2;
 	if (jump > MAX_JUMP_SIZE)
 	{
@@ -175,8 +227,492 @@ void CodeGenerator::EndLoop(int line)
 	);
 }
 
+void CodeGenerator::EmitIntegerArithmetic(OpCode op, int line)
+{
+	if (!TryEmitArithmeticSuperinstruction(op, line))
+	{
+		EmitByte(op, line);
+	}
+}
+
+MidoriArray::Packing CodeGenerator::GetArrayPacking(const MidoriType* element_type)
+{
+	if (MidoriTypeUtil::IsIntegerType(element_type))
+	{
+		return MidoriArray::Packing::Integers;
+	}
+	else if (MidoriTypeUtil::IsFractionType(element_type))
+	{
+		return MidoriArray::Packing::Fractions;
+	}
+	else if (MidoriTypeUtil::IsBoolType(element_type))
+	{
+		return MidoriArray::Packing::Bools;
+	}
+	else
+	{
+		return MidoriArray::Packing::Values;
+	}
+}
+
+void CodeGenerator::EmitArrayElementAccess(OpCode generic_op, const MidoriType* element_type, int line)
+{
+	bool is_get = generic_op == OpCode::GET_ARRAY_ELEMENT;
+	switch (GetArrayPacking(element_type))
+	{
+	case MidoriArray::Packing::Integers:
+		EmitByte(is_get ? OpCode::GET_ARRAY_ELEMENT_INTEGER : OpCode::SET_ARRAY_ELEMENT_INTEGER, line);
+		break;
+	case MidoriArray::Packing::Fractions:
+		EmitByte(is_get ? OpCode::GET_ARRAY_ELEMENT_FRACTION : OpCode::SET_ARRAY_ELEMENT_FRACTION, line);
+		break;
+	case MidoriArray::Packing::Bools:
+		EmitByte(is_get ? OpCode::GET_ARRAY_ELEMENT_BOOL : OpCode::SET_ARRAY_ELEMENT_BOOL, line);
+		break;
+	default:
+		EmitByte(generic_op, line);
+		break;
+	}
+}
+
+std::optional<OpCode> CodeGenerator::SelectRegisterForm(OpCode op, std::optional<RegisterOperand>& left, std::optional<RegisterOperand>& right)
+{
+	// the mirrored form is used when the immediate is on the left, i.e. "0 < x" becomes "x > 0"
+	OpCode register_op;
+	OpCode immediate_op;
+	std::optional<OpCode> mirrored_immediate_op; // none for arithmetic that does not commute
+	switch (op)
+	{
+	case OpCode::ADD_INTEGER:
+		register_op = OpCode::ADD_INTEGER_RR;
+		immediate_op = OpCode::ADD_INTEGER_RI;
+		mirrored_immediate_op = OpCode::ADD_INTEGER_RI;
+		break;
+	case OpCode::SUBTRACT_INTEGER:
+		register_op = OpCode::SUBTRACT_INTEGER_RR;
+		immediate_op = OpCode::SUBTRACT_INTEGER_RI;
+		break;
+	case OpCode::MULTIPLY_INTEGER:
+		register_op = OpCode::MULTIPLY_INTEGER_RR;
+		immediate_op = OpCode::MULTIPLY_INTEGER_RI;
+		mirrored_immediate_op = OpCode::MULTIPLY_INTEGER_RI;
+		break;
+	case OpCode::MODULO_INTEGER:
+		register_op = OpCode::MODULO_INTEGER_RR;
+		immediate_op = OpCode::MODULO_INTEGER_RI;
+		break;
+	case OpCode::IF_INTEGER_LESS:
+		register_op = OpCode::IF_INTEGER_LESS_RR;
+		immediate_op = OpCode::IF_INTEGER_LESS_RI;
+		mirrored_immediate_op = OpCode::IF_INTEGER_GREATER_RI;
+		break;
+	case OpCode::IF_INTEGER_LESS_EQUAL:
+		register_op = OpCode::IF_INTEGER_LESS_EQUAL_RR;
+		immediate_op = OpCode::IF_INTEGER_LESS_EQUAL_RI;
+		mirrored_immediate_op = OpCode::IF_INTEGER_GREATER_EQUAL_RI;
+		break;
+	case OpCode::IF_INTEGER_GREATER:
+		register_op = OpCode::IF_INTEGER_GREATER_RR;
+		immediate_op = OpCode::IF_INTEGER_GREATER_RI;
+		mirrored_immediate_op = OpCode::IF_INTEGER_LESS_RI;
+		break;
+	case OpCode::IF_INTEGER_GREATER_EQUAL:
+		register_op = OpCode::IF_INTEGER_GREATER_EQUAL_RR;
+		immediate_op = OpCode::IF_INTEGER_GREATER_EQUAL_RI;
+		mirrored_immediate_op = OpCode::IF_INTEGER_LESS_EQUAL_RI;
+		break;
+	case OpCode::IF_INTEGER_EQUAL:
+		register_op = OpCode::IF_INTEGER_EQUAL_RR;
+		immediate_op = OpCode::IF_INTEGER_EQUAL_RI;
+		mirrored_immediate_op = OpCode::IF_INTEGER_EQUAL_RI;
+		break;
+	case OpCode::IF_INTEGER_NOT_EQUAL:
+		register_op = OpCode::IF_INTEGER_NOT_EQUAL_RR;
+		immediate_op = OpCode::IF_INTEGER_NOT_EQUAL_RI;
+		mirrored_immediate_op = OpCode::IF_INTEGER_NOT_EQUAL_RI;
+		break;
+	default:
+		return std::nullopt;
+	}
+
+	if (!left.has_value() || !right.has_value() || (left->m_is_immediate && right->m_is_immediate))
+	{
+		return std::nullopt;
+	}
+
+	if (left->m_is_immediate)
+	{
+		if (!mirrored_immediate_op.has_value())
+		{
+			return std::nullopt;
+		}
+		std::swap(left, right);
+		return mirrored_immediate_op;
+	}
+
+	return right->m_is_immediate ? immediate_op : register_op;
+}
+
+std::optional<OpCode> CodeGenerator::SelectRegisterStoreForm(OpCode op, std::optional<RegisterOperand>& left, std::optional<RegisterOperand>& right)
+{
+	// the operands are arranged exactly as for the two-operand form, only the opcode differs
+	std::optional<OpCode> register_op = SelectRegisterForm(op, left, right);
+	if (!register_op.has_value())
+	{
+		return std::nullopt;
+	}
+
+	switch (register_op.value())
+	{
+	case OpCode::ADD_INTEGER_RR:
+		return OpCode::ADD_INTEGER_RRR;
+	case OpCode::ADD_INTEGER_RI:
+		return OpCode::ADD_INTEGER_RRI;
+	case OpCode::SUBTRACT_INTEGER_RR:
+		return OpCode::SUBTRACT_INTEGER_RRR;
+	case OpCode::SUBTRACT_INTEGER_RI:
+		return OpCode::SUBTRACT_INTEGER_RRI;
+	default:
+		return std::nullopt;
+	}
+}
+
+void CodeGenerator::EmitRegisterInstruction(OpCode op, const RegisterOperand& left, const RegisterOperand& right, int line)
+{
+	EmitByte(op, line);
+	EmitRegisterOperand(left, line);
+	EmitRegisterOperand(right, line);
+}
+
+void CodeGenerator::EmitRegisterOperand(const RegisterOperand& operand, int line)
+{
+	if (operand.m_is_immediate)
+	{
+		EmitTwoBytes(operand.m_value, operand.m_value >> 8, line);
+		EmitTwoBytes(operand.m_value >> 16, operand.m_value >> 24, line);
+	}
+	else
+	{
+		EmitByte(static_cast<OpCode>(operand.m_value), line);
+	}
+}
+
+void CodeGenerator::RecordLoad(OpCode op, MidoriInteger operand, int position, int line)
+{
+	m_recent_loads[0u] = m_recent_loads[1u];
+	m_recent_loads[1u] = { op, operand, m_current_procedure_index, position, m_procedures[m_current_procedure_index].GetByteCodeSize() - position, line };
+}
+
+void CodeGenerator::ForgetLoads()
+{
+	m_recent_loads.fill(LoadInstruction());
+}
+
+bool CodeGenerator::HasFusableLoads(int count) const
+{
+	// loads are fusable only if they are the last instructions emitted into the current procedure, back to back
+	int end = m_procedures[m_current_procedure_index].GetByteCodeSize();
+	for (int i = 1; i >= 2 - count; i -= 1)
+	{
+		const LoadInstruction& load = m_recent_loads[static_cast<size_t>(i)];
+		if (load.m_procedure_index != m_current_procedure_index || load.m_position + load.m_size != end)
+		{
+			return false;
+		}
+		end = load.m_position;
+	}
+	return true;
+}
+
+void CodeGenerator::DiscardLoads(int count)
+{
+	// each load is popped with its own line, the operands of a binary operator may span several lines
+	for (int i = 1; i >= 2 - count; i -= 1)
+	{
+		const LoadInstruction& load = m_recent_loads[static_cast<size_t>(i)];
+		for (int byte = 0; byte < load.m_size; byte += 1)
+		{
+			PopByte(load.m_line);
+		}
+	}
+	ForgetLoads();
+}
+
+std::optional<CodeGenerator::RegisterOperand> CodeGenerator::GetRegisterOperand(const LoadInstruction& load) const
+{
+	if (load.m_op == OpCode::GET_LOCAL)
+	{
+		return RegisterOperand{ static_cast<int>(load.m_operand), false };
+	}
+	else if (load.m_op == OpCode::INTEGER_CONSTANT && load.m_operand >= INT32_MIN && load.m_operand <= INT32_MAX)
+	{
+		return RegisterOperand{ static_cast<int>(load.m_operand), true };
+	}
+
+	return std::nullopt;
+}
+
+bool CodeGenerator::TryEmitArithmeticSuperinstruction(OpCode op, int line)
+{
+	if (!HasFusableLoads(2))
+	{
+		return false;
+	}
+
+	std::optional<RegisterOperand> left = GetRegisterOperand(m_recent_loads[0u]);
+	std::optional<RegisterOperand> right = GetRegisterOperand(m_recent_loads[1u]);
+	std::optional<OpCode> register_op = SelectRegisterForm(op, left, right);
+	if (!register_op.has_value())
+	{
+		return false;
+	}
+
+	DiscardLoads(2);
+	EmitRegisterInstruction(register_op.value(), left.value(), right.value(), line);
+	return true;
+}
+
+std::optional<int> CodeGenerator::TryEmitConditionalJumpSuperinstruction(OpCode op, int line)
+{
+	if (!HasFusableLoads(2))
+	{
+		return std::nullopt;
+	}
+
+	std::optional<RegisterOperand> left = GetRegisterOperand(m_recent_loads[0u]);
+	std::optional<RegisterOperand> right = GetRegisterOperand(m_recent_loads[1u]);
+	std::optional<OpCode> register_op = SelectRegisterForm(op, left, right);
+	if (!register_op.has_value())
+	{
+		return std::nullopt;
+	}
+
+	DiscardLoads(2);
+	EmitRegisterInstruction(register_op.value(), left.value(), right.value(), line);
+	return EmitJumpOffset(line);
+}
+
+bool CodeGenerator::TryEmitCallSuperinstruction(int arity, int line)
+{
+	if (!HasFusableLoads(1))
+	{
+		return false;
+	}
+
+	OpCode call_op;
+	int callee_index = static_cast<int>(m_recent_loads[1u].m_operand);
+	switch (m_recent_loads[1u].m_op)
+	{
+	case OpCode::GET_GLOBAL:
+		if (std::unordered_map<int, int>::const_iterator it = m_direct_call_procedures.find(callee_index); it != m_direct_call_procedures.cend() && it->second <= MAX_FUNCTION_COUNT)
+		{
+			call_op = OpCode::CALL_DIRECT;
+			callee_index = it->second;
+			break;
+		}
+		call_op = OpCode::CALL_GLOBAL;
+		break;
+	case OpCode::GET_LOCAL:
+		call_op = OpCode::CALL_LOCAL;
+		break;
+	case OpCode::GET_CELL:
+		call_op = OpCode::CALL_CELL;
+		break;
+	default:
+		return false;
+	}
+
+	DiscardLoads(1);
+	EmitByte(call_op, line);
+	EmitByte(static_cast<OpCode>(callee_index), line);
+	EmitByte(static_cast<OpCode>(arity), line);
+	return true;
+}
+
+bool CodeGenerator::TryEmitIndexedForeignCall(int arity, int line)
+{
+	if (!HasFusableLoads(1) || m_recent_loads[1u].m_op != OpCode::GET_GLOBAL)
+	{
+		return false;
+	}
+
+	std::unordered_map<int, int>::const_iterator it = m_foreign_global_variables.find(static_cast<int>(m_recent_loads[1u].m_operand));
+	if (it == m_foreign_global_variables.cend() || it->second > UINT8_MAX)
+	{
+		return false;
+	}
+
+	DiscardLoads(1);
+	EmitByte(OpCode::CALL_FOREIGN_INDEXED, line);
+	EmitByte(static_cast<OpCode>(it->second), line);
+	EmitByte(static_cast<OpCode>(arity), line);
+	return true;
+}
+
+void CodeGenerator::MarkTailCalls(MidoriExpression& expr)
+{
+	if (Call* call = std::get_if<Call>(&expr))
+	{
+		call->m_is_tail_call = !call->m_is_foreign;
+	}
+	else if (Ternary* ternary = std::get_if<Ternary>(&expr))
+	{
+		MarkTailCalls(*ternary->m_true_branch);
+		MarkTailCalls(*ternary->m_else_branch);
+	}
+	else if (Group* group = std::get_if<Group>(&expr))
+	{
+		MarkTailCalls(*group->m_expr_in);
+	}
+}
+
+#ifdef MIDORI_REGISTER_BYTECODE
+std::optional<CodeGenerator::RegisterOperand> CodeGenerator::GetRegisterOperand(const MidoriExpression& expr) const
+{
+	if (const Variable* variable = std::get_if<Variable>(&expr))
+	{
+		const VariableSemantic::Local* local = std::get_if<VariableSemantic::Local>(&variable->m_semantic_tag);
+		if (local != nullptr && local->m_index <= MAX_LOCAL_VARIABLES)
+		{
+			return RegisterOperand{ local->m_index, false };
+		}
+	}
+	else if (const IntegerLiteral* integer = std::get_if<IntegerLiteral>(&expr))
+	{
+		MidoriInteger value = std::stoll(integer->m_token.m_lexeme);
+		if (value >= INT32_MIN && value <= INT32_MAX)
+		{
+			return RegisterOperand{ static_cast<int>(value), true };
+		}
+	}
+
+	return std::nullopt;
+}
+
+std::optional<OpCode> CodeGenerator::GetIntegerArithmeticOp(const Binary& binary)
+{
+	if (!MidoriTypeUtil::IsIntegerType(binary.m_type))
+	{
+		return std::nullopt;
+	}
+
+	switch (binary.m_op.m_token_name)
+	{
+	case Token::Name::SINGLE_PLUS:
+		return OpCode::ADD_INTEGER;
+	case Token::Name::SINGLE_MINUS:
+		return OpCode::SUBTRACT_INTEGER;
+	case Token::Name::STAR:
+		return OpCode::MULTIPLY_INTEGER;
+	case Token::Name::PERCENT:
+		return OpCode::MODULO_INTEGER;
+	default:
+		return std::nullopt;
+	}
+}
+
+bool CodeGenerator::TryEmitRegisterBinary(Binary& binary)
+{
+	std::optional<OpCode> op = GetIntegerArithmeticOp(binary);
+	if (!op.has_value())
+	{
+		return false;
+	}
+
+	std::optional<RegisterOperand> left = GetRegisterOperand(*binary.m_left);
+	std::optional<RegisterOperand> right = GetRegisterOperand(*binary.m_right);
+	std::optional<OpCode> register_op = SelectRegisterForm(op.value(), left, right);
+	if (!register_op.has_value())
+	{
+		return false;
+	}
+
+	EmitRegisterInstruction(register_op.value(), left.value(), right.value(), binary.m_op.m_line);
+	return true;
+}
+
+bool CodeGenerator::TryEmitRegisterStore(Bind& bind)
+{
+	const VariableSemantic::Local* destination = std::get_if<VariableSemantic::Local>(&bind.m_semantic_tag);
+	Binary* binary = std::get_if<Binary>(bind.m_value.get());
+	if (destination == nullptr || destination->m_index > MAX_LOCAL_VARIABLES || binary == nullptr)
+	{
+		return false;
+	}
+
+	std::optional<OpCode> op = GetIntegerArithmeticOp(*binary);
+	if (!op.has_value())
+	{
+		return false;
+	}
+
+	std::optional<RegisterOperand> left = GetRegisterOperand(*binary->m_left);
+	std::optional<RegisterOperand> right = GetRegisterOperand(*binary->m_right);
+	std::optional<OpCode> register_op = SelectRegisterStoreForm(op.value(), left, right);
+	if (!register_op.has_value())
+	{
+		return false;
+	}
+
+	int line = bind.m_name.m_line;
+	EmitByte(register_op.value(), line);
+	EmitRegisterOperand(RegisterOperand{ destination->m_index, false }, line);
+	EmitRegisterOperand(left.value(), line);
+	EmitRegisterOperand(right.value(), line);
+	return true;
+}
+
+std::optional<int> CodeGenerator::TryEmitRegisterConditionalJump(MidoriExpression& condition, int line)
+{
+	Binary* binary = std::get_if<Binary>(&condition);
+	if (binary == nullptr || !MidoriTypeUtil::IsIntegerType(binary->m_type))
+	{
+		return std::nullopt;
+	}
+
+	OpCode jump_op;
+	switch (binary->m_op.m_token_name)
+	{
+	case Token::Name::LEFT_ANGLE:
+		jump_op = OpCode::IF_INTEGER_LESS;
+		break;
+	case Token::Name::LESS_EQUAL:
+		jump_op = OpCode::IF_INTEGER_LESS_EQUAL;
+		break;
+	case Token::Name::RIGHT_ANGLE:
+		jump_op = OpCode::IF_INTEGER_GREATER;
+		break;
+	case Token::Name::GREATER_EQUAL:
+		jump_op = OpCode::IF_INTEGER_GREATER_EQUAL;
+		break;
+	case Token::Name::DOUBLE_EQUAL:
+		jump_op = OpCode::IF_INTEGER_EQUAL;
+		break;
+	case Token::Name::BANG_EQUAL:
+		jump_op = OpCode::IF_INTEGER_NOT_EQUAL;
+		break;
+	default:
+		return std::nullopt;
+	}
+
+	std::optional<RegisterOperand> left = GetRegisterOperand(*binary->m_left);
+	std::optional<RegisterOperand> right = GetRegisterOperand(*binary->m_right);
+	std::optional<OpCode> register_op = SelectRegisterForm(jump_op, left, right);
+	if (!register_op.has_value())
+	{
+		return std::nullopt;
+	}
+
+	EmitRegisterInstruction(register_op.value(), left.value(), right.value(), line);
+	return EmitJumpOffset(line);
+}
+#endif
+
 MidoriResult::CodeGeneratorResult CodeGenerator::GenerateCode(MidoriProgramTree&& program_tree)
 {
+	// constants are allocated straight into the heap the program will run on
+	MidoriHeap::Scope heap_scope(m_executable.GetHeap());
+
 	std::ranges::for_each
 	(
 		program_tree,
@@ -199,9 +735,10 @@ MidoriResult::CodeGeneratorResult CodeGenerator::GenerateCode(MidoriProgramTree&
 		return std::unexpected<std::string>(std::move(m_errors));
 	}
 
-	// invoke the program entry (main)
+	// invoke the program entry (main), a host that only calls into the program stops at the first halt
 	const CodeGenerator::MainProcedureContext& main_module_ctx = m_main_function_ctx.value();
 	m_current_procedure_index = main_module_ctx.m_main_procedure_index;
+	EmitByte(OpCode::HALT, main_module_ctx.m_main_procedure_line);
 	EmitVariable(main_module_ctx.m_main_procedure_global_table_index, OpCode::GET_GLOBAL, main_module_ctx.m_main_procedure_line);
 	EmitByte(OpCode::CALL_DEFINED, main_module_ctx.m_main_procedure_line);
 	EmitByte(static_cast<OpCode>(0), main_module_ctx.m_main_procedure_line);
@@ -211,8 +748,9 @@ MidoriResult::CodeGeneratorResult CodeGenerator::GenerateCode(MidoriProgramTree&
 	m_executable.AttachProcedureNames(std::move(m_procedure_names));
 #endif
 	m_executable.AttachProcedures(std::move(m_procedures));
+	m_executable.AttachProcedureArities(std::move(m_procedure_arities));
 
-	return m_executable;
+	return std::move(m_executable);
 }
 
 void CodeGenerator::operator()(Block& block)
@@ -244,6 +782,13 @@ void CodeGenerator::operator()(Block& block)
 
 void CodeGenerator::operator()(Simple& simple)
 {
+#ifdef MIDORI_REGISTER_BYTECODE
+	if (Bind* bind = std::get_if<Bind>(simple.m_expr.get()); bind != nullptr && TryEmitRegisterStore(*bind))
+	{
+		return;
+	}
+#endif
+
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
@@ -261,6 +806,13 @@ void CodeGenerator::operator()(Define& def)
 		MidoriText variable_name(def.m_name.m_lexeme.c_str());
 		index.emplace(m_executable.AddGlobalVariable(std::move(variable_name)));
 		m_global_variables[def.m_name.m_lexeme] = index.value();
+
+		// the closure is the next procedure generated, registered first so that recursive calls are direct too
+		const Closure* closure = std::get_if<Closure>(def.m_value.get());
+		if (def.m_is_fixed && closure != nullptr && closure->m_captured_count == 0)
+		{
+			m_direct_call_procedures[index.value()] = static_cast<int>(m_procedures.size());
+		}
 	}
 
 	std::visit([this](auto&& arg)
@@ -290,6 +842,23 @@ void CodeGenerator::operator()(Define& def)
 void CodeGenerator::operator()(If& if_stmt)
 {
 	int line = if_stmt.m_if_keyword.m_line;
+
+#ifdef MIDORI_REGISTER_BYTECODE
+	if (std::optional<int> if_jump = TryEmitRegisterConditionalJump(*if_stmt.m_condition, line); if_jump.has_value())
+	{
+		if (if_stmt.m_else_branch.has_value())
+		{
+			EmitConditionalBranches<std::unique_ptr<MidoriStatement>&>(if_jump.value(), if_stmt.m_true_branch, if_stmt.m_else_branch.value(), line);
+		}
+		else
+		{
+			std::unique_ptr<MidoriStatement> null_else_branch = nullptr;
+			EmitConditionalBranches<std::unique_ptr<MidoriStatement>&>(if_jump.value(), if_stmt.m_true_branch, null_else_branch, line);
+		}
+		return;
+	}
+#endif
+
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
@@ -334,17 +903,45 @@ void CodeGenerator::operator()(If& if_stmt)
 
 void CodeGenerator::operator()(While& while_stmt)
 {
+	ForgetLoads();
 	int loop_start = m_procedures[m_current_procedure_index].GetByteCodeSize();
 	BeginLoop(loop_start);
 
+	int line = while_stmt.m_while_keyword.m_line;
+
+#ifdef MIDORI_REGISTER_BYTECODE
+	if (std::optional<int> exit_jump = TryEmitRegisterConditionalJump(*while_stmt.m_condition, line); exit_jump.has_value())
+	{
+		std::visit([this](auto&& arg)
+			{
+				(*this)(arg);
+			}, *while_stmt.m_body);
+
+		EmitLoop(loop_start, line);
+		PatchJump(exit_jump.value(), line);
+
+		EndLoop(line);
+		return;
+	}
+#endif
+
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
 		}, *while_stmt.m_condition);
 
-	int line = while_stmt.m_while_keyword.m_line;
-	int jump_if_false = EmitJump(OpCode::JUMP_IF_FALSE, line);
-	EmitByte(OpCode::POP, line);
+	// integer comparisons branch directly and leave nothing on the stack to pop
+	std::optional<int> exit_jump = std::nullopt;
+	if (while_stmt.m_condition_operand_type == ConditionOperandType::INTEGER)
+	{
+		exit_jump = EmitIntegerConditionalJump(line);
+	}
+	bool is_condition_on_stack = !exit_jump.has_value();
+	if (is_condition_on_stack)
+	{
+		exit_jump.emplace(EmitJump(OpCode::JUMP_IF_FALSE, line));
+		EmitByte(OpCode::POP, line);
+	}
 
 	std::visit([this](auto&& arg)
 		{
@@ -352,8 +949,11 @@ void CodeGenerator::operator()(While& while_stmt)
 		}, *while_stmt.m_body);
 
 	EmitLoop(loop_start, line);
-	PatchJump(jump_if_false, line);
-	EmitByte(OpCode::POP, line);
+	PatchJump(exit_jump.value(), line);
+	if (is_condition_on_stack)
+	{
+		EmitByte(OpCode::POP, line);
+	}
 
 	EndLoop(line);
 }
@@ -368,22 +968,51 @@ void CodeGenerator::operator()(For& for_stmt)
 			}, *for_stmt.m_condition_intializer.value());
 	}
 
+	ForgetLoads();
 	int loop_start = m_procedures[m_current_procedure_index].GetByteCodeSize();
 	int line = for_stmt.m_for_keyword.m_line;
 
 	int exit_jump = -1;
+	bool is_condition_on_stack = false;
 	if (for_stmt.m_condition.has_value())
 	{
-		std::visit([this](auto&& arg)
+#ifdef MIDORI_REGISTER_BYTECODE
+		std::optional<int> register_exit_jump = TryEmitRegisterConditionalJump(*for_stmt.m_condition.value(), line);
+		if (register_exit_jump.has_value())
+		{
+			exit_jump = register_exit_jump.value();
+		}
+		else
+#endif
+		{
+			std::visit([this](auto&& arg)
+				{
+					(*this)(arg);
+				}, *for_stmt.m_condition.value());
+
+			// integer comparisons branch directly and leave nothing on the stack to pop
+			std::optional<int> integer_exit_jump = std::nullopt;
+			if (for_stmt.m_condition_operand_type == ConditionOperandType::INTEGER)
 			{
-				(*this)(arg);
-			}, *for_stmt.m_condition.value());
-		exit_jump = EmitJump(OpCode::JUMP_IF_FALSE, line);
-		EmitByte(OpCode::POP, line);
+				integer_exit_jump = EmitIntegerConditionalJump(line);
+			}
+
+			if (integer_exit_jump.has_value())
+			{
+				exit_jump = integer_exit_jump.value();
+			}
+			else
+			{
+				exit_jump = EmitJump(OpCode::JUMP_IF_FALSE, line);
+				EmitByte(OpCode::POP, line);
+				is_condition_on_stack = true;
+			}
+		}
 	}
 	if (for_stmt.m_condition_incrementer.has_value())
 	{
 		int body_jump = EmitJump(OpCode::JUMP, line);
+		ForgetLoads();
 		int incrementer_start = m_procedures[m_current_procedure_index].GetByteCodeSize();
 		std::visit([this](auto&& arg)
 			{
@@ -405,7 +1034,10 @@ void CodeGenerator::operator()(For& for_stmt)
 	if (exit_jump != -1)
 	{
 		PatchJump(exit_jump, line);
-		EmitByte(OpCode::POP, line);
+		if (is_condition_on_stack)
+		{
+			EmitByte(OpCode::POP, line);
+		}
 	}
 
 	while (for_stmt.m_control_block_local_count > 0)
@@ -418,6 +1050,42 @@ void CodeGenerator::operator()(For& for_stmt)
 	EndLoop(line);
 }
 
+void CodeGenerator::operator()(ForEach& for_each)
+{
+	int line = for_each.m_for_keyword.m_line;
+
+	// the generator stays on the stack as the loop's first local
+	std::visit([this](auto&& arg)
+		{
+			(*this)(arg);
+		}, *for_each.m_generator);
+
+	ForgetLoads();
+	int loop_start = m_procedures[m_current_procedure_index].GetByteCodeSize();
+	BeginLoop(loop_start);
+
+	// a resumed generator leaves its next element below true, a finished one leaves only false
+	EmitByte(OpCode::RESUME_GENERATOR, line);
+	int exit_jump = EmitJump(OpCode::JUMP_IF_FALSE, line);
+	EmitByte(OpCode::POP, line);
+
+	std::visit([this](auto&& arg)
+		{
+			(*this)(arg);
+		}, *for_each.m_body);
+
+	EmitByte(OpCode::POP_SCOPE, line);
+	EmitByte(static_cast<OpCode>(1), line);
+	EmitLoop(loop_start, line);
+
+	PatchJump(exit_jump, line);
+	EmitByte(OpCode::POP, line);
+	EmitByte(OpCode::POP_SCOPE, line);
+	EmitByte(static_cast<OpCode>(1), line);
+
+	EndLoop(line);
+}
+
 void CodeGenerator::operator()(Break& break_stmt)
 {
 	int line = break_stmt.m_keyword.m_line;
@@ -452,6 +1120,18 @@ void CodeGenerator::operator()(Return& return_stmt)
 {
 	int line = return_stmt.m_keyword.m_line;
 
+	if (m_is_in_generator)
+	{
+		std::visit([this](auto&& arg)
+			{
+				(*this)(arg);
+			}, *return_stmt.m_value);
+
+		EmitByte(OpCode::FINISH_GENERATOR, line);
+		return;
+	}
+
+	MarkTailCalls(*return_stmt.m_value);
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
@@ -460,6 +1140,18 @@ void CodeGenerator::operator()(Return& return_stmt)
 	EmitByte(OpCode::RETURN, line);
 }
 
+void CodeGenerator::operator()(Yield& yield_stmt)
+{
+	int line = yield_stmt.m_keyword.m_line;
+
+	std::visit([this](auto&& arg)
+		{
+			(*this)(arg);
+		}, *yield_stmt.m_value);
+
+	EmitByte(OpCode::YIELD, line);
+}
+
 void CodeGenerator::operator()(Foreign& foreign)
 {
 	int line = foreign.m_function_name.m_line;
@@ -472,7 +1164,15 @@ void CodeGenerator::operator()(Foreign& foreign)
 		m_global_variables[foreign.m_function_name.m_lexeme] = index.value();
 	}
 
-	EmitConstant(MidoriTraceable::AllocateTraceable(foreign.m_foreign_name.c_str()), line);
+	int foreign_index = m_executable.AddForeignFunction(MidoriText(foreign.m_foreign_name.c_str()));
+	if (is_global)
+	{
+		m_foreign_global_variables[index.value()] = foreign_index;
+		m_executable.AddForeignGlobalVariable(index.value(), static_cast<int>(MidoriTypeUtil::GetFunctionType(foreign.m_type).m_param_types.size()));
+	}
+
+	// the value of a foreign function is its index in the foreign function table
+	EmitConstant(static_cast<MidoriInteger>(foreign_index), line);
 
 	if (is_global)
 	{
@@ -497,24 +1197,69 @@ void CodeGenerator::operator()(Switch& switch_stmt)
 		{
 			(*this)(arg);
 		}, *switch_stmt.m_arg_expr);
-	EmitByte(OpCode::LOAD_TAG, line);
 
-	// for each case
-	// compare tag
-	std::vector<int> jumps;
+	// cases after the default are unreachable
+	std::vector<Switch::Case*> reachable_cases;
+	int entry_count = 0;
 	for (Switch::Case& switch_case : switch_stmt.m_cases)
 	{
-		if (Switch::IsMemberCase(switch_case))
+		reachable_cases.emplace_back(&switch_case);
+		if (Switch::IsDefaultCase(switch_case))
 		{
-			const Switch::MemberCase& member_case = Switch::GetMemberCase(switch_case);
+			break;
+		}
+		entry_count = std::max(entry_count, Switch::GetMemberCase(switch_case).m_tag + 1);
+	}
+
+	if (entry_count > MAX_UNION_TAG + 1)
+	{
+		AddError(MidoriError::GenerateCodeGeneratorError(std::format("Union tag too large (max {}).", MAX_UNION_TAG + 1), line));
+		return;
+	}
+
+	// SWITCH_TABLE entry_count default_offset tag_0_offset ... tag_n_offset, offsets are relative to the end of the table
+	EmitByte(OpCode::SWITCH_TABLE, line);
+	EmitTwoBytes(entry_count, entry_count >> 8, line);
+	int table_begin = m_procedures[m_current_procedure_index].GetByteCodeSize();
+	for (int i = 0; i <= entry_count; i += 1)
+	{
+		EmitTwoBytes(0xff, 0xff, line);
+	}
+	int table_end = m_procedures[m_current_procedure_index].GetByteCodeSize();
+
+	auto set_entry = [this, table_begin](int entry, int offset)
+		{
+			m_procedures[m_current_procedure_index].SetByteCode(table_begin + entry * 2, static_cast<OpCode>(offset & 0xff));
+			m_procedures[m_current_procedure_index].SetByteCode(table_begin + entry * 2 + 1, static_cast<OpCode>((offset >> 8) & 0xff));
+		};
+
+	// the current position becomes the target of a table entry
+	auto patch_entry = [this, table_end, line, &set_entry](int entry) -> int
+		{
+			ForgetLoads();
 
-			EmitByte(OpCode::DUP, line);
-			MidoriInteger member_tag = static_cast<MidoriInteger>(member_case.m_tag);
-			EmitConstant(member_tag, line);
-			EmitByte(OpCode::EQUAL_INTEGER, line);
-			int jump_if_false = EmitJump(OpCode::JUMP_IF_FALSE, line);
-			EmitByte(OpCode::POP, line); // pop tag
-			EmitByte(OpCode::POP, line); // pop comp result
+			int offset = m_procedures[m_current_procedure_index].GetByteCodeSize() - table_end;
+			if (offset > MAX_JUMP_SIZE)
+			{
+				AddError(MidoriError::GenerateCodeGeneratorError(std::format("Too much code to jump over (max {}).", MAX_JUMP_SIZE + 1), line));
+				return 0;
+			}
+
+			set_entry(entry, offset);
+			return offset;
+		};
+
+	std::vector<bool> is_tag_matched(static_cast<size_t>(entry_count), false);
+	std::optional<int> default_offset = std::nullopt;
+	std::vector<int> jumps;
+	for (Switch::Case* switch_case : reachable_cases)
+	{
+		if (Switch::IsMemberCase(*switch_case))
+		{
+			// the table entry of a tag is right after the default offset, SWITCH_TABLE pushes the members for its bindings
+			const Switch::MemberCase& member_case = Switch::GetMemberCase(*switch_case);
+			patch_entry(member_case.m_tag + 1);
+			is_tag_matched[static_cast<size_t>(member_case.m_tag)] = true;
 
 			std::visit([this](auto&& arg)
 				{
@@ -529,23 +1274,35 @@ void CodeGenerator::operator()(Switch& switch_stmt)
 				EmitByte(static_cast<OpCode>(count_to_pop), line);
 				num_to_pop -= count_to_pop;
 			}
-			jumps.emplace_back(EmitJump(OpCode::JUMP, line));
-
-			PatchJump(jump_if_false, line);
-			EmitByte(OpCode::POP, line); // pop comp result
 		}
 		else
 		{
-			const Switch::DefaultCase& default_case = Switch::GetDefaultCase(switch_case);
+			const Switch::DefaultCase& default_case = Switch::GetDefaultCase(*switch_case);
+			default_offset = patch_entry(0);
 
 			std::visit([this](auto&& arg)
 				{
 					(*this)(arg);
 				}, *default_case.m_stmt);
+		}
 
-			EmitByte(OpCode::POP, line);
+		if (switch_case != reachable_cases.back())
+		{
 			jumps.emplace_back(EmitJump(OpCode::JUMP, line));
-			break;
+		}
+	}
+
+	// without a default case every tag has its own case, so the fallback only keeps the table well-formed
+	if (!default_offset.has_value())
+	{
+		default_offset = patch_entry(0);
+	}
+
+	for (int tag = 0; tag < entry_count; tag += 1)
+	{
+		if (!is_tag_matched[static_cast<size_t>(tag)])
+		{
+			set_entry(tag + 1, default_offset.value());
 		}
 	}
 
@@ -620,6 +1377,14 @@ void CodeGenerator::operator()(Binary& binary)
 {
 	int line = binary.m_op.m_line;
 	const MidoriType* expr_type = binary.m_type;
+
+#ifdef MIDORI_REGISTER_BYTECODE
+	if (TryEmitRegisterBinary(binary))
+	{
+		return;
+	}
+#endif
+
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
@@ -632,26 +1397,26 @@ void CodeGenerator::operator()(Binary& binary)
 	switch (binary.m_op.m_token_name)
 	{
 	case Token::Name::SINGLE_PLUS:
-		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::ADD_FRACTION, line) : EmitByte(OpCode::ADD_INTEGER, line);
+		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::ADD_FRACTION, line) : EmitIntegerArithmetic(OpCode::ADD_INTEGER, line);
 		break;
 	case Token::Name::DOUBLE_PLUS:
 		MidoriTypeUtil::IsTextType(expr_type) ? EmitByte(OpCode::CONCAT_TEXT, line) : EmitByte(OpCode::CONCAT_ARRAY, line);
 		break;
 	case Token::Name::SINGLE_MINUS:
-		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::SUBTRACT_FRACTION, line) : EmitByte(OpCode::SUBTRACT_INTEGER, line);
+		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::SUBTRACT_FRACTION, line) : EmitIntegerArithmetic(OpCode::SUBTRACT_INTEGER, line);
 		break;
 	case Token::Name::STAR:
 		MidoriTypeUtil::IsFractionType(expr_type) 
 			? EmitByte(OpCode::MULTIPLY_FRACTION, line) 
 			: MidoriTypeUtil::IsIntegerType(expr_type)
-			? EmitByte(OpCode::MULTIPLY_INTEGER, line)
+			? EmitIntegerArithmetic(OpCode::MULTIPLY_INTEGER, line)
 			: EmitByte(OpCode::DUP_ARRAY, line);
 		break;
 	case Token::Name::SLASH:
 		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::DIVIDE_FRACTION, line) : EmitByte(OpCode::DIVIDE_INTEGER, line);
 		break;
 	case Token::Name::PERCENT:
-		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::MODULO_FRACTION, line) : EmitByte(OpCode::MODULO_INTEGER, line);
+		MidoriTypeUtil::IsFractionType(expr_type) ? EmitByte(OpCode::MODULO_FRACTION, line) : EmitIntegerArithmetic(OpCode::MODULO_INTEGER, line);
 		break;
 	case Token::Name::LEFT_SHIFT:
 		EmitByte(OpCode::LEFT_SHIFT, line);
@@ -806,10 +1571,22 @@ void CodeGenerator::operator()(Call& call)
 			(*this)(arg);
 		}, *call.m_callee);
 
-	if (call.m_is_foreign)
+	if (call.m_is_tail_call)
+	{
+		EmitByte(OpCode::TAIL_CALL, line);
+	}
+	else if (call.m_is_foreign)
 	{
+		if (TryEmitIndexedForeignCall(arity, line))
+		{
+			return;
+		}
 		EmitByte(OpCode::CALL_FOREIGN, line);
 	}
+	else if (TryEmitCallSuperinstruction(arity, line))
+	{
+		return;
+	}
 	else
 	{
 		EmitByte(OpCode::CALL_DEFINED, line);
@@ -905,7 +1682,7 @@ void CodeGenerator::operator()(Bind& bind)
 
 void CodeGenerator::operator()(TextLiteral& text)
 {
-	EmitConstant(MidoriTraceable::AllocateTraceable(text.m_token.m_lexeme.c_str()), text.m_token.m_line);
+	EmitConstantLoad(m_executable.AddTextConstant(MidoriText(text.m_token.m_lexeme.c_str())), text.m_token.m_line);
 }
 
 void CodeGenerator::operator()(BoolLiteral& bool_expr)
@@ -945,14 +1722,31 @@ void CodeGenerator::operator()(Closure& closure)
 	}
 
 	int prev_index = m_current_procedure_index;
+	bool prev_is_in_generator = m_is_in_generator;
 	m_current_procedure_index = static_cast<int>(m_procedures.size());
+	m_is_in_generator = closure.m_is_generator;
 	m_procedures.emplace_back();
+	m_procedure_arities.emplace_back(arity);
+
+	// calling a generator only packages up its arguments, the body runs when the generator is resumed
+	if (m_is_in_generator)
+	{
+		EmitByte(OpCode::CREATE_GENERATOR, line);
+	}
+
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
 		}, *closure.m_body);
 
+	// running off the end of the body finishes the generator
+	if (m_is_in_generator)
+	{
+		EmitByte(OpCode::FINISH_GENERATOR, line);
+	}
+
 	int closure_proc_index = m_current_procedure_index;
+	m_is_in_generator = prev_is_in_generator;
 #ifdef DEBUG
 	std::string closure_line = "Closure at line: " + std::to_string(line) + "(index: " + std::to_string(closure_proc_index) + ")";
 	m_procedure_names.emplace_back(closure_line.c_str());
@@ -966,6 +1760,13 @@ void CodeGenerator::operator()(Closure& closure)
 		return;
 	}
 
+	// without captures every evaluation would produce the same closure: share one that lives in the constant pool
+	if (captured_count == 0)
+	{
+		EmitConstant(MidoriTraceable::AllocateTraceable(MidoriClosure{ MidoriClosure::Environment{}, closure_proc_index }), line);
+		return;
+	}
+
 	EmitByte(OpCode::ALLOCATE_CLOSURE, line);
 	EmitByte(static_cast<OpCode>(closure_proc_index), line);
 
@@ -994,26 +1795,37 @@ void CodeGenerator::operator()(Construct& construct)
 	if (is_struct)
 	{
 		EmitByte(OpCode::CONSTRUCT_STRUCT, line);
+		EmitByte(size, line);
+		return;
 	}
-	else
+
+	int tag = std::get<Construct::Union>(construct.m_construct_ctx).m_index;
+
+	if (tag > MAX_UNION_TAG)
 	{
-		EmitByte(OpCode::CONSTRUCT_UNION, line);
+		AddError(MidoriError::GenerateCodeGeneratorError(std::format("Union tag too large (max {}).", MAX_UNION_TAG + 1), line));
+		return;
 	}
-	EmitByte(size, line);
 
-	if (!is_struct)
+	// a case without payload is immutable: every construction shares one union per tag from the constant pool
+	if (size == static_cast<OpCode>(0))
 	{
-		int tag = std::get<Construct::Union>(construct.m_construct_ctx).m_index;
-
-		if (tag > MAX_UNION_TAG)
+		std::unordered_map<int, int>::const_iterator it = m_nullary_union_constants.find(tag);
+		if (it == m_nullary_union_constants.cend())
 		{
-			AddError(MidoriError::GenerateCodeGeneratorError(std::format("Union tag too large (max {}).", MAX_UNION_TAG + 1), line));
-			return;
+			MidoriTraceable* nullary_union = MidoriTraceable::AllocateTraceable(MidoriUnion{ 0 });
+			nullary_union->GetUnion().m_index = tag;
+			it = m_nullary_union_constants.emplace(tag, m_executable.AddConstant(nullary_union)).first;
 		}
 
-		EmitByte(OpCode::SET_TAG, line);
-		EmitByte(static_cast<OpCode>(tag), line);
+		EmitConstantLoad(it->second, line);
+		return;
 	}
+
+	EmitByte(OpCode::CONSTRUCT_UNION, line);
+	EmitByte(size, line);
+	EmitByte(OpCode::SET_TAG, line);
+	EmitByte(static_cast<OpCode>(tag), line);
 }
 
 void CodeGenerator::operator()(Array& array)
@@ -1040,6 +1852,7 @@ void CodeGenerator::operator()(Array& array)
 	);
 	EmitByte(OpCode::CREATE_ARRAY, line);
 	EmitThreeBytes(length, length >> 8, length >> 16, line);
+	EmitByte(static_cast<OpCode>(GetArrayPacking(MidoriTypeUtil::GetArrayType(array.m_type).m_element_type)), line);
 }
 
 void CodeGenerator::operator()(ArrayGet& array_get)
@@ -1069,6 +1882,12 @@ void CodeGenerator::operator()(ArrayGet& array_get)
 		}
 	);
 
+	if (array_get.m_indices.size() == 1u)
+	{
+		EmitArrayElementAccess(OpCode::GET_ARRAY_ELEMENT, array_get.m_type, line);
+		return;
+	}
+
 	EmitByte(OpCode::GET_ARRAY, line);
 	EmitByte(static_cast<OpCode>(array_get.m_indices.size()), line);
 }
@@ -1105,6 +1924,12 @@ void CodeGenerator::operator()(ArraySet& array_set)
 			(*this)(arg);
 		}, *array_set.m_value);
 
+	if (array_set.m_indices.size() == 1u)
+	{
+		EmitArrayElementAccess(OpCode::SET_ARRAY_ELEMENT, array_set.m_type, line);
+		return;
+	}
+
 	EmitByte(OpCode::SET_ARRAY, line);
 	EmitByte(static_cast<OpCode>(array_set.m_indices.size()), line);
 }
@@ -1112,6 +1937,15 @@ void CodeGenerator::operator()(ArraySet& array_set)
 void CodeGenerator::operator()(Ternary& ternary)
 {
 	int line = ternary.m_colon.m_line;
+
+#ifdef MIDORI_REGISTER_BYTECODE
+	if (std::optional<int> if_jump = TryEmitRegisterConditionalJump(*ternary.m_condition, line); if_jump.has_value())
+	{
+		EmitConditionalBranches<std::unique_ptr<MidoriExpression>&>(if_jump.value(), ternary.m_true_branch, ternary.m_else_branch, line);
+		return;
+	}
+#endif
+
 	std::visit([this](auto&& arg)
 		{
 			(*this)(arg);
@@ -4,6 +4,7 @@
 #include "Common/Result/Result.h"
 
 #include <algorithm>
+#include <array>
 #include <stack>
 
 class CodeGenerator
@@ -25,18 +26,40 @@ private:
 		int m_loop_start = 0;
 	};
 
+	struct RegisterOperand
+	{
+		int m_value = 0;
+		bool m_is_immediate = false;
+	};
+
+	struct LoadInstruction
+	{
+		OpCode m_op = OpCode::HALT;
+		MidoriInteger m_operand = 0;
+		int m_procedure_index = -1;
+		int m_position = -1;
+		int m_size = 0;
+		int m_line = 0;
+	};
+
 	MidoriExecutable::Procedures m_procedures{ BytecodeStream() };
+	std::vector<int> m_procedure_arities{ 0 };
 #ifdef DEBUG
 	std::vector<MidoriText> m_procedure_names{ MidoriText("runtime startup") };
 #endif
 	std::string m_errors;
 	std::stack<LoopContext> m_loop_contexts;
 	std::unordered_map<std::string, int> m_global_variables;
+	std::unordered_map<int, int> m_foreign_global_variables; // global index -> foreign function index
+	std::unordered_map<int, int> m_direct_call_procedures; // fixed non-capturing global function index -> procedure index
+	std::unordered_map<int, int> m_nullary_union_constants; // union tag -> constant index of the shared payload-less union
 
 	MidoriExecutable m_executable;
 	std::optional<MainProcedureContext> m_main_function_ctx = std::nullopt;
 	int m_current_procedure_index = 0;
+	bool m_is_in_generator = false; // returns finish the generator instead of returning a value
 	OpCode m_last_opcode = OpCode::HALT;
+	std::array<LoadInstruction, 2u> m_recent_loads; // superinstruction candidates, oldest first
 
 public:
 
@@ -51,45 +74,13 @@ private:
 		int if_jump;
 		if (operand_type == ConditionOperandType::INTEGER)
 		{
-			PopByte(line);
-			switch (m_last_opcode)
+			std::optional<int> integer_jump = EmitIntegerConditionalJump(line);
+			if (!integer_jump.has_value())
 			{
-			case OpCode::LESS_INTEGER:
-				if_jump = EmitJump(OpCode::IF_INTEGER_LESS, line);
-				break;
-			case OpCode::LESS_EQUAL_INTEGER:
-				if_jump = EmitJump(OpCode::IF_INTEGER_LESS_EQUAL, line);
-				break;
-			case OpCode::GREATER_INTEGER:
-				if_jump = EmitJump(OpCode::IF_INTEGER_GREATER, line);
-				break;
-			case OpCode::GREATER_EQUAL_INTEGER:
-				if_jump = EmitJump(OpCode::IF_INTEGER_GREATER_EQUAL, line);
-				break;
-			case OpCode::EQUAL_INTEGER:
-				if_jump = EmitJump(OpCode::IF_INTEGER_EQUAL, line);
-				break;
-			case OpCode::NOT_EQUAL_INTEGER:
-				if_jump = EmitJump(OpCode::IF_INTEGER_NOT_EQUAL, line);
-				break;
-			default:
 				AddError(MidoriError::GenerateCodeGeneratorError("Invalid opcode for integer ternary condition.", line));
 				return;
 			}
-			std::visit([this](auto&& arg)
-				{
-					(*this)(arg);
-				}, *true_branch);
-			int else_jump = EmitJump(OpCode::JUMP, line);
-			PatchJump(if_jump, line);
-			if (else_branch != nullptr)
-			{
-				std::visit([this](auto&& arg)
-					{
-						(*this)(arg);
-					}, *else_branch);
-			}
-			PatchJump(else_jump, line);
+			EmitConditionalBranches<T>(integer_jump.value(), true_branch, else_branch, line);
 		}
 		else
 		{
@@ -118,21 +109,28 @@ private:
 				AddError(MidoriError::GenerateCodeGeneratorError("Invalid opcode for fraction ternary condition.", line));
 				return;
 			}
+			EmitConditionalBranches<T>(if_jump, true_branch, else_branch, line);
+		}
+	}
+
+	template<typename T>
+	requires std::is_same_v<T, std::unique_ptr<MidoriExpression>&> || std::is_same_v<T, std::unique_ptr<MidoriStatement>&>
+	void EmitConditionalBranches(int if_jump, T true_branch, T else_branch, int line)
+	{
+		std::visit([this](auto&& arg)
+			{
+				(*this)(arg);
+			}, *true_branch);
+		int else_jump = EmitJump(OpCode::JUMP, line);
+		PatchJump(if_jump, line);
+		if (else_branch != nullptr)
+		{
 			std::visit([this](auto&& arg)
 				{
 					(*this)(arg);
-				}, *true_branch);
-			int else_jump = EmitJump(OpCode::JUMP, line);
-			PatchJump(if_jump, line);
-			if (else_branch != nullptr)
-			{
-				std::visit([this](auto&& arg)
-					{
-						(*this)(arg);
-					}, *else_branch);
-			}
-			PatchJump(else_jump, line);
+				}, *else_branch);
 		}
+		PatchJump(else_jump, line);
 	}
 
 	void AddError(std::string&& error);
@@ -149,10 +147,17 @@ private:
 
 	void EmitConstant(MidoriValue&& value, int line);
 
+	void EmitConstantLoad(int index, int line);
+
 	void EmitVariable(int variable_index, OpCode op, int line);
 
 	int EmitJump(OpCode op, int line);
 
+	// the two offset bytes of a jump, to be filled in by PatchJump
+	int EmitJumpOffset(int line);
+
+	std::optional<int> EmitIntegerConditionalJump(int line);
+
 	void PatchJump(int offset, int line);
 
 	void EmitLoop(int loop_start, int line);
@@ -161,6 +166,62 @@ private:
 
 	void EndLoop(int line);
 
+	void EmitIntegerArithmetic(OpCode op, int line);
+
+	// arrays of Int, Frac and Bool keep their elements unboxed
+	static MidoriArray::Packing GetArrayPacking(const MidoriType* element_type);
+
+	// accesses the element through the opcode specialized for the packing of the array if there is one
+	void EmitArrayElementAccess(OpCode generic_op, const MidoriType* element_type, int line);
+
+	// the register-addressed form of an integer arithmetic opcode or conditional jump, swaps the operands so that
+	// an immediate ends up on the right
+	static std::optional<OpCode> SelectRegisterForm(OpCode op, std::optional<RegisterOperand>& left, std::optional<RegisterOperand>& right);
+
+	// the three-operand form that stores into a register, arranges the operands like SelectRegisterForm
+	static std::optional<OpCode> SelectRegisterStoreForm(OpCode op, std::optional<RegisterOperand>& left, std::optional<RegisterOperand>& right);
+
+	void EmitRegisterInstruction(OpCode op, const RegisterOperand& left, const RegisterOperand& right, int line);
+
+	void EmitRegisterOperand(const RegisterOperand& operand, int line);
+
+	void RecordLoad(OpCode op, MidoriInteger operand, int position, int line);
+
+	void ForgetLoads();
+
+	bool HasFusableLoads(int count) const;
+
+	void DiscardLoads(int count);
+
+	std::optional<RegisterOperand> GetRegisterOperand(const LoadInstruction& load) const;
+
+	bool TryEmitArithmeticSuperinstruction(OpCode op, int line);
+
+	std::optional<int> TryEmitConditionalJumpSuperinstruction(OpCode op, int line);
+
+	bool TryEmitCallSuperinstruction(int arity, int line);
+
+	// returned calls reuse the frame of the returning procedure (TAIL_CALL), so the RETURN after them is never reached
+	void MarkTailCalls(MidoriExpression& expr);
+
+	// calls a global foreign function through its table index instead of loading it first
+	bool TryEmitIndexedForeignCall(int arity, int line);
+
+#ifdef MIDORI_REGISTER_BYTECODE
+	// the _RR/_RI forms chosen here from the syntax tree are what the superinstructions fuse to anyway,
+	// only TryEmitRegisterStore emits opcodes that a build without MIDORI_REGISTER_BYTECODE never does
+	std::optional<RegisterOperand> GetRegisterOperand(const MidoriExpression& expr) const;
+
+	// the stack opcode of integer arithmetic that has register forms
+	static std::optional<OpCode> GetIntegerArithmeticOp(const Binary& binary);
+
+	bool TryEmitRegisterBinary(Binary& binary);
+
+	bool TryEmitRegisterStore(Bind& bind);
+
+	std::optional<int> TryEmitRegisterConditionalJump(MidoriExpression& condition, int line);
+#endif
+
 	void operator()(Block& block);
 
 	void operator()(Simple& simple);
@@ -173,12 +234,16 @@ private:
 
 	void operator()(For& for_stmt);
 
+	void operator()(ForEach& for_each);
+
 	void operator()(Break& break_stmt);
 
 	void operator()(Continue& continue_stmt);
 
 	void operator()(Return& return_stmt);
 
+	void operator()(Yield& yield_stmt);
+
 	void operator()(Foreign& foreign);
 
 	void operator()(Struct& struct_stmt);
@@ -14,6 +14,9 @@ namespace Compiler
 {
 	MidoriResult::CompilerResult Compile(std::string&& script, std::string&& file_name)
 	{
+		// types only live as long as the compilation, so concurrent compilations never share them
+		MidoriTypeUtil::TypeTable type_table;
+
 		Lexer lexer(std::move(script));
 		MidoriResult::LexerResult lexer_result = lexer.Lex();
 		if (!lexer_result.has_value())
@@ -61,7 +64,7 @@ namespace Compiler
 						Disassembler::DisassembleBytecodeStream(executable, static_cast<int>(i), variable_name.GetCString());
 					}
 #endif
-					return compilation_result.value();
+					return std::move(compilation_result.value());
 				}
 			}
 		}
@@ -9,6 +9,7 @@ const std::unordered_map<std::string, Token::Name> Lexer::s_keywords =
 	{"Bool"s, Token::Name::BOOL},
 	{"Unit"s, Token::Name::UNIT},
 	{"Array"s, Token::Name::ARRAY},
+	{"Generator"s, Token::Name::GENERATOR},
 
 	// reserved keywords
 	{"else"s, Token::Name::ELSE},
@@ -34,6 +35,8 @@ const std::unordered_map<std::string, Token::Name> Lexer::s_keywords =
 	{"default"s, Token::Name::DEFAULT},
 	{"switch"s, Token::Name::SWITCH},
 	{"namespace"s, Token::Name::NAMESPACE},
+	{"yield"s, Token::Name::YIELD},
+	{"in"s, Token::Name::IN},
 };
 
 const std::unordered_set<std::string> Lexer::s_directives =
@@ -27,7 +27,7 @@ namespace
 Parser::Parser(TokenStream&& tokens, const std::string& file_name) : m_tokens(std::move(tokens))
 {
 	std::string absolute_file_path = std::filesystem::absolute(file_name).string();
-	s_dependency_graph[absolute_file_path] = {};
+	m_dependency_graph[absolute_file_path] = {};
 	m_file_name = std::move(absolute_file_path);
 }
 
@@ -346,6 +346,7 @@ MidoriResult::ExpressionResult Parser::ParseBind()
 				// cell
 				else
 				{
+					m_cell_reference_count += 1;
 					return std::make_unique<MidoriExpression>(Bind{ std::move(variable_expr.m_name), std::move(value.value()), VariableSemantic::Cell(find_result->second.m_absolute_index.value()) });
 				}
 			}
@@ -643,6 +644,7 @@ MidoriResult::ExpressionResult Parser::ParsePrimary()
 			// cell
 			else
 			{
+				m_cell_reference_count += 1;
 				return std::make_unique<MidoriExpression>(Variable{ std::move(variable), VariableSemantic::Cell(find_result->second.m_absolute_index.value()) });
 			}
 		}
@@ -660,7 +662,10 @@ MidoriResult::ExpressionResult Parser::ParsePrimary()
 		std::vector<const MidoriType*> param_types;
 
 		int prev_total_locals = m_total_locals_in_curr_scope;
+		int prev_cell_reference_count = m_cell_reference_count;
+		int prev_yield_count = m_yield_count;
 		m_total_locals_in_curr_scope = 0;
+		m_yield_count = 0;
 		m_closure_depth += 1;
 
 		std::vector<std::unique_ptr<MidoriStatement>> statements;
@@ -730,15 +735,22 @@ MidoriResult::ExpressionResult Parser::ParsePrimary()
 		int block_local_count = EndScope();
 
 		std::unique_ptr<MidoriStatement> closure_body = std::make_unique<MidoriStatement>(Block{ std::move(right_brace), std::move(statements), block_local_count });
-		if (!HasReturnStatement(*closure_body))
+
+		// a generator finishes when its body runs off the end
+		bool is_generator = m_yield_count != 0;
+		if (!is_generator && !HasReturnStatement(*closure_body))
 		{
 			return std::unexpected<std::string>(GenerateParserError("function does not return in all paths.", keyword));
 		}
 
 		m_closure_depth -= 1;
 		m_total_locals_in_curr_scope = prev_total_locals;
+		m_yield_count = prev_yield_count;
+
+		// neither the closure nor any closure nested in it refers to a captured variable: its environment can stay empty
+		int captured_count = m_cell_reference_count == prev_cell_reference_count ? 0 : m_total_variables;
 
-		return std::make_unique<MidoriExpression>(Closure{ std::move(keyword), std::move(params), std::move(param_types), std::move(closure_body), std::move(return_type.value()), m_total_variables });
+		return std::make_unique<MidoriExpression>(Closure{ std::move(keyword), std::move(params), std::move(param_types), std::move(closure_body), std::move(return_type.value()), captured_count, is_generator });
 	}
 	else if (Match(Token::Name::TRUE, Token::Name::FALSE))
 	{
@@ -884,7 +896,7 @@ MidoriResult::StatementResult Parser::ParseDefineStatement()
 	MidoriResult::TokenResult semi_colon = Consume(Token::Name::SINGLE_SEMICOLON, "Expected ';' after variable declaration.");
 	VERIFY_RESULT(semi_colon);
 
-	return std::make_unique<MidoriStatement>(Define{ std::move(name), std::move(expr.value()), std::move(type_annotation), std::move(local_index) });
+	return std::make_unique<MidoriStatement>(Define{ std::move(name), std::move(expr.value()), std::move(type_annotation), std::move(local_index), is_fixed });
 }
 
 MidoriResult::StatementResult Parser::ParseStructDeclaration()
@@ -1087,6 +1099,11 @@ MidoriResult::StatementResult Parser::ParseWhileStatement()
 MidoriResult::StatementResult Parser::ParseForStatement()
 {
 	Token& keyword = Previous();
+	if (Check(Token::Name::LEFT_PAREN, 0) && (Check(Token::Name::VAR, 1) || Check(Token::Name::FIXED, 1)) && Check(Token::Name::IDENTIFIER_LITERAL, 2) && Check(Token::Name::IN, 3))
+	{
+		return ParseForEachStatement(keyword);
+	}
+
 	m_local_count_before_loop.emplace(m_total_variables);
 
 	BeginScope();
@@ -1139,6 +1156,43 @@ MidoriResult::StatementResult Parser::ParseForStatement()
 	return std::make_unique<MidoriStatement>(For{ std::move(keyword), std::move(condition), std::move(increment), std::move(initializer), std::move(body.value()), control_block_local_count });
 }
 
+MidoriResult::StatementResult Parser::ParseForEachStatement(Token& keyword)
+{
+	m_local_count_before_loop.emplace(m_total_variables);
+
+	BeginScope();
+
+	VERIFY_RESULT(Consume(Token::Name::LEFT_PAREN, "Expected '(' after \"for\"."));
+
+	bool is_fixed = Advance().m_token_name == Token::Name::FIXED;
+	MidoriResult::TokenResult var_name = Consume(Token::Name::IDENTIFIER_LITERAL, "Expected variable name.");
+	VERIFY_RESULT(var_name);
+
+	VERIFY_RESULT(Consume(Token::Name::IN, "Expected \"in\" after variable name."));
+
+	// the generator lives in a local slot that no name can refer to
+	constexpr bool is_generator_fixed = true;
+	RegisterOrUpdateLocalVariable("$generator"s, is_generator_fixed);
+
+	MidoriResult::ExpressionResult generator = ParseExpression();
+	VERIFY_RESULT(generator);
+
+	constexpr bool is_variable = true;
+	MidoriResult::TokenResult define_name_result = DefineName(var_name.value(), is_fixed, is_variable);
+	VERIFY_RESULT(define_name_result);
+	RegisterOrUpdateLocalVariable(define_name_result.value().m_lexeme, is_fixed);
+
+	VERIFY_RESULT(Consume(Token::Name::RIGHT_PAREN, "Expected ')' after \"for\" clauses."));
+
+	MidoriResult::StatementResult body = ParseStatement();
+	VERIFY_RESULT(body);
+
+	EndScope();
+	m_local_count_before_loop.pop();
+
+	return std::make_unique<MidoriStatement>(ForEach{ std::move(keyword), std::move(define_name_result.value()), std::move(generator.value()), std::move(body.value()) });
+}
+
 MidoriResult::StatementResult Parser::ParseBreakStatement()
 {
 	Token& keyword = Previous();
@@ -1194,6 +1248,23 @@ MidoriResult::StatementResult Parser::ParseReturnStatement()
 	return std::make_unique<MidoriStatement>(Return{ std::move(keyword), std::move(expr.value()) });
 }
 
+MidoriResult::StatementResult Parser::ParseYieldStatement()
+{
+	Token& keyword = Previous();
+	if (m_closure_depth == 0)
+	{
+		return std::unexpected<std::string>(GenerateParserError("'yield' must be used inside a closure.", keyword));
+	}
+
+	MidoriResult::ExpressionResult expr = ParseExpression();
+	VERIFY_RESULT(expr);
+
+	VERIFY_RESULT(Consume(Token::Name::SINGLE_SEMICOLON, "Expected ';' after yield value."));
+
+	m_yield_count += 1;
+	return std::make_unique<MidoriStatement>(Yield{ std::move(keyword), std::move(expr.value()) });
+}
+
 MidoriResult::StatementResult Parser::ParseForeignStatement()
 {
 	MidoriResult::TokenResult foreign_name = Consume(Token::Name::TEXT_LITERAL, "Expected name used in library.");
@@ -1404,6 +1475,10 @@ MidoriResult::StatementResult Parser::ParseStatement()
 	{
 		return ParseReturnStatement();
 	}
+	else if (Match(Token::Name::YIELD))
+	{
+		return ParseYieldStatement();
+	}
 	else if (Match(Token::Name::SWITCH))
 	{
 		return ParseSwitchStatement();
@@ -1447,6 +1522,17 @@ MidoriResult::TypeResult Parser::ParseType(bool is_foreign)
 
 		return MidoriTypeUtil::InsertArrayType(type.value());
 	}
+	else if (Match(Token::Name::GENERATOR))
+	{
+		VERIFY_RESULT(Consume(Token::Name::LEFT_BRACKET, "Expected '[' after 'Generator'."));
+
+		MidoriResult::TypeResult type = ParseType();
+		VERIFY_RESULT(type);
+
+		VERIFY_RESULT(Consume(Token::Name::RIGHT_BRACKET, "Expected ']' after generator type."));
+
+		return MidoriTypeUtil::InsertGeneratorType(type.value());
+	}
 	else if (Match(Token::Name::LEFT_PAREN))
 	{
 		std::vector<const MidoriType*> types;
@@ -1507,7 +1593,13 @@ bool Parser::HasCircularDependency() const
 		in_progress.erase(current);
 		visited.emplace(current);
 
-		for (const std::string& dependency : s_dependency_graph[current])
+		DependencyGraph::const_iterator dependencies = m_dependency_graph.find(current);
+		if (dependencies == m_dependency_graph.cend())
+		{
+			continue; // Not parsed yet, so nothing included from it
+		}
+
+		for (const std::string& dependency : dependencies->second)
 		{
 			if (visited.contains(dependency))
 			{
@@ -1534,12 +1626,12 @@ MidoriResult::TokenResult Parser::HandleDirective()
 		Token& include_path = Previous();
 		std::string include_absolute_path_str = std::filesystem::absolute(include_path.m_lexeme).string();
 
-		if (s_dependency_graph.contains(include_absolute_path_str))
+		if (m_dependency_graph.contains(include_absolute_path_str))
 		{
 			return directive;
 		}
 
-		s_dependency_graph[m_file_name].emplace_back(include_absolute_path_str);
+		m_dependency_graph[m_file_name].emplace_back(include_absolute_path_str);
 
 		std::ifstream include_file(include_absolute_path_str);
 		if (!include_file.is_open())
@@ -1619,6 +1711,10 @@ bool Parser::HasReturnStatement(const MidoriStatement& stmt)
 			{
 				return HasReturnStatement(*arg.m_body);
 			}
+			else if constexpr (std::is_same_v<T, ForEach>)
+			{
+				return HasReturnStatement(*arg.m_body);
+			}
 			else
 			{
 				return false;
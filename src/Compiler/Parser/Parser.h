@@ -44,9 +44,9 @@ private:
 	using DependencyGraph = std::unordered_map<std::string, std::vector<std::string>>;
 	using Scopes = std::vector<Scope>;
 	
-	inline static DependencyGraph s_dependency_graph{};
 	TokenStream m_tokens;
 	std::string m_file_name;
+	DependencyGraph m_dependency_graph;
 	Scopes m_scopes;
 	std::stack<int> m_local_count_before_loop;
 	std::vector<std::string> m_namespaces;
@@ -54,6 +54,8 @@ private:
 	int m_current_token_index = 0;
 	int m_total_locals_in_curr_scope = 0;
 	int m_total_variables = 0;
+	int m_cell_reference_count = 0; // a closure whose body adds none never reads its environment
+	int m_yield_count = 0; // a closure whose body yields is a generator
 
 public:
 	Parser(TokenStream&& tokens, const std::string& file_name);
@@ -207,6 +209,8 @@ private:
 
 	MidoriResult::StatementResult ParseForStatement();
 
+	MidoriResult::StatementResult ParseForEachStatement(Token& keyword);
+
 	MidoriResult::StatementResult ParseBreakStatement();
 
 	MidoriResult::StatementResult ParseContinueStatement();
@@ -215,6 +219,8 @@ private:
 
 	MidoriResult::StatementResult ParseReturnStatement();
 
+	MidoriResult::StatementResult ParseYieldStatement();
+
 	MidoriResult::StatementResult ParseForeignStatement();
 
 	MidoriResult::StatementResult ParseSwitchStatement();
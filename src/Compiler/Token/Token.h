@@ -79,6 +79,8 @@ struct Token
 		DEFAULT,
 		SWITCH,
 		NAMESPACE,
+		YIELD,
+		IN,
 
 		// types
 		FRACTION,
@@ -87,6 +89,7 @@ struct Token
 		BOOL,
 		UNIT,
 		ARRAY,
+		GENERATOR,
 
 		// directive
 		DIRECTIVE,
@@ -170,7 +170,7 @@ void TypeChecker::operator()(Define& def)
 	}
 	else if (std::holds_alternative<Array>(*def.m_value))
 	{
-		const Array& array = std::get<Array>(*def.m_value);
+		Array& array = std::get<Array>(*def.m_value);
 		if (array.m_elems.empty())
 		{
 			if (!def.m_annotated_type.has_value() || !MidoriTypeUtil::IsArrayType(def.m_annotated_type.value()))
@@ -181,6 +181,7 @@ void TypeChecker::operator()(Define& def)
 				return;
 			}
 
+			array.m_type = def.m_annotated_type.value();
 			m_name_type_table.back().emplace(def.m_name.m_lexeme, def.m_annotated_type.value());
 		}
 		else
@@ -289,6 +290,8 @@ void TypeChecker::operator()(While& while_stmt)
 			AddError(MidoriError::GenerateTypeCheckerError("While statement condition must be of type bool.", while_stmt.m_while_keyword, actual_type, MidoriTypeUtil::GetType("Bool"s)));
 			return;
 		}
+
+		UpdateConditionOperandType(while_stmt.m_condition_operand_type, while_stmt.m_condition);
 	}
 	else
 	{
@@ -326,6 +329,8 @@ void TypeChecker::operator()(For& for_stmt)
 				AddError(MidoriError::GenerateTypeCheckerError("For statement condition must be of type bool.", for_stmt.m_for_keyword, actual_type, MidoriTypeUtil::GetType("Bool"s)));
 				return;
 			}
+
+			UpdateConditionOperandType(for_stmt.m_condition_operand_type, for_stmt.m_condition.value());
 		}
 		else
 		{
@@ -348,6 +353,35 @@ void TypeChecker::operator()(For& for_stmt)
 	EndScope();
 }
 
+void TypeChecker::operator()(ForEach& for_each)
+{
+	MidoriResult::TypeResult generator_type = std::visit([this](auto&& arg)
+		{
+			return (*this)(arg);
+		}, *for_each.m_generator);
+	if (!generator_type.has_value())
+	{
+		AddError(std::move(generator_type.error()));
+		return;
+	}
+
+	const MidoriType* actual_type = generator_type.value();
+	if (!MidoriTypeUtil::IsGeneratorType(actual_type))
+	{
+		AddError(MidoriError::GenerateTypeCheckerError("For statement must iterate over a generator.", for_each.m_for_keyword, actual_type));
+		return;
+	}
+
+	BeginScope();
+	m_name_type_table.back()[for_each.m_name.m_lexeme] = MidoriTypeUtil::GetGeneratorType(actual_type).m_element_type;
+
+	std::visit([this](auto&& arg)
+		{
+			(*this)(arg);
+		}, *for_each.m_body);
+	EndScope();
+}
+
 void TypeChecker::operator()(Break&)
 {
 	return;
@@ -380,6 +414,28 @@ void TypeChecker::operator()(Return& return_stmt)
 	}
 }
 
+void TypeChecker::operator()(Yield& yield_stmt)
+{
+	MidoriResult::TypeResult yield_type = std::visit([this](auto&& arg)
+		{
+			return (*this)(arg);
+		}, *yield_stmt.m_value);
+
+	if (!yield_type.has_value())
+	{
+		AddError(std::move(yield_type.error()));
+		return;
+	}
+
+	const MidoriType* actual_type = yield_type.value();
+	const MidoriType* expected_type = m_curr_closure_yield_type;
+	if (*actual_type != *expected_type)
+	{
+		AddError(MidoriError::GenerateTypeCheckerError("Yield statement expression type error.", yield_stmt.m_keyword, actual_type, expected_type));
+		return;
+	}
+}
+
 void TypeChecker::operator()(Foreign& foreign)
 {
 	m_name_type_table.back()[foreign.m_function_name.m_lexeme] = foreign.m_type;
@@ -941,7 +997,22 @@ MidoriResult::TypeResult TypeChecker::operator()(UnitLiteral&)
 MidoriResult::TypeResult TypeChecker::operator()(Closure& closure)
 {
 	const MidoriType* prev_return_type = m_curr_closure_return_type;
+	const MidoriType* prev_yield_type = m_curr_closure_yield_type;
 	m_curr_closure_return_type = closure.m_return_type;
+	m_curr_closure_yield_type = nullptr;
+
+	// a generator yields its elements and may only return unit to finish early
+	if (closure.m_is_generator)
+	{
+		if (!MidoriTypeUtil::IsGeneratorType(closure.m_return_type))
+		{
+			m_curr_closure_return_type = prev_return_type;
+			return std::unexpected<std::string>(MidoriError::GenerateTypeCheckerError("A function that yields must return a generator.", closure.m_closure_keyword, closure.m_return_type));
+		}
+
+		m_curr_closure_return_type = MidoriTypeUtil::GetType("Unit"s);
+		m_curr_closure_yield_type = MidoriTypeUtil::GetGeneratorType(closure.m_return_type).m_element_type;
+	}
 
 	BeginScope();
 	for (size_t i : std::views::iota(0u, closure.m_param_types.size()))
@@ -957,6 +1028,7 @@ MidoriResult::TypeResult TypeChecker::operator()(Closure& closure)
 	EndScope();
 
 	m_curr_closure_return_type = prev_return_type;
+	m_curr_closure_yield_type = prev_yield_type;
 	return MidoriTypeUtil::InsertFunctionType(closure.m_param_types, closure.m_return_type);
 }
 
@@ -1051,7 +1123,8 @@ MidoriResult::TypeResult TypeChecker::operator()(Array& array)
 		}
 	}
 
-	return MidoriTypeUtil::InsertArrayType(element_results[0u]);
+	array.m_type = MidoriTypeUtil::InsertArrayType(element_results[0u]);
+	return array.m_type;
 }
 
 MidoriResult::TypeResult TypeChecker::operator()(ArrayGet& array_get)
@@ -1099,6 +1172,7 @@ MidoriResult::TypeResult TypeChecker::operator()(ArrayGet& array_get)
 		array_var_type = MidoriTypeUtil::GetArrayType(array_var_type).m_element_type;
 	}
 
+	array_get.m_type = array_var_type;
 	return array_var_type;
 }
 
@@ -1162,6 +1236,7 @@ MidoriResult::TypeResult TypeChecker::operator()(ArraySet& array_set)
 		return std::unexpected<std::string>(MidoriError::GenerateTypeCheckerError("Array set expression type error", array_set.m_op, value_type, &*array_var_type));
 	}
 
+	array_set.m_type = array_var_type;
 	return value_result.value();
 }
 
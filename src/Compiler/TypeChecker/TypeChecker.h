@@ -23,6 +23,7 @@ private:
 	const std::array<Token::Name, 5> m_binary_bitwise_operators{ Token::Name::CARET, Token::Name::SINGLE_AMPERSAND, Token::Name::SINGLE_BAR, Token::Name::RIGHT_SHIFT, Token::Name::LEFT_SHIFT };
 	TypeEnvironmentStack m_name_type_table;
 	const MidoriType* m_curr_closure_return_type = nullptr;
+	const MidoriType* m_curr_closure_yield_type = nullptr; // nullptr unless the current closure is a generator
 
 public:
 
@@ -50,12 +51,16 @@ private:
 
 	void operator()(For& for_stmt);
 
+	void operator()(ForEach& for_each);
+
 	void operator()(Break& break_stmt);
 
 	void operator()(Continue& continue_stmt);
 
 	void operator()(Return& return_stmt);
 
+	void operator()(Yield& yield_stmt);
+
 	void operator()(Foreign& foreign);
 
 	void operator()(Struct& struct_stmt);
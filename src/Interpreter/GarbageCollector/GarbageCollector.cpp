@@ -2,46 +2,47 @@
 
 #include <algorithm>
 #include <ranges>
-#include <execution>
 
 #ifdef DEBUG
 #include <format>
 #include "Common\Printer\Printer.h"
 #endif
 
-void GarbageCollector::Mark(MidoriTraceable::GarbageCollectionRoots&& roots)
+void GarbageCollector::Mark()
 {
 #ifdef DEBUG
-	std::ranges::for_each
-	(
-		MidoriTraceable::s_traceables,
-		[](MidoriTraceable* ptr)
-		{
-			Printer::Print<Printer::Color::CYAN>(std::format("Tracked traceable pointer: {:p}, value: {}\n", static_cast<void*>(ptr), ptr->ToText().GetCString()));
-		}
-	);
+	for (MidoriTraceable* ptr = m_heap.m_traceables; ptr != nullptr; ptr = ptr->m_next_traceable)
+	{
+		Printer::Print<Printer::Color::CYAN>(std::format("Tracked traceable pointer: {:p}, value: {}\n", static_cast<void*>(ptr), ptr->ToText().GetCString()));
+	}
 #endif
-	roots.insert(m_constant_roots.begin(), m_constant_roots.end());
 	std::ranges::for_each
 	(
-		roots,
-		[](MidoriTraceable* ptr)
+		m_constant_roots,
+		[this](MidoriTraceable* ptr)
 		{
-			ptr->Trace();
+			MarkRoot(ptr);
 		}
 	);
+
+	while (!m_mark_worklist.empty())
+	{
+		MidoriTraceable* traceable_ptr = m_mark_worklist.back();
+		m_mark_worklist.pop_back();
+		traceable_ptr->Trace(m_mark_worklist);
+	}
 }
 
 void GarbageCollector::Sweep()
 {
-	std::list<MidoriTraceable*>::iterator it = MidoriTraceable::s_traceables.begin();
-	while (it != MidoriTraceable::s_traceables.end())
+	MidoriTraceable** link = &m_heap.m_traceables;
+	while (*link != nullptr)
 	{
-		MidoriTraceable* traceable_ptr = *it;
+		MidoriTraceable* traceable_ptr = *link;
 		if (traceable_ptr->Marked())
 		{
 			traceable_ptr->Unmark();
-			++it;
+			link = &traceable_ptr->m_next_traceable;
 		}
 		else
 		{
@@ -49,16 +50,28 @@ void GarbageCollector::Sweep()
 			Printer::Print<Printer::Color::RED>(std::format("Deleting traceable pointer: {:p}\n", static_cast<void*>(traceable_ptr)));
 #endif
 
-			it = MidoriTraceable::s_traceables.erase(it);
+			*link = traceable_ptr->m_next_traceable;
+			m_heap.m_traceable_count -= 1u;
+			m_heap.m_total_bytes_allocated -= traceable_ptr->GetSize();
+#ifdef MIDORI_TEXT_INTERNING
+			if (traceable_ptr->IsText() && traceable_ptr->GetText().GetLength() <= MidoriHeap::s_max_interned_text_length)
+			{
+				std::unordered_map<MidoriText, MidoriTraceable*>::const_iterator interned = m_heap.m_interned_texts.find(traceable_ptr->GetText());
+				if (interned != m_heap.m_interned_texts.cend() && interned->second == traceable_ptr)
+				{
+					m_heap.m_interned_texts.erase(interned);
+				}
+			}
+#endif
 			delete traceable_ptr;
 		}
 	}
 	return;
 }
 
-void GarbageCollector::ReclaimMemory(MidoriTraceable::GarbageCollectionRoots&& roots)
+void GarbageCollector::ReclaimMemory()
 {
-	Mark(std::move(roots));
+	Mark();
 	Sweep();
 }
 
@@ -67,29 +80,8 @@ void GarbageCollector::CleanUp()
 #ifdef DEBUG
 	Printer::Print<Printer::Color::BLUE>("\nBefore the final clean-up:\n");
 	PrintMemoryTelemetry();
-	std::ranges::for_each
-	(
-		MidoriTraceable::s_traceables,
-		[](MidoriTraceable* traceable_ptr)
-		{
-			Printer::Print<Printer::Color::MAGENTA>(std::format("Deleting traceable pointer: {:p}\n", static_cast<void*>(traceable_ptr)));
-			delete traceable_ptr;
-		}
-	);
-#else
-	std::for_each
-	(
-		std::execution::par_unseq,
-		MidoriTraceable::s_traceables.begin(),
-		MidoriTraceable::s_traceables.end(),
-		[](MidoriTraceable* traceable_ptr)
-		{
-			delete traceable_ptr;
-		}
-	);
 #endif
-	MidoriTraceable::s_traceables.clear();
-	MidoriTraceable::s_static_bytes_allocated = 0u;
+	m_heap.FreeAll();
 #ifdef DEBUG
 	Printer::Print<Printer::Color::BLUE>("\nAfter the final clean-up:\n");
 	PrintMemoryTelemetry();
@@ -110,10 +102,10 @@ void GarbageCollector::PrintMemoryTelemetry()
 				"\tStatic Bytes allocated: {}\n"
 				"\tDynamic Bytes allocated: {}\n"
 				"\t------------------------------\n\n",
-				MidoriTraceable::s_traceables.size(),
-				MidoriTraceable::s_total_bytes_allocated,
-				MidoriTraceable::s_static_bytes_allocated,
-				MidoriTraceable::s_total_bytes_allocated - MidoriTraceable::s_static_bytes_allocated
+				m_heap.m_traceable_count,
+				m_heap.m_total_bytes_allocated,
+				m_heap.m_static_bytes_allocated,
+				m_heap.m_total_bytes_allocated - m_heap.m_static_bytes_allocated
 			)
 		);
 #endif
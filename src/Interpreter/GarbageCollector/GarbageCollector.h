@@ -5,19 +5,44 @@
 class GarbageCollector
 {
 private:
+	MidoriHeap& m_heap;
 	const MidoriTraceable::GarbageCollectionRoots& m_constant_roots;
+	MidoriTraceable::MarkWorklist m_mark_worklist; // reused across collections, marking itself does not allocate
 
 public:
-	explicit GarbageCollector(const MidoriTraceable::GarbageCollectionRoots& roots) : m_constant_roots(roots) {}
-
-	void ReclaimMemory(MidoriTraceable::GarbageCollectionRoots&& roots);
+	GarbageCollector(MidoriHeap& heap, const MidoriTraceable::GarbageCollectionRoots& roots) : m_heap(heap), m_constant_roots(roots) {}
+
+	size_t GetDynamicBytesAllocated() const
+	{
+		return m_heap.m_total_bytes_allocated - m_heap.m_static_bytes_allocated;
+	}
+
+	void MarkRoot(MidoriTraceable* root)
+	{
+		if (!root->Marked())
+		{
+			root->Mark();
+			m_mark_worklist.emplace_back(root);
+		}
+	}
+
+	void MarkRoot(const MidoriValue& value)
+	{
+		if (MidoriTraceable* traceable = value.GetTraceable())
+		{
+			MarkRoot(traceable);
+		}
+	}
+
+	// frees every traceable that is not reachable from the constants or the roots marked since the last collection
+	void ReclaimMemory();
 
 	void CleanUp();
 
 	void PrintMemoryTelemetry();
 
 private:
-	void Mark(MidoriTraceable::GarbageCollectionRoots&& roots);
+	void Mark();
 
 	void Sweep();
 };
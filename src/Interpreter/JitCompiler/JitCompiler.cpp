@@ -0,0 +1,990 @@
+#ifdef MIDORI_JIT
+#include "JitCompiler.h"
+#include "X64Assembler.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <optional>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+	// The perf map of the process, shared by every JIT in it. Opened on the first entry written and closed when
+	// the process exits, so virtual machines on other threads never truncate each other's entries.
+	class PerfMap
+	{
+	public:
+		static void Write(const std::string& entry) noexcept
+		{
+			static PerfMap perf_map;
+
+			std::lock_guard<std::mutex> lock(perf_map.m_mutex);
+			if (perf_map.m_file == nullptr)
+			{
+				return;
+			}
+			std::fputs(entry.c_str(), perf_map.m_file);
+			std::fflush(perf_map.m_file);
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::FILE* m_file;
+
+		PerfMap() noexcept : m_file(std::fopen(std::format("/tmp/perf-{}.map", static_cast<long>(getpid())).c_str(), "a"))
+		{}
+
+		~PerfMap()
+		{
+			if (m_file != nullptr)
+			{
+				std::fclose(m_file);
+			}
+		}
+	};
+
+	// pinned in callee-saved registers for the whole native procedure
+	constexpr X64Register VM_REGISTER = X64Register::RBX;
+	constexpr X64Register BASE_POINTER_REGISTER = X64Register::R12;
+	constexpr X64Register STACK_POINTER_REGISTER = X64Register::R13;
+
+	struct Instruction
+	{
+		int m_offset;
+		int m_size;
+		OpCode m_op;
+	};
+
+	template<typename T>
+	T ReadOperand(const OpCode* bytecode, int offset)
+	{
+		T value;
+		std::memcpy(&value, bytecode + offset, sizeof(T));
+		return value;
+	}
+
+	// 0 for instructions the baseline JIT leaves to the interpreter
+	int GetInstructionSize(OpCode op)
+	{
+		switch (op)
+		{
+		case OpCode::OP_UNIT:
+		case OpCode::OP_TRUE:
+		case OpCode::OP_FALSE:
+		case OpCode::LEFT_SHIFT:
+		case OpCode::RIGHT_SHIFT:
+		case OpCode::BITWISE_AND:
+		case OpCode::BITWISE_OR:
+		case OpCode::BITWISE_XOR:
+		case OpCode::BITWISE_NOT:
+		case OpCode::ADD_FRACTION:
+		case OpCode::SUBTRACT_FRACTION:
+		case OpCode::MULTIPLY_FRACTION:
+		case OpCode::DIVIDE_FRACTION:
+		case OpCode::ADD_INTEGER:
+		case OpCode::SUBTRACT_INTEGER:
+		case OpCode::MULTIPLY_INTEGER:
+		case OpCode::DIVIDE_INTEGER:
+		case OpCode::MODULO_INTEGER:
+		case OpCode::EQUAL_FRACTION:
+		case OpCode::NOT_EQUAL_FRACTION:
+		case OpCode::GREATER_FRACTION:
+		case OpCode::GREATER_EQUAL_FRACTION:
+		case OpCode::LESS_FRACTION:
+		case OpCode::LESS_EQUAL_FRACTION:
+		case OpCode::EQUAL_INTEGER:
+		case OpCode::NOT_EQUAL_INTEGER:
+		case OpCode::GREATER_INTEGER:
+		case OpCode::GREATER_EQUAL_INTEGER:
+		case OpCode::LESS_INTEGER:
+		case OpCode::LESS_EQUAL_INTEGER:
+		case OpCode::NOT:
+		case OpCode::NEGATE_FRACTION:
+		case OpCode::NEGATE_INTEGER:
+		case OpCode::POP:
+		case OpCode::DUP:
+		case OpCode::RETURN:
+			return 1;
+		case OpCode::LOAD_CONSTANT:
+		case OpCode::CALL_DEFINED:
+		case OpCode::GET_GLOBAL:
+		case OpCode::SET_GLOBAL:
+		case OpCode::GET_LOCAL:
+		case OpCode::SET_LOCAL:
+		case OpCode::GET_CELL:
+		case OpCode::SET_CELL:
+		case OpCode::POP_SCOPE:
+		case OpCode::POP_MULTIPLE:
+			return 2;
+		case OpCode::LOAD_CONSTANT_LONG:
+		case OpCode::JUMP_IF_FALSE:
+		case OpCode::JUMP_IF_TRUE:
+		case OpCode::JUMP:
+		case OpCode::JUMP_BACK:
+		case OpCode::IF_INTEGER_LESS:
+		case OpCode::IF_INTEGER_LESS_EQUAL:
+		case OpCode::IF_INTEGER_GREATER:
+		case OpCode::IF_INTEGER_GREATER_EQUAL:
+		case OpCode::IF_INTEGER_EQUAL:
+		case OpCode::IF_INTEGER_NOT_EQUAL:
+		case OpCode::IF_FRACTION_LESS:
+		case OpCode::IF_FRACTION_LESS_EQUAL:
+		case OpCode::IF_FRACTION_GREATER:
+		case OpCode::IF_FRACTION_GREATER_EQUAL:
+		case OpCode::IF_FRACTION_EQUAL:
+		case OpCode::IF_FRACTION_NOT_EQUAL:
+		case OpCode::CALL_GLOBAL:
+		case OpCode::CALL_LOCAL:
+		case OpCode::CALL_CELL:
+		case OpCode::CALL_DIRECT:
+		case OpCode::ADD_INTEGER_RR:
+		case OpCode::SUBTRACT_INTEGER_RR:
+		case OpCode::MULTIPLY_INTEGER_RR:
+		case OpCode::MODULO_INTEGER_RR:
+			return 3;
+		case OpCode::LOAD_CONSTANT_LONG_LONG:
+		case OpCode::ADD_INTEGER_RRR:
+		case OpCode::SUBTRACT_INTEGER_RRR:
+			return 4;
+		case OpCode::IF_INTEGER_LESS_RR:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+		case OpCode::IF_INTEGER_GREATER_RR:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+		case OpCode::IF_INTEGER_EQUAL_RR:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RR:
+			return 5;
+		case OpCode::ADD_INTEGER_RI:
+		case OpCode::SUBTRACT_INTEGER_RI:
+		case OpCode::MULTIPLY_INTEGER_RI:
+		case OpCode::MODULO_INTEGER_RI:
+			return 6;
+		case OpCode::ADD_INTEGER_RRI:
+		case OpCode::SUBTRACT_INTEGER_RRI:
+			return 7;
+		case OpCode::IF_INTEGER_LESS_RI:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+		case OpCode::IF_INTEGER_GREATER_RI:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+		case OpCode::IF_INTEGER_EQUAL_RI:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RI:
+			return 8;
+		case OpCode::INTEGER_CONSTANT:
+		case OpCode::FRACTION_CONSTANT:
+			return 9;
+		default:
+			return 0;
+		}
+	}
+
+	int GetStackEffect(const OpCode* bytecode, const Instruction& instruction)
+	{
+		auto read_byte = [bytecode, &instruction](int index) -> int
+			{
+				return static_cast<int>(bytecode[instruction.m_offset + index]);
+			};
+
+		switch (instruction.m_op)
+		{
+		case OpCode::LOAD_CONSTANT:
+		case OpCode::LOAD_CONSTANT_LONG:
+		case OpCode::LOAD_CONSTANT_LONG_LONG:
+		case OpCode::INTEGER_CONSTANT:
+		case OpCode::FRACTION_CONSTANT:
+		case OpCode::OP_UNIT:
+		case OpCode::OP_TRUE:
+		case OpCode::OP_FALSE:
+		case OpCode::GET_GLOBAL:
+		case OpCode::GET_LOCAL:
+		case OpCode::GET_CELL:
+		case OpCode::DUP:
+		case OpCode::ADD_INTEGER_RR:
+		case OpCode::ADD_INTEGER_RI:
+		case OpCode::SUBTRACT_INTEGER_RR:
+		case OpCode::SUBTRACT_INTEGER_RI:
+		case OpCode::MULTIPLY_INTEGER_RR:
+		case OpCode::MULTIPLY_INTEGER_RI:
+		case OpCode::MODULO_INTEGER_RR:
+		case OpCode::MODULO_INTEGER_RI:
+			return 1;
+		case OpCode::BITWISE_NOT:
+		case OpCode::NOT:
+		case OpCode::NEGATE_FRACTION:
+		case OpCode::NEGATE_INTEGER:
+		case OpCode::SET_GLOBAL:
+		case OpCode::SET_LOCAL:
+		case OpCode::SET_CELL:
+		case OpCode::JUMP_IF_FALSE:
+		case OpCode::JUMP_IF_TRUE:
+		case OpCode::JUMP:
+		case OpCode::JUMP_BACK:
+		case OpCode::ADD_INTEGER_RRR:
+		case OpCode::ADD_INTEGER_RRI:
+		case OpCode::SUBTRACT_INTEGER_RRR:
+		case OpCode::SUBTRACT_INTEGER_RRI:
+		case OpCode::IF_INTEGER_LESS_RR:
+		case OpCode::IF_INTEGER_LESS_RI:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+		case OpCode::IF_INTEGER_GREATER_RR:
+		case OpCode::IF_INTEGER_GREATER_RI:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+		case OpCode::IF_INTEGER_EQUAL_RR:
+		case OpCode::IF_INTEGER_EQUAL_RI:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RR:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RI:
+		case OpCode::RETURN:
+			return 0;
+		case OpCode::IF_INTEGER_LESS:
+		case OpCode::IF_INTEGER_LESS_EQUAL:
+		case OpCode::IF_INTEGER_GREATER:
+		case OpCode::IF_INTEGER_GREATER_EQUAL:
+		case OpCode::IF_INTEGER_EQUAL:
+		case OpCode::IF_INTEGER_NOT_EQUAL:
+		case OpCode::IF_FRACTION_LESS:
+		case OpCode::IF_FRACTION_LESS_EQUAL:
+		case OpCode::IF_FRACTION_GREATER:
+		case OpCode::IF_FRACTION_GREATER_EQUAL:
+		case OpCode::IF_FRACTION_EQUAL:
+		case OpCode::IF_FRACTION_NOT_EQUAL:
+			return -2;
+		case OpCode::POP_SCOPE:
+		case OpCode::POP_MULTIPLE:
+			return -read_byte(1);
+		case OpCode::CALL_DEFINED:
+			return -read_byte(1); // callee and arguments are replaced by the result
+		case OpCode::CALL_GLOBAL:
+		case OpCode::CALL_LOCAL:
+		case OpCode::CALL_CELL:
+		case OpCode::CALL_DIRECT:
+			return 1 - read_byte(2);
+		default:
+			return -1; // binary operators
+		}
+	}
+
+	std::optional<int> GetJumpTarget(const OpCode* bytecode, const Instruction& instruction)
+	{
+		// the 16-bit jump offset is always the last operand and is relative to the next instruction
+		int next = instruction.m_offset + instruction.m_size;
+		auto read_offset = [bytecode, next]() { return static_cast<int>(ReadOperand<uint16_t>(bytecode, next - 2)); };
+
+		switch (instruction.m_op)
+		{
+		case OpCode::JUMP_BACK:
+			return next - read_offset();
+		case OpCode::JUMP_IF_FALSE:
+		case OpCode::JUMP_IF_TRUE:
+		case OpCode::JUMP:
+		case OpCode::IF_INTEGER_LESS:
+		case OpCode::IF_INTEGER_LESS_EQUAL:
+		case OpCode::IF_INTEGER_GREATER:
+		case OpCode::IF_INTEGER_GREATER_EQUAL:
+		case OpCode::IF_INTEGER_EQUAL:
+		case OpCode::IF_INTEGER_NOT_EQUAL:
+		case OpCode::IF_FRACTION_LESS:
+		case OpCode::IF_FRACTION_LESS_EQUAL:
+		case OpCode::IF_FRACTION_GREATER:
+		case OpCode::IF_FRACTION_GREATER_EQUAL:
+		case OpCode::IF_FRACTION_EQUAL:
+		case OpCode::IF_FRACTION_NOT_EQUAL:
+		case OpCode::IF_INTEGER_LESS_RR:
+		case OpCode::IF_INTEGER_LESS_RI:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+		case OpCode::IF_INTEGER_GREATER_RR:
+		case OpCode::IF_INTEGER_GREATER_RI:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+		case OpCode::IF_INTEGER_EQUAL_RR:
+		case OpCode::IF_INTEGER_EQUAL_RI:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RR:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RI:
+			return next + read_offset();
+		default:
+			return std::nullopt;
+		}
+	}
+
+	bool IsUnconditionalTransfer(OpCode op)
+	{
+		return op == OpCode::JUMP || op == OpCode::JUMP_BACK || op == OpCode::RETURN;
+	}
+
+	NumericComparison GetComparison(OpCode op)
+	{
+		switch (op)
+		{
+		case OpCode::LESS_FRACTION:
+		case OpCode::LESS_INTEGER:
+		case OpCode::IF_INTEGER_LESS:
+		case OpCode::IF_FRACTION_LESS:
+		case OpCode::IF_INTEGER_LESS_RR:
+		case OpCode::IF_INTEGER_LESS_RI:
+			return NumericComparison::LESS;
+		case OpCode::LESS_EQUAL_FRACTION:
+		case OpCode::LESS_EQUAL_INTEGER:
+		case OpCode::IF_INTEGER_LESS_EQUAL:
+		case OpCode::IF_FRACTION_LESS_EQUAL:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+			return NumericComparison::LESS_EQUAL;
+		case OpCode::GREATER_FRACTION:
+		case OpCode::GREATER_INTEGER:
+		case OpCode::IF_INTEGER_GREATER:
+		case OpCode::IF_FRACTION_GREATER:
+		case OpCode::IF_INTEGER_GREATER_RR:
+		case OpCode::IF_INTEGER_GREATER_RI:
+			return NumericComparison::GREATER;
+		case OpCode::GREATER_EQUAL_FRACTION:
+		case OpCode::GREATER_EQUAL_INTEGER:
+		case OpCode::IF_INTEGER_GREATER_EQUAL:
+		case OpCode::IF_FRACTION_GREATER_EQUAL:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+			return NumericComparison::GREATER_EQUAL;
+		case OpCode::EQUAL_FRACTION:
+		case OpCode::EQUAL_INTEGER:
+		case OpCode::IF_INTEGER_EQUAL:
+		case OpCode::IF_FRACTION_EQUAL:
+		case OpCode::IF_INTEGER_EQUAL_RR:
+		case OpCode::IF_INTEGER_EQUAL_RI:
+			return NumericComparison::EQUAL;
+		default:
+			return NumericComparison::NOT_EQUAL;
+		}
+	}
+}
+
+JitCompiler::JitCompiler(const MidoriExecutable& executable, const std::vector<MidoriValue>& global_vars, RuntimeHelpers helpers) noexcept
+	: m_executable(executable), m_global_vars(global_vars), m_helpers(helpers), m_profiles(static_cast<size_t>(executable.GetProcedureCount()))
+{}
+
+JitCompiler::~JitCompiler()
+{
+	for (const CodeRegion& region : m_code_regions)
+	{
+		munmap(region.m_address, region.m_size);
+	}
+}
+
+std::unique_ptr<JitCompiler::NativeProcedure> JitCompiler::Compile(int proc_index) noexcept
+{
+	constexpr uint8_t fraction_tag = MidoriValue::MidoriValueTypeTag::Fraction;
+	constexpr uint8_t integer_tag = MidoriValue::MidoriValueTypeTag::Integer;
+	constexpr uint8_t unit_tag = MidoriValue::MidoriValueTypeTag::Unit;
+	constexpr uint8_t bool_tag = MidoriValue::MidoriValueTypeTag::Bool;
+	constexpr int unvisited = INT_MIN;
+
+	const BytecodeStream& stream = m_executable.GetBytecodeStream(proc_index);
+	const OpCode* bytecode = stream[0];
+	int bytecode_size = stream.GetByteCodeSize();
+
+	// decode, bailing out on anything the interpreter has to handle
+	std::vector<Instruction> instructions;
+	std::vector<int> instruction_at(static_cast<size_t>(bytecode_size), -1);
+	for (int offset = 0; offset < bytecode_size;)
+	{
+		OpCode op = bytecode[offset];
+		int size = GetInstructionSize(op);
+		if (size == 0 || offset + size > bytecode_size)
+		{
+			return nullptr;
+		}
+
+		instruction_at[static_cast<size_t>(offset)] = static_cast<int>(instructions.size());
+		instructions.emplace_back(Instruction{ offset, size, op });
+		offset += size;
+	}
+
+	// stack depth at every reachable instruction, relative to the stack pointer on entry
+	std::vector<int> depths(static_cast<size_t>(bytecode_size), unvisited);
+	std::vector<int> worklist{ 0 };
+	int max_stack_depth = 0;
+	depths[0u] = 0;
+
+	while (!worklist.empty())
+	{
+		int offset = worklist.back();
+		worklist.pop_back();
+
+		const Instruction& instruction = instructions[static_cast<size_t>(instruction_at[static_cast<size_t>(offset)])];
+		int depth_after = depths[static_cast<size_t>(offset)] + GetStackEffect(bytecode, instruction);
+		max_stack_depth = std::max({ max_stack_depth, depths[static_cast<size_t>(offset)], depth_after });
+
+		std::vector<int> successors;
+		if (!IsUnconditionalTransfer(instruction.m_op))
+		{
+			successors.emplace_back(instruction.m_offset + instruction.m_size);
+		}
+		if (std::optional<int> target = GetJumpTarget(bytecode, instruction))
+		{
+			successors.emplace_back(*target);
+		}
+
+		for (int successor : successors)
+		{
+			if (successor < 0 || successor >= bytecode_size || instruction_at[static_cast<size_t>(successor)] == -1)
+			{
+				return nullptr;
+			}
+
+			int& successor_depth = depths[static_cast<size_t>(successor)];
+			if (successor_depth == unvisited)
+			{
+				successor_depth = depth_after;
+				worklist.emplace_back(successor);
+			}
+			else if (successor_depth != depth_after)
+			{
+				return nullptr;
+			}
+		}
+	}
+
+	constexpr X64Register vm = VM_REGISTER;
+	constexpr X64Register bp = BASE_POINTER_REGISTER;
+	constexpr X64Register sp = STACK_POINTER_REGISTER;
+	constexpr X64Register rax = X64Register::RAX;
+	constexpr X64Register rcx = X64Register::RCX;
+
+	X64Assembler assembler;
+	std::vector<X64Assembler::Label> labels(instructions.size());
+	std::ranges::generate(labels, [&assembler]() { return assembler.CreateLabel(); });
+
+	auto label_at = [&labels, &instruction_at](int offset)
+		{
+			return labels[static_cast<size_t>(instruction_at[static_cast<size_t>(offset)])];
+		};
+	auto slot = [](int depth) { return -s_value_size * depth; };
+	auto local = [](int index) { return s_value_size * index; };
+	auto grow_stack = [&assembler](int count) { assembler.ArithmeticRegImm32(X64ArithmeticOp::ADD, sp, s_value_size * count); };
+	auto shrink_stack = [&assembler](int count) { assembler.ArithmeticRegImm32(X64ArithmeticOp::SUB, sp, s_value_size * count); };
+	auto push_value = [&assembler, &grow_stack](X64Register base, int displacement)
+		{
+			assembler.LoadXmm0Unaligned(base, displacement);
+			assembler.StoreXmm0Unaligned(sp, 0);
+			grow_stack(1);
+		};
+	auto push_rax = [&assembler, &grow_stack](uint8_t tag)
+		{
+			assembler.MovMemReg(sp, 0, rax);
+			assembler.MovByteMemImm8(sp, s_type_tag_offset, tag);
+			grow_stack(1);
+		};
+	auto store_rax = [&assembler](X64Register base, int displacement, uint8_t tag)
+		{
+			assembler.MovMemReg(base, displacement, rax);
+			assembler.MovByteMemImm8(base, displacement + s_type_tag_offset, tag);
+		};
+	auto global_address = [this](int index)
+		{
+			return reinterpret_cast<uint64_t>(&m_global_vars[static_cast<size_t>(index)]);
+		};
+	auto call_cell_helper = [this, &assembler](int index)
+		{
+			assembler.MovRegReg(X64Register::RDI, vm);
+			assembler.MovRegImm64(X64Register::RSI, static_cast<uint64_t>(index));
+			assembler.CallAbsolute(reinterpret_cast<const void*>(m_helpers.m_get_cell));
+		};
+
+	// entry: save the pinned registers (keeping rsp 16-byte aligned) and jump to the requested instruction
+	assembler.Push(vm);
+	assembler.Push(bp);
+	assembler.Push(sp);
+	assembler.MovRegReg(vm, X64Register::RDI);
+	assembler.MovRegReg(bp, X64Register::RSI);
+	assembler.MovRegReg(sp, X64Register::RDX);
+	assembler.JumpReg(X64Register::RCX);
+
+	X64Assembler::Label exit_label = assembler.CreateLabel();
+	assembler.BindLabel(exit_label);
+	assembler.Pop(sp);
+	assembler.Pop(bp);
+	assembler.Pop(vm);
+	assembler.Ret();
+
+	for (size_t i = 0u; i < instructions.size(); i += 1u)
+	{
+		const Instruction& instruction = instructions[i];
+		int operand = instruction.m_offset + 1;
+		auto read_byte = [bytecode](int index) { return static_cast<int>(bytecode[index]); };
+		auto read_immediate = [bytecode](int index) { return ReadOperand<int32_t>(bytecode, index); };
+
+		assembler.BindLabel(labels[i]);
+
+		// dead code, e.g. the jump over an else branch after a return, may even jump past the end
+		if (depths[static_cast<size_t>(instruction.m_offset)] == unvisited)
+		{
+			continue;
+		}
+
+		switch (instruction.m_op)
+		{
+		case OpCode::LOAD_CONSTANT:
+		case OpCode::LOAD_CONSTANT_LONG:
+		case OpCode::LOAD_CONSTANT_LONG_LONG:
+		{
+			int index = 0;
+			for (int byte = 0; byte < instruction.m_size - 1; byte += 1)
+			{
+				index |= read_byte(operand + byte) << (8 * byte);
+			}
+			assembler.MovRegImm64(rax, reinterpret_cast<uint64_t>(&m_executable.GetConstant(index)));
+			push_value(rax, 0);
+			break;
+		}
+		case OpCode::INTEGER_CONSTANT:
+		{
+			assembler.MovRegImm64(rax, ReadOperand<uint64_t>(bytecode, operand));
+			push_rax(integer_tag);
+			break;
+		}
+		case OpCode::FRACTION_CONSTANT:
+		{
+			assembler.MovRegImm64(rax, ReadOperand<uint64_t>(bytecode, operand));
+			push_rax(fraction_tag);
+			break;
+		}
+		case OpCode::OP_UNIT:
+		{
+			assembler.MovMemImm32(sp, 0, 0);
+			assembler.MovByteMemImm8(sp, s_type_tag_offset, unit_tag);
+			grow_stack(1);
+			break;
+		}
+		case OpCode::OP_TRUE:
+		case OpCode::OP_FALSE:
+		{
+			assembler.MovMemImm32(sp, 0, instruction.m_op == OpCode::OP_TRUE ? 1 : 0);
+			assembler.MovByteMemImm8(sp, s_type_tag_offset, bool_tag);
+			grow_stack(1);
+			break;
+		}
+		case OpCode::LEFT_SHIFT:
+		case OpCode::RIGHT_SHIFT:
+		{
+			assembler.MovRegMem(rcx, sp, slot(1));
+			assembler.MovRegMem(rax, sp, slot(2));
+			if (instruction.m_op == OpCode::LEFT_SHIFT)
+			{
+				assembler.ShiftLeftRegCl(rax);
+			}
+			else
+			{
+				assembler.ShiftRightArithmeticRegCl(rax);
+			}
+			assembler.MovMemReg(sp, slot(2), rax);
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::BITWISE_AND:
+		case OpCode::BITWISE_OR:
+		case OpCode::BITWISE_XOR:
+		case OpCode::ADD_INTEGER:
+		case OpCode::SUBTRACT_INTEGER:
+		{
+			X64ArithmeticOp op = instruction.m_op == OpCode::BITWISE_AND ? X64ArithmeticOp::AND
+				: instruction.m_op == OpCode::BITWISE_OR ? X64ArithmeticOp::OR
+				: instruction.m_op == OpCode::BITWISE_XOR ? X64ArithmeticOp::XOR
+				: instruction.m_op == OpCode::ADD_INTEGER ? X64ArithmeticOp::ADD
+				: X64ArithmeticOp::SUB;
+			assembler.MovRegMem(rax, sp, slot(2));
+			assembler.ArithmeticRegMem(op, rax, sp, slot(1));
+			assembler.MovMemReg(sp, slot(2), rax);
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::MULTIPLY_INTEGER:
+		{
+			assembler.MovRegMem(rax, sp, slot(2));
+			assembler.ImulRegMem(rax, sp, slot(1));
+			assembler.MovMemReg(sp, slot(2), rax);
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::DIVIDE_INTEGER:
+		case OpCode::MODULO_INTEGER:
+		{
+			assembler.MovRegMem(rax, sp, slot(2));
+			assembler.Cqo();
+			assembler.IdivMem(sp, slot(1));
+			assembler.MovMemReg(sp, slot(2), instruction.m_op == OpCode::DIVIDE_INTEGER ? rax : X64Register::RDX);
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::BITWISE_NOT:
+		{
+			assembler.NotMem(sp, slot(1));
+			break;
+		}
+		case OpCode::NEGATE_INTEGER:
+		{
+			assembler.NegMem(sp, slot(1));
+			break;
+		}
+		case OpCode::NEGATE_FRACTION:
+		{
+			assembler.MovRegImm64(rax, 0x8000000000000000ull);
+			assembler.XorMemReg(sp, slot(1), rax);
+			break;
+		}
+		case OpCode::NOT:
+		{
+			assembler.ArithmeticByteMemImm8(X64ArithmeticOp::XOR, sp, slot(1), 1u);
+			break;
+		}
+		case OpCode::ADD_FRACTION:
+		case OpCode::SUBTRACT_FRACTION:
+		case OpCode::MULTIPLY_FRACTION:
+		case OpCode::DIVIDE_FRACTION:
+		{
+			X64ScalarDoubleOp op = instruction.m_op == OpCode::ADD_FRACTION ? X64ScalarDoubleOp::ADD
+				: instruction.m_op == OpCode::SUBTRACT_FRACTION ? X64ScalarDoubleOp::SUBTRACT
+				: instruction.m_op == OpCode::MULTIPLY_FRACTION ? X64ScalarDoubleOp::MULTIPLY
+				: X64ScalarDoubleOp::DIVIDE;
+			assembler.LoadScalarDouble(0, sp, slot(2));
+			assembler.ScalarDoubleMem(op, 0, sp, slot(1));
+			assembler.StoreScalarDouble(0, sp, slot(2));
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::EQUAL_INTEGER:
+		case OpCode::NOT_EQUAL_INTEGER:
+		case OpCode::GREATER_INTEGER:
+		case OpCode::GREATER_EQUAL_INTEGER:
+		case OpCode::LESS_INTEGER:
+		case OpCode::LESS_EQUAL_INTEGER:
+		{
+			assembler.MovRegMem(rax, sp, slot(2));
+			assembler.ArithmeticRegMem(X64ArithmeticOp::CMP, rax, sp, slot(1));
+			assembler.SetConditionByte(X64Assembler::GetIntegerCondition(GetComparison(instruction.m_op)), rax);
+			assembler.MovzxRegByteReg(rax, rax);
+			store_rax(sp, slot(2), bool_tag);
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::EQUAL_FRACTION:
+		case OpCode::NOT_EQUAL_FRACTION:
+		case OpCode::GREATER_FRACTION:
+		case OpCode::GREATER_EQUAL_FRACTION:
+		case OpCode::LESS_FRACTION:
+		case OpCode::LESS_EQUAL_FRACTION:
+		{
+			assembler.LoadScalarDouble(0, sp, slot(2));
+			assembler.LoadScalarDouble(1, sp, slot(1));
+			assembler.SetFractionComparison(GetComparison(instruction.m_op));
+			assembler.MovzxRegByteReg(rax, rax);
+			store_rax(sp, slot(2), bool_tag);
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::JUMP_IF_FALSE:
+		case OpCode::JUMP_IF_TRUE:
+		{
+			assembler.ArithmeticByteMemImm8(X64ArithmeticOp::CMP, sp, slot(1), 0u);
+			assembler.JumpIf(instruction.m_op == OpCode::JUMP_IF_FALSE ? X64Condition::EQUAL : X64Condition::NOT_EQUAL, label_at(*GetJumpTarget(bytecode, instruction)));
+			break;
+		}
+		case OpCode::JUMP:
+		case OpCode::JUMP_BACK:
+		{
+			assembler.Jump(label_at(*GetJumpTarget(bytecode, instruction)));
+			break;
+		}
+		case OpCode::IF_INTEGER_LESS:
+		case OpCode::IF_INTEGER_LESS_EQUAL:
+		case OpCode::IF_INTEGER_GREATER:
+		case OpCode::IF_INTEGER_GREATER_EQUAL:
+		case OpCode::IF_INTEGER_EQUAL:
+		case OpCode::IF_INTEGER_NOT_EQUAL:
+		{
+			assembler.MovRegMem(rax, sp, slot(2));
+			shrink_stack(2);
+			assembler.ArithmeticRegMem(X64ArithmeticOp::CMP, rax, sp, local(1));
+			assembler.JumpIf(X64Assembler::NegateCondition(X64Assembler::GetIntegerCondition(GetComparison(instruction.m_op))), label_at(*GetJumpTarget(bytecode, instruction)));
+			break;
+		}
+		case OpCode::IF_FRACTION_LESS:
+		case OpCode::IF_FRACTION_LESS_EQUAL:
+		case OpCode::IF_FRACTION_GREATER:
+		case OpCode::IF_FRACTION_GREATER_EQUAL:
+		case OpCode::IF_FRACTION_EQUAL:
+		case OpCode::IF_FRACTION_NOT_EQUAL:
+		{
+			assembler.LoadScalarDouble(0, sp, slot(2));
+			assembler.LoadScalarDouble(1, sp, slot(1));
+			shrink_stack(2);
+			assembler.SetFractionComparison(GetComparison(instruction.m_op));
+			assembler.TestByteRegReg(rax, rax);
+			assembler.JumpIf(X64Condition::EQUAL, label_at(*GetJumpTarget(bytecode, instruction)));
+			break;
+		}
+		case OpCode::CALL_DEFINED:
+		case OpCode::CALL_GLOBAL:
+		case OpCode::CALL_LOCAL:
+		case OpCode::CALL_CELL:
+		{
+			// rcx := the callee closure
+			switch (instruction.m_op)
+			{
+			case OpCode::CALL_DEFINED:
+				assembler.MovRegMem(rcx, sp, slot(1));
+				shrink_stack(1);
+				break;
+			case OpCode::CALL_GLOBAL:
+				assembler.MovRegImm64(rax, global_address(read_byte(operand)));
+				assembler.MovRegMem(rcx, rax, 0);
+				break;
+			case OpCode::CALL_LOCAL:
+				assembler.MovRegMem(rcx, bp, local(read_byte(operand)));
+				break;
+			default:
+				call_cell_helper(read_byte(operand));
+				assembler.MovRegMem(rcx, rax, 0);
+				break;
+			}
+
+			int arity = read_byte(instruction.m_offset + instruction.m_size - 1);
+			assembler.MovRegReg(X64Register::RDI, vm);
+			assembler.MovRegReg(X64Register::RSI, sp);
+			assembler.MovRegImm64(X64Register::RDX, reinterpret_cast<uint64_t>(bytecode + instruction.m_offset + instruction.m_size));
+			assembler.MovRegImm64(X64Register::R8, static_cast<uint64_t>(arity));
+			assembler.CallAbsolute(reinterpret_cast<const void*>(m_helpers.m_call));
+			assembler.MovRegReg(sp, rax);
+			break;
+		}
+		case OpCode::CALL_DIRECT:
+		{
+			assembler.MovRegReg(X64Register::RDI, vm);
+			assembler.MovRegReg(X64Register::RSI, sp);
+			assembler.MovRegImm64(X64Register::RDX, reinterpret_cast<uint64_t>(bytecode + instruction.m_offset + instruction.m_size));
+			assembler.MovRegImm64(X64Register::RCX, static_cast<uint64_t>(read_byte(operand)));
+			assembler.MovRegImm64(X64Register::R8, static_cast<uint64_t>(read_byte(operand + 1)));
+			assembler.CallAbsolute(reinterpret_cast<const void*>(m_helpers.m_call_direct));
+			assembler.MovRegReg(sp, rax);
+			break;
+		}
+		case OpCode::GET_GLOBAL:
+		{
+			assembler.MovRegImm64(rax, global_address(read_byte(operand)));
+			push_value(rax, 0);
+			break;
+		}
+		case OpCode::SET_GLOBAL:
+		{
+			assembler.MovRegImm64(rax, global_address(read_byte(operand)));
+			assembler.LoadXmm0Unaligned(sp, slot(1));
+			assembler.StoreXmm0Unaligned(rax, 0);
+			break;
+		}
+		case OpCode::GET_LOCAL:
+		{
+			push_value(bp, local(read_byte(operand)));
+			break;
+		}
+		case OpCode::SET_LOCAL:
+		{
+			assembler.LoadXmm0Unaligned(sp, slot(1));
+			assembler.StoreXmm0Unaligned(bp, local(read_byte(operand)));
+			break;
+		}
+		case OpCode::GET_CELL:
+		{
+			call_cell_helper(read_byte(operand));
+			push_value(rax, 0);
+			break;
+		}
+		case OpCode::SET_CELL:
+		{
+			call_cell_helper(read_byte(operand));
+			assembler.LoadXmm0Unaligned(sp, slot(1));
+			assembler.StoreXmm0Unaligned(rax, 0);
+			break;
+		}
+		case OpCode::ADD_INTEGER_RR:
+		case OpCode::SUBTRACT_INTEGER_RR:
+		case OpCode::ADD_INTEGER_RI:
+		case OpCode::SUBTRACT_INTEGER_RI:
+		{
+			bool is_add = instruction.m_op == OpCode::ADD_INTEGER_RR || instruction.m_op == OpCode::ADD_INTEGER_RI;
+			X64ArithmeticOp op = is_add ? X64ArithmeticOp::ADD : X64ArithmeticOp::SUB;
+			assembler.MovRegMem(rax, bp, local(read_byte(operand)));
+			if (instruction.m_op == OpCode::ADD_INTEGER_RR || instruction.m_op == OpCode::SUBTRACT_INTEGER_RR)
+			{
+				assembler.ArithmeticRegMem(op, rax, bp, local(read_byte(operand + 1)));
+			}
+			else
+			{
+				assembler.ArithmeticRegImm32(op, rax, read_immediate(operand + 1));
+			}
+			push_rax(integer_tag);
+			break;
+		}
+		case OpCode::MULTIPLY_INTEGER_RR:
+		{
+			assembler.MovRegMem(rax, bp, local(read_byte(operand)));
+			assembler.ImulRegMem(rax, bp, local(read_byte(operand + 1)));
+			push_rax(integer_tag);
+			break;
+		}
+		case OpCode::MULTIPLY_INTEGER_RI:
+		{
+			assembler.MovRegMem(rax, bp, local(read_byte(operand)));
+			assembler.ImulRegRegImm32(rax, rax, read_immediate(operand + 1));
+			push_rax(integer_tag);
+			break;
+		}
+		case OpCode::MODULO_INTEGER_RR:
+		case OpCode::MODULO_INTEGER_RI:
+		{
+			assembler.MovRegMem(rax, bp, local(read_byte(operand)));
+			assembler.Cqo();
+			if (instruction.m_op == OpCode::MODULO_INTEGER_RR)
+			{
+				assembler.IdivMem(bp, local(read_byte(operand + 1)));
+			}
+			else
+			{
+				assembler.MovRegImm64(rcx, static_cast<uint64_t>(static_cast<int64_t>(read_immediate(operand + 1))));
+				assembler.IdivReg(rcx);
+			}
+			assembler.MovRegReg(rax, X64Register::RDX);
+			push_rax(integer_tag);
+			break;
+		}
+		case OpCode::ADD_INTEGER_RRR:
+		case OpCode::SUBTRACT_INTEGER_RRR:
+		case OpCode::ADD_INTEGER_RRI:
+		case OpCode::SUBTRACT_INTEGER_RRI:
+		{
+			bool is_add = instruction.m_op == OpCode::ADD_INTEGER_RRR || instruction.m_op == OpCode::ADD_INTEGER_RRI;
+			X64ArithmeticOp op = is_add ? X64ArithmeticOp::ADD : X64ArithmeticOp::SUB;
+			assembler.MovRegMem(rax, bp, local(read_byte(operand + 1)));
+			if (instruction.m_op == OpCode::ADD_INTEGER_RRR || instruction.m_op == OpCode::SUBTRACT_INTEGER_RRR)
+			{
+				assembler.ArithmeticRegMem(op, rax, bp, local(read_byte(operand + 2)));
+			}
+			else
+			{
+				assembler.ArithmeticRegImm32(op, rax, read_immediate(operand + 2));
+			}
+			store_rax(bp, local(read_byte(operand)), integer_tag);
+			break;
+		}
+		case OpCode::IF_INTEGER_LESS_RR:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+		case OpCode::IF_INTEGER_GREATER_RR:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+		case OpCode::IF_INTEGER_EQUAL_RR:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RR:
+		case OpCode::IF_INTEGER_LESS_RI:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+		case OpCode::IF_INTEGER_GREATER_RI:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+		case OpCode::IF_INTEGER_EQUAL_RI:
+		case OpCode::IF_INTEGER_NOT_EQUAL_RI:
+		{
+			assembler.MovRegMem(rax, bp, local(read_byte(operand)));
+			if (instruction.m_size == GetInstructionSize(OpCode::IF_INTEGER_LESS_RR))
+			{
+				assembler.ArithmeticRegMem(X64ArithmeticOp::CMP, rax, bp, local(read_byte(operand + 1)));
+			}
+			else
+			{
+				assembler.ArithmeticRegImm32(X64ArithmeticOp::CMP, rax, read_immediate(operand + 1));
+			}
+			assembler.JumpIf(X64Assembler::NegateCondition(X64Assembler::GetIntegerCondition(GetComparison(instruction.m_op))), label_at(*GetJumpTarget(bytecode, instruction)));
+			break;
+		}
+		case OpCode::POP:
+		{
+			shrink_stack(1);
+			break;
+		}
+		case OpCode::DUP:
+		{
+			push_value(sp, slot(1));
+			break;
+		}
+		case OpCode::POP_SCOPE:
+		{
+			shrink_stack(read_byte(operand));
+			assembler.MovRegReg(X64Register::RDI, vm);
+			assembler.MovRegReg(X64Register::RSI, sp);
+			assembler.CallAbsolute(reinterpret_cast<const void*>(m_helpers.m_promote_cells));
+			break;
+		}
+		case OpCode::POP_MULTIPLE:
+		{
+			shrink_stack(read_byte(operand));
+			break;
+		}
+		case OpCode::RETURN:
+		{
+			assembler.MovRegReg(X64Register::RDI, vm);
+			assembler.MovRegReg(X64Register::RSI, sp);
+			assembler.CallAbsolute(reinterpret_cast<const void*>(m_helpers.m_return));
+			assembler.Jump(exit_label);
+			break;
+		}
+		default:
+		{
+			return nullptr; // unreachable: rejected while decoding
+		}
+		}
+	}
+
+	std::vector<uint8_t> code = assembler.Finalize();
+	uint8_t* code_address = static_cast<uint8_t*>(InstallCode(code));
+	if (code_address == nullptr)
+	{
+		return nullptr;
+	}
+	WritePerfMapEntry(code_address, code.size(), proc_index);
+
+	std::unique_ptr<NativeProcedure> native_procedure = std::make_unique<NativeProcedure>();
+	native_procedure->m_entry = reinterpret_cast<NativeEntry>(code_address);
+	native_procedure->m_max_stack_depth = max_stack_depth;
+	native_procedure->m_instruction_addresses.resize(static_cast<size_t>(bytecode_size), nullptr);
+	for (size_t i = 0u; i < instructions.size(); i += 1u)
+	{
+		native_procedure->m_instruction_addresses[static_cast<size_t>(instructions[i].m_offset)] = code_address + assembler.GetLabelPosition(labels[i]);
+	}
+
+	return native_procedure;
+}
+
+void* JitCompiler::InstallCode(const std::vector<uint8_t>& code) noexcept
+{
+	size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t region_size = (code.size() + page_size - 1u) / page_size * page_size;
+
+	void* address = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (address == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	std::memcpy(address, code.data(), code.size());
+	if (mprotect(address, region_size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(address, region_size);
+		return nullptr;
+	}
+
+	m_code_regions.emplace_back(CodeRegion{ address, region_size });
+	return address;
+}
+
+void JitCompiler::WritePerfMapEntry(const void* address, size_t size, int proc_index) noexcept
+{
+	PerfMap::Write(std::format("{:x} {:x} midori::procedure_{} (line {})\n", reinterpret_cast<uintptr_t>(address), size, proc_index, m_executable.GetLine(0, proc_index)));
+}
+#endif
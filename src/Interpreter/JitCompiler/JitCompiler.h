@@ -0,0 +1,110 @@
+#ifdef MIDORI_JIT
+#pragma once
+
+#include "Common/Executable/Executable.h"
+#include "Common/Value/Value.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#ifndef MIDORI_JIT_THRESHOLD
+#define MIDORI_JIT_THRESHOLD 1000
+#endif
+
+class VirtualMachine;
+
+// Baseline JIT: translates a hot procedure instruction by instruction into x86-64 code.
+// The native code works directly on the VM value stack and call frames, so the interpreter
+// can pick up (or hand over) at every call boundary and at every loop header.
+class JitCompiler
+{
+public:
+	// runs native code starting at the given address until the procedure returns
+	using NativeEntry = void(*)(VirtualMachine* virtual_machine, MidoriValue* base_pointer, MidoriValue* stack_pointer, const void* start_address);
+
+	// VM services the native code calls back into
+	struct RuntimeHelpers
+	{
+		// runs the callee to completion and returns the new stack pointer
+		MidoriValue* (*m_call)(VirtualMachine* virtual_machine, MidoriValue* stack_pointer, const OpCode* return_address, MidoriTraceable* closure, int arity) noexcept;
+
+		// same as m_call for a procedure that captures nothing
+		MidoriValue* (*m_call_direct)(VirtualMachine* virtual_machine, MidoriValue* stack_pointer, const OpCode* return_address, int proc_index, int arity) noexcept;
+
+		// unwinds the current call frame exactly like RETURN
+		void (*m_return)(VirtualMachine* virtual_machine, MidoriValue* stack_pointer) noexcept;
+
+		MidoriValue* (*m_get_cell)(VirtualMachine* virtual_machine, int index) noexcept;
+
+		// closes over the captured locals in the slots a POP_SCOPE leaves
+		void (*m_promote_cells)(VirtualMachine* virtual_machine, MidoriValue* scope_begin) noexcept;
+	};
+
+	struct NativeProcedure
+	{
+		NativeEntry m_entry;
+		std::vector<const void*> m_instruction_addresses; // indexed by bytecode offset, nullptr between instructions
+		int m_max_stack_depth;
+	};
+
+private:
+	static constexpr int s_compilation_threshold = MIDORI_JIT_THRESHOLD;
+	static_assert(s_compilation_threshold > 0, "MIDORI_JIT_THRESHOLD must be positive.");
+
+	// MidoriValue layout the generated code relies on
+	static constexpr int s_value_size = static_cast<int>(sizeof(MidoriValue));
+	static constexpr int s_type_tag_offset = static_cast<int>(offsetof(MidoriValue, m_type_tag));
+
+	struct ProcedureProfile
+	{
+		int m_hotness = 0;
+		std::unique_ptr<NativeProcedure> m_native_procedure;
+	};
+
+	struct CodeRegion
+	{
+		void* m_address;
+		size_t m_size;
+	};
+
+	const MidoriExecutable& m_executable;
+	const std::vector<MidoriValue>& m_global_vars;
+	RuntimeHelpers m_helpers;
+	std::vector<ProcedureProfile> m_profiles;
+	std::vector<CodeRegion> m_code_regions;
+
+public:
+
+	JitCompiler(const MidoriExecutable& executable, const std::vector<MidoriValue>& global_vars, RuntimeHelpers helpers) noexcept;
+
+	~JitCompiler();
+
+	JitCompiler(const JitCompiler&) = delete;
+
+	JitCompiler& operator=(const JitCompiler&) = delete;
+
+	// Counts one call or loop iteration of a procedure and compiles it once it crosses the threshold.
+	// Returns nullptr while the procedure is still interpreted.
+	const NativeProcedure* Profile(int proc_index) noexcept
+	{
+		ProcedureProfile& profile = m_profiles[static_cast<size_t>(proc_index)];
+		if (profile.m_hotness < s_compilation_threshold && ++profile.m_hotness == s_compilation_threshold) [[unlikely]]
+			{
+				profile.m_native_procedure = Compile(proc_index);
+			}
+
+		return profile.m_native_procedure.get();
+	}
+
+private:
+
+	// nullptr if the procedure uses an instruction the baseline JIT does not translate
+	std::unique_ptr<NativeProcedure> Compile(int proc_index) noexcept;
+
+	void* InstallCode(const std::vector<uint8_t>& code) noexcept;
+
+	// one "address size name" line per procedure in the perf map of the process, so that perf can symbolize native frames
+	void WritePerfMapEntry(const void* address, size_t size, int proc_index) noexcept;
+};
+#endif
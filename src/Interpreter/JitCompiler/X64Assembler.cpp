@@ -0,0 +1,525 @@
+#if defined(MIDORI_JIT) || defined(MIDORI_TRACING_JIT)
+#include "X64Assembler.h"
+
+#include <cstring>
+
+namespace
+{
+	constexpr int RegisterCode(X64Register reg)
+	{
+		return static_cast<int>(reg);
+	}
+
+	constexpr uint8_t ModRM(int mod, int reg, int rm)
+	{
+		return static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+	}
+}
+
+X64Assembler::Label X64Assembler::CreateLabel()
+{
+	m_label_positions.emplace_back(-1);
+	return static_cast<Label>(m_label_positions.size() - 1u);
+}
+
+void X64Assembler::BindLabel(Label label)
+{
+	m_label_positions[static_cast<size_t>(label)] = GetSize();
+}
+
+int X64Assembler::GetLabelPosition(Label label) const
+{
+	return m_label_positions[static_cast<size_t>(label)];
+}
+
+int X64Assembler::GetSize() const
+{
+	return static_cast<int>(m_code.size());
+}
+
+std::vector<uint8_t> X64Assembler::Finalize()
+{
+	for (const Fixup& fixup : m_fixups)
+	{
+		int32_t relative = static_cast<int32_t>(GetLabelPosition(fixup.m_label) - (fixup.m_position + 4));
+		std::memcpy(&m_code[static_cast<size_t>(fixup.m_position)], &relative, sizeof(relative));
+	}
+	m_fixups.clear();
+
+	return m_code;
+}
+
+void X64Assembler::Push(X64Register reg)
+{
+	EmitRex(false, 0, RegisterCode(reg));
+	EmitByte(static_cast<uint8_t>(0x50 | (RegisterCode(reg) & 7)));
+}
+
+void X64Assembler::Pop(X64Register reg)
+{
+	EmitRex(false, 0, RegisterCode(reg));
+	EmitByte(static_cast<uint8_t>(0x58 | (RegisterCode(reg) & 7)));
+}
+
+void X64Assembler::Ret()
+{
+	EmitByte(0xC3);
+}
+
+void X64Assembler::MovRegReg(X64Register destination, X64Register source)
+{
+	EmitRex(true, RegisterCode(source), RegisterCode(destination));
+	EmitByte(0x89);
+	EmitByte(ModRM(0b11, RegisterCode(source), RegisterCode(destination)));
+}
+
+void X64Assembler::MovRegImm64(X64Register destination, uint64_t immediate)
+{
+	EmitRex(true, 0, RegisterCode(destination));
+	EmitByte(static_cast<uint8_t>(0xB8 | (RegisterCode(destination) & 7)));
+	for (int i = 0; i < 8; i += 1)
+	{
+		EmitByte(static_cast<uint8_t>(immediate >> (8 * i)));
+	}
+}
+
+void X64Assembler::MovRegMem(X64Register destination, X64Register base, int displacement)
+{
+	EmitRex(true, RegisterCode(destination), RegisterCode(base));
+	EmitByte(0x8B);
+	EmitMemoryOperand(RegisterCode(destination), base, displacement);
+}
+
+void X64Assembler::MovMemReg(X64Register base, int displacement, X64Register source)
+{
+	EmitRex(true, RegisterCode(source), RegisterCode(base));
+	EmitByte(0x89);
+	EmitMemoryOperand(RegisterCode(source), base, displacement);
+}
+
+void X64Assembler::MovMemImm32(X64Register base, int displacement, int32_t immediate)
+{
+	EmitRex(true, 0, RegisterCode(base));
+	EmitByte(0xC7);
+	EmitMemoryOperand(0, base, displacement);
+	EmitInt32(immediate);
+}
+
+void X64Assembler::MovByteMemImm8(X64Register base, int displacement, uint8_t immediate)
+{
+	EmitRex(false, 0, RegisterCode(base));
+	EmitByte(0xC6);
+	EmitMemoryOperand(0, base, displacement);
+	EmitByte(immediate);
+}
+
+void X64Assembler::ArithmeticRegMem(X64ArithmeticOp op, X64Register destination, X64Register base, int displacement)
+{
+	EmitRex(true, RegisterCode(destination), RegisterCode(base));
+	EmitByte(static_cast<uint8_t>((static_cast<int>(op) << 3) | 0x03));
+	EmitMemoryOperand(RegisterCode(destination), base, displacement);
+}
+
+void X64Assembler::ArithmeticRegImm32(X64ArithmeticOp op, X64Register destination, int32_t immediate)
+{
+	EmitRex(true, 0, RegisterCode(destination));
+	EmitByte(0x81);
+	EmitByte(ModRM(0b11, static_cast<int>(op), RegisterCode(destination)));
+	EmitInt32(immediate);
+}
+
+void X64Assembler::ArithmeticRegReg(X64ArithmeticOp op, X64Register destination, X64Register source)
+{
+	EmitRex(true, RegisterCode(source), RegisterCode(destination));
+	EmitByte(static_cast<uint8_t>((static_cast<int>(op) << 3) | 0x01));
+	EmitByte(ModRM(0b11, RegisterCode(source), RegisterCode(destination)));
+}
+
+void X64Assembler::ArithmeticByteMemImm8(X64ArithmeticOp op, X64Register base, int displacement, uint8_t immediate)
+{
+	EmitRex(false, 0, RegisterCode(base));
+	EmitByte(0x80);
+	EmitMemoryOperand(static_cast<int>(op), base, displacement);
+	EmitByte(immediate);
+}
+
+void X64Assembler::XorMemReg(X64Register base, int displacement, X64Register source)
+{
+	EmitRex(true, RegisterCode(source), RegisterCode(base));
+	EmitByte(0x31);
+	EmitMemoryOperand(RegisterCode(source), base, displacement);
+}
+
+void X64Assembler::ImulRegMem(X64Register destination, X64Register base, int displacement)
+{
+	EmitRex(true, RegisterCode(destination), RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(0xAF);
+	EmitMemoryOperand(RegisterCode(destination), base, displacement);
+}
+
+void X64Assembler::ImulRegRegImm32(X64Register destination, X64Register source, int32_t immediate)
+{
+	EmitRex(true, RegisterCode(destination), RegisterCode(source));
+	EmitByte(0x69);
+	EmitByte(ModRM(0b11, RegisterCode(destination), RegisterCode(source)));
+	EmitInt32(immediate);
+}
+
+void X64Assembler::ImulRegReg(X64Register destination, X64Register source)
+{
+	EmitRex(true, RegisterCode(destination), RegisterCode(source));
+	EmitByte(0x0F);
+	EmitByte(0xAF);
+	EmitByte(ModRM(0b11, RegisterCode(destination), RegisterCode(source)));
+}
+
+void X64Assembler::Cqo()
+{
+	EmitByte(0x48);
+	EmitByte(0x99);
+}
+
+void X64Assembler::IdivMem(X64Register base, int displacement)
+{
+	EmitRex(true, 0, RegisterCode(base));
+	EmitByte(0xF7);
+	EmitMemoryOperand(7, base, displacement);
+}
+
+void X64Assembler::IdivReg(X64Register divisor)
+{
+	EmitRex(true, 0, RegisterCode(divisor));
+	EmitByte(0xF7);
+	EmitByte(ModRM(0b11, 7, RegisterCode(divisor)));
+}
+
+void X64Assembler::NegMem(X64Register base, int displacement)
+{
+	EmitRex(true, 0, RegisterCode(base));
+	EmitByte(0xF7);
+	EmitMemoryOperand(3, base, displacement);
+}
+
+void X64Assembler::NotMem(X64Register base, int displacement)
+{
+	EmitRex(true, 0, RegisterCode(base));
+	EmitByte(0xF7);
+	EmitMemoryOperand(2, base, displacement);
+}
+
+void X64Assembler::NegReg(X64Register destination)
+{
+	EmitRex(true, 0, RegisterCode(destination));
+	EmitByte(0xF7);
+	EmitByte(ModRM(0b11, 3, RegisterCode(destination)));
+}
+
+void X64Assembler::NotReg(X64Register destination)
+{
+	EmitRex(true, 0, RegisterCode(destination));
+	EmitByte(0xF7);
+	EmitByte(ModRM(0b11, 2, RegisterCode(destination)));
+}
+
+void X64Assembler::TestRegReg(X64Register left, X64Register right)
+{
+	EmitRex(true, RegisterCode(right), RegisterCode(left));
+	EmitByte(0x85);
+	EmitByte(ModRM(0b11, RegisterCode(right), RegisterCode(left)));
+}
+
+void X64Assembler::IncrementMem(X64Register base, int displacement)
+{
+	EmitRex(true, 0, RegisterCode(base));
+	EmitByte(0xFF);
+	EmitMemoryOperand(0, base, displacement);
+}
+
+void X64Assembler::ShiftLeftRegCl(X64Register destination)
+{
+	EmitRex(true, 0, RegisterCode(destination));
+	EmitByte(0xD3);
+	EmitByte(ModRM(0b11, 4, RegisterCode(destination)));
+}
+
+void X64Assembler::ShiftRightArithmeticRegCl(X64Register destination)
+{
+	EmitRex(true, 0, RegisterCode(destination));
+	EmitByte(0xD3);
+	EmitByte(ModRM(0b11, 7, RegisterCode(destination)));
+}
+
+void X64Assembler::SetConditionByte(X64Condition condition, X64Register destination)
+{
+	EmitByte(0x0F);
+	EmitByte(static_cast<uint8_t>(0x90 | static_cast<int>(condition)));
+	EmitByte(ModRM(0b11, 0, RegisterCode(destination)));
+}
+
+void X64Assembler::AndByteRegReg(X64Register destination, X64Register source)
+{
+	EmitByte(0x20);
+	EmitByte(ModRM(0b11, RegisterCode(source), RegisterCode(destination)));
+}
+
+void X64Assembler::OrByteRegReg(X64Register destination, X64Register source)
+{
+	EmitByte(0x08);
+	EmitByte(ModRM(0b11, RegisterCode(source), RegisterCode(destination)));
+}
+
+void X64Assembler::TestByteRegReg(X64Register destination, X64Register source)
+{
+	EmitByte(0x84);
+	EmitByte(ModRM(0b11, RegisterCode(source), RegisterCode(destination)));
+}
+
+void X64Assembler::MovzxRegByteReg(X64Register destination, X64Register source)
+{
+	EmitRex(false, RegisterCode(destination), RegisterCode(source));
+	EmitByte(0x0F);
+	EmitByte(0xB6);
+	EmitByte(ModRM(0b11, RegisterCode(destination), RegisterCode(source)));
+}
+
+void X64Assembler::MovzxRegByteMem(X64Register destination, X64Register base, int displacement)
+{
+	EmitRex(false, RegisterCode(destination), RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(0xB6);
+	EmitMemoryOperand(RegisterCode(destination), base, displacement);
+}
+
+void X64Assembler::LoadXmm0Unaligned(X64Register base, int displacement)
+{
+	EmitRex(false, 0, RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(0x10);
+	EmitMemoryOperand(0, base, displacement);
+}
+
+void X64Assembler::StoreXmm0Unaligned(X64Register base, int displacement)
+{
+	EmitRex(false, 0, RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(0x11);
+	EmitMemoryOperand(0, base, displacement);
+}
+
+void X64Assembler::LoadScalarDouble(int xmm, X64Register base, int displacement)
+{
+	EmitByte(0xF2);
+	EmitRex(false, xmm, RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(0x10);
+	EmitMemoryOperand(xmm, base, displacement);
+}
+
+void X64Assembler::StoreScalarDouble(int xmm, X64Register base, int displacement)
+{
+	EmitByte(0xF2);
+	EmitRex(false, xmm, RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(0x11);
+	EmitMemoryOperand(xmm, base, displacement);
+}
+
+void X64Assembler::ScalarDoubleMem(X64ScalarDoubleOp op, int xmm, X64Register base, int displacement)
+{
+	EmitByte(0xF2);
+	EmitRex(false, xmm, RegisterCode(base));
+	EmitByte(0x0F);
+	EmitByte(static_cast<uint8_t>(op));
+	EmitMemoryOperand(xmm, base, displacement);
+}
+
+void X64Assembler::UnorderedCompareScalarDouble(int left_xmm, int right_xmm)
+{
+	EmitByte(0x66);
+	EmitByte(0x0F);
+	EmitByte(0x2E);
+	EmitByte(ModRM(0b11, left_xmm, right_xmm));
+}
+
+void X64Assembler::ScalarDoubleRegReg(X64ScalarDoubleOp op, int destination_xmm, int source_xmm)
+{
+	EmitByte(0xF2);
+	EmitRex(false, destination_xmm, source_xmm);
+	EmitByte(0x0F);
+	EmitByte(static_cast<uint8_t>(op));
+	EmitByte(ModRM(0b11, destination_xmm, source_xmm));
+}
+
+void X64Assembler::MovqXmmReg(int xmm, X64Register source)
+{
+	EmitByte(0x66);
+	EmitRex(true, xmm, RegisterCode(source));
+	EmitByte(0x0F);
+	EmitByte(0x6E);
+	EmitByte(ModRM(0b11, xmm, RegisterCode(source)));
+}
+
+void X64Assembler::MovqRegXmm(X64Register destination, int xmm)
+{
+	EmitByte(0x66);
+	EmitRex(true, xmm, RegisterCode(destination));
+	EmitByte(0x0F);
+	EmitByte(0x7E);
+	EmitByte(ModRM(0b11, xmm, RegisterCode(destination)));
+}
+
+void X64Assembler::ConvertIntegerToScalarDouble(int xmm, X64Register source)
+{
+	EmitByte(0xF2);
+	EmitRex(true, xmm, RegisterCode(source));
+	EmitByte(0x0F);
+	EmitByte(0x2A);
+	EmitByte(ModRM(0b11, xmm, RegisterCode(source)));
+}
+
+void X64Assembler::ConvertScalarDoubleToInteger(X64Register destination, int xmm)
+{
+	EmitByte(0xF2);
+	EmitRex(true, RegisterCode(destination), xmm);
+	EmitByte(0x0F);
+	EmitByte(0x2C);
+	EmitByte(ModRM(0b11, RegisterCode(destination), xmm));
+}
+
+void X64Assembler::SetFractionComparison(NumericComparison comparison)
+{
+	switch (comparison)
+	{
+	case NumericComparison::LESS:
+		UnorderedCompareScalarDouble(1, 0);
+		SetConditionByte(X64Condition::ABOVE, X64Register::RAX);
+		break;
+	case NumericComparison::LESS_EQUAL:
+		UnorderedCompareScalarDouble(1, 0);
+		SetConditionByte(X64Condition::ABOVE_EQUAL, X64Register::RAX);
+		break;
+	case NumericComparison::GREATER:
+		UnorderedCompareScalarDouble(0, 1);
+		SetConditionByte(X64Condition::ABOVE, X64Register::RAX);
+		break;
+	case NumericComparison::GREATER_EQUAL:
+		UnorderedCompareScalarDouble(0, 1);
+		SetConditionByte(X64Condition::ABOVE_EQUAL, X64Register::RAX);
+		break;
+	case NumericComparison::EQUAL:
+		UnorderedCompareScalarDouble(0, 1);
+		SetConditionByte(X64Condition::EQUAL, X64Register::RAX);
+		SetConditionByte(X64Condition::NOT_PARITY, X64Register::RCX);
+		AndByteRegReg(X64Register::RAX, X64Register::RCX);
+		break;
+	case NumericComparison::NOT_EQUAL:
+		UnorderedCompareScalarDouble(0, 1);
+		SetConditionByte(X64Condition::NOT_EQUAL, X64Register::RAX);
+		SetConditionByte(X64Condition::PARITY, X64Register::RCX);
+		OrByteRegReg(X64Register::RAX, X64Register::RCX);
+		break;
+	}
+}
+
+void X64Assembler::Jump(Label label)
+{
+	EmitByte(0xE9);
+	EmitRel32(label);
+}
+
+void X64Assembler::JumpIf(X64Condition condition, Label label)
+{
+	EmitByte(0x0F);
+	EmitByte(static_cast<uint8_t>(0x80 | static_cast<int>(condition)));
+	EmitRel32(label);
+}
+
+void X64Assembler::JumpReg(X64Register target)
+{
+	EmitRex(false, 0, RegisterCode(target));
+	EmitByte(0xFF);
+	EmitByte(ModRM(0b11, 4, RegisterCode(target)));
+}
+
+void X64Assembler::CallAbsolute(const void* target)
+{
+	MovRegImm64(X64Register::RAX, reinterpret_cast<uint64_t>(target));
+	EmitByte(0xFF);
+	EmitByte(ModRM(0b11, 2, RegisterCode(X64Register::RAX)));
+}
+
+X64Condition X64Assembler::GetIntegerCondition(NumericComparison comparison)
+{
+	switch (comparison)
+	{
+	case NumericComparison::LESS:
+		return X64Condition::LESS;
+	case NumericComparison::LESS_EQUAL:
+		return X64Condition::LESS_EQUAL;
+	case NumericComparison::GREATER:
+		return X64Condition::GREATER;
+	case NumericComparison::GREATER_EQUAL:
+		return X64Condition::GREATER_EQUAL;
+	case NumericComparison::EQUAL:
+		return X64Condition::EQUAL;
+	default:
+		return X64Condition::NOT_EQUAL;
+	}
+}
+
+X64Condition X64Assembler::NegateCondition(X64Condition condition)
+{
+	return static_cast<X64Condition>(static_cast<int>(condition) ^ 1);
+}
+
+void X64Assembler::EmitByte(uint8_t byte)
+{
+	m_code.emplace_back(byte);
+}
+
+void X64Assembler::EmitInt32(int32_t value)
+{
+	uint32_t bits = static_cast<uint32_t>(value);
+	for (int i = 0; i < 4; i += 1)
+	{
+		EmitByte(static_cast<uint8_t>(bits >> (8 * i)));
+	}
+}
+
+void X64Assembler::EmitRex(bool is_wide, int reg, int base)
+{
+	int rex = (is_wide ? 0x08 : 0x00) | ((reg & 8) ? 0x04 : 0x00) | ((base & 8) ? 0x01 : 0x00);
+	if (rex != 0)
+	{
+		EmitByte(static_cast<uint8_t>(0x40 | rex));
+	}
+}
+
+void X64Assembler::EmitMemoryOperand(int reg, X64Register base, int displacement)
+{
+	bool is_short_displacement = displacement >= INT8_MIN && displacement <= INT8_MAX;
+	EmitByte(ModRM(is_short_displacement ? 0b01 : 0b10, reg, RegisterCode(base)));
+
+	// rsp and r12 can only be addressed through a SIB byte
+	if ((RegisterCode(base) & 7) == RegisterCode(X64Register::RSP))
+	{
+		EmitByte(0x24);
+	}
+
+	if (is_short_displacement)
+	{
+		EmitByte(static_cast<uint8_t>(static_cast<int8_t>(displacement)));
+	}
+	else
+	{
+		EmitInt32(static_cast<int32_t>(displacement));
+	}
+}
+
+void X64Assembler::EmitRel32(Label label)
+{
+	m_fixups.emplace_back(Fixup{ GetSize(), label });
+	EmitInt32(0);
+}
+#endif
@@ -0,0 +1,227 @@
+#if defined(MIDORI_JIT) || defined(MIDORI_TRACING_JIT)
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class X64Register : uint8_t
+{
+	RAX,
+	RCX,
+	RDX,
+	RBX,
+	RSP,
+	RBP,
+	RSI,
+	RDI,
+	R8,
+	R9,
+	R10,
+	R11,
+	R12,
+	R13,
+	R14,
+	R15,
+};
+
+// condition code nibbles shared by jcc and setcc
+enum class X64Condition : uint8_t
+{
+	BELOW = 0x2,
+	ABOVE_EQUAL = 0x3,
+	EQUAL = 0x4,
+	NOT_EQUAL = 0x5,
+	BELOW_EQUAL = 0x6,
+	ABOVE = 0x7,
+	PARITY = 0xA,
+	NOT_PARITY = 0xB,
+	LESS = 0xC,
+	GREATER_EQUAL = 0xD,
+	LESS_EQUAL = 0xE,
+	GREATER = 0xF,
+};
+
+// the /digit of the 0x81 group, which also selects the register-memory opcode of the same operation
+enum class X64ArithmeticOp : uint8_t
+{
+	ADD = 0,
+	OR = 1,
+	AND = 4,
+	SUB = 5,
+	XOR = 6,
+	CMP = 7,
+};
+
+enum class NumericComparison : uint8_t
+{
+	LESS,
+	LESS_EQUAL,
+	GREATER,
+	GREATER_EQUAL,
+	EQUAL,
+	NOT_EQUAL,
+};
+
+enum class X64ScalarDoubleOp : uint8_t
+{
+	ADD = 0x58,
+	MULTIPLY = 0x59,
+	SUBTRACT = 0x5C,
+	DIVIDE = 0x5E,
+};
+
+// Minimal x86-64 encoder shared by the baseline and tracing JITs.
+// Memory operands are always [base + displacement]; only xmm0 and xmm1 are used for doubles.
+class X64Assembler
+{
+public:
+	using Label = int;
+
+private:
+	struct Fixup
+	{
+		int m_position; // start of the rel32 field
+		Label m_label;
+	};
+
+	std::vector<uint8_t> m_code;
+	std::vector<int> m_label_positions;
+	std::vector<Fixup> m_fixups;
+
+public:
+
+	Label CreateLabel();
+
+	void BindLabel(Label label);
+
+	int GetLabelPosition(Label label) const;
+
+	int GetSize() const;
+
+	// resolves every jump and returns the machine code
+	std::vector<uint8_t> Finalize();
+
+	void Push(X64Register reg);
+
+	void Pop(X64Register reg);
+
+	void Ret();
+
+	void MovRegReg(X64Register destination, X64Register source);
+
+	void MovRegImm64(X64Register destination, uint64_t immediate);
+
+	void MovRegMem(X64Register destination, X64Register base, int displacement);
+
+	void MovMemReg(X64Register base, int displacement, X64Register source);
+
+	// sign-extended 32-bit immediate into a qword
+	void MovMemImm32(X64Register base, int displacement, int32_t immediate);
+
+	void MovByteMemImm8(X64Register base, int displacement, uint8_t immediate);
+
+	void ArithmeticRegMem(X64ArithmeticOp op, X64Register destination, X64Register base, int displacement);
+
+	void ArithmeticRegImm32(X64ArithmeticOp op, X64Register destination, int32_t immediate);
+
+	void ArithmeticRegReg(X64ArithmeticOp op, X64Register destination, X64Register source);
+
+	void ArithmeticByteMemImm8(X64ArithmeticOp op, X64Register base, int displacement, uint8_t immediate);
+
+	void XorMemReg(X64Register base, int displacement, X64Register source);
+
+	void ImulRegMem(X64Register destination, X64Register base, int displacement);
+
+	void ImulRegRegImm32(X64Register destination, X64Register source, int32_t immediate);
+
+	void ImulRegReg(X64Register destination, X64Register source);
+
+	void Cqo();
+
+	void IdivMem(X64Register base, int displacement);
+
+	void IdivReg(X64Register divisor);
+
+	void NegMem(X64Register base, int displacement);
+
+	void NotMem(X64Register base, int displacement);
+
+	void NegReg(X64Register destination);
+
+	void NotReg(X64Register destination);
+
+	void TestRegReg(X64Register left, X64Register right);
+
+	void IncrementMem(X64Register base, int displacement);
+
+	void ShiftLeftRegCl(X64Register destination);
+
+	void ShiftRightArithmeticRegCl(X64Register destination);
+
+	// setcc into al or cl
+	void SetConditionByte(X64Condition condition, X64Register destination);
+
+	void AndByteRegReg(X64Register destination, X64Register source);
+
+	void OrByteRegReg(X64Register destination, X64Register source);
+
+	void TestByteRegReg(X64Register destination, X64Register source);
+
+	void MovzxRegByteReg(X64Register destination, X64Register source);
+
+	void MovzxRegByteMem(X64Register destination, X64Register base, int displacement);
+
+	// 16-byte unaligned move of a whole MidoriValue through xmm0
+	void LoadXmm0Unaligned(X64Register base, int displacement);
+
+	void StoreXmm0Unaligned(X64Register base, int displacement);
+
+	void LoadScalarDouble(int xmm, X64Register base, int displacement);
+
+	void StoreScalarDouble(int xmm, X64Register base, int displacement);
+
+	void ScalarDoubleMem(X64ScalarDoubleOp op, int xmm, X64Register base, int displacement);
+
+	void UnorderedCompareScalarDouble(int left_xmm, int right_xmm);
+
+	void ScalarDoubleRegReg(X64ScalarDoubleOp op, int destination_xmm, int source_xmm);
+
+	// raw 64-bit moves between general purpose and xmm registers
+	void MovqXmmReg(int xmm, X64Register source);
+
+	void MovqRegXmm(X64Register destination, int xmm);
+
+	void ConvertIntegerToScalarDouble(int xmm, X64Register source);
+
+	// truncates toward zero like a C++ cast
+	void ConvertScalarDoubleToInteger(X64Register destination, int xmm);
+
+	// al := xmm0 <comparison> xmm1, false whenever either side is NaN (clobbers cl)
+	void SetFractionComparison(NumericComparison comparison);
+
+	void Jump(Label label);
+
+	void JumpIf(X64Condition condition, Label label);
+
+	void JumpReg(X64Register target);
+
+	// clobbers rax
+	void CallAbsolute(const void* target);
+
+	static X64Condition GetIntegerCondition(NumericComparison comparison);
+
+	static X64Condition NegateCondition(X64Condition condition);
+
+private:
+
+	void EmitByte(uint8_t byte);
+
+	void EmitInt32(int32_t value);
+
+	void EmitRex(bool is_wide, int reg, int base);
+
+	void EmitMemoryOperand(int reg, X64Register base, int displacement);
+
+	void EmitRel32(Label label);
+};
+#endif
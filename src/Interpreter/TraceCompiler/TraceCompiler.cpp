@@ -0,0 +1,1599 @@
+#ifdef MIDORI_TRACING_JIT
+#include "TraceCompiler.h"
+#include "Interpreter/JitCompiler/X64Assembler.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <optional>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+	// pinned for the whole trace, the native loop never touches the VM itself
+	constexpr X64Register BASE_POINTER_REGISTER = X64Register::R12;
+
+	// rax, rcx and rdx stay free as scratch for constants, shift counts and division
+	constexpr std::array<X64Register, 10> ALLOCATABLE_REGISTERS
+	{
+		X64Register::RBX, X64Register::RSI, X64Register::RDI, X64Register::R8, X64Register::R9,
+		X64Register::R10, X64Register::R11, X64Register::R13, X64Register::R14, X64Register::R15,
+	};
+
+	constexpr std::array<X64Register, 5> CALLEE_SAVED_REGISTERS
+	{
+		X64Register::RBX, X64Register::R12, X64Register::R13, X64Register::R14, X64Register::R15,
+	};
+
+	// bytecode instructions per recorded iteration
+	constexpr int MAX_TRACE_LENGTH = 1000;
+
+	enum class TraceOp : uint8_t
+	{
+		CONSTANT,
+		LOAD_LOCAL,
+		LOAD_GLOBAL,
+		STORE_LOCAL,
+		STORE_GLOBAL,
+		ADD,
+		SUBTRACT,
+		MULTIPLY,
+		DIVIDE,
+		MODULO,
+		LEFT_SHIFT,
+		RIGHT_SHIFT,
+		BITWISE_AND,
+		BITWISE_OR,
+		BITWISE_XOR,
+		BITWISE_NOT,
+		NEGATE,
+		NOT,
+		CONVERT,
+		COMPARE,
+		GUARD_TRUE,
+		GUARD_FALSE,
+	};
+
+	enum class TraceType : uint8_t
+	{
+		INTEGER,
+		FRACTION,
+		BOOL,
+	};
+
+	// one SSA value per instruction, operands refer to earlier instructions
+	struct TraceInstruction
+	{
+		TraceOp m_op;
+		TraceType m_type; // of the operands for COMPARE, of the stored value for stores, of the result otherwise
+		int m_left = -1;
+		int m_right = -1;
+		int64_t m_immediate = 0; // constant bits, frame slot, global index or NumericComparison
+		int m_snapshot = -1; // guards only
+		bool m_is_dead = false;
+	};
+
+	// interpreter state a failing guard resumes with; slots below the loop header depth already live in the frame
+	struct Snapshot
+	{
+		const OpCode* m_resume_address;
+		std::vector<int> m_stack;
+	};
+
+	// the types observed for frame slots and globals the trace reads before writing them
+	struct EntryGuard
+	{
+		bool m_is_global;
+		int m_index;
+		TraceType m_type;
+	};
+
+	bool IsGuard(TraceOp op)
+	{
+		return op == TraceOp::GUARD_TRUE || op == TraceOp::GUARD_FALSE;
+	}
+
+	bool HasSideEffect(TraceOp op)
+	{
+		return op == TraceOp::STORE_LOCAL || op == TraceOp::STORE_GLOBAL || IsGuard(op);
+	}
+
+	bool IsUnary(TraceOp op)
+	{
+		return op == TraceOp::BITWISE_NOT || op == TraceOp::NEGATE || op == TraceOp::NOT || op == TraceOp::CONVERT;
+	}
+
+	TraceType GetResultType(const TraceInstruction& instruction)
+	{
+		return instruction.m_op == TraceOp::COMPARE ? TraceType::BOOL : instruction.m_type;
+	}
+
+	int64_t FractionBits(MidoriFraction value)
+	{
+		return std::bit_cast<int64_t>(value);
+	}
+
+	MidoriFraction BitsFraction(int64_t bits)
+	{
+		return std::bit_cast<MidoriFraction>(bits);
+	}
+
+	template<typename T>
+	bool Compare(NumericComparison comparison, T left, T right)
+	{
+		switch (comparison)
+		{
+		case NumericComparison::LESS:
+			return left < right;
+		case NumericComparison::LESS_EQUAL:
+			return left <= right;
+		case NumericComparison::GREATER:
+			return left > right;
+		case NumericComparison::GREATER_EQUAL:
+			return left >= right;
+		case NumericComparison::EQUAL:
+			return left == right;
+		default:
+			return left != right;
+		}
+	}
+
+	// the value an operation produces on the given operand bits, std::nullopt where the hardware would trap
+	std::optional<int64_t> Evaluate(const TraceInstruction& instruction, int64_t left, int64_t right)
+	{
+		if (instruction.m_type == TraceType::FRACTION)
+		{
+			MidoriFraction a = BitsFraction(left);
+			MidoriFraction b = BitsFraction(right);
+			switch (instruction.m_op)
+			{
+			case TraceOp::ADD:
+				return FractionBits(a + b);
+			case TraceOp::SUBTRACT:
+				return FractionBits(a - b);
+			case TraceOp::MULTIPLY:
+				return FractionBits(a * b);
+			case TraceOp::DIVIDE:
+				return FractionBits(a / b);
+			case TraceOp::NEGATE:
+				return FractionBits(-a);
+			case TraceOp::CONVERT:
+				return FractionBits(static_cast<MidoriFraction>(left));
+			case TraceOp::COMPARE:
+				return Compare(static_cast<NumericComparison>(instruction.m_immediate), a, b) ? 1 : 0;
+			default:
+				return std::nullopt;
+			}
+		}
+
+		// integers wrap around exactly like the generated code
+		uint64_t a = static_cast<uint64_t>(left);
+		uint64_t b = static_cast<uint64_t>(right);
+		switch (instruction.m_op)
+		{
+		case TraceOp::ADD:
+			return static_cast<int64_t>(a + b);
+		case TraceOp::SUBTRACT:
+			return static_cast<int64_t>(a - b);
+		case TraceOp::MULTIPLY:
+			return static_cast<int64_t>(a * b);
+		case TraceOp::DIVIDE:
+		case TraceOp::MODULO:
+			if (right == 0 || (left == INT64_MIN && right == -1))
+			{
+				return std::nullopt;
+			}
+			return instruction.m_op == TraceOp::DIVIDE ? left / right : left % right;
+		case TraceOp::LEFT_SHIFT:
+			return static_cast<int64_t>(a << (b & 63u));
+		case TraceOp::RIGHT_SHIFT:
+			return left >> (b & 63u);
+		case TraceOp::BITWISE_AND:
+			return left & right;
+		case TraceOp::BITWISE_OR:
+			return left | right;
+		case TraceOp::BITWISE_XOR:
+			return left ^ right;
+		case TraceOp::BITWISE_NOT:
+			return ~left;
+		case TraceOp::NEGATE:
+			return static_cast<int64_t>(0u - a);
+		case TraceOp::NOT:
+			return left ^ 1;
+		case TraceOp::CONVERT:
+		{
+			// cvttsd2si yields INT64_MIN for NaN and anything out of range
+			MidoriFraction fraction = BitsFraction(left);
+			return fraction >= -9223372036854775808.0 && fraction < 9223372036854775808.0 ? static_cast<int64_t>(fraction) : INT64_MIN;
+		}
+		case TraceOp::COMPARE:
+			return Compare(static_cast<NumericComparison>(instruction.m_immediate), left, right) ? 1 : 0;
+		default:
+			return std::nullopt;
+		}
+	}
+
+	std::optional<std::pair<TraceOp, TraceType>> GetArithmetic(OpCode op)
+	{
+		switch (op)
+		{
+		case OpCode::LEFT_SHIFT:
+			return std::make_pair(TraceOp::LEFT_SHIFT, TraceType::INTEGER);
+		case OpCode::RIGHT_SHIFT:
+			return std::make_pair(TraceOp::RIGHT_SHIFT, TraceType::INTEGER);
+		case OpCode::BITWISE_AND:
+			return std::make_pair(TraceOp::BITWISE_AND, TraceType::INTEGER);
+		case OpCode::BITWISE_OR:
+			return std::make_pair(TraceOp::BITWISE_OR, TraceType::INTEGER);
+		case OpCode::BITWISE_XOR:
+			return std::make_pair(TraceOp::BITWISE_XOR, TraceType::INTEGER);
+		case OpCode::ADD_FRACTION:
+			return std::make_pair(TraceOp::ADD, TraceType::FRACTION);
+		case OpCode::SUBTRACT_FRACTION:
+			return std::make_pair(TraceOp::SUBTRACT, TraceType::FRACTION);
+		case OpCode::MULTIPLY_FRACTION:
+			return std::make_pair(TraceOp::MULTIPLY, TraceType::FRACTION);
+		case OpCode::DIVIDE_FRACTION:
+			return std::make_pair(TraceOp::DIVIDE, TraceType::FRACTION);
+		case OpCode::ADD_INTEGER:
+		case OpCode::ADD_INTEGER_RR:
+		case OpCode::ADD_INTEGER_RI:
+		case OpCode::ADD_INTEGER_RRR:
+		case OpCode::ADD_INTEGER_RRI:
+			return std::make_pair(TraceOp::ADD, TraceType::INTEGER);
+		case OpCode::SUBTRACT_INTEGER:
+		case OpCode::SUBTRACT_INTEGER_RR:
+		case OpCode::SUBTRACT_INTEGER_RI:
+		case OpCode::SUBTRACT_INTEGER_RRR:
+		case OpCode::SUBTRACT_INTEGER_RRI:
+			return std::make_pair(TraceOp::SUBTRACT, TraceType::INTEGER);
+		case OpCode::MULTIPLY_INTEGER:
+		case OpCode::MULTIPLY_INTEGER_RR:
+		case OpCode::MULTIPLY_INTEGER_RI:
+			return std::make_pair(TraceOp::MULTIPLY, TraceType::INTEGER);
+		case OpCode::DIVIDE_INTEGER:
+			return std::make_pair(TraceOp::DIVIDE, TraceType::INTEGER);
+		case OpCode::MODULO_INTEGER:
+		case OpCode::MODULO_INTEGER_RR:
+		case OpCode::MODULO_INTEGER_RI:
+			return std::make_pair(TraceOp::MODULO, TraceType::INTEGER);
+		default:
+			return std::nullopt;
+		}
+	}
+
+	NumericComparison GetComparison(OpCode op)
+	{
+		switch (op)
+		{
+		case OpCode::LESS_FRACTION:
+		case OpCode::LESS_INTEGER:
+		case OpCode::IF_INTEGER_LESS:
+		case OpCode::IF_FRACTION_LESS:
+		case OpCode::IF_INTEGER_LESS_RR:
+		case OpCode::IF_INTEGER_LESS_RI:
+			return NumericComparison::LESS;
+		case OpCode::LESS_EQUAL_FRACTION:
+		case OpCode::LESS_EQUAL_INTEGER:
+		case OpCode::IF_INTEGER_LESS_EQUAL:
+		case OpCode::IF_FRACTION_LESS_EQUAL:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+			return NumericComparison::LESS_EQUAL;
+		case OpCode::GREATER_FRACTION:
+		case OpCode::GREATER_INTEGER:
+		case OpCode::IF_INTEGER_GREATER:
+		case OpCode::IF_FRACTION_GREATER:
+		case OpCode::IF_INTEGER_GREATER_RR:
+		case OpCode::IF_INTEGER_GREATER_RI:
+			return NumericComparison::GREATER;
+		case OpCode::GREATER_EQUAL_FRACTION:
+		case OpCode::GREATER_EQUAL_INTEGER:
+		case OpCode::IF_INTEGER_GREATER_EQUAL:
+		case OpCode::IF_FRACTION_GREATER_EQUAL:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+			return NumericComparison::GREATER_EQUAL;
+		case OpCode::EQUAL_FRACTION:
+		case OpCode::EQUAL_INTEGER:
+		case OpCode::IF_INTEGER_EQUAL:
+		case OpCode::IF_FRACTION_EQUAL:
+		case OpCode::IF_INTEGER_EQUAL_RR:
+		case OpCode::IF_INTEGER_EQUAL_RI:
+			return NumericComparison::EQUAL;
+		default:
+			return NumericComparison::NOT_EQUAL;
+		}
+	}
+
+	template<typename T>
+	T ReadOperand(const OpCode*& instruction_pointer)
+	{
+		T value;
+		std::memcpy(&value, instruction_pointer, sizeof(T));
+		instruction_pointer += sizeof(T);
+		return value;
+	}
+
+	int ReadSlot(const OpCode*& instruction_pointer)
+	{
+		return static_cast<int>(ReadOperand<uint8_t>(instruction_pointer));
+	}
+
+	int ReadJumpOffset(const OpCode*& instruction_pointer)
+	{
+		return static_cast<int>(ReadOperand<uint16_t>(instruction_pointer));
+	}
+}
+
+class TraceCompiler::TraceBuilder
+{
+private:
+	static constexpr int s_value_size = static_cast<int>(sizeof(MidoriValue));
+	static constexpr int s_type_tag_offset = static_cast<int>(offsetof(MidoriValue, m_type_tag));
+
+	std::vector<MidoriValue>& m_global_vars;
+	const OpCode* m_loop_header;
+	MidoriValue* m_base_pointer;
+	int m_header_depth;
+	int m_max_stack_depth;
+
+	std::vector<TraceInstruction> m_instructions;
+	std::vector<int64_t> m_recorded_values; // what every instruction produced while recording
+	std::vector<Snapshot> m_snapshots;
+	std::vector<EntryGuard> m_entry_guards;
+	std::vector<int> m_stack; // the value of every stack slot from the loop header depth upwards
+	std::unordered_map<int, int> m_local_values; // frame slot below the loop header depth -> value it currently holds
+	std::unordered_map<int, int> m_global_values;
+	bool m_is_aborted = false;
+
+public:
+
+	TraceBuilder(std::vector<MidoriValue>& global_vars, const OpCode* loop_header, MidoriValue* base_pointer, MidoriValue* stack_pointer) noexcept
+		: m_global_vars(global_vars), m_loop_header(loop_header), m_base_pointer(base_pointer),
+		m_header_depth(static_cast<int>(stack_pointer - base_pointer)), m_max_stack_depth(m_header_depth)
+	{
+	}
+
+	// Shadow-executes one iteration from the loop header back to it without touching the VM state.
+	bool Record() noexcept
+	{
+		const OpCode* instruction_pointer = m_loop_header;
+
+		for (int length = 0; length < MAX_TRACE_LENGTH && !m_is_aborted; length += 1)
+		{
+			OpCode op = *instruction_pointer;
+			++instruction_pointer;
+
+			switch (op)
+			{
+			case OpCode::INTEGER_CONSTANT:
+			{
+				Push(EmitConstant(TraceType::INTEGER, ReadOperand<MidoriInteger>(instruction_pointer)));
+				break;
+			}
+			case OpCode::FRACTION_CONSTANT:
+			{
+				Push(EmitConstant(TraceType::FRACTION, FractionBits(ReadOperand<MidoriFraction>(instruction_pointer))));
+				break;
+			}
+			case OpCode::OP_TRUE:
+			{
+				Push(EmitConstant(TraceType::BOOL, 1));
+				break;
+			}
+			case OpCode::OP_FALSE:
+			{
+				Push(EmitConstant(TraceType::BOOL, 0));
+				break;
+			}
+			case OpCode::LEFT_SHIFT:
+			case OpCode::RIGHT_SHIFT:
+			case OpCode::BITWISE_AND:
+			case OpCode::BITWISE_OR:
+			case OpCode::BITWISE_XOR:
+			case OpCode::ADD_FRACTION:
+			case OpCode::SUBTRACT_FRACTION:
+			case OpCode::MULTIPLY_FRACTION:
+			case OpCode::DIVIDE_FRACTION:
+			case OpCode::ADD_INTEGER:
+			case OpCode::SUBTRACT_INTEGER:
+			case OpCode::MULTIPLY_INTEGER:
+			case OpCode::DIVIDE_INTEGER:
+			case OpCode::MODULO_INTEGER:
+			{
+				auto [trace_op, type] = *GetArithmetic(op);
+				int right = Pop();
+				int left = Pop();
+				Push(EmitOperation(trace_op, type, left, right));
+				break;
+			}
+			case OpCode::BITWISE_NOT:
+			{
+				Push(EmitOperation(TraceOp::BITWISE_NOT, TraceType::INTEGER, Pop(), -1));
+				break;
+			}
+			case OpCode::NEGATE_INTEGER:
+			{
+				Push(EmitOperation(TraceOp::NEGATE, TraceType::INTEGER, Pop(), -1));
+				break;
+			}
+			case OpCode::NEGATE_FRACTION:
+			{
+				Push(EmitOperation(TraceOp::NEGATE, TraceType::FRACTION, Pop(), -1));
+				break;
+			}
+			case OpCode::NOT:
+			{
+				Push(EmitOperation(TraceOp::NOT, TraceType::BOOL, Pop(), -1));
+				break;
+			}
+			case OpCode::CAST_TO_FRACTION:
+			case OpCode::CAST_TO_INTEGER:
+			{
+				TraceType type = op == OpCode::CAST_TO_FRACTION ? TraceType::FRACTION : TraceType::INTEGER;
+				int value = Pop();
+				if (value >= 0 && GetResultType(m_instructions[static_cast<size_t>(value)]) == type)
+				{
+					Push(value);
+				}
+				else
+				{
+					Push(EmitOperation(TraceOp::CONVERT, type, value, -1));
+				}
+				break;
+			}
+			case OpCode::EQUAL_FRACTION:
+			case OpCode::NOT_EQUAL_FRACTION:
+			case OpCode::GREATER_FRACTION:
+			case OpCode::GREATER_EQUAL_FRACTION:
+			case OpCode::LESS_FRACTION:
+			case OpCode::LESS_EQUAL_FRACTION:
+			case OpCode::EQUAL_INTEGER:
+			case OpCode::NOT_EQUAL_INTEGER:
+			case OpCode::GREATER_INTEGER:
+			case OpCode::GREATER_EQUAL_INTEGER:
+			case OpCode::LESS_INTEGER:
+			case OpCode::LESS_EQUAL_INTEGER:
+			{
+				TraceType type = op <= OpCode::LESS_EQUAL_FRACTION ? TraceType::FRACTION : TraceType::INTEGER;
+				int right = Pop();
+				int left = Pop();
+				Push(EmitComparison(GetComparison(op), type, left, right));
+				break;
+			}
+			case OpCode::JUMP_IF_FALSE:
+			case OpCode::JUMP_IF_TRUE:
+			{
+				int offset = ReadJumpOffset(instruction_pointer);
+				int condition = Peek();
+				if (m_is_aborted)
+				{
+					break;
+				}
+
+				bool value = m_recorded_values[static_cast<size_t>(condition)] != 0;
+				bool is_taken = value == (op == OpCode::JUMP_IF_TRUE);
+				Guard(condition, value, is_taken ? instruction_pointer : instruction_pointer + offset);
+				if (is_taken)
+				{
+					instruction_pointer += offset;
+				}
+				break;
+			}
+			case OpCode::JUMP:
+			{
+				int offset = ReadJumpOffset(instruction_pointer);
+				instruction_pointer += offset;
+				break;
+			}
+			case OpCode::JUMP_BACK:
+			{
+				int offset = ReadJumpOffset(instruction_pointer);
+				instruction_pointer -= offset;
+				if (instruction_pointer == m_loop_header)
+				{
+					return m_stack.empty();
+				}
+				break;
+			}
+			case OpCode::IF_INTEGER_LESS:
+			case OpCode::IF_INTEGER_LESS_EQUAL:
+			case OpCode::IF_INTEGER_GREATER:
+			case OpCode::IF_INTEGER_GREATER_EQUAL:
+			case OpCode::IF_INTEGER_EQUAL:
+			case OpCode::IF_INTEGER_NOT_EQUAL:
+			case OpCode::IF_FRACTION_LESS:
+			case OpCode::IF_FRACTION_LESS_EQUAL:
+			case OpCode::IF_FRACTION_GREATER:
+			case OpCode::IF_FRACTION_GREATER_EQUAL:
+			case OpCode::IF_FRACTION_EQUAL:
+			case OpCode::IF_FRACTION_NOT_EQUAL:
+			{
+				TraceType type = op <= OpCode::IF_INTEGER_NOT_EQUAL ? TraceType::INTEGER : TraceType::FRACTION;
+				int offset = ReadJumpOffset(instruction_pointer);
+				int right = Pop();
+				int left = Pop();
+				RecordConditionalJump(EmitComparison(GetComparison(op), type, left, right), instruction_pointer, offset);
+				break;
+			}
+			case OpCode::ADD_INTEGER_RR:
+			case OpCode::SUBTRACT_INTEGER_RR:
+			case OpCode::MULTIPLY_INTEGER_RR:
+			case OpCode::MODULO_INTEGER_RR:
+			{
+				int left = GetLocal(ReadSlot(instruction_pointer));
+				int right = GetLocal(ReadSlot(instruction_pointer));
+				Push(EmitOperation(GetArithmetic(op)->first, TraceType::INTEGER, left, right));
+				break;
+			}
+			case OpCode::ADD_INTEGER_RI:
+			case OpCode::SUBTRACT_INTEGER_RI:
+			case OpCode::MULTIPLY_INTEGER_RI:
+			case OpCode::MODULO_INTEGER_RI:
+			{
+				int left = GetLocal(ReadSlot(instruction_pointer));
+				int right = EmitConstant(TraceType::INTEGER, ReadOperand<int32_t>(instruction_pointer));
+				Push(EmitOperation(GetArithmetic(op)->first, TraceType::INTEGER, left, right));
+				break;
+			}
+			case OpCode::ADD_INTEGER_RRR:
+			case OpCode::SUBTRACT_INTEGER_RRR:
+			{
+				int destination = ReadSlot(instruction_pointer);
+				int left = GetLocal(ReadSlot(instruction_pointer));
+				int right = GetLocal(ReadSlot(instruction_pointer));
+				SetLocal(destination, EmitOperation(GetArithmetic(op)->first, TraceType::INTEGER, left, right));
+				break;
+			}
+			case OpCode::ADD_INTEGER_RRI:
+			case OpCode::SUBTRACT_INTEGER_RRI:
+			{
+				int destination = ReadSlot(instruction_pointer);
+				int left = GetLocal(ReadSlot(instruction_pointer));
+				int right = EmitConstant(TraceType::INTEGER, ReadOperand<int32_t>(instruction_pointer));
+				SetLocal(destination, EmitOperation(GetArithmetic(op)->first, TraceType::INTEGER, left, right));
+				break;
+			}
+			case OpCode::IF_INTEGER_LESS_RR:
+			case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+			case OpCode::IF_INTEGER_GREATER_RR:
+			case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+			case OpCode::IF_INTEGER_EQUAL_RR:
+			case OpCode::IF_INTEGER_NOT_EQUAL_RR:
+			{
+				int left = GetLocal(ReadSlot(instruction_pointer));
+				int right = GetLocal(ReadSlot(instruction_pointer));
+				int offset = ReadJumpOffset(instruction_pointer);
+				RecordConditionalJump(EmitComparison(GetComparison(op), TraceType::INTEGER, left, right), instruction_pointer, offset);
+				break;
+			}
+			case OpCode::IF_INTEGER_LESS_RI:
+			case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+			case OpCode::IF_INTEGER_GREATER_RI:
+			case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+			case OpCode::IF_INTEGER_EQUAL_RI:
+			case OpCode::IF_INTEGER_NOT_EQUAL_RI:
+			{
+				int left = GetLocal(ReadSlot(instruction_pointer));
+				int right = EmitConstant(TraceType::INTEGER, ReadOperand<int32_t>(instruction_pointer));
+				int offset = ReadJumpOffset(instruction_pointer);
+				RecordConditionalJump(EmitComparison(GetComparison(op), TraceType::INTEGER, left, right), instruction_pointer, offset);
+				break;
+			}
+			case OpCode::GET_GLOBAL:
+			{
+				Push(GetGlobal(ReadSlot(instruction_pointer)));
+				break;
+			}
+			case OpCode::SET_GLOBAL:
+			{
+				int index = ReadSlot(instruction_pointer);
+				SetGlobal(index, Peek());
+				break;
+			}
+			case OpCode::GET_LOCAL:
+			{
+				Push(GetLocal(ReadSlot(instruction_pointer)));
+				break;
+			}
+			case OpCode::SET_LOCAL:
+			{
+				int slot = ReadSlot(instruction_pointer);
+				SetLocal(slot, Peek());
+				break;
+			}
+			case OpCode::POP:
+			{
+				Pop();
+				break;
+			}
+			case OpCode::DUP:
+			{
+				Push(Peek());
+				break;
+			}
+			case OpCode::POP_SCOPE:
+			case OpCode::POP_MULTIPLE:
+			{
+				// no cells can be pending inside a trace, so leaving a scope only drops its slots
+				int count = ReadSlot(instruction_pointer);
+				for (int i = 0; i < count; i += 1)
+				{
+					Pop();
+				}
+				break;
+			}
+			default:
+			{
+				return false;
+			}
+			}
+		}
+
+		return false;
+	}
+
+	void Optimize() noexcept
+	{
+		std::vector<int> replacements(m_instructions.size());
+		std::vector<int8_t> guarded_values(m_instructions.size(), -1);
+		for (size_t i = 0u; i < replacements.size(); i += 1u)
+		{
+			replacements[i] = static_cast<int>(i);
+		}
+
+		const auto resolve = [&replacements](int value) -> int
+			{
+				return value < 0 ? value : replacements[static_cast<size_t>(value)];
+			};
+		const auto is_constant = [this](int value) -> bool
+			{
+				return value >= 0 && m_instructions[static_cast<size_t>(value)].m_op == TraceOp::CONSTANT;
+			};
+		const auto constant_bits = [this](int value) -> int64_t
+			{
+				return m_instructions[static_cast<size_t>(value)].m_immediate;
+			};
+
+		// forward pass: constant folding, algebraic identities and redundant guards
+		for (size_t i = 0u; i < m_instructions.size(); i += 1u)
+		{
+			TraceInstruction& instruction = m_instructions[i];
+			instruction.m_left = resolve(instruction.m_left);
+			instruction.m_right = resolve(instruction.m_right);
+
+			if (instruction.m_op == TraceOp::CONSTANT || instruction.m_op == TraceOp::LOAD_LOCAL || instruction.m_op == TraceOp::LOAD_GLOBAL
+				|| instruction.m_op == TraceOp::STORE_LOCAL || instruction.m_op == TraceOp::STORE_GLOBAL)
+			{
+				continue;
+			}
+
+			if (IsGuard(instruction.m_op))
+			{
+				int8_t expected = instruction.m_op == TraceOp::GUARD_TRUE ? 1 : 0;
+				int8_t& guarded = guarded_values[static_cast<size_t>(instruction.m_left)];
+
+				// a constant condition holds exactly as recorded
+				if (is_constant(instruction.m_left) || guarded == expected)
+				{
+					instruction.m_is_dead = true;
+				}
+				guarded = expected;
+				continue;
+			}
+
+			bool is_unary = IsUnary(instruction.m_op);
+			if (is_constant(instruction.m_left) && (is_unary || is_constant(instruction.m_right)))
+			{
+				if (std::optional<int64_t> folded = Evaluate(instruction, constant_bits(instruction.m_left), is_unary ? 0 : constant_bits(instruction.m_right)))
+				{
+					instruction = TraceInstruction{ TraceOp::CONSTANT, GetResultType(instruction), -1, -1, *folded };
+				}
+				continue;
+			}
+
+			if (instruction.m_type != TraceType::INTEGER || is_unary)
+			{
+				continue;
+			}
+
+			// x + 0, x - 0, x * 1, x | 0, x ^ 0, x << 0, x >> 0 and their mirrored forms
+			int identity = -1;
+			if (is_constant(instruction.m_right))
+			{
+				int64_t right = constant_bits(instruction.m_right);
+				bool is_neutral = instruction.m_op == TraceOp::MULTIPLY ? right == 1 :
+					right == 0 && (instruction.m_op == TraceOp::ADD || instruction.m_op == TraceOp::SUBTRACT || instruction.m_op == TraceOp::BITWISE_OR
+						|| instruction.m_op == TraceOp::BITWISE_XOR || instruction.m_op == TraceOp::LEFT_SHIFT || instruction.m_op == TraceOp::RIGHT_SHIFT);
+				identity = is_neutral ? instruction.m_left : -1;
+			}
+			else if (is_constant(instruction.m_left))
+			{
+				int64_t left = constant_bits(instruction.m_left);
+				bool is_neutral = instruction.m_op == TraceOp::MULTIPLY ? left == 1 :
+					left == 0 && (instruction.m_op == TraceOp::ADD || instruction.m_op == TraceOp::BITWISE_OR || instruction.m_op == TraceOp::BITWISE_XOR);
+				identity = is_neutral ? instruction.m_right : -1;
+			}
+
+			if (identity != -1)
+			{
+				replacements[i] = identity;
+				instruction.m_is_dead = true;
+			}
+		}
+
+		for (Snapshot& snapshot : m_snapshots)
+		{
+			std::ranges::transform(snapshot.m_stack, snapshot.m_stack.begin(), resolve);
+		}
+
+		// backward pass: drop everything no store, guard or side exit depends on
+		std::vector<bool> is_live(m_instructions.size(), false);
+		for (size_t i = m_instructions.size(); i-- > 0u;)
+		{
+			TraceInstruction& instruction = m_instructions[i];
+			if (instruction.m_is_dead || !(is_live[i] || HasSideEffect(instruction.m_op)))
+			{
+				instruction.m_is_dead = true;
+				continue;
+			}
+
+			for (int operand : { instruction.m_left, instruction.m_right })
+			{
+				if (operand >= 0)
+				{
+					is_live[static_cast<size_t>(operand)] = true;
+				}
+			}
+			if (IsGuard(instruction.m_op))
+			{
+				for (int value : m_snapshots[static_cast<size_t>(instruction.m_snapshot)].m_stack)
+				{
+					is_live[static_cast<size_t>(value)] = true;
+				}
+			}
+		}
+	}
+
+	// nullptr if the trace needs more registers than the allocator has
+	std::unique_ptr<Trace> Assemble(TraceCompiler& trace_compiler) noexcept
+	{
+		struct PendingExit
+		{
+			X64Assembler::Label m_label;
+			int m_snapshot;
+			std::vector<int> m_registers; // per snapshot slot, -1 for constants
+		};
+
+		constexpr X64Register bp = BASE_POINTER_REGISTER;
+		constexpr X64Register rax = X64Register::RAX;
+		constexpr X64Register rcx = X64Register::RCX;
+
+		size_t instruction_count = m_instructions.size();
+		std::unique_ptr<Trace> trace = std::make_unique<Trace>();
+
+		// liveness over the surviving instructions, side exits keep their values alive until the guard
+		std::vector<int> last_uses(instruction_count, -1);
+		std::vector<int> use_counts(instruction_count, 0);
+		const auto for_each_use = [this](size_t index, auto&& callback) -> void
+			{
+				const TraceInstruction& instruction = m_instructions[index];
+				for (int operand : { instruction.m_left, instruction.m_right })
+				{
+					if (operand >= 0)
+					{
+						callback(operand);
+					}
+				}
+				if (IsGuard(instruction.m_op))
+				{
+					for (int value : m_snapshots[static_cast<size_t>(instruction.m_snapshot)].m_stack)
+					{
+						callback(value);
+					}
+				}
+			};
+		for (size_t i = 0u; i < instruction_count; i += 1u)
+		{
+			if (!m_instructions[i].m_is_dead)
+			{
+				for_each_use(i, [&](int value) -> void
+					{
+						last_uses[static_cast<size_t>(value)] = static_cast<int>(i);
+						use_counts[static_cast<size_t>(value)] += 1;
+					});
+			}
+		}
+
+		X64Assembler assembler;
+		X64Assembler::Label loop_label = assembler.CreateLabel();
+		X64Assembler::Label entry_exit_label = assembler.CreateLabel();
+		X64Assembler::Label epilogue_label = assembler.CreateLabel();
+		std::vector<PendingExit> pending_exits;
+		std::vector<int> value_registers(instruction_count, -1);
+		std::array<int, 16> register_owners;
+		register_owners.fill(-1);
+
+		const auto is_constant = [this](int value) -> bool
+			{
+				return m_instructions[static_cast<size_t>(value)].m_op == TraceOp::CONSTANT;
+			};
+		const auto constant_bits = [this](int value) -> int64_t
+			{
+				return m_instructions[static_cast<size_t>(value)].m_immediate;
+			};
+		const auto immediate32 = [&](int value) -> std::optional<int32_t>
+			{
+				if (is_constant(value) && constant_bits(value) >= INT32_MIN && constant_bits(value) <= INT32_MAX)
+				{
+					return static_cast<int32_t>(constant_bits(value));
+				}
+				return std::nullopt;
+			};
+		const auto allocate = [&](size_t value) -> std::optional<X64Register>
+			{
+				for (X64Register reg : ALLOCATABLE_REGISTERS)
+				{
+					int& owner = register_owners[static_cast<size_t>(reg)];
+					if (owner == -1)
+					{
+						owner = static_cast<int>(value);
+						value_registers[value] = static_cast<int>(reg);
+						return reg;
+					}
+				}
+				return std::nullopt;
+			};
+		// the register holding a value, constants are materialized into the scratch register
+		const auto operand = [&](int value, X64Register scratch) -> X64Register
+			{
+				if (is_constant(value))
+				{
+					assembler.MovRegImm64(scratch, static_cast<uint64_t>(constant_bits(value)));
+					return scratch;
+				}
+				return static_cast<X64Register>(value_registers[static_cast<size_t>(value)]);
+			};
+		const auto create_exit = [&](int snapshot) -> X64Assembler::Label
+			{
+				PendingExit pending_exit{ assembler.CreateLabel(), snapshot, {} };
+				for (int value : m_snapshots[static_cast<size_t>(snapshot)].m_stack)
+				{
+					pending_exit.m_registers.emplace_back(is_constant(value) ? -1 : value_registers[static_cast<size_t>(value)]);
+				}
+				pending_exits.emplace_back(std::move(pending_exit));
+				return pending_exits.back().m_label;
+			};
+		// the guard consuming a comparison right away is folded into its conditional jump
+		const auto fused_guard = [&](size_t index) -> std::optional<size_t>
+			{
+				if (use_counts[index] != 1)
+				{
+					return std::nullopt;
+				}
+				for (size_t next = index + 1u; next < instruction_count; next += 1u)
+				{
+					const TraceInstruction& instruction = m_instructions[next];
+					if (instruction.m_is_dead || instruction.m_op == TraceOp::CONSTANT)
+					{
+						continue;
+					}
+					if (IsGuard(instruction.m_op) && instruction.m_left == static_cast<int>(index))
+					{
+						return next;
+					}
+					return std::nullopt;
+				}
+				return std::nullopt;
+			};
+
+		for (X64Register reg : CALLEE_SAVED_REGISTERS)
+		{
+			assembler.Push(reg);
+		}
+		assembler.MovRegReg(bp, X64Register::RDI);
+
+		for (const EntryGuard& entry_guard : m_entry_guards)
+		{
+			X64Register base = bp;
+			int displacement = entry_guard.m_index * s_value_size;
+			if (entry_guard.m_is_global)
+			{
+				assembler.MovRegImm64(rax, reinterpret_cast<uint64_t>(&m_global_vars[static_cast<size_t>(entry_guard.m_index)]));
+				base = rax;
+				displacement = 0;
+			}
+			assembler.ArithmeticByteMemImm8(X64ArithmeticOp::CMP, base, displacement + s_type_tag_offset, GetTag(entry_guard.m_type));
+			assembler.JumpIf(X64Condition::NOT_EQUAL, entry_exit_label);
+		}
+
+		assembler.BindLabel(loop_label);
+		std::optional<size_t> pending_fused_guard;
+		for (size_t i = 0u; i < instruction_count; i += 1u)
+		{
+			const TraceInstruction& instruction = m_instructions[i];
+			if (instruction.m_is_dead || instruction.m_op == TraceOp::CONSTANT)
+			{
+				continue;
+			}
+
+			std::optional<X64Register> destination;
+			if (!HasSideEffect(instruction.m_op) && !(instruction.m_op == TraceOp::COMPARE && fused_guard(i).has_value()))
+			{
+				destination = allocate(i);
+				if (!destination.has_value())
+				{
+					return nullptr;
+				}
+			}
+
+			// the result register starts out as a copy of the left operand
+			const auto load_left = [&]() -> void
+				{
+					if (is_constant(instruction.m_left))
+					{
+						assembler.MovRegImm64(*destination, static_cast<uint64_t>(constant_bits(instruction.m_left)));
+					}
+					else
+					{
+						assembler.MovRegReg(*destination, static_cast<X64Register>(value_registers[static_cast<size_t>(instruction.m_left)]));
+					}
+				};
+
+			switch (instruction.m_op)
+			{
+			case TraceOp::LOAD_LOCAL:
+			case TraceOp::LOAD_GLOBAL:
+			{
+				X64Register base = bp;
+				int displacement = static_cast<int>(instruction.m_immediate) * s_value_size;
+				if (instruction.m_op == TraceOp::LOAD_GLOBAL)
+				{
+					assembler.MovRegImm64(rax, reinterpret_cast<uint64_t>(&m_global_vars[static_cast<size_t>(instruction.m_immediate)]));
+					base = rax;
+					displacement = 0;
+				}
+
+				// only the first byte of a bool payload is meaningful
+				if (instruction.m_type == TraceType::BOOL)
+				{
+					assembler.MovzxRegByteMem(*destination, base, displacement);
+				}
+				else
+				{
+					assembler.MovRegMem(*destination, base, displacement);
+				}
+				break;
+			}
+			case TraceOp::STORE_LOCAL:
+			case TraceOp::STORE_GLOBAL:
+			{
+				X64Register base = bp;
+				int displacement = static_cast<int>(instruction.m_immediate) * s_value_size;
+				if (instruction.m_op == TraceOp::STORE_GLOBAL)
+				{
+					assembler.MovRegImm64(rcx, reinterpret_cast<uint64_t>(&m_global_vars[static_cast<size_t>(instruction.m_immediate)]));
+					base = rcx;
+					displacement = 0;
+				}
+				assembler.MovMemReg(base, displacement, operand(instruction.m_left, rax));
+				assembler.MovByteMemImm8(base, displacement + s_type_tag_offset, GetTag(instruction.m_type));
+				break;
+			}
+			case TraceOp::ADD:
+			case TraceOp::SUBTRACT:
+			case TraceOp::MULTIPLY:
+			case TraceOp::DIVIDE:
+			case TraceOp::BITWISE_AND:
+			case TraceOp::BITWISE_OR:
+			case TraceOp::BITWISE_XOR:
+			{
+				if (instruction.m_type == TraceType::FRACTION)
+				{
+					assembler.MovqXmmReg(0, operand(instruction.m_left, rax));
+					assembler.MovqXmmReg(1, operand(instruction.m_right, rcx));
+					assembler.ScalarDoubleRegReg(GetScalarDoubleOp(instruction.m_op), 0, 1);
+					assembler.MovqRegXmm(*destination, 0);
+					break;
+				}
+				if (instruction.m_op == TraceOp::DIVIDE)
+				{
+					EmitDivision(assembler, instruction, operand, *destination);
+					break;
+				}
+
+				load_left();
+				std::optional<int32_t> right_immediate = immediate32(instruction.m_right);
+				if (instruction.m_op == TraceOp::MULTIPLY)
+				{
+					if (right_immediate.has_value())
+					{
+						assembler.ImulRegRegImm32(*destination, *destination, *right_immediate);
+					}
+					else
+					{
+						assembler.ImulRegReg(*destination, operand(instruction.m_right, rcx));
+					}
+					break;
+				}
+
+				X64ArithmeticOp arithmetic_op = GetArithmeticOp(instruction.m_op);
+				if (right_immediate.has_value())
+				{
+					assembler.ArithmeticRegImm32(arithmetic_op, *destination, *right_immediate);
+				}
+				else
+				{
+					assembler.ArithmeticRegReg(arithmetic_op, *destination, operand(instruction.m_right, rcx));
+				}
+				break;
+			}
+			case TraceOp::MODULO:
+			{
+				EmitDivision(assembler, instruction, operand, *destination);
+				break;
+			}
+			case TraceOp::LEFT_SHIFT:
+			case TraceOp::RIGHT_SHIFT:
+			{
+				X64Register count = operand(instruction.m_right, rcx);
+				if (count != rcx)
+				{
+					assembler.MovRegReg(rcx, count);
+				}
+				load_left();
+				if (instruction.m_op == TraceOp::LEFT_SHIFT)
+				{
+					assembler.ShiftLeftRegCl(*destination);
+				}
+				else
+				{
+					assembler.ShiftRightArithmeticRegCl(*destination);
+				}
+				break;
+			}
+			case TraceOp::BITWISE_NOT:
+			{
+				load_left();
+				assembler.NotReg(*destination);
+				break;
+			}
+			case TraceOp::NEGATE:
+			{
+				load_left();
+				if (instruction.m_type == TraceType::FRACTION)
+				{
+					assembler.MovRegImm64(rax, 1ull << 63);
+					assembler.ArithmeticRegReg(X64ArithmeticOp::XOR, *destination, rax);
+				}
+				else
+				{
+					assembler.NegReg(*destination);
+				}
+				break;
+			}
+			case TraceOp::NOT:
+			{
+				load_left();
+				assembler.ArithmeticRegImm32(X64ArithmeticOp::XOR, *destination, 1);
+				break;
+			}
+			case TraceOp::CONVERT:
+			{
+				if (instruction.m_type == TraceType::FRACTION)
+				{
+					assembler.ConvertIntegerToScalarDouble(0, operand(instruction.m_left, rax));
+					assembler.MovqRegXmm(*destination, 0);
+				}
+				else
+				{
+					assembler.MovqXmmReg(0, operand(instruction.m_left, rax));
+					assembler.ConvertScalarDoubleToInteger(*destination, 0);
+				}
+				break;
+			}
+			case TraceOp::COMPARE:
+			{
+				NumericComparison comparison = static_cast<NumericComparison>(instruction.m_immediate);
+				std::optional<size_t> guard_index = fused_guard(i);
+
+				// the condition that holds when the comparison is true
+				X64Condition condition;
+				if (instruction.m_type == TraceType::FRACTION)
+				{
+					assembler.MovqXmmReg(0, operand(instruction.m_left, rax));
+					assembler.MovqXmmReg(1, operand(instruction.m_right, rcx));
+					assembler.SetFractionComparison(comparison);
+					if (guard_index.has_value())
+					{
+						assembler.TestByteRegReg(rax, rax);
+					}
+					condition = X64Condition::NOT_EQUAL;
+				}
+				else
+				{
+					X64Register left = operand(instruction.m_left, rax);
+					if (std::optional<int32_t> right_immediate = immediate32(instruction.m_right))
+					{
+						assembler.ArithmeticRegImm32(X64ArithmeticOp::CMP, left, *right_immediate);
+					}
+					else
+					{
+						assembler.ArithmeticRegReg(X64ArithmeticOp::CMP, left, operand(instruction.m_right, rcx));
+					}
+					condition = X64Assembler::GetIntegerCondition(comparison);
+					if (!guard_index.has_value())
+					{
+						assembler.SetConditionByte(condition, rax);
+					}
+				}
+
+				if (guard_index.has_value())
+				{
+					const TraceInstruction& guard = m_instructions[*guard_index];
+					X64Condition exit_condition = guard.m_op == TraceOp::GUARD_TRUE ? X64Assembler::NegateCondition(condition) : condition;
+					assembler.JumpIf(exit_condition, create_exit(guard.m_snapshot));
+					pending_fused_guard = guard_index;
+				}
+				else
+				{
+					assembler.MovzxRegByteReg(*destination, rax);
+				}
+				break;
+			}
+			case TraceOp::GUARD_TRUE:
+			case TraceOp::GUARD_FALSE:
+			{
+				if (pending_fused_guard == i)
+				{
+					pending_fused_guard.reset();
+					break;
+				}
+
+				X64Register condition = operand(instruction.m_left, rax);
+				assembler.TestRegReg(condition, condition);
+				assembler.JumpIf(instruction.m_op == TraceOp::GUARD_TRUE ? X64Condition::EQUAL : X64Condition::NOT_EQUAL, create_exit(instruction.m_snapshot));
+				break;
+			}
+			default:
+			{
+				break; // unreachable
+			}
+			}
+
+			// operands whose last use this was give their registers back
+			for_each_use(i, [&](int value) -> void
+				{
+					int& reg = value_registers[static_cast<size_t>(value)];
+					if (last_uses[static_cast<size_t>(value)] == static_cast<int>(i) && reg != -1)
+					{
+						register_owners[static_cast<size_t>(reg)] = -1;
+						reg = -1;
+					}
+				});
+		}
+
+		// every value of an iteration is dead by now, the next one reloads what it needs from the frame
+		assembler.MovRegImm64(rax, reinterpret_cast<uint64_t>(&trace->m_iterations));
+		assembler.IncrementMem(rax, 0);
+		assembler.Jump(loop_label);
+
+		trace->m_side_exits.emplace_back(SideExit{ m_loop_header, m_header_depth });
+		assembler.BindLabel(entry_exit_label);
+		assembler.MovRegImm64(rax, 0u);
+		assembler.Jump(epilogue_label);
+
+		for (const PendingExit& pending_exit : pending_exits)
+		{
+			const Snapshot& snapshot = m_snapshots[static_cast<size_t>(pending_exit.m_snapshot)];
+			assembler.BindLabel(pending_exit.m_label);
+			for (size_t k = 0u; k < snapshot.m_stack.size(); k += 1u)
+			{
+				int value = snapshot.m_stack[k];
+				int displacement = (m_header_depth + static_cast<int>(k)) * s_value_size;
+				X64Register source = pending_exit.m_registers[k] == -1 ? operand(value, rax) : static_cast<X64Register>(pending_exit.m_registers[k]);
+				assembler.MovMemReg(bp, displacement, source);
+				assembler.MovByteMemImm8(bp, displacement + s_type_tag_offset, GetTag(GetResultType(m_instructions[static_cast<size_t>(value)])));
+			}
+
+			assembler.MovRegImm64(rax, static_cast<uint64_t>(trace->m_side_exits.size()));
+			assembler.Jump(epilogue_label);
+			trace->m_side_exits.emplace_back(SideExit{ snapshot.m_resume_address, m_header_depth + static_cast<int>(snapshot.m_stack.size()) });
+		}
+
+		assembler.BindLabel(epilogue_label);
+		for (auto it = CALLEE_SAVED_REGISTERS.rbegin(); it != CALLEE_SAVED_REGISTERS.rend(); ++it)
+		{
+			assembler.Pop(*it);
+		}
+		assembler.Ret();
+
+		void* code_address = trace_compiler.InstallCode(assembler.Finalize());
+		if (code_address == nullptr)
+		{
+			return nullptr;
+		}
+
+		trace->m_entry = reinterpret_cast<NativeTrace>(code_address);
+		trace->m_max_stack_depth = m_max_stack_depth;
+		return trace;
+	}
+
+private:
+
+	static uint8_t GetTag(TraceType type)
+	{
+		switch (type)
+		{
+		case TraceType::INTEGER:
+			return MidoriValue::MidoriValueTypeTag::Integer;
+		case TraceType::FRACTION:
+			return MidoriValue::MidoriValueTypeTag::Fraction;
+		default:
+			return MidoriValue::MidoriValueTypeTag::Bool;
+		}
+	}
+
+	static std::optional<TraceType> GetTraceType(const MidoriValue& value)
+	{
+		if (value.IsInteger())
+		{
+			return TraceType::INTEGER;
+		}
+		else if (value.IsFraction())
+		{
+			return TraceType::FRACTION;
+		}
+		else if (value.IsBool())
+		{
+			return TraceType::BOOL;
+		}
+		return std::nullopt;
+	}
+
+	static int64_t GetBits(const MidoriValue& value)
+	{
+		if (value.IsInteger())
+		{
+			return value.GetInteger();
+		}
+		else if (value.IsFraction())
+		{
+			return FractionBits(value.GetFraction());
+		}
+		return value.GetBool() ? 1 : 0;
+	}
+
+	static X64ArithmeticOp GetArithmeticOp(TraceOp op)
+	{
+		switch (op)
+		{
+		case TraceOp::ADD:
+			return X64ArithmeticOp::ADD;
+		case TraceOp::SUBTRACT:
+			return X64ArithmeticOp::SUB;
+		case TraceOp::BITWISE_AND:
+			return X64ArithmeticOp::AND;
+		case TraceOp::BITWISE_OR:
+			return X64ArithmeticOp::OR;
+		default:
+			return X64ArithmeticOp::XOR;
+		}
+	}
+
+	static X64ScalarDoubleOp GetScalarDoubleOp(TraceOp op)
+	{
+		switch (op)
+		{
+		case TraceOp::ADD:
+			return X64ScalarDoubleOp::ADD;
+		case TraceOp::SUBTRACT:
+			return X64ScalarDoubleOp::SUBTRACT;
+		case TraceOp::MULTIPLY:
+			return X64ScalarDoubleOp::MULTIPLY;
+		default:
+			return X64ScalarDoubleOp::DIVIDE;
+		}
+	}
+
+	template<typename OperandFunction>
+	static void EmitDivision(X64Assembler& assembler, const TraceInstruction& instruction, const OperandFunction& operand, X64Register destination)
+	{
+		X64Register dividend = operand(instruction.m_left, X64Register::RAX);
+		if (dividend != X64Register::RAX)
+		{
+			assembler.MovRegReg(X64Register::RAX, dividend);
+		}
+		assembler.Cqo();
+		assembler.IdivReg(operand(instruction.m_right, X64Register::RCX));
+		assembler.MovRegReg(destination, instruction.m_op == TraceOp::DIVIDE ? X64Register::RAX : X64Register::RDX);
+	}
+
+	int Emit(TraceInstruction instruction, int64_t recorded_value) noexcept
+	{
+		m_instructions.emplace_back(instruction);
+		m_recorded_values.emplace_back(recorded_value);
+		return static_cast<int>(m_instructions.size() - 1u);
+	}
+
+	int EmitConstant(TraceType type, int64_t bits) noexcept
+	{
+		return Emit(TraceInstruction{ TraceOp::CONSTANT, type, -1, -1, bits }, bits);
+	}
+
+	int EmitOperation(TraceOp op, TraceType type, int left, int right, int64_t immediate = 0) noexcept
+	{
+		bool is_unary = IsUnary(op);
+		if (left < 0 || (!is_unary && right < 0))
+		{
+			m_is_aborted = true;
+			return -1;
+		}
+
+		// the operands have to carry the types the bytecode expects
+		TraceType operand_type = op == TraceOp::NOT ? TraceType::BOOL : type;
+		if (op == TraceOp::CONVERT)
+		{
+			operand_type = type == TraceType::FRACTION ? TraceType::INTEGER : TraceType::FRACTION;
+		}
+		if (GetResultType(m_instructions[static_cast<size_t>(left)]) != operand_type
+			|| (!is_unary && GetResultType(m_instructions[static_cast<size_t>(right)]) != operand_type))
+		{
+			m_is_aborted = true;
+			return -1;
+		}
+
+		TraceInstruction instruction{ op, type, left, is_unary ? -1 : right, immediate };
+		std::optional<int64_t> value = Evaluate(instruction, m_recorded_values[static_cast<size_t>(left)], is_unary ? 0 : m_recorded_values[static_cast<size_t>(right)]);
+		if (!value.has_value())
+		{
+			// let the interpreter report the fault
+			m_is_aborted = true;
+			return -1;
+		}
+
+		return Emit(instruction, *value);
+	}
+
+	int EmitComparison(NumericComparison comparison, TraceType type, int left, int right) noexcept
+	{
+		return EmitOperation(TraceOp::COMPARE, type, left, right, static_cast<int64_t>(comparison));
+	}
+
+	// records the direction the iteration takes and leaves through a guard when a later one goes the other way
+	void Guard(int condition, bool value, const OpCode* exit_address) noexcept
+	{
+		if (condition < 0 || GetResultType(m_instructions[static_cast<size_t>(condition)]) != TraceType::BOOL)
+		{
+			m_is_aborted = true;
+			return;
+		}
+
+		m_snapshots.emplace_back(Snapshot{ exit_address, m_stack });
+		TraceInstruction guard{ value ? TraceOp::GUARD_TRUE : TraceOp::GUARD_FALSE, TraceType::BOOL, condition };
+		guard.m_snapshot = static_cast<int>(m_snapshots.size() - 1u);
+		Emit(guard, 0);
+	}
+
+	// IF_* falls through when the comparison holds and jumps over the body otherwise
+	void RecordConditionalJump(int comparison, const OpCode*& instruction_pointer, int offset) noexcept
+	{
+		if (comparison < 0)
+		{
+			m_is_aborted = true;
+			return;
+		}
+
+		bool holds = m_recorded_values[static_cast<size_t>(comparison)] != 0;
+		Guard(comparison, holds, holds ? instruction_pointer + offset : instruction_pointer);
+		if (!holds)
+		{
+			instruction_pointer += offset;
+		}
+	}
+
+	void Push(int value) noexcept
+	{
+		if (value < 0)
+		{
+			m_is_aborted = true;
+			return;
+		}
+
+		m_stack.emplace_back(value);
+		m_max_stack_depth = std::max(m_max_stack_depth, m_header_depth + static_cast<int>(m_stack.size()));
+	}
+
+	// values below the loop header depth belong to the enclosing code and stay in the frame
+	int Pop() noexcept
+	{
+		if (m_stack.empty())
+		{
+			m_is_aborted = true;
+			return -1;
+		}
+
+		int value = m_stack.back();
+		m_stack.pop_back();
+		return value;
+	}
+
+	int Peek() noexcept
+	{
+		if (m_stack.empty())
+		{
+			m_is_aborted = true;
+			return -1;
+		}
+
+		return m_stack.back();
+	}
+
+	// the first read of a slot loads it from the frame behind a type guard, later reads reuse the value
+	int GetLocal(int slot) noexcept
+	{
+		if (slot >= m_header_depth)
+		{
+			size_t index = static_cast<size_t>(slot - m_header_depth);
+			if (index >= m_stack.size())
+			{
+				m_is_aborted = true;
+				return -1;
+			}
+			return m_stack[index];
+		}
+
+		if (std::unordered_map<int, int>::const_iterator it = m_local_values.find(slot); it != m_local_values.cend())
+		{
+			return it->second;
+		}
+
+		return Load(false, slot, m_base_pointer[slot]);
+	}
+
+	void SetLocal(int slot, int value) noexcept
+	{
+		if (value < 0)
+		{
+			m_is_aborted = true;
+			return;
+		}
+
+		if (slot >= m_header_depth)
+		{
+			size_t index = static_cast<size_t>(slot - m_header_depth);
+			if (index >= m_stack.size())
+			{
+				m_is_aborted = true;
+				return;
+			}
+			m_stack[index] = value;
+			return;
+		}
+
+		Store(false, slot, value);
+		m_local_values[slot] = value;
+	}
+
+	int GetGlobal(int index) noexcept
+	{
+		if (std::unordered_map<int, int>::const_iterator it = m_global_values.find(index); it != m_global_values.cend())
+		{
+			return it->second;
+		}
+
+		return Load(true, index, m_global_vars[static_cast<size_t>(index)]);
+	}
+
+	void SetGlobal(int index, int value) noexcept
+	{
+		if (value < 0)
+		{
+			m_is_aborted = true;
+			return;
+		}
+
+		Store(true, index, value);
+		m_global_values[index] = value;
+	}
+
+	int Load(bool is_global, int index, const MidoriValue& observed_value) noexcept
+	{
+		std::optional<TraceType> type = GetTraceType(observed_value);
+		if (!type.has_value())
+		{
+			m_is_aborted = true;
+			return -1;
+		}
+
+		m_entry_guards.emplace_back(EntryGuard{ is_global, index, *type });
+		int value = Emit(TraceInstruction{ is_global ? TraceOp::LOAD_GLOBAL : TraceOp::LOAD_LOCAL, *type, -1, -1, index }, GetBits(observed_value));
+		(is_global ? m_global_values : m_local_values)[index] = value;
+		return value;
+	}
+
+	// stores are written through, so that a side exit never has to reconstruct the frame
+	void Store(bool is_global, int index, int value) noexcept
+	{
+		TraceType type = GetResultType(m_instructions[static_cast<size_t>(value)]);
+
+		// the next iteration loads the slot behind the guard recorded for this one
+		std::vector<EntryGuard>::const_iterator entry_guard = std::ranges::find_if(m_entry_guards, [is_global, index](const EntryGuard& guard) -> bool
+			{
+				return guard.m_is_global == is_global && guard.m_index == index;
+			});
+		if (entry_guard != m_entry_guards.cend() && entry_guard->m_type != type)
+		{
+			m_is_aborted = true;
+			return;
+		}
+
+		Emit(TraceInstruction{ is_global ? TraceOp::STORE_GLOBAL : TraceOp::STORE_LOCAL, type, value, -1, index }, 0);
+	}
+};
+
+TraceCompiler::TraceCompiler(std::vector<MidoriValue>& global_vars) noexcept
+	: m_global_vars(global_vars)
+{
+}
+
+TraceCompiler::~TraceCompiler()
+{
+	for (const CodeRegion& region : m_code_regions)
+	{
+		munmap(region.m_address, region.m_size);
+	}
+}
+
+TraceCompiler::SideExit TraceCompiler::Run(Trace& trace, MidoriValue* base_pointer) noexcept
+{
+	int exit_index = trace.m_entry(base_pointer);
+
+	trace.m_entries += 1u;
+	if (trace.m_entries == s_blacklist_sample_size && trace.m_iterations < s_blacklist_sample_size * s_min_iterations_per_entry) [[unlikely]]
+		{
+			trace.m_is_blacklisted = true;
+		}
+
+	return trace.m_side_exits[static_cast<size_t>(exit_index)];
+}
+
+std::unique_ptr<TraceCompiler::Trace> TraceCompiler::Record(const OpCode* loop_header, MidoriValue* base_pointer, MidoriValue* stack_pointer) noexcept
+{
+	TraceBuilder builder(m_global_vars, loop_header, base_pointer, stack_pointer);
+	if (!builder.Record())
+	{
+		return nullptr;
+	}
+
+	builder.Optimize();
+	return builder.Assemble(*this);
+}
+
+void* TraceCompiler::InstallCode(const std::vector<uint8_t>& code) noexcept
+{
+	size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t region_size = (code.size() + page_size - 1u) / page_size * page_size;
+
+	void* address = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (address == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	std::memcpy(address, code.data(), code.size());
+	if (mprotect(address, region_size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(address, region_size);
+		return nullptr;
+	}
+
+	m_code_regions.emplace_back(CodeRegion{ address, region_size });
+	return address;
+}
+#endif
@@ -0,0 +1,117 @@
+#ifdef MIDORI_TRACING_JIT
+#pragma once
+
+#include "Common/Executable/Executable.h"
+#include "Common/Value/Value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#ifndef MIDORI_TRACE_THRESHOLD
+#define MIDORI_TRACE_THRESHOLD 100
+#endif
+
+// Tracing JIT for loop-dominated code.
+// Once a loop header has been reached through enough backward jumps, one iteration of the loop is recorded as a
+// linear trace of typed operations that follows the branches actually taken. The trace is optimized (constant
+// folding, redundant guard elimination, store-to-load forwarding, no operand stack traffic) and compiled into a
+// native loop that keeps iterating until one of its guards fails; the interpreter then resumes at the bytecode
+// the guard stands for.
+class TraceCompiler
+{
+public:
+	// iterates the loop until a guard fails and returns the index of the side exit taken
+	using NativeTrace = int(*)(MidoriValue* base_pointer);
+
+	struct SideExit
+	{
+		const OpCode* m_resume_address;
+		int m_stack_depth; // relative to the base pointer, values above the loop header depth are written back by the trace
+	};
+
+	struct Trace
+	{
+		NativeTrace m_entry = nullptr;
+		std::vector<SideExit> m_side_exits;
+		int m_max_stack_depth = 0;
+		uint64_t m_entries = 0u;
+		uint64_t m_iterations = 0u; // incremented by the native loop on every back edge
+		bool m_is_blacklisted = false;
+	};
+
+private:
+	static constexpr int s_recording_threshold = MIDORI_TRACE_THRESHOLD;
+	static_assert(s_recording_threshold > 0, "MIDORI_TRACE_THRESHOLD must be positive.");
+	static constexpr int s_max_recording_attempts = 3;
+
+	// a trace that leaves almost as often as it is entered costs more than it saves
+	static constexpr uint64_t s_blacklist_sample_size = 1000u;
+	static constexpr uint64_t s_min_iterations_per_entry = 2u;
+
+	struct LoopProfile
+	{
+		int m_hotness = 0;
+		int m_recording_attempts = 0;
+		std::unique_ptr<Trace> m_trace;
+	};
+
+	struct CodeRegion
+	{
+		void* m_address;
+		size_t m_size;
+	};
+
+	// records, optimizes and assembles a single trace
+	class TraceBuilder;
+
+	std::vector<MidoriValue>& m_global_vars;
+	std::unordered_map<const OpCode*, LoopProfile> m_loops;
+	std::vector<CodeRegion> m_code_regions;
+
+public:
+
+	TraceCompiler(std::vector<MidoriValue>& global_vars) noexcept;
+
+	~TraceCompiler();
+
+	TraceCompiler(const TraceCompiler&) = delete;
+
+	TraceCompiler& operator=(const TraceCompiler&) = delete;
+
+	// Counts one backward jump to a loop header and records a trace once the loop is hot.
+	// Returns nullptr while the loop is interpreted.
+	Trace* OnBackEdge(const OpCode* loop_header, MidoriValue* base_pointer, MidoriValue* stack_pointer) noexcept
+	{
+		LoopProfile& profile = m_loops[loop_header];
+		if (profile.m_trace != nullptr) [[likely]]
+			{
+				return profile.m_trace->m_is_blacklisted ? nullptr : profile.m_trace.get();
+			}
+
+		if (profile.m_hotness < s_recording_threshold && ++profile.m_hotness == s_recording_threshold) [[unlikely]]
+			{
+				profile.m_trace = Record(loop_header, base_pointer, stack_pointer);
+				if (profile.m_trace == nullptr && ++profile.m_recording_attempts < s_max_recording_attempts)
+				{
+					// the next iteration may take a path that can be traced
+					profile.m_hotness = 0;
+				}
+			}
+
+		return profile.m_trace.get();
+	}
+
+	// runs the trace from the loop header and returns where the interpreter picks up
+	SideExit Run(Trace& trace, MidoriValue* base_pointer) noexcept;
+
+private:
+
+	// nullptr if the iteration leaves the loop, runs into an operation traces do not cover, or is unstable in type
+	std::unique_ptr<Trace> Record(const OpCode* loop_header, MidoriValue* base_pointer, MidoriValue* stack_pointer) noexcept;
+
+	void* InstallCode(const std::vector<uint8_t>& code) noexcept;
+};
+#endif
@@ -0,0 +1,92 @@
+#include "GrowableStack.h"
+
+#include <algorithm>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	size_t GetPageSize() noexcept
+	{
+#if defined(_WIN32) || defined(_WIN64)
+		SYSTEM_INFO system_info;
+		GetSystemInfo(&system_info);
+		return static_cast<size_t>(system_info.dwPageSize);
+#else
+		return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	size_t RoundUpToPage(size_t bytes) noexcept
+	{
+		size_t page_size = GetPageSize();
+		return (bytes + page_size - 1u) / page_size * page_size;
+	}
+}
+
+StackMemory::StackMemory(size_t reserved_bytes, size_t initial_bytes) noexcept : m_reserved_bytes(RoundUpToPage(reserved_bytes))
+{
+#if defined(_WIN32) || defined(_WIN64)
+	m_base = VirtualAlloc(nullptr, m_reserved_bytes, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* address = mmap(nullptr, m_reserved_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	m_base = address == MAP_FAILED ? nullptr : address;
+#endif
+	if (m_base == nullptr)
+	{
+		m_reserved_bytes = 0u;
+		return;
+	}
+
+	Commit(initial_bytes);
+}
+
+StackMemory::~StackMemory()
+{
+	if (m_base == nullptr)
+	{
+		return;
+	}
+
+#if defined(_WIN32) || defined(_WIN64)
+	VirtualFree(m_base, 0u, MEM_RELEASE);
+#else
+	munmap(m_base, m_reserved_bytes);
+#endif
+}
+
+bool StackMemory::Commit(size_t min_bytes) noexcept
+{
+	if (min_bytes <= m_committed_bytes)
+	{
+		return true;
+	}
+	else if (min_bytes > m_reserved_bytes)
+	{
+		return false;
+	}
+
+	size_t new_committed_bytes = std::min(RoundUpToPage(std::max(min_bytes, m_committed_bytes * 2u)), m_reserved_bytes);
+	void* commit_begin = static_cast<char*>(m_base) + m_committed_bytes;
+	size_t commit_size = new_committed_bytes - m_committed_bytes;
+
+#if defined(_WIN32) || defined(_WIN64)
+	if (VirtualAlloc(commit_begin, commit_size, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+	{
+		return false;
+	}
+#else
+	if (mprotect(commit_begin, commit_size, PROT_READ | PROT_WRITE) != 0)
+	{
+		return false;
+	}
+#endif
+
+	m_committed_bytes = new_committed_bytes;
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+// Address space for the maximum size is reserved up front and pages are committed as the stack grows, so
+// elements never move: native frames, call frames and open cells keep pointing into the stack across growth.
+class StackMemory
+{
+private:
+	void* m_base = nullptr;
+	size_t m_reserved_bytes = 0u;
+	size_t m_committed_bytes = 0u;
+
+public:
+	StackMemory(size_t reserved_bytes, size_t initial_bytes) noexcept;
+
+	~StackMemory();
+
+	StackMemory(const StackMemory&) = delete;
+
+	StackMemory& operator=(const StackMemory&) = delete;
+
+	void* GetBase() const noexcept { return m_base; }
+
+	size_t GetCommittedBytes() const noexcept { return m_committed_bytes; }
+
+	// commits at least min_bytes, at least doubling what is committed; false past the reservation
+	bool Commit(size_t min_bytes) noexcept;
+};
+
+template<typename T>
+class GrowableStack
+{
+	static_assert(std::is_trivially_destructible_v<T>, "Stack slots are reused without being destroyed.");
+
+private:
+	StackMemory m_memory;
+	size_t m_max_size;
+
+public:
+	GrowableStack(size_t max_size, size_t initial_size) noexcept : m_memory(max_size * sizeof(T), initial_size * sizeof(T)), m_max_size(max_size) {}
+
+	T* GetBase() const noexcept { return static_cast<T*>(m_memory.GetBase()); }
+
+	// one past the last slot that can be written without growing
+	T* GetCommittedEnd() const noexcept { return GetBase() + m_memory.GetCommittedBytes() / sizeof(T); }
+
+	size_t GetMaxSize() const noexcept { return m_max_size; }
+
+	// false if the stack cannot hold size elements
+	bool Grow(size_t size) noexcept { return size <= m_max_size && m_memory.Commit(size * sizeof(T)); }
+};
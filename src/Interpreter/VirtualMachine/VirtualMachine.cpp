@@ -8,24 +8,77 @@
 #include <numeric>
 #include <execution>
 #include <format>
+#include <utility>
 
-VirtualMachine::VirtualMachine(MidoriExecutable&& executable) noexcept : m_executable(std::move(executable)), m_garbage_collector(m_executable.GetConstantRoots())
+// Threaded dispatch relies on the "labels as values" extension, which only GCC and Clang provide.
+// Every other toolchain falls back to the portable switch-based dispatch loop.
+#if defined(MIDORI_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define MIDORI_USE_COMPUTED_GOTO
+#endif
+
+#ifdef DEBUG
+#define VM_TRACE() PrintExecutionTrace()
+#else
+#define VM_TRACE() (void)0
+#endif
+
+#ifdef MIDORI_USE_COMPUTED_GOTO
+#define VM_LABEL(op) HANDLE_##op
+#define VM_CASE(op) case OpCode::op: VM_LABEL(op):
+#define VM_DISPATCH() \
+	do \
+	{ \
+		VM_TRACE(); \
+		instruction = ReadByte(); \
+		goto *dispatch_table[static_cast<size_t>(instruction)]; \
+	} while (false)
+#else
+#define VM_CASE(op) case OpCode::op:
+#define VM_DISPATCH() break
+#endif
+
+VirtualMachine::VirtualMachine(MidoriExecutable&& executable) noexcept : VirtualMachine(std::move(executable), StackLimits{})
+{}
+
+VirtualMachine::VirtualMachine(MidoriExecutable&& executable, StackLimits stack_limits) noexcept
+	: m_executable(std::move(executable)), m_garbage_collector(m_executable.GetHeap(), m_executable.GetConstantRoots()),
+	m_value_stack(stack_limits.m_max_value_stack_size, s_initial_value_stack_size),
+	m_call_stack(stack_limits.m_max_call_depth + 1u, s_initial_call_stack_size)
 {
+	if (m_value_stack.GetBase() == nullptr || m_call_stack.GetBase() == nullptr) [[unlikely]]
+		{
+			TerminateExecution("Failed to reserve memory for the stacks.\n");
+		}
+
+	MidoriHeap::Scope heap_scope(m_executable.GetHeap());
+
 	constexpr int runtime_startup_proc_index = 0;
-	MidoriTraceable* sentinel_closure = MidoriTraceable::AllocateTraceable(MidoriClosure());
+	MidoriTraceable* sentinel_closure = MidoriTraceable::AllocateTraceable(MidoriClosure{ MidoriClosure::Environment{}, runtime_startup_proc_index });
 
 	m_global_vars.resize(static_cast<size_t>(m_executable.GetGlobalVariableCount()));
-	m_instruction_pointer = &*m_executable.GetBytecodeStream(runtime_startup_proc_index).cbegin();
-	(*m_call_stack)[0u] = CallFrame{ nullptr, nullptr, nullptr, sentinel_closure };
+	m_procedure_entry_points.reserve(static_cast<size_t>(m_executable.GetProcedureCount()));
+	for (int i = 0; i < m_executable.GetProcedureCount(); i += 1)
+	{
+		m_procedure_entry_points.emplace_back(m_executable.GetBytecodeStream(i)[0]);
+	}
+
+	m_instruction_pointer = m_procedure_entry_points[static_cast<size_t>(runtime_startup_proc_index)];
+	*m_call_stack.GetBase() = CallFrame{ nullptr, nullptr, nullptr, sentinel_closure, &sentinel_closure->GetClosure().m_cell_values };
+	LoadForeignFunctions();
 }
 
 VirtualMachine::~VirtualMachine()
 {
 	m_garbage_collector.CleanUp();
+#ifndef MIDORI_STATIC_PRELUDE
+	if (m_library_handle != nullptr)
+	{
 #ifdef _WIN32
-	FreeLibrary(m_library_handle);
+		FreeLibrary(m_library_handle);
 #else
-	dlclose(m_library_handle);
+		dlclose(m_library_handle);
+#endif
+	}
 #endif
 }
 
@@ -99,6 +152,18 @@ MidoriInteger VirtualMachine::ReadIntegerConstant() noexcept
 	return value;
 }
 
+MidoriInteger VirtualMachine::ReadIntegerImmediate() noexcept
+{
+	int32_t value = *reinterpret_cast<const int32_t*>(m_instruction_pointer);
+	m_instruction_pointer += sizeof(int32_t);
+	return static_cast<MidoriInteger>(value);
+}
+
+MidoriValue& VirtualMachine::ReadRegister() noexcept
+{
+	return *(m_value_stack_base_pointer + static_cast<int>(ReadByte()));
+}
+
 MidoriFraction VirtualMachine::ReadFractionConstant() noexcept
 {
 	MidoriFraction value = *reinterpret_cast<const MidoriFraction*>(m_instruction_pointer);
@@ -151,11 +216,86 @@ std::string VirtualMachine::GenerateRuntimeError(std::string_view message, int l
 	return MidoriError::GenerateRuntimeError(message, line);
 }
 
-void VirtualMachine::PushCallFrame(ValueStackPointer return_bp, ValueStackPointer return_sp, InstructionPointer return_ip, MidoriTraceable* closure_ptr) noexcept
+void VirtualMachine::LoadForeignFunctions() noexcept
+{
+	int foreign_function_count = m_executable.GetForeignFunctionCount();
+	if (foreign_function_count == 0)
+	{
+		return;
+	}
+
+#ifndef MIDORI_STATIC_PRELUDE
+#ifdef _WIN32
+	m_library_handle = LoadLibrary("./MidoriStdLib.dll");
+#else
+	m_library_handle = dlopen("./libMidoriStdLib.so", RTLD_LAZY);
+#endif
+
+	if (m_library_handle == NULL) [[unlikely]]
+		{
+			TerminateExecution("Failed to load the standard library.");
+		}
+#endif
+
+	// unresolved functions are only reported when they are called
+	m_foreign_functions.reserve(static_cast<size_t>(foreign_function_count));
+	for (int i = 0; i < foreign_function_count; i += 1)
+	{
+		const char* foreign_function_name = m_executable.GetForeignFunction(i).GetCString();
+#if defined(MIDORI_STATIC_PRELUDE)
+		m_foreign_functions.emplace_back(FindPreludeFunction(foreign_function_name));
+#elif defined(_WIN32)
+		m_foreign_functions.emplace_back(reinterpret_cast<ForeignFunction>(GetProcAddress(m_library_handle, foreign_function_name)));
+#else
+		m_foreign_functions.emplace_back(reinterpret_cast<ForeignFunction>(dlsym(m_library_handle, foreign_function_name)));
+#endif
+	}
+}
+
+void VirtualMachine::CallForeignFunction(int foreign_index, int arity) noexcept
+{
+	ForeignFunction foreign_function = m_foreign_functions[static_cast<size_t>(foreign_index)];
+	if (foreign_function == nullptr) [[unlikely]]
+		{
+			TerminateExecution(GenerateRuntimeError(std::format("Failed to load foreign function '{}'.", m_executable.GetForeignFunction(foreign_index).GetCString()), GetLine()));
+		}
+
+	ValueStackPointer args = m_value_stack_pointer - arity;
+	MidoriValue return_val;
+	foreign_function(args, &return_val);
+
+	// a nullary function has no argument to overwrite, its result may need a slot beyond the committed stack
+	m_value_stack_pointer = args;
+	Push(return_val);
+}
+
+bool VirtualMachine::GrowValueStack(ValueStackPointer required_end) noexcept
+{
+	if (!m_value_stack.Grow(static_cast<size_t>(required_end - m_value_stack_begin)))
+	{
+		return false;
+	}
+
+	m_value_stack_end = m_value_stack.GetCommittedEnd() - 1;
+	return true;
+}
+
+bool VirtualMachine::GrowCallStack() noexcept
+{
+	if (!m_call_stack.Grow(static_cast<size_t>(m_call_stack_pointer - m_call_stack.GetBase()) + 1u))
+	{
+		return false;
+	}
+
+	m_call_stack_end = m_call_stack.GetCommittedEnd() - 1;
+	return true;
+}
+
+void VirtualMachine::PushCallFrame(ValueStackPointer return_bp, ValueStackPointer return_sp, InstructionPointer return_ip, MidoriTraceable* closure_ptr, const MidoriClosure::Environment* environment) noexcept
 {
-	if (m_call_stack_pointer <= m_call_stack_end) [[likely]]
+	if (m_call_stack_pointer <= m_call_stack_end || GrowCallStack()) [[likely]]
 		{
-			*m_call_stack_pointer = { return_bp, return_sp, return_ip, closure_ptr };
+			*m_call_stack_pointer = { return_bp, return_sp, return_ip, closure_ptr, environment };
 			++m_call_stack_pointer;
 			return;
 		}
@@ -165,6 +305,99 @@ void VirtualMachine::PushCallFrame(ValueStackPointer return_bp, ValueStackPointe
 		}
 }
 
+void VirtualMachine::CallClosure(MidoriTraceable* closure_ptr, int arity) noexcept
+{
+	MidoriClosure& closure = closure_ptr->GetClosure();
+	m_curr_environment = &closure.m_cell_values;
+
+	// Return address := pop all the arguments and the callee
+	PushCallFrame(m_value_stack_base_pointer, m_value_stack_pointer - arity, m_instruction_pointer, closure_ptr, m_curr_environment);
+
+	m_instruction_pointer = m_procedure_entry_points[static_cast<size_t>(closure.m_proc_index)];
+	m_value_stack_base_pointer = m_value_stack_pointer - arity;
+
+#ifdef MIDORI_JIT
+	m_curr_procedure_index = closure.m_proc_index;
+	(m_call_stack_pointer - 1)->m_proc_index = m_curr_procedure_index;
+	if (const JitCompiler::NativeProcedure* native_procedure = m_jit_compiler.Profile(closure.m_proc_index))
+	{
+		TryEnterNativeCode(*native_procedure, 0);
+	}
+#endif
+}
+
+void VirtualMachine::CallDirect(int proc_index, int arity) noexcept
+{
+	m_curr_environment = &m_empty_environment;
+
+	PushCallFrame(m_value_stack_base_pointer, m_value_stack_pointer - arity, m_instruction_pointer, nullptr, m_curr_environment);
+
+	m_instruction_pointer = m_procedure_entry_points[static_cast<size_t>(proc_index)];
+	m_value_stack_base_pointer = m_value_stack_pointer - arity;
+
+#ifdef MIDORI_JIT
+	m_curr_procedure_index = proc_index;
+	(m_call_stack_pointer - 1)->m_proc_index = m_curr_procedure_index;
+	if (const JitCompiler::NativeProcedure* native_procedure = m_jit_compiler.Profile(proc_index))
+	{
+		TryEnterNativeCode(*native_procedure, 0);
+	}
+#endif
+}
+
+void VirtualMachine::TailCallClosure(MidoriTraceable* closure_ptr, int arity) noexcept
+{
+	// the frame is about to be overwritten, same as on return
+	PromoteCells(m_value_stack_base_pointer);
+
+	std::copy(m_value_stack_pointer - arity, m_value_stack_pointer, m_value_stack_base_pointer);
+	m_value_stack_pointer = m_value_stack_base_pointer + arity;
+
+	MidoriClosure& closure = closure_ptr->GetClosure();
+	m_curr_environment = &closure.m_cell_values;
+
+	CallFrame& frame = *(m_call_stack_pointer - 1);
+	frame.m_closure = closure_ptr;
+	frame.m_environment = m_curr_environment;
+
+	m_instruction_pointer = m_procedure_entry_points[static_cast<size_t>(closure.m_proc_index)];
+
+#ifdef MIDORI_JIT
+	m_curr_procedure_index = closure.m_proc_index;
+	frame.m_proc_index = m_curr_procedure_index;
+	if (const JitCompiler::NativeProcedure* native_procedure = m_jit_compiler.Profile(closure.m_proc_index))
+	{
+		TryEnterNativeCode(*native_procedure, 0);
+	}
+#endif
+}
+
+void VirtualMachine::ReturnFromCall() noexcept
+{
+	// on return, promote all cells to heap
+	PromoteCells(m_value_stack_base_pointer);
+
+	const MidoriValue& value = Pop();
+	PopCallFrame();
+	Push(value);
+}
+
+void VirtualMachine::PopCallFrame() noexcept
+{
+	--m_call_stack_pointer;
+
+	const CallFrame& top_frame = *m_call_stack_pointer;
+	const CallFrame& caller_frame = *(m_call_stack_pointer - 1);
+
+	m_curr_environment = caller_frame.m_environment;
+	m_value_stack_base_pointer = top_frame.m_return_bp;
+	m_instruction_pointer = top_frame.m_return_ip;
+	m_value_stack_pointer = top_frame.m_return_sp;
+#ifdef MIDORI_JIT
+	m_curr_procedure_index = caller_frame.m_proc_index;
+#endif
+}
+
 MidoriValue& VirtualMachine::Peek() noexcept
 {
 	return *(m_value_stack_pointer - 1);
@@ -176,19 +409,60 @@ MidoriValue& VirtualMachine::Pop() noexcept
 	return value;
 }
 
-void VirtualMachine::PromoteCells() noexcept
+void VirtualMachine::PromoteCells(ValueStackPointer scope_begin) noexcept
 {
-	for (size_t i = 0u; i < m_cell_promotion_count; i += 1u)
+	// pending cells are ordered by their slot, so the cells of the slots being left are the last ones pending
+	while (!m_cells_to_promote.empty())
 	{
-		MidoriCellValue* cell = m_cells_to_promote[i];
-		if (cell->m_stack_value_ref >= m_value_stack_base_pointer)
+		MidoriCellValue& cell = m_cells_to_promote.back()->GetCellValue();
+		if (cell.m_stack_value_ref < scope_begin)
 		{
-			cell->m_heap_value = *cell->m_stack_value_ref;
-			cell->m_is_on_heap = true;
+			return;
 		}
+
+		cell.m_heap_value = *cell.m_stack_value_ref;
+		cell.m_is_on_heap = true;
+		m_cells_to_promote.pop_back();
+	}
+}
+
+bool VirtualMachine::HasPendingCellsInFrame() noexcept
+{
+	return !m_cells_to_promote.empty() && m_cells_to_promote.back()->GetCellValue().m_stack_value_ref >= m_value_stack_base_pointer;
+}
+
+void VirtualMachine::SuspendCells() noexcept
+{
+	// closures reach the value through the heap while the frame is suspended, and the frame keeps the cell in its slot
+	while (HasPendingCellsInFrame())
+	{
+		MidoriTraceable* cell_ptr = m_cells_to_promote.back();
+		MidoriCellValue& cell = cell_ptr->GetCellValue();
+		cell.m_heap_value = *cell.m_stack_value_ref;
+		cell.m_is_on_heap = true;
+		*cell.m_stack_value_ref = cell_ptr;
+		m_cells_to_promote.pop_back();
 	}
+}
+
+void VirtualMachine::ResumeCells() noexcept
+{
+	// cells are never values of the language, so a cell in a slot of the resumed frame stands for a captured local
+	for (MidoriValue* slot = m_value_stack_base_pointer; slot < m_value_stack_pointer; slot += 1)
+	{
+		if (!slot->IsPointer() || !slot->GetPointer()->IsCellValue())
+		{
+			continue;
+		}
 
-	m_cell_promotion_count = 0u;
+		MidoriTraceable* cell_ptr = slot->GetPointer();
+		MidoriCellValue& cell = cell_ptr->GetCellValue();
+		*slot = cell.m_heap_value;
+		cell.m_heap_value = MidoriValue();
+		cell.m_stack_value_ref = slot;
+		cell.m_is_on_heap = false;
+		m_cells_to_promote.emplace_back(cell_ptr);
+	}
 }
 
 void VirtualMachine::CheckIndexBounds(const MidoriValue& index, MidoriInteger size) noexcept
@@ -220,1186 +494,1968 @@ void VirtualMachine::CheckArrayPopResult(const std::optional<MidoriValue>& resul
 	}
 }
 
-MidoriTraceable::GarbageCollectionRoots VirtualMachine::GetGlobalTableGarbageCollectionRoots() const noexcept
+MidoriTraceable* VirtualMachine::AllocateText(MidoriText&& text) noexcept
 {
-	MidoriTraceable::GarbageCollectionRoots roots;
-	roots.reserve(m_global_vars.size());
+#ifdef MIDORI_TEXT_INTERNING
+	return m_executable.GetHeap().InternText(std::move(text));
+#else
+	return MidoriTraceable::AllocateTraceable(std::move(text));
+#endif
+}
 
-	std::ranges::for_each
+void VirtualMachine::MarkGarbageCollectionRoots() noexcept
+{
+	std::for_each
 	(
-		m_global_vars,
-		[&roots](const MidoriValue& val) -> void
+		std::execution::seq,
+		m_value_stack_begin,
+		m_value_stack_pointer,
+		[this](const MidoriValue& value) -> void
 		{
-			if (val.IsPointer())
-			{
-				roots.emplace(val.GetPointer());
-			}
+			m_garbage_collector.MarkRoot(value);
 		}
 	);
 
-	return roots;
-}
-
-MidoriTraceable::GarbageCollectionRoots VirtualMachine::GetValueStackGarbageCollectionRoots() const noexcept
-{
-	MidoriTraceable::GarbageCollectionRoots roots;
-	roots.reserve((m_value_stack_pointer - m_value_stack_begin) + (m_call_stack_pointer - m_call_stack_begin));
-
-	std::for_each_n
+	std::for_each
 	(
 		std::execution::seq,
-		m_value_stack->begin(),
-		m_value_stack_pointer - m_value_stack_begin,
-		[&roots](const MidoriValue& value) -> void
+		m_call_stack_begin,
+		m_call_stack_pointer,
+		[this](const CallFrame& call_frame) -> void
 		{
-			if (value.IsPointer())
+			if (call_frame.m_closure != nullptr)
 			{
-				roots.emplace(value.GetPointer());
+				m_garbage_collector.MarkRoot(call_frame.m_closure);
 			}
 		}
 	);
+	m_garbage_collector.MarkRoot(m_call_stack.GetBase()->m_closure); // Sentinel closure
+	m_garbage_collector.MarkRoot(m_host_result);
 
-	std::for_each_n
+	// a pending cell is promoted once its frame leaves, even if no closure refers to it by then
+	std::ranges::for_each
 	(
-		std::execution::seq,
-		m_call_stack_begin,
-		m_call_stack_pointer - m_call_stack_begin,
-		[&roots](CallFrame& call_frame) -> void
+		m_cells_to_promote,
+		[this](MidoriTraceable* cell_ptr) -> void
 		{
-			roots.emplace(call_frame.m_closure);
+			m_garbage_collector.MarkRoot(cell_ptr);
 		}
 	);
-	roots.emplace((*m_call_stack)[0u].m_closure); // Sentinel closure
-
-	return roots;
-}
-
-MidoriTraceable::GarbageCollectionRoots VirtualMachine::GetGarbageCollectionRoots() const noexcept
-{
-	MidoriTraceable::GarbageCollectionRoots stack_roots = GetValueStackGarbageCollectionRoots();
-	MidoriTraceable::GarbageCollectionRoots global_roots = GetGlobalTableGarbageCollectionRoots();
 
-	stack_roots.insert(global_roots.cbegin(), global_roots.cend());
-	return stack_roots;
+	std::ranges::for_each
+	(
+		m_global_vars,
+		[this](const MidoriValue& value) -> void
+		{
+			m_garbage_collector.MarkRoot(value);
+		}
+	);
 }
 
 void VirtualMachine::CollectGarbage() noexcept
 {
-	if (MidoriTraceable::s_total_bytes_allocated - MidoriTraceable::s_static_bytes_allocated < s_garbage_collection_threshold)
+	if (m_garbage_collector.GetDynamicBytesAllocated() < s_garbage_collection_threshold)
 	{
 		return;
 	}
 
-	MidoriTraceable::GarbageCollectionRoots roots = GetGarbageCollectionRoots();
-	if (roots.empty()) [[unlikely]]
-		{
-			return;
-		}
-	else [[likely]]
-		{
 #ifdef DEBUG
-			Printer::Print<Printer::Color::BLUE>("\nBefore garbage collection:");
-			m_garbage_collector.PrintMemoryTelemetry();
+	Printer::Print<Printer::Color::BLUE>("\nBefore garbage collection:");
+	m_garbage_collector.PrintMemoryTelemetry();
 #endif
-			m_garbage_collector.ReclaimMemory(std::move(roots));
+	MarkGarbageCollectionRoots();
+	m_garbage_collector.ReclaimMemory();
 #ifdef DEBUG
-			Printer::Print<Printer::Color::BLUE>("\nAfter garbage collection:");
-			m_garbage_collector.PrintMemoryTelemetry();
+	Printer::Print<Printer::Color::BLUE>("\nAfter garbage collection:");
+	m_garbage_collector.PrintMemoryTelemetry();
 #endif
-		}
 }
 
-void VirtualMachine::Execute() noexcept
+#ifdef DEBUG
+void VirtualMachine::PrintExecutionTrace() noexcept
 {
-#ifdef _WIN32
-	m_library_handle = LoadLibrary("./MidoriStdLib.dll");
-#else
-	m_library_handle = dlopen("./libMidoriStdLib.so", RTLD_LAZY);
-#endif
-
-	if (m_library_handle == NULL) [[unlikely]]
+	Printer::Print("          ");
+	std::for_each
+	(
+		std::execution::seq,
+		m_value_stack_base_pointer,
+		m_value_stack_pointer,
+		[](MidoriValue& value) -> void
 		{
-#ifdef _WIN32
-			FreeLibrary(m_library_handle);
-#else
-			dlclose(m_library_handle);
-#endif
-			TerminateExecution("Failed to load the standard library.");
+			Printer::Print(("[ "s + value.ToText().GetCString() + " ]"s));
 		}
+	);
+	Printer::Print("\n");
+	int dbg_instruction_pointer = -1;
+	int dbg_proc_index = -1;
 
-			while (true)
-			{
-#ifdef DEBUG
-				Printer::Print("          ");
-				std::for_each
-				(
-					std::execution::seq,
-					m_value_stack_base_pointer,
-					m_value_stack_pointer,
-					[](MidoriValue& value) -> void
-					{
-						Printer::Print(("[ "s + value.ToText().GetCString() + " ]"s));
-					}
-				);
-				Printer::Print("\n");
-				int dbg_instruction_pointer = -1;
-				int dbg_proc_index = -1;
-
-				for (int i : std::views::iota(0, m_executable.GetProcedureCount()))
-				{
-					if (&*m_instruction_pointer >= &*m_executable.GetBytecodeStream(i).cbegin() && &*m_instruction_pointer <= &*std::prev(m_executable.GetBytecodeStream(i).cend()))
-					{
-						dbg_proc_index = i;
-						dbg_instruction_pointer = static_cast<int>(m_instruction_pointer - &*m_executable.GetBytecodeStream(i).cbegin());
-					}
-				}
+	for (int i : std::views::iota(0, m_executable.GetProcedureCount()))
+	{
+		if (&*m_instruction_pointer >= &*m_executable.GetBytecodeStream(i).cbegin() && &*m_instruction_pointer <= &*std::prev(m_executable.GetBytecodeStream(i).cend()))
+		{
+			dbg_proc_index = i;
+			dbg_instruction_pointer = static_cast<int>(m_instruction_pointer - &*m_executable.GetBytecodeStream(i).cbegin());
+		}
+	}
 
-				Disassembler::DisassembleInstruction(m_executable, dbg_proc_index, dbg_instruction_pointer);
+	Disassembler::DisassembleInstruction(m_executable, dbg_proc_index, dbg_instruction_pointer);
+}
 #endif
-				OpCode instruction = ReadByte();
 
-				switch (instruction)
-				{
-				case OpCode::LOAD_CONSTANT:
-				case OpCode::LOAD_CONSTANT_LONG:
-				case OpCode::LOAD_CONSTANT_LONG_LONG:
-				{
-					Push(ReadConstant(instruction));
-					break;
-				}
-				case OpCode::INTEGER_CONSTANT:
-				{
-					Push(ReadIntegerConstant());
-					break;
-				}
-				case OpCode::FRACTION_CONSTANT:
-				{
-					Push(ReadFractionConstant());
-					break;
-				}
-				case OpCode::OP_UNIT:
-				{
-					Push();
-					break;
-				}
-				case OpCode::OP_TRUE:
-				{
-					Push(true);
-					break;
-				}
-				case OpCode::OP_FALSE:
-				{
-					Push(false);
-					break;
-				}
-				case OpCode::CREATE_ARRAY:
-				{
-					int count = ReadThreeBytes();
-					MidoriArray arr(count);
+#ifdef MIDORI_JIT
+bool VirtualMachine::TryEnterNativeCode(const JitCompiler::NativeProcedure& native_procedure, int bytecode_offset) noexcept
+{
+	if (m_native_nesting_depth == s_max_native_nesting_depth) [[unlikely]]
+		{
+			return false;
+		}
+	else if (m_value_stack_end + 1 - m_value_stack_pointer < native_procedure.m_max_stack_depth && !GrowValueStack(m_value_stack_pointer + native_procedure.m_max_stack_depth)) [[unlikely]]
+		{
+			return false;
+		}
 
-					for (int i = count - 1; i >= 0; i -= 1)
-					{
-						arr[i] = Pop();
-					}
+	m_native_nesting_depth += 1;
+	native_procedure.m_entry(this, m_value_stack_base_pointer, m_value_stack_pointer, native_procedure.m_instruction_addresses[static_cast<size_t>(bytecode_offset)]);
+	m_native_nesting_depth -= 1;
+	return true;
+}
 
-					Push(MidoriTraceable::AllocateTraceable(std::move(arr)));
-					CollectGarbage();
-					break;
-				}
-				case OpCode::GET_ARRAY:
-				{
-					int num_indices = static_cast<int>(ReadByte());
-					MidoriArray indices(num_indices);
+void VirtualMachine::InterpretUntilReturn(CallStackPointer boundary) noexcept
+{
+	CallStackPointer enclosing_boundary = m_jit_return_boundary;
+	m_jit_return_boundary = boundary;
+	Interpret();
+	m_jit_return_boundary = enclosing_boundary;
+}
 
-					for (int i = num_indices - 1; i >= 0; i -= 1)
-					{
-						indices[i] = Pop();
-					}
+MidoriValue* VirtualMachine::JitCall(VirtualMachine* virtual_machine, MidoriValue* stack_pointer, InstructionPointer return_address, MidoriTraceable* closure_ptr, int arity) noexcept
+{
+	virtual_machine->m_value_stack_pointer = stack_pointer;
+	virtual_machine->m_instruction_pointer = return_address;
 
-					MidoriValue& arr = Pop();
-					MidoriArray& arr_ref = arr.GetPointer()->GetArray();
-					MidoriInteger arr_size = static_cast<MidoriInteger>(arr_ref.GetLength());
+	CallStackPointer caller_frame = virtual_machine->m_call_stack_pointer;
+	virtual_machine->CallClosure(closure_ptr, arity);
 
-					for (int i = 0; i < num_indices; i += 1)
-					{
-						MidoriValue& index = indices[i];
-						CheckIndexBounds(index, arr_size);
-
-						MidoriValue& next_val = arr_ref[static_cast<int>(index.GetInteger())];
-
-						if (i != num_indices - 1)
-						{
-							arr_ref = next_val.GetPointer()->GetArray();
-						}
-						else
-						{
-							Push(next_val);
-						}
-					}
+	// the callee has no native code (yet): interpret it until it returns into the native caller
+	if (virtual_machine->m_call_stack_pointer != caller_frame)
+	{
+		virtual_machine->InterpretUntilReturn(caller_frame);
+	}
 
-					break;
-				}
-				case OpCode::SET_ARRAY:
-				{
-					int num_indices = static_cast<int>(ReadByte());
-					const MidoriValue& value_to_set = Pop();
-					MidoriArray indices(num_indices);
+	return virtual_machine->m_value_stack_pointer;
+}
 
-					for (int i = num_indices - 1; i >= 0; i -= 1)
-					{
-						indices[i] = Pop();
-					}
+MidoriValue* VirtualMachine::JitCallDirect(VirtualMachine* virtual_machine, MidoriValue* stack_pointer, InstructionPointer return_address, int proc_index, int arity) noexcept
+{
+	virtual_machine->m_value_stack_pointer = stack_pointer;
+	virtual_machine->m_instruction_pointer = return_address;
 
-					MidoriValue& arr = Pop();
-					MidoriArray& arr_ref = arr.GetPointer()->GetArray();
-					MidoriInteger arr_size = static_cast<MidoriInteger>(arr_ref.GetLength());
+	CallStackPointer caller_frame = virtual_machine->m_call_stack_pointer;
+	virtual_machine->CallDirect(proc_index, arity);
 
-					for (int i = 0; i < num_indices; i += 1)
-					{
-						MidoriValue& index = indices[i];
-						CheckIndexBounds(index, arr_size);
-						MidoriValue& next_val = arr_ref[static_cast<int>(index.GetInteger())];
-						if (i != num_indices - 1)
-						{
-							arr_ref = next_val.GetPointer()->GetArray();
-						}
-						else
-						{
-							next_val = value_to_set;
-						}
-					}
+	if (virtual_machine->m_call_stack_pointer != caller_frame)
+	{
+		virtual_machine->InterpretUntilReturn(caller_frame);
+	}
 
-					Push(value_to_set);
-					break;
-				}
-				case OpCode::DUP_ARRAY:
-				{
-					MidoriValue size_val = Pop();
-					MidoriValue arr_val = Pop();
-					MidoriArray& arr_ref = arr_val.GetPointer()->GetArray();
+	return virtual_machine->m_value_stack_pointer;
+}
 
-					MidoriInteger original_size = arr_ref.GetLength();
-					MidoriInteger repeat_count = size_val.GetInteger();
-					MidoriInteger new_size = repeat_count * original_size;
+void VirtualMachine::JitReturn(VirtualMachine* virtual_machine, MidoriValue* stack_pointer) noexcept
+{
+	virtual_machine->m_value_stack_pointer = stack_pointer;
+	virtual_machine->ReturnFromCall();
+}
 
-					CheckNewArraySize(new_size);
+MidoriValue* VirtualMachine::JitGetCell(VirtualMachine* virtual_machine, int index) noexcept
+{
+	return &(*virtual_machine->m_curr_environment)[index].GetPointer()->GetCellValue().GetValue();
+}
 
-					MidoriArray new_arr(static_cast<int>(new_size));
+void VirtualMachine::JitPromoteCells(VirtualMachine* virtual_machine, MidoriValue* scope_begin) noexcept
+{
+	virtual_machine->PromoteCells(scope_begin);
+}
+#endif
 
-					if (new_size <= 1000)
-					{
-						for (int i = 0; i < static_cast<int>(new_size); i += 1)
-						{
-							new_arr[i] = arr_ref[i % original_size];
-						}
-					}
-					else 
-					{
-						// Process big arrays in parallel
-						std::ranges::iota_view<int, int> counters = std::views::iota(0, static_cast<int>(new_size));
-						std::for_each
-						(
-							std::execution::par_unseq,
-							counters.cbegin(), 
-							counters.cend(),
-							[&new_arr, &arr_ref, original_size](int i)
-							{
-								new_arr[i] = arr_ref[i % original_size];
-							}
-						);
-					}
+#ifdef MIDORI_TRACING_JIT
+void VirtualMachine::RunTrace(TraceCompiler::Trace& trace) noexcept
+{
+	// traces neither promote cells on scope exit nor check for stack overflow
+	if (HasPendingCellsInFrame() || (m_value_stack_end + 1 - m_value_stack_base_pointer < trace.m_max_stack_depth && !GrowValueStack(m_value_stack_base_pointer + trace.m_max_stack_depth))) [[unlikely]]
+		{
+			return;
+		}
 
-					Push(MidoriTraceable::AllocateTraceable(std::move(new_arr)));
-					CollectGarbage();
-					break;
-				}
-				case OpCode::ADD_BACK_ARRAY:
-				{
-					MidoriValue& val = Pop();
-					MidoriValue& arr = Peek();
+	TraceCompiler::SideExit side_exit = m_trace_compiler.Run(trace, m_value_stack_base_pointer);
+	m_instruction_pointer = side_exit.m_resume_address;
+	m_value_stack_pointer = m_value_stack_base_pointer + side_exit.m_stack_depth;
+}
+#endif
 
-					MidoriArray& arr_ref = arr.GetPointer()->GetArray();
-					arr_ref.AddBack(val);
+void VirtualMachine::Execute() noexcept
+{
+	Initialize();
 
-					break;
-				}
-				case OpCode::ADD_FRONT_ARRAY:
-				{
-					MidoriValue& arr = Pop();
-					MidoriValue& val = Peek();
+	m_instruction_pointer = m_main_call_address;
+	Interpret();
+}
 
-					MidoriArray& arr_ref = arr.GetPointer()->GetArray();
-					arr_ref.AddFront(val);
+void VirtualMachine::Initialize() noexcept
+{
+	if (m_main_call_address != nullptr)
+	{
+		return;
+	}
 
-					val = arr;
+	// the startup procedure halts once after defining the globals, right before it calls main
+	Interpret();
+	m_main_call_address = m_instruction_pointer;
+}
 
-					break;
-				}
-				case OpCode::CAST_TO_FRACTION:
-				{
-					const MidoriValue& value = Pop();
+std::optional<int> VirtualMachine::FindGlobal(std::string_view name) noexcept
+{
+	Initialize();
 
-					if (value.IsInteger())
-					{
-						Push(static_cast<MidoriFraction>(value.GetInteger()));
-					}
-					else if (value.IsFraction())
-					{
-						Push(value);
-					}
-					else if (value.IsPointer() && value.GetPointer()->IsText())
-					{
-						MidoriFraction fraction = value.GetPointer()->GetText().ToFraction();
-						Push(fraction);
-					}
-					else
-					{
-						TerminateExecution(GenerateRuntimeError("Unable to cast to Fraction.", GetLine()));
-					}
+	for (int i = 0; i < m_executable.GetGlobalVariableCount(); i += 1)
+	{
+		if (name == m_executable.GetGlobalVariable(i).GetCString())
+		{
+			if (!GetGlobalFunctionArity(i).has_value())
+			{
+				return std::nullopt;
+			}
 
-					break;
-				}
-				case OpCode::CAST_TO_INTEGER:
-				{
-					const MidoriValue& value = Pop();
+			return i;
+		}
+	}
 
-					if (value.IsInteger())
-					{
-						Push(value);
-					}
-					else if (value.IsFraction())
-					{
-						Push(static_cast<MidoriInteger>(value.GetFraction()));
-					}
-					else if (value.IsPointer() && value.GetPointer()->IsText())
-					{
-						MidoriInteger integer = value.GetPointer()->GetText().ToInteger();
-						Push(integer);
-					}
-					else
-					{
-						TerminateExecution(GenerateRuntimeError("Unable to cast to Integer.", GetLine()));
-					}
+	return std::nullopt;
+}
 
-					break;
-				}
-				case OpCode::CAST_TO_TEXT:
-				{
-					const MidoriValue& value = Pop();
+void VirtualMachine::PushTextArgument(std::string_view text) noexcept
+{
+	MidoriHeap::Scope heap_scope(m_executable.GetHeap());
+	Push(AllocateText(MidoriText(std::string(text).c_str())));
+	CollectGarbage();
+}
 
-					if (value.IsBool())
-					{
-						Push(MidoriTraceable::AllocateTraceable(value.GetBool() ? MidoriText("true") : MidoriText("false")));
-					}
-					else if (value.IsInteger())
-					{
-						Push(MidoriTraceable::AllocateTraceable(MidoriText::FromInteger(value.GetInteger())));
-					}
-					else if (value.IsFraction())
-					{
-						Push(MidoriTraceable::AllocateTraceable(MidoriText::FromFraction(value.GetFraction())));
-					}
-					else if (value.IsPointer())
-					{
-						MidoriTraceable& ptr = *value.GetPointer();
-						if (ptr.IsText())
-						{
-							Push(value);
-						}
-						else
-						{
-							Push(MidoriTraceable::AllocateTraceable(ptr.ToText()));
-						}
-					}
-					else if (value.IsUnit())
-					{
-						Push(MidoriTraceable::AllocateTraceable(MidoriText("()")));
-					}
-					else
-					{
-						TerminateExecution(GenerateRuntimeError("Unable to cast to Text.", GetLine()));
-					}
-					CollectGarbage();
-					break;
-				}
-				case OpCode::CAST_TO_BOOL:
-				{
-					const MidoriValue& value = Pop();
+std::optional<int> VirtualMachine::GetGlobalFunctionArity(int global_index) const noexcept
+{
+	if (global_index < 0 || global_index >= m_executable.GetGlobalVariableCount())
+	{
+		return std::nullopt;
+	}
 
-					if (value.IsBool())
-					{
-						Push(value);
-					}
-					else if (value.IsInteger())
-					{
-						Push(value.GetInteger() != 0ll);
-					}
-					else if (value.IsFraction())
-					{
-						Push(value.GetFraction() != 0.0);
-					}
-					else
-					{
-						TerminateExecution(GenerateRuntimeError("Unable to cast to Bool.", GetLine()));
-					}
+	const MidoriValue& global = m_global_vars[static_cast<size_t>(global_index)];
+	if (global.IsPointer())
+	{
+		if (!global.GetPointer()->IsClosure())
+		{
+			return std::nullopt;
+		}
 
-					break;
-				}
-				case OpCode::CAST_TO_UNIT:
-				{
-					Peek() = {};
-					break;
-				}
-				case OpCode::LEFT_SHIFT:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+		return m_executable.GetProcedureArity(global.GetPointer()->GetClosure().m_proc_index);
+	}
 
-					left = left.GetInteger() << right.GetInteger();
-					break;
-				}
-				case OpCode::RIGHT_SHIFT:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+	// the value of a foreign global is an integer, only how the global was defined tells it apart from an integer global
+	return m_executable.GetForeignGlobalVariableArity(global_index);
+}
 
-					left = left.GetInteger() >> right.GetInteger();
+std::optional<MidoriValue> VirtualMachine::Invoke(int global_index, int arity) noexcept
+{
+	Initialize();
 
-					break;
-				}
-				case OpCode::BITWISE_AND:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+	MidoriHeap::Scope heap_scope(m_executable.GetHeap());
+	int pushed_count = static_cast<int>(m_value_stack_pointer - m_value_stack_base_pointer);
+	std::optional<int> expected_arity = GetGlobalFunctionArity(global_index);
+	if (!expected_arity.has_value() || expected_arity.value() != arity || pushed_count < arity) [[unlikely]]
+		{
+			m_value_stack_pointer -= std::clamp(arity, 0, pushed_count);
+			return std::nullopt;
+		}
 
-					left = left.GetInteger() & right.GetInteger();
+	const MidoriValue& callee = m_global_vars[static_cast<size_t>(global_index)];
 
-					break;
-				}
-				case OpCode::BITWISE_OR:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+	// foreign functions run in place
+	if (!callee.IsPointer())
+	{
+		CallForeignFunction(static_cast<int>(callee.GetInteger()), arity);
+		m_host_result = Pop();
+		return m_host_result;
+	}
 
-					left = left.GetInteger() | right.GetInteger();
+	// the callee returns to a HALT: once it has, the arguments are replaced by the result
+	m_instruction_pointer = &s_host_return_instruction;
+	CallStackPointer host_frame = m_call_stack_pointer;
+	CallClosure(callee.GetPointer(), arity);
+	if (m_call_stack_pointer != host_frame)
+	{
+		Interpret();
+	}
 
-					break;
-				}
-				case OpCode::BITWISE_XOR:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+	m_host_result = Pop();
+	return m_host_result;
+}
 
-					left = left.GetInteger() ^ right.GetInteger();
+void VirtualMachine::Interpret() noexcept
+{
+	// everything the program allocates goes to its own heap, whichever thread runs it
+	MidoriHeap::Scope heap_scope(m_executable.GetHeap());
+	OpCode instruction;
+
+#ifdef MIDORI_USE_COMPUTED_GOTO
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+	// one entry per OpCode, in declaration order
+	static void* const dispatch_table[] =
+	{
+		&&VM_LABEL(LOAD_CONSTANT),
+		&&VM_LABEL(LOAD_CONSTANT_LONG),
+		&&VM_LABEL(LOAD_CONSTANT_LONG_LONG),
+		&&VM_LABEL(INTEGER_CONSTANT),
+		&&VM_LABEL(FRACTION_CONSTANT),
+		&&VM_LABEL(OP_UNIT),
+		&&VM_LABEL(OP_TRUE),
+		&&VM_LABEL(OP_FALSE),
+		&&VM_LABEL(CREATE_ARRAY),
+		&&VM_LABEL(GET_ARRAY),
+		&&VM_LABEL(SET_ARRAY),
+		&&VM_LABEL(GET_ARRAY_ELEMENT),
+		&&VM_LABEL(SET_ARRAY_ELEMENT),
+		&&VM_LABEL(GET_ARRAY_ELEMENT_INTEGER),
+		&&VM_LABEL(GET_ARRAY_ELEMENT_FRACTION),
+		&&VM_LABEL(GET_ARRAY_ELEMENT_BOOL),
+		&&VM_LABEL(SET_ARRAY_ELEMENT_INTEGER),
+		&&VM_LABEL(SET_ARRAY_ELEMENT_FRACTION),
+		&&VM_LABEL(SET_ARRAY_ELEMENT_BOOL),
+		&&VM_LABEL(DUP_ARRAY),
+		&&VM_LABEL(ADD_BACK_ARRAY),
+		&&VM_LABEL(ADD_FRONT_ARRAY),
+		&&VM_LABEL(CAST_TO_FRACTION),
+		&&VM_LABEL(CAST_TO_INTEGER),
+		&&VM_LABEL(CAST_TO_TEXT),
+		&&VM_LABEL(CAST_TO_BOOL),
+		&&VM_LABEL(CAST_TO_UNIT),
+		&&VM_LABEL(LEFT_SHIFT),
+		&&VM_LABEL(RIGHT_SHIFT),
+		&&VM_LABEL(BITWISE_AND),
+		&&VM_LABEL(BITWISE_OR),
+		&&VM_LABEL(BITWISE_XOR),
+		&&VM_LABEL(BITWISE_NOT),
+		&&VM_LABEL(ADD_FRACTION),
+		&&VM_LABEL(SUBTRACT_FRACTION),
+		&&VM_LABEL(MULTIPLY_FRACTION),
+		&&VM_LABEL(DIVIDE_FRACTION),
+		&&VM_LABEL(MODULO_FRACTION),
+		&&VM_LABEL(ADD_INTEGER),
+		&&VM_LABEL(SUBTRACT_INTEGER),
+		&&VM_LABEL(MULTIPLY_INTEGER),
+		&&VM_LABEL(DIVIDE_INTEGER),
+		&&VM_LABEL(MODULO_INTEGER),
+		&&VM_LABEL(CONCAT_ARRAY),
+		&&VM_LABEL(CONCAT_TEXT),
+		&&VM_LABEL(EQUAL_FRACTION),
+		&&VM_LABEL(NOT_EQUAL_FRACTION),
+		&&VM_LABEL(GREATER_FRACTION),
+		&&VM_LABEL(GREATER_EQUAL_FRACTION),
+		&&VM_LABEL(LESS_FRACTION),
+		&&VM_LABEL(LESS_EQUAL_FRACTION),
+		&&VM_LABEL(EQUAL_INTEGER),
+		&&VM_LABEL(NOT_EQUAL_INTEGER),
+		&&VM_LABEL(GREATER_INTEGER),
+		&&VM_LABEL(GREATER_EQUAL_INTEGER),
+		&&VM_LABEL(LESS_INTEGER),
+		&&VM_LABEL(LESS_EQUAL_INTEGER),
+		&&VM_LABEL(EQUAL_TEXT),
+		&&VM_LABEL(NOT),
+		&&VM_LABEL(NEGATE_FRACTION),
+		&&VM_LABEL(NEGATE_INTEGER),
+		&&VM_LABEL(JUMP_IF_FALSE),
+		&&VM_LABEL(JUMP_IF_TRUE),
+		&&VM_LABEL(JUMP),
+		&&VM_LABEL(JUMP_BACK),
+		&&VM_LABEL(IF_INTEGER_LESS),
+		&&VM_LABEL(IF_INTEGER_LESS_EQUAL),
+		&&VM_LABEL(IF_INTEGER_GREATER),
+		&&VM_LABEL(IF_INTEGER_GREATER_EQUAL),
+		&&VM_LABEL(IF_INTEGER_EQUAL),
+		&&VM_LABEL(IF_INTEGER_NOT_EQUAL),
+		&&VM_LABEL(IF_FRACTION_LESS),
+		&&VM_LABEL(IF_FRACTION_LESS_EQUAL),
+		&&VM_LABEL(IF_FRACTION_GREATER),
+		&&VM_LABEL(IF_FRACTION_GREATER_EQUAL),
+		&&VM_LABEL(IF_FRACTION_EQUAL),
+		&&VM_LABEL(IF_FRACTION_NOT_EQUAL),
+		&&VM_LABEL(SWITCH_TABLE),
+		&&VM_LABEL(SET_TAG),
+		&&VM_LABEL(CALL_FOREIGN),
+		&&VM_LABEL(CALL_FOREIGN_INDEXED),
+		&&VM_LABEL(CALL_DEFINED),
+		&&VM_LABEL(CALL_GLOBAL),
+		&&VM_LABEL(CALL_LOCAL),
+		&&VM_LABEL(CALL_CELL),
+		&&VM_LABEL(CALL_DIRECT),
+		&&VM_LABEL(TAIL_CALL),
+		&&VM_LABEL(CONSTRUCT_STRUCT),
+		&&VM_LABEL(CONSTRUCT_UNION),
+		&&VM_LABEL(CREATE_GENERATOR),
+		&&VM_LABEL(RESUME_GENERATOR),
+		&&VM_LABEL(YIELD),
+		&&VM_LABEL(FINISH_GENERATOR),
+		&&VM_LABEL(ALLOCATE_CLOSURE),
+		&&VM_LABEL(CONSTRUCT_CLOSURE),
+		&&VM_LABEL(DEFINE_GLOBAL),
+		&&VM_LABEL(GET_GLOBAL),
+		&&VM_LABEL(SET_GLOBAL),
+		&&VM_LABEL(GET_LOCAL),
+		&&VM_LABEL(SET_LOCAL),
+		&&VM_LABEL(GET_CELL),
+		&&VM_LABEL(SET_CELL),
+		&&VM_LABEL(GET_MEMBER),
+		&&VM_LABEL(SET_MEMBER),
+		&&VM_LABEL(ADD_INTEGER_RR),
+		&&VM_LABEL(ADD_INTEGER_RI),
+		&&VM_LABEL(SUBTRACT_INTEGER_RR),
+		&&VM_LABEL(SUBTRACT_INTEGER_RI),
+		&&VM_LABEL(MULTIPLY_INTEGER_RR),
+		&&VM_LABEL(MULTIPLY_INTEGER_RI),
+		&&VM_LABEL(MODULO_INTEGER_RR),
+		&&VM_LABEL(MODULO_INTEGER_RI),
+		&&VM_LABEL(ADD_INTEGER_RRR),
+		&&VM_LABEL(ADD_INTEGER_RRI),
+		&&VM_LABEL(SUBTRACT_INTEGER_RRR),
+		&&VM_LABEL(SUBTRACT_INTEGER_RRI),
+		&&VM_LABEL(IF_INTEGER_LESS_RR),
+		&&VM_LABEL(IF_INTEGER_LESS_RI),
+		&&VM_LABEL(IF_INTEGER_LESS_EQUAL_RR),
+		&&VM_LABEL(IF_INTEGER_LESS_EQUAL_RI),
+		&&VM_LABEL(IF_INTEGER_GREATER_RR),
+		&&VM_LABEL(IF_INTEGER_GREATER_RI),
+		&&VM_LABEL(IF_INTEGER_GREATER_EQUAL_RR),
+		&&VM_LABEL(IF_INTEGER_GREATER_EQUAL_RI),
+		&&VM_LABEL(IF_INTEGER_EQUAL_RR),
+		&&VM_LABEL(IF_INTEGER_EQUAL_RI),
+		&&VM_LABEL(IF_INTEGER_NOT_EQUAL_RR),
+		&&VM_LABEL(IF_INTEGER_NOT_EQUAL_RI),
+		&&VM_LABEL(POP),
+		&&VM_LABEL(DUP),
+		&&VM_LABEL(POP_SCOPE),
+		&&VM_LABEL(POP_MULTIPLE),
+		&&VM_LABEL(RETURN),
+		&&VM_LABEL(HALT),
+	};
+	static_assert(std::size(dispatch_table) == static_cast<size_t>(OpCode::HALT) + 1u, "Dispatch table is out of sync with OpCode.");
+#endif
 
-					break;
-				}
-				case OpCode::BITWISE_NOT:
-				{
-					MidoriValue& right = Peek();
+	while (true)
+	{
+		VM_TRACE();
+		instruction = ReadByte();
 
-					right = ~right.GetInteger();
+		switch (instruction)
+		{
+		VM_CASE(LOAD_CONSTANT)
+		VM_CASE(LOAD_CONSTANT_LONG)
+		VM_CASE(LOAD_CONSTANT_LONG_LONG)
+		{
+			Push(ReadConstant(instruction));
+			VM_DISPATCH();
+		}
+		VM_CASE(INTEGER_CONSTANT)
+		{
+			Push(ReadIntegerConstant());
+			VM_DISPATCH();
+		}
+		VM_CASE(FRACTION_CONSTANT)
+		{
+			Push(ReadFractionConstant());
+			VM_DISPATCH();
+		}
+		VM_CASE(OP_UNIT)
+		{
+			Push();
+			VM_DISPATCH();
+		}
+		VM_CASE(OP_TRUE)
+		{
+			Push(true);
+			VM_DISPATCH();
+		}
+		VM_CASE(OP_FALSE)
+		{
+			Push(false);
+			VM_DISPATCH();
+		}
+		VM_CASE(CREATE_ARRAY)
+		{
+			int count = ReadThreeBytes();
+			MidoriArray::Packing packing = static_cast<MidoriArray::Packing>(ReadByte());
+			MidoriArray arr(count, packing);
 
-					break;
-				}
-				case OpCode::ADD_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			for (int i = count - 1; i >= 0; i -= 1)
+			{
+				arr.Set(i, Pop());
+			}
 
-					left = left.GetFraction() + right.GetFraction();
+			Push(MidoriTraceable::AllocateTraceable(std::move(arr)));
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_ARRAY)
+		{
+			// the indices are read in place, the element replaces the array below them
+			int num_indices = static_cast<int>(ReadByte());
+			ValueStackPointer indices = m_value_stack_pointer - num_indices;
+			const MidoriArray* arr = &(indices - 1)->GetPointer()->GetArray();
 
-					break;
-				}
-				case OpCode::SUBTRACT_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			for (int i = 0; i < num_indices - 1; i += 1)
+			{
+				CheckIndexBounds(indices[i], static_cast<MidoriInteger>(arr->GetLength()));
+				arr = &(*arr)[static_cast<int>(indices[i].GetInteger())].GetPointer()->GetArray();
+			}
 
-					left = left.GetFraction() - right.GetFraction();
+			// only the innermost array may be packed
+			CheckIndexBounds(indices[num_indices - 1], static_cast<MidoriInteger>(arr->GetLength()));
+			*(indices - 1) = arr->Get(static_cast<int>(indices[num_indices - 1].GetInteger()));
+			m_value_stack_pointer = indices;
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_ARRAY)
+		{
+			int num_indices = static_cast<int>(ReadByte());
+			const MidoriValue& value_to_set = Peek();
+			ValueStackPointer indices = m_value_stack_pointer - 1 - num_indices;
+			MidoriArray* arr = &(indices - 1)->GetPointer()->GetArray();
 
-					break;
-				}
-				case OpCode::MULTIPLY_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			for (int i = 0; i < num_indices - 1; i += 1)
+			{
+				// the outer arrays are only read, the innermost one is written to
+				CheckIndexBounds(indices[i], static_cast<MidoriInteger>(arr->GetLength()));
+				arr = &std::as_const(*arr)[static_cast<int>(indices[i].GetInteger())].GetPointer()->GetArray();
+			}
 
-					left = left.GetFraction() * right.GetFraction();
+			CheckIndexBounds(indices[num_indices - 1], static_cast<MidoriInteger>(arr->GetLength()));
+			arr->Set(static_cast<int>(indices[num_indices - 1].GetInteger()), value_to_set);
+			*(indices - 1) = value_to_set;
+			m_value_stack_pointer = indices;
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_ARRAY_ELEMENT)
+		{
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			const MidoriArray& arr_ref = arr.GetPointer()->GetArray();
 
-					break;
-				}
-				case OpCode::DIVIDE_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr = arr_ref.Get(static_cast<int>(index.GetInteger()));
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_ARRAY_ELEMENT)
+		{
+			const MidoriValue& value_to_set = Pop();
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			MidoriArray& arr_ref = arr.GetPointer()->GetArray();
+
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr_ref.Set(static_cast<int>(index.GetInteger()), value_to_set);
+			arr = value_to_set;
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_ARRAY_ELEMENT_INTEGER)
+		{
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			const MidoriArray& arr_ref = arr.GetPointer()->GetArray();
 
-					left = left.GetFraction() / right.GetFraction();
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr = arr_ref.GetPacked<MidoriInteger>(static_cast<int>(index.GetInteger()));
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_ARRAY_ELEMENT_FRACTION)
+		{
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			const MidoriArray& arr_ref = arr.GetPointer()->GetArray();
 
-					break;
-				}
-				case OpCode::MODULO_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr = arr_ref.GetPacked<MidoriFraction>(static_cast<int>(index.GetInteger()));
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_ARRAY_ELEMENT_BOOL)
+		{
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			const MidoriArray& arr_ref = arr.GetPointer()->GetArray();
 
-					left = std::fmod(left.GetFraction(), right.GetFraction());
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr = arr_ref.GetPacked<MidoriBool>(static_cast<int>(index.GetInteger()));
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_ARRAY_ELEMENT_INTEGER)
+		{
+			const MidoriValue& value_to_set = Pop();
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			MidoriArray& arr_ref = arr.GetPointer()->GetArray();
+
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr_ref.SetPacked(static_cast<int>(index.GetInteger()), value_to_set.GetInteger());
+			arr = value_to_set;
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_ARRAY_ELEMENT_FRACTION)
+		{
+			const MidoriValue& value_to_set = Pop();
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			MidoriArray& arr_ref = arr.GetPointer()->GetArray();
+
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr_ref.SetPacked(static_cast<int>(index.GetInteger()), value_to_set.GetFraction());
+			arr = value_to_set;
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_ARRAY_ELEMENT_BOOL)
+		{
+			const MidoriValue& value_to_set = Pop();
+			const MidoriValue& index = Pop();
+			MidoriValue& arr = Peek();
+			MidoriArray& arr_ref = arr.GetPointer()->GetArray();
+
+			CheckIndexBounds(index, static_cast<MidoriInteger>(arr_ref.GetLength()));
+			arr_ref.SetPacked(static_cast<int>(index.GetInteger()), value_to_set.GetBool());
+			arr = value_to_set;
+			VM_DISPATCH();
+		}
+		VM_CASE(DUP_ARRAY)
+		{
+			MidoriValue size_val = Pop();
+			MidoriValue arr_val = Pop();
+			const MidoriArray& arr_ref = arr_val.GetPointer()->GetArray();
 
-					break;
-				}
-				case OpCode::ADD_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			MidoriInteger original_size = arr_ref.GetLength();
+			MidoriInteger repeat_count = size_val.GetInteger();
+			MidoriInteger new_size = repeat_count * original_size;
 
-					left = left.GetInteger() + right.GetInteger();
+			CheckNewArraySize(new_size);
 
-					break;
-				}
-				case OpCode::SUBTRACT_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			Push(MidoriTraceable::AllocateTraceable(MidoriArray::Repeat(arr_ref, static_cast<int>(repeat_count))));
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_BACK_ARRAY)
+		{
+			MidoriValue& val = Pop();
+			MidoriValue& arr = Peek();
 
-					left = left.GetInteger() - right.GetInteger();
+			MidoriArray& arr_ref = arr.GetPointer()->GetArray();
+			arr_ref.AddBack(val);
 
-					break;
-				}
-				case OpCode::MULTIPLY_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_FRONT_ARRAY)
+		{
+			MidoriValue& arr = Pop();
+			MidoriValue& val = Peek();
 
-					left = left.GetInteger() * right.GetInteger();
+			MidoriArray& arr_ref = arr.GetPointer()->GetArray();
+			arr_ref.AddFront(val);
 
-					break;
-				}
-				case OpCode::DIVIDE_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			val = arr;
 
-					left = left.GetInteger() / right.GetInteger();
+			VM_DISPATCH();
+		}
+		VM_CASE(CAST_TO_FRACTION)
+		{
+			const MidoriValue& value = Pop();
 
-					break;
-				}
-				case OpCode::MODULO_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			if (value.IsInteger())
+			{
+				Push(static_cast<MidoriFraction>(value.GetInteger()));
+			}
+			else if (value.IsFraction())
+			{
+				Push(value);
+			}
+			else if (value.IsPointer() && value.GetPointer()->IsText())
+			{
+				MidoriFraction fraction = value.GetPointer()->GetText().ToFraction();
+				Push(fraction);
+			}
+			else
+			{
+				TerminateExecution(GenerateRuntimeError("Unable to cast to Fraction.", GetLine()));
+			}
 
-					left = left.GetInteger() % right.GetInteger();
+			VM_DISPATCH();
+		}
+		VM_CASE(CAST_TO_INTEGER)
+		{
+			const MidoriValue& value = Pop();
 
-					break;
-				}
-				case OpCode::CONCAT_ARRAY:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			if (value.IsInteger())
+			{
+				Push(value);
+			}
+			else if (value.IsFraction())
+			{
+				Push(static_cast<MidoriInteger>(value.GetFraction()));
+			}
+			else if (value.IsPointer() && value.GetPointer()->IsText())
+			{
+				MidoriInteger integer = value.GetPointer()->GetText().ToInteger();
+				Push(integer);
+			}
+			else
+			{
+				TerminateExecution(GenerateRuntimeError("Unable to cast to Integer.", GetLine()));
+			}
 
-					MidoriArray& left_value_vector_ref = left.GetPointer()->GetArray();
-					MidoriArray& right_value_vector_ref = right.GetPointer()->GetArray();
-					MidoriArray result = MidoriArray::Concatenate(left_value_vector_ref, right_value_vector_ref);
+			VM_DISPATCH();
+		}
+		VM_CASE(CAST_TO_TEXT)
+		{
+			const MidoriValue& value = Pop();
 
-					left = MidoriTraceable::AllocateTraceable(std::move(result));
-					CollectGarbage();
-					break;
+			if (value.IsBool())
+			{
+				Push(AllocateText(value.GetBool() ? MidoriText("true") : MidoriText("false")));
+			}
+			else if (value.IsInteger())
+			{
+				Push(AllocateText(MidoriText::FromInteger(value.GetInteger())));
+			}
+			else if (value.IsFraction())
+			{
+				Push(AllocateText(MidoriText::FromFraction(value.GetFraction())));
+			}
+			else if (value.IsPointer())
+			{
+				MidoriTraceable& ptr = *value.GetPointer();
+				if (ptr.IsText())
+				{
+					Push(value);
 				}
-				case OpCode::CONCAT_TEXT:
+				else
 				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+					Push(AllocateText(ptr.ToText()));
+				}
+			}
+			else if (value.IsUnit())
+			{
+				Push(AllocateText(MidoriText("()")));
+			}
+			else
+			{
+				TerminateExecution(GenerateRuntimeError("Unable to cast to Text.", GetLine()));
+			}
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(CAST_TO_BOOL)
+		{
+			const MidoriValue& value = Pop();
 
-					MidoriText& left_value_string_ref = left.GetPointer()->GetText();
-					MidoriText& right_value_string_ref = right.GetPointer()->GetText();
+			if (value.IsBool())
+			{
+				Push(value);
+			}
+			else if (value.IsInteger())
+			{
+				Push(value.GetInteger() != 0ll);
+			}
+			else if (value.IsFraction())
+			{
+				Push(value.GetFraction() != 0.0);
+			}
+			else
+			{
+				TerminateExecution(GenerateRuntimeError("Unable to cast to Bool.", GetLine()));
+			}
 
-					MidoriText result = MidoriText::Concatenate(left_value_string_ref, right_value_string_ref);
+			VM_DISPATCH();
+		}
+		VM_CASE(CAST_TO_UNIT)
+		{
+			Peek() = {};
+			VM_DISPATCH();
+		}
+		VM_CASE(LEFT_SHIFT)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = MidoriTraceable::AllocateTraceable(std::move(result));
-					CollectGarbage();
-					break;
-				}
-				case OpCode::EQUAL_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			left = left.GetInteger() << right.GetInteger();
+			VM_DISPATCH();
+		}
+		VM_CASE(RIGHT_SHIFT)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetFraction() == right.GetFraction();
+			left = left.GetInteger() >> right.GetInteger();
 
-					break;
-				}
-				case OpCode::NOT_EQUAL_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(BITWISE_AND)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetFraction() != right.GetFraction();
+			left = left.GetInteger() & right.GetInteger();
 
-					break;
-				}
-				case OpCode::GREATER_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(BITWISE_OR)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetFraction() > right.GetFraction();
+			left = left.GetInteger() | right.GetInteger();
 
-					break;
-				}
-				case OpCode::GREATER_EQUAL_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(BITWISE_XOR)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetFraction() >= right.GetFraction();
+			left = left.GetInteger() ^ right.GetInteger();
 
-					break;
-				}
-				case OpCode::LESS_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(BITWISE_NOT)
+		{
+			MidoriValue& right = Peek();
 
-					left = left.GetFraction() < right.GetFraction();
+			right = ~right.GetInteger();
 
-					break;
-				}
-				case OpCode::LESS_EQUAL_FRACTION:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetFraction() <= right.GetFraction();
+			left = left.GetFraction() + right.GetFraction();
 
-					break;
-				}
-				case OpCode::EQUAL_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(SUBTRACT_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetInteger() == right.GetInteger();
+			left = left.GetFraction() - right.GetFraction();
 
-					break;
-				}
-				case OpCode::NOT_EQUAL_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(MULTIPLY_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetInteger() != right.GetInteger();
+			left = left.GetFraction() * right.GetFraction();
 
-					break;
-				}
-				case OpCode::GREATER_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(DIVIDE_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetInteger() > right.GetInteger();
+			left = left.GetFraction() / right.GetFraction();
 
-					break;
-				}
-				case OpCode::GREATER_EQUAL_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(MODULO_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetInteger() >= right.GetInteger();
+			left = std::fmod(left.GetFraction(), right.GetFraction());
 
-					break;
-				}
-				case OpCode::LESS_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetInteger() < right.GetInteger();
+			left = left.GetInteger() + right.GetInteger();
 
-					break;
-				}
-				case OpCode::LESS_EQUAL_INTEGER:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(SUBTRACT_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetInteger() <= right.GetInteger();
+			left = left.GetInteger() - right.GetInteger();
 
-					break;
-				}
-				case OpCode::EQUAL_TEXT:
-				{
-					const MidoriValue& right = Pop();
-					MidoriValue& left = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(MULTIPLY_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					left = left.GetPointer()->GetText() == right.GetPointer()->GetText();
+			left = left.GetInteger() * right.GetInteger();
 
-					break;
-				}
-				case OpCode::NOT:
-				{
-					MidoriValue& value = Peek();
-					value = !value.GetBool();
-					break;
-				}
-				case OpCode::NEGATE_FRACTION:
-				{
-					MidoriValue& value = Peek();
-					value = -value.GetFraction();
-					break;
-				}
-				case OpCode::NEGATE_INTEGER:
-				{
-					MidoriValue& value = Peek();
-					value = -value.GetInteger();
-					break;
-				}
-				case OpCode::JUMP_IF_FALSE:
-				{
-					const MidoriValue& value = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(DIVIDE_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
 
-					int offset = ReadShort();
-					if (!value.GetBool())
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::JUMP_IF_TRUE:
-				{
-					const MidoriValue& value = Peek();
+			left = left.GetInteger() / right.GetInteger();
 
-					int offset = ReadShort();
-					if (value.GetBool())
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::JUMP:
-				{
-					int offset = ReadShort();
-					m_instruction_pointer += offset;
-					break;
-				}
-				case OpCode::JUMP_BACK:
+			VM_DISPATCH();
+		}
+		VM_CASE(MODULO_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() % right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CONCAT_ARRAY)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			MidoriArray& left_value_vector_ref = left.GetPointer()->GetArray();
+			MidoriArray& right_value_vector_ref = right.GetPointer()->GetArray();
+			MidoriArray result = MidoriArray::Concatenate(left_value_vector_ref, right_value_vector_ref);
+
+			left = MidoriTraceable::AllocateTraceable(std::move(result));
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(CONCAT_TEXT)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			MidoriText& left_value_string_ref = left.GetPointer()->GetText();
+			MidoriText& right_value_string_ref = right.GetPointer()->GetText();
+
+			MidoriText result = MidoriText::Concatenate(left_value_string_ref, right_value_string_ref);
+
+			left = AllocateText(std::move(result));
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(EQUAL_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetFraction() == right.GetFraction();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(NOT_EQUAL_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetFraction() != right.GetFraction();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(GREATER_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetFraction() > right.GetFraction();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(GREATER_EQUAL_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetFraction() >= right.GetFraction();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(LESS_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetFraction() < right.GetFraction();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(LESS_EQUAL_FRACTION)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetFraction() <= right.GetFraction();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(EQUAL_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() == right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(NOT_EQUAL_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() != right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(GREATER_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() > right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(GREATER_EQUAL_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() >= right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(LESS_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() < right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(LESS_EQUAL_INTEGER)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetInteger() <= right.GetInteger();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(EQUAL_TEXT)
+		{
+			const MidoriValue& right = Pop();
+			MidoriValue& left = Peek();
+
+			left = left.GetPointer() == right.GetPointer() || left.GetPointer()->GetText() == right.GetPointer()->GetText();
+
+			VM_DISPATCH();
+		}
+		VM_CASE(NOT)
+		{
+			MidoriValue& value = Peek();
+			value = !value.GetBool();
+			VM_DISPATCH();
+		}
+		VM_CASE(NEGATE_FRACTION)
+		{
+			MidoriValue& value = Peek();
+			value = -value.GetFraction();
+			VM_DISPATCH();
+		}
+		VM_CASE(NEGATE_INTEGER)
+		{
+			MidoriValue& value = Peek();
+			value = -value.GetInteger();
+			VM_DISPATCH();
+		}
+		VM_CASE(JUMP_IF_FALSE)
+		{
+			const MidoriValue& value = Peek();
+
+			int offset = ReadShort();
+			if (!value.GetBool())
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(JUMP_IF_TRUE)
+		{
+			const MidoriValue& value = Peek();
+
+			int offset = ReadShort();
+			if (value.GetBool())
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(JUMP)
+		{
+			int offset = ReadShort();
+			m_instruction_pointer += offset;
+			VM_DISPATCH();
+		}
+		VM_CASE(JUMP_BACK)
+		{
+			int offset = ReadShort();
+			m_instruction_pointer -= offset;
+#ifdef MIDORI_NAN_BOXING
+			// wide integers are boxed, so loops that only compute on integers allocate too
+			CollectGarbage();
+#endif
+#ifdef MIDORI_TRACING_JIT
+			// hot loop header: keep iterating in the compiled trace until one of its guards fails
+			if (TraceCompiler::Trace* trace = m_trace_compiler.OnBackEdge(m_instruction_pointer, m_value_stack_base_pointer, m_value_stack_pointer))
+			{
+				RunTrace(*trace);
+				VM_DISPATCH();
+			}
+#endif
+#ifdef MIDORI_JIT
+			// loop header of a hot procedure: continue the remaining iterations in native code
+			if (const JitCompiler::NativeProcedure* native_procedure = m_jit_compiler.Profile(m_curr_procedure_index)) [[unlikely]]
+			{
+				int bytecode_offset = static_cast<int>(m_instruction_pointer - m_executable.GetBytecodeStream(m_curr_procedure_index)[0]);
+				if (TryEnterNativeCode(*native_procedure, bytecode_offset) && m_call_stack_pointer == m_jit_return_boundary)
 				{
-					int offset = ReadShort();
-					m_instruction_pointer -= offset;
-					break;
+					return;
 				}
-				case OpCode::IF_INTEGER_LESS:
-				{
-					int offset = ReadShort();
-					MidoriInteger right = Pop().GetInteger();
-					MidoriInteger left = Pop().GetInteger();
+			}
+#endif
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_LESS)
+		{
+			int offset = ReadShort();
+			MidoriInteger right = Pop().GetInteger();
+			MidoriInteger left = Pop().GetInteger();
 
-					if (!(left < right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_INTEGER_LESS_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriInteger right = Pop().GetInteger();
-					MidoriInteger left = Pop().GetInteger();
+			if (!(left < right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_LESS_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriInteger right = Pop().GetInteger();
+			MidoriInteger left = Pop().GetInteger();
 
-					if (!(left <= right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_INTEGER_GREATER:
-				{
-					int offset = ReadShort();
-					MidoriInteger right = Pop().GetInteger();
-					MidoriInteger left = Pop().GetInteger();
+			if (!(left <= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_GREATER)
+		{
+			int offset = ReadShort();
+			MidoriInteger right = Pop().GetInteger();
+			MidoriInteger left = Pop().GetInteger();
 
-					if (!(left > right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_INTEGER_GREATER_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriInteger right = Pop().GetInteger();
-					MidoriInteger left = Pop().GetInteger();
+			if (!(left > right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_GREATER_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriInteger right = Pop().GetInteger();
+			MidoriInteger left = Pop().GetInteger();
 
-					if (!(left >= right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_INTEGER_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriInteger right = Pop().GetInteger();
-					MidoriInteger left = Pop().GetInteger();
+			if (!(left >= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriInteger right = Pop().GetInteger();
+			MidoriInteger left = Pop().GetInteger();
 
-					if (!(left == right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_INTEGER_NOT_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriInteger right = Pop().GetInteger();
-					MidoriInteger left = Pop().GetInteger();
+			if (!(left == right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_NOT_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriInteger right = Pop().GetInteger();
+			MidoriInteger left = Pop().GetInteger();
 
-					if (!(left != right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_FRACTION_LESS:
-				{
-					int offset = ReadShort();
-					MidoriFraction right = Pop().GetFraction();
-					MidoriFraction left = Pop().GetFraction();
+			if (!(left != right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_FRACTION_LESS)
+		{
+			int offset = ReadShort();
+			MidoriFraction right = Pop().GetFraction();
+			MidoriFraction left = Pop().GetFraction();
 
-					if (!(left < right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_FRACTION_LESS_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriFraction right = Pop().GetFraction();
-					MidoriFraction left = Pop().GetFraction();
+			if (!(left < right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_FRACTION_LESS_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriFraction right = Pop().GetFraction();
+			MidoriFraction left = Pop().GetFraction();
 
-					if (!(left <= right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_FRACTION_GREATER:
-				{
-					int offset = ReadShort();
-					MidoriFraction right = Pop().GetFraction();
-					MidoriFraction left = Pop().GetFraction();
+			if (!(left <= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_FRACTION_GREATER)
+		{
+			int offset = ReadShort();
+			MidoriFraction right = Pop().GetFraction();
+			MidoriFraction left = Pop().GetFraction();
 
-					if (!(left > right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_FRACTION_GREATER_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriFraction right = Pop().GetFraction();
-					MidoriFraction left = Pop().GetFraction();
+			if (!(left > right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_FRACTION_GREATER_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriFraction right = Pop().GetFraction();
+			MidoriFraction left = Pop().GetFraction();
 
-					if (!(left >= right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_FRACTION_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriFraction right = Pop().GetFraction();
-					MidoriFraction left = Pop().GetFraction();
+			if (!(left >= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_FRACTION_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriFraction right = Pop().GetFraction();
+			MidoriFraction left = Pop().GetFraction();
 
-					if (!(left == right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::IF_FRACTION_NOT_EQUAL:
-				{
-					int offset = ReadShort();
-					MidoriFraction right = Pop().GetFraction();
-					MidoriFraction left = Pop().GetFraction();
+			if (!(left == right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_FRACTION_NOT_EQUAL)
+		{
+			int offset = ReadShort();
+			MidoriFraction right = Pop().GetFraction();
+			MidoriFraction left = Pop().GetFraction();
 
-					if (!(left != right))
-					{
-						m_instruction_pointer += offset;
-					}
-					break;
-				}
-				case OpCode::LOAD_TAG:
-				{
-					MidoriValue& union_val = Pop();
-					MidoriUnion& union_ref = union_val.GetPointer()->GetUnion();
+			if (!(left != right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(SWITCH_TABLE)
+		{
+			MidoriTraceable* union_ptr = Pop().GetPointer();
+			const MidoriUnion& union_ref = union_ptr->GetUnion();
+			int entry_count = ReadShort();
+			int default_offset = ReadShort();
+			InstructionPointer table_end = m_instruction_pointer + entry_count * 2;
 
-					for (int i = 0; i < union_ref.m_values.GetLength(); i += 1)
-					{
-						Push(union_ref.m_values[i]);
-					}
+			if (union_ref.m_index >= entry_count)
+			{
+				m_instruction_pointer = table_end + default_offset;
+				VM_DISPATCH();
+			}
 
-					Push(static_cast<MidoriInteger>(union_ref.m_index));
-					break;
-				}
-				case OpCode::SET_TAG:
+			m_instruction_pointer += union_ref.m_index * 2;
+			int offset = ReadShort();
+			m_instruction_pointer = table_end + offset;
+
+			// a tag without its own case takes the default, which binds nothing
+			if (offset != default_offset)
+			{
+				const MidoriValue* members = union_ptr->GetMembers();
+				for (int i = 0; i < union_ref.m_size; i += 1)
 				{
-					int tag = static_cast<int>(ReadByte());
-					MidoriUnion& union_ref = Peek().GetPointer()->GetUnion();
-					union_ref.m_index = tag;
-					break;
+					Push(members[i]);
 				}
-				case OpCode::CALL_FOREIGN:
-				{
-					const MidoriValue& foreign_function_name = Pop();
-					int arity = static_cast<int>(ReadByte());
-					MidoriText& foreign_function_name_ref = foreign_function_name.GetPointer()->GetText();
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_TAG)
+		{
+			int tag = static_cast<int>(ReadByte());
+			MidoriUnion& union_ref = Peek().GetPointer()->GetUnion();
+			union_ref.m_index = tag;
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_FOREIGN)
+		{
+			int foreign_index = static_cast<int>(Pop().GetInteger());
+			int arity = static_cast<int>(ReadByte());
 
-					// Platform-specific function loading
-#ifdef _WIN32
-					FARPROC proc = GetProcAddress(m_library_handle, foreign_function_name_ref.GetCString());
-#else
-					void* proc = dlsym(m_library_handle, foreign_function_name_ref.c_str());
+			CallForeignFunction(foreign_index, arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_FOREIGN_INDEXED)
+		{
+			int foreign_index = static_cast<int>(ReadByte());
+			int arity = static_cast<int>(ReadByte());
+
+			CallForeignFunction(foreign_index, arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_DEFINED)
+		{
+			const MidoriValue& callable = Pop();
+			int arity = static_cast<int>(ReadByte());
+
+			CallClosure(callable.GetPointer(), arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_GLOBAL)
+		{
+			int global_idx = ReadGlobalVariable();
+			int arity = static_cast<int>(ReadByte());
+
+			CallClosure(m_global_vars[global_idx].GetPointer(), arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_LOCAL)
+		{
+			MidoriTraceable* callable = ReadRegister().GetPointer();
+			int arity = static_cast<int>(ReadByte());
+
+			CallClosure(callable, arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_CELL)
+		{
+			int offset = static_cast<int>(ReadByte());
+			MidoriTraceable* callable = (*m_curr_environment)[offset].GetPointer()->GetCellValue().GetValue().GetPointer();
+			int arity = static_cast<int>(ReadByte());
+
+			CallClosure(callable, arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(CALL_DIRECT)
+		{
+			int proc_index = static_cast<int>(ReadByte());
+			int arity = static_cast<int>(ReadByte());
+
+			CallDirect(proc_index, arity);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(TAIL_CALL)
+		{
+			const MidoriValue& callable = Pop();
+			int arity = static_cast<int>(ReadByte());
+
+			TailCallClosure(callable.GetPointer(), arity);
+#ifdef MIDORI_NAN_BOXING
+			CollectGarbage();
 #endif
-					if (proc == nullptr)
-					{
-						TerminateExecution(GenerateRuntimeError(std::format("Failed to load foreign function '{}'.", foreign_function_name_ref.GetCString()), GetLine()));
-					}
+#ifdef MIDORI_JIT
+			// native code may have run the callee to completion and returned from the reused frame
+			if (m_call_stack_pointer == m_jit_return_boundary) [[unlikely]]
+			{
+				return;
+			}
+#endif
+			VM_DISPATCH();
+		}
+		VM_CASE(CONSTRUCT_STRUCT)
+		{
+			int size = static_cast<int>(ReadByte());
+			MidoriTraceable* new_struct = MidoriTraceable::AllocateTraceable(MidoriStruct{ size });
 
-					MidoriValue args[UINT8_MAX];
-					for (int i = arity - 1; i >= 0; i -= 1)
-					{
-						args[i] = Pop();
-					}
+			m_value_stack_pointer -= size;
+			std::copy_n(m_value_stack_pointer, size, new_struct->GetMembers());
 
-					MidoriValue return_val;
+			Push(new_struct);
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(CONSTRUCT_UNION)
+		{
+			int size = static_cast<int>(ReadByte());
+			MidoriTraceable* new_union = MidoriTraceable::AllocateTraceable(MidoriUnion{ size });
 
-					void(*ffi)(MidoriValue*, MidoriValue*) = reinterpret_cast<void(*)(MidoriValue*, MidoriValue*)>(proc);
-					if (ffi == nullptr) [[unlikely]]
-						{
-							TerminateExecution(GenerateRuntimeError(std::format("Failed to load foreign function '{}'.", foreign_function_name_ref.GetCString()), GetLine()));
-						}
-					else [[likely]]
-						{
-							ffi(args, &return_val);
-							Push(return_val);
-						}
+			m_value_stack_pointer -= size;
+			std::copy_n(m_value_stack_pointer, size, new_union->GetMembers());
 
-						break;
-				}
-				case OpCode::CALL_DEFINED:
-				{
-					const MidoriValue& callable = Pop();
-					int arity = static_cast<int>(ReadByte());
+			Push(new_union);
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(CREATE_GENERATOR)
+		{
+			// only the arguments are on the frame yet, the body runs once the generator is resumed
+			const CallFrame& frame = *(m_call_stack_pointer - 1);
+			MidoriGenerator generator{ std::vector<MidoriValue>(m_value_stack_base_pointer, m_value_stack_pointer), frame.m_closure, m_instruction_pointer };
+#ifdef MIDORI_JIT
+			generator.m_proc_index = m_curr_procedure_index;
+#endif
+			Push(MidoriTraceable::AllocateTraceable(std::move(generator)));
+			CollectGarbage();
 
-					// Return address := pop all the arguments and the callee
-					PushCallFrame(m_value_stack_base_pointer, m_value_stack_pointer - arity, m_instruction_pointer, callable.GetPointer());
+			ReturnFromCall();
+#ifdef MIDORI_JIT
+			if (m_call_stack_pointer == m_jit_return_boundary) [[unlikely]]
+			{
+				return;
+			}
+#endif
+			VM_DISPATCH();
+		}
+		VM_CASE(RESUME_GENERATOR)
+		{
+			// the generator stays on the stack right below the frame it resumes
+			MidoriGenerator& generator = Peek().GetPointer()->GetGenerator();
+			if (generator.m_is_finished)
+			{
+				Push(false);
+				VM_DISPATCH();
+			}
+			if (generator.m_is_running) [[unlikely]]
+			{
+				TerminateExecution(GenerateRuntimeError("Generator is already running.", GetLine()));
+			}
 
-					MidoriClosure& closure = callable.GetPointer()->GetClosure();
-					m_curr_environment = &closure.m_cell_values;
+			MidoriTraceable* closure_ptr = generator.m_closure;
+			m_curr_environment = closure_ptr != nullptr ? &closure_ptr->GetClosure().m_cell_values : &m_empty_environment;
+			PushCallFrame(m_value_stack_base_pointer, m_value_stack_pointer, m_instruction_pointer, closure_ptr, m_curr_environment);
 
-					m_instruction_pointer = m_executable.GetBytecodeStream(closure.m_proc_index)[0];
-					m_value_stack_base_pointer = m_value_stack_pointer - arity;
+			ValueStackPointer frame_end = m_value_stack_pointer + generator.m_frame_values.size();
+			if (frame_end > m_value_stack_end + 1 && !GrowValueStack(frame_end)) [[unlikely]]
+			{
+				TerminateExecution(GenerateRuntimeError("Value stack overflow.", GetLine()));
+			}
 
-					break;
-				}
-				case OpCode::CONSTRUCT_STRUCT:
-				{
-					MidoriTraceable* new_struct = MidoriTraceable::AllocateTraceable(MidoriStruct());
-					int size = static_cast<int>(ReadByte());
-					MidoriArray args(size);
+			m_value_stack_base_pointer = m_value_stack_pointer;
+			m_value_stack_pointer = std::copy(generator.m_frame_values.begin(), generator.m_frame_values.end(), m_value_stack_pointer);
+			generator.m_frame_values.clear();
+			ResumeCells();
+			generator.m_is_running = true;
+			m_instruction_pointer = generator.m_resume_address;
+#ifdef MIDORI_JIT
+			m_curr_procedure_index = generator.m_proc_index;
+			(m_call_stack_pointer - 1)->m_proc_index = m_curr_procedure_index;
+#endif
+			VM_DISPATCH();
+		}
+		VM_CASE(YIELD)
+		{
+			MidoriValue value = Pop();
+
+			// captured locals are closed over while the frame is suspended, then the frame moves into the generator
+			SuspendCells();
+			MidoriGenerator& generator = (m_value_stack_base_pointer - 1)->GetPointer()->GetGenerator();
+			generator.m_frame_values.assign(m_value_stack_base_pointer, m_value_stack_pointer);
+			generator.m_resume_address = m_instruction_pointer;
+			generator.m_is_running = false;
+
+			PopCallFrame();
+			Push(value);
+			Push(true);
+			VM_DISPATCH();
+		}
+		VM_CASE(FINISH_GENERATOR)
+		{
+			PromoteCells(m_value_stack_base_pointer);
 
-					for (int i = size - 1; i >= 0; i -= 1)
-					{
-						args[i] = Pop();
-					}
+			MidoriGenerator& generator = (m_value_stack_base_pointer - 1)->GetPointer()->GetGenerator();
+			generator.m_closure = nullptr;
+			generator.m_is_running = false;
+			generator.m_is_finished = true;
 
-					MidoriArray& members = new_struct->GetStruct().m_values;
-					members = std::move(args);
+			PopCallFrame();
+			Push(false);
+			VM_DISPATCH();
+		}
+		VM_CASE(ALLOCATE_CLOSURE)
+		{
+			int proc_index = static_cast<int>(ReadByte());
+			Push(MidoriTraceable::AllocateTraceable(MidoriClosure{ MidoriClosure::Environment{}, proc_index }));
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(CONSTRUCT_CLOSURE)
+		{
+			int captured_count = static_cast<int>(ReadByte());
 
-					Push(new_struct);
-					CollectGarbage();
-					break;
-				}
-				case OpCode::CONSTRUCT_UNION:
-				{
-					MidoriTraceable* new_union = MidoriTraceable::AllocateTraceable(MidoriUnion());
+			if (captured_count == 0)
+			{
+				VM_DISPATCH();
+			}
 
-					int size = static_cast<int>(ReadByte());
-					MidoriArray args(size);
+			MidoriClosure::Environment& captured_variables = (m_value_stack_pointer - 1)->GetPointer()->GetClosure().m_cell_values;
 
-					for (int i = size - 1; i >= 0; i -= 1)
-					{
-						args[i] = Pop();
-					}
+			const MidoriClosure::Environment& parent_closure = *m_curr_environment;
+			if (captured_count == parent_closure.GetLength())
+			{
+				// captures nothing of its own, the environment is shared with the enclosing closure
+				captured_variables = parent_closure;
+				VM_DISPATCH();
+			}
 
-					MidoriArray& members = new_union->GetUnion().m_values;
-					members = std::move(args);
+			// a single allocation holds the enclosing environment and the new cells
+			captured_variables = parent_closure;
+			captured_variables.Reserve(captured_count);
+			captured_count -= parent_closure.GetLength();
 
-					Push(new_union);
-					CollectGarbage();
-					break;
-				}
-				case OpCode::ALLOCATE_CLOSURE:
-				{
-					int proc_index = static_cast<int>(ReadByte());
-					Push(MidoriTraceable::AllocateTraceable(MidoriClosure{ MidoriClosure::Environment{}, proc_index }));
-					CollectGarbage();
-					break;
-				}
-				case OpCode::CONSTRUCT_CLOSURE:
+			// a slot has at most one pending cell, closures capturing the same local share it
+			size_t pending_index = static_cast<size_t>(std::ranges::partition_point(m_cells_to_promote, [this](MidoriTraceable* cell_ptr)
 				{
-					int captured_count = static_cast<int>(ReadByte());
+					return cell_ptr->GetCellValue().m_stack_value_ref < m_value_stack_base_pointer;
+				}) - m_cells_to_promote.begin());
 
-					if (captured_count == 0)
+			std::for_each_n
+			(
+				std::execution::seq,
+				m_value_stack_base_pointer,
+				captured_count,
+				[&captured_variables, &pending_index, this](MidoriValue& value)
+				{
+					MidoriValue* stack_value_ref = &value;
+					if (pending_index < m_cells_to_promote.size() && m_cells_to_promote[pending_index]->GetCellValue().m_stack_value_ref == stack_value_ref)
 					{
-						break;
+						captured_variables.AddBack(m_cells_to_promote[pending_index]);
+						pending_index += 1u;
+						return;
 					}
 
-					MidoriClosure::Environment& captured_variables = (m_value_stack_pointer - 1)->GetPointer()->GetClosure().m_cell_values;
-
-					const MidoriClosure::Environment& parent_closure = (m_call_stack_pointer - 1)->m_closure->GetClosure().m_cell_values;
-					captured_variables = parent_closure;
-					captured_count -= parent_closure.GetLength();
-
-					std::for_each_n
-					(
-						std::execution::seq,
-						m_value_stack_base_pointer,
-						captured_count,
-						[&captured_variables, this](MidoriValue& value)
-						{
-							MidoriValue* stack_value_ref = &value;
-							MidoriValue cell_value = MidoriTraceable::AllocateTraceable(MidoriCellValue{ MidoriValue(), stack_value_ref, false });
-							captured_variables.AddBack(cell_value);
-							m_cells_to_promote[m_cell_promotion_count++] = &cell_value.GetPointer()->GetCellValue();
-						}
-					);
-					CollectGarbage();
-					break;
-				}
-				case OpCode::DEFINE_GLOBAL:
-				{
-					const MidoriValue& value = Pop();
-					int global_idx = ReadGlobalVariable();
-					MidoriValue& var = m_global_vars[global_idx];
-					var = value;
-					break;
-				}
-				case OpCode::GET_GLOBAL:
-				{
-					int global_idx = ReadGlobalVariable();
-					Push(m_global_vars[global_idx]);
-					break;
-				}
-				case OpCode::SET_GLOBAL:
-				{
-					int global_idx = ReadGlobalVariable();
-					MidoriValue& var = m_global_vars[global_idx];
-					var = Peek();
-					break;
-				}
-				case OpCode::GET_LOCAL:
-				{
-					int offset = static_cast<int>(ReadByte());
-					Push(*(m_value_stack_base_pointer + offset));
-					break;
+					MidoriValue cell_value = MidoriTraceable::AllocateTraceable(MidoriCellValue{ MidoriValue(), stack_value_ref, false });
+					captured_variables.AddBack(cell_value);
+					m_cells_to_promote.emplace_back(cell_value.GetPointer());
 				}
-				case OpCode::SET_LOCAL:
-				{
-					int offset = static_cast<int>(ReadByte());
-					MidoriValue& var = *(m_value_stack_base_pointer + offset);
+			);
+			CollectGarbage();
+			VM_DISPATCH();
+		}
+		VM_CASE(DEFINE_GLOBAL)
+		{
+			const MidoriValue& value = Pop();
+			int global_idx = ReadGlobalVariable();
+			MidoriValue& var = m_global_vars[global_idx];
+			var = value;
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_GLOBAL)
+		{
+			int global_idx = ReadGlobalVariable();
+			Push(m_global_vars[global_idx]);
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_GLOBAL)
+		{
+			int global_idx = ReadGlobalVariable();
+			MidoriValue& var = m_global_vars[global_idx];
+			var = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_LOCAL)
+		{
+			int offset = static_cast<int>(ReadByte());
+			Push(*(m_value_stack_base_pointer + offset));
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_LOCAL)
+		{
+			int offset = static_cast<int>(ReadByte());
+			MidoriValue& var = *(m_value_stack_base_pointer + offset);
 
-					const MidoriValue& value = Peek();
-					var = value;
-					break;
-				}
-				case OpCode::GET_CELL:
-				{
-					int offset = static_cast<int>(ReadByte());
-					const MidoriValue& cell_value = (*m_curr_environment)[offset].GetPointer()->GetCellValue().GetValue();
-					Push(cell_value);
-					break;
-				}
-				case OpCode::SET_CELL:
-				{
-					int offset = static_cast<int>(ReadByte());
-					MidoriValue& cell_value = (*m_curr_environment)[offset].GetPointer()->GetCellValue().GetValue();
-					cell_value = Peek();
-					break;
-				}
-				case OpCode::GET_MEMBER:
-				{
-					int index = static_cast<int>(ReadByte());
-					const MidoriValue& value = Pop();
-					Push(value.GetPointer()->GetStruct().m_values[index]);
-					break;
-				}
-				case OpCode::SET_MEMBER:
-				{
-					int index = static_cast<int>(ReadByte());
-					const MidoriValue& value = Pop();
-					const MidoriValue& var = Peek();
-					var.GetPointer()->GetStruct().m_values[index] = value;
-					break;
-				}
-				case OpCode::POP:
-				{
-					--m_value_stack_pointer;
-					break;
-				}
-				case OpCode::DUP:
-				{
-					Push(Peek());
-					break;
-				}
-				case OpCode::POP_SCOPE:
-				{
-					// on scope exit, promote all cells to heap
-					PromoteCells();
+			const MidoriValue& value = Peek();
+			var = value;
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_CELL)
+		{
+			int offset = static_cast<int>(ReadByte());
+			const MidoriValue& cell_value = (*m_curr_environment)[offset].GetPointer()->GetCellValue().GetValue();
+			Push(cell_value);
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_CELL)
+		{
+			int offset = static_cast<int>(ReadByte());
+			MidoriValue& cell_value = (*m_curr_environment)[offset].GetPointer()->GetCellValue().GetValue();
+			cell_value = Peek();
+			VM_DISPATCH();
+		}
+		VM_CASE(GET_MEMBER)
+		{
+			int index = static_cast<int>(ReadByte());
+			const MidoriValue& value = Pop();
+			Push(value.GetPointer()->GetMembers()[index]);
+			VM_DISPATCH();
+		}
+		VM_CASE(SET_MEMBER)
+		{
+			int index = static_cast<int>(ReadByte());
+			const MidoriValue& value = Pop();
+			const MidoriValue& var = Peek();
+			var.GetPointer()->GetMembers()[index] = value;
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_INTEGER_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
 
-					m_value_stack_pointer -= static_cast<int>(ReadByte());
-					break;
-				}
-				case OpCode::POP_MULTIPLE:
-				{
-					m_value_stack_pointer -= static_cast<int>(ReadByte());
-					break;
-				}
-				case OpCode::RETURN:
-				{
-					// on return, promote all cells to heap
-					PromoteCells();
+			Push(left + right);
 
-					const MidoriValue& value = Pop();
-					--m_call_stack_pointer;
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_INTEGER_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
 
-					CallFrame& top_frame = *m_call_stack_pointer;
+			Push(left + right);
 
-					m_curr_environment = &(m_call_stack_pointer - 1)->m_closure->GetClosure().m_cell_values;
-					m_value_stack_base_pointer = top_frame.m_return_bp;
-					m_instruction_pointer = top_frame.m_return_ip;
-					m_value_stack_pointer = top_frame.m_return_sp;
+			VM_DISPATCH();
+		}
+		VM_CASE(SUBTRACT_INTEGER_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
 
-					Push(value);
+			Push(left - right);
 
-					break;
-				}
-				case OpCode::HALT:
-				{
-					return;
-				}
-				default:
-				{
+			VM_DISPATCH();
+		}
+		VM_CASE(SUBTRACT_INTEGER_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+
+			Push(left - right);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(MULTIPLY_INTEGER_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+
+			Push(left * right);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(MULTIPLY_INTEGER_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+
+			Push(left * right);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(MODULO_INTEGER_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+
+			Push(left % right);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(MODULO_INTEGER_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+
+			Push(left % right);
+
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_INTEGER_RRR)
+		{
+			MidoriValue& destination = ReadRegister();
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+
+			destination = left + right;
+
+			VM_DISPATCH();
+		}
+		VM_CASE(ADD_INTEGER_RRI)
+		{
+			MidoriValue& destination = ReadRegister();
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+
+			destination = left + right;
+
+			VM_DISPATCH();
+		}
+		VM_CASE(SUBTRACT_INTEGER_RRR)
+		{
+			MidoriValue& destination = ReadRegister();
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+
+			destination = left - right;
+
+			VM_DISPATCH();
+		}
+		VM_CASE(SUBTRACT_INTEGER_RRI)
+		{
+			MidoriValue& destination = ReadRegister();
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+
+			destination = left - right;
+
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_LESS_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+			int offset = ReadShort();
+
+			if (!(left < right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_LESS_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+			int offset = ReadShort();
+
+			if (!(left < right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_LESS_EQUAL_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+			int offset = ReadShort();
+
+			if (!(left <= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_LESS_EQUAL_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+			int offset = ReadShort();
+
+			if (!(left <= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_GREATER_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+			int offset = ReadShort();
+
+			if (!(left > right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_GREATER_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+			int offset = ReadShort();
+
+			if (!(left > right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_GREATER_EQUAL_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+			int offset = ReadShort();
+
+			if (!(left >= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_GREATER_EQUAL_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+			int offset = ReadShort();
+
+			if (!(left >= right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_EQUAL_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+			int offset = ReadShort();
+
+			if (!(left == right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_EQUAL_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+			int offset = ReadShort();
+
+			if (!(left == right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_NOT_EQUAL_RR)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadRegister().GetInteger();
+			int offset = ReadShort();
+
+			if (!(left != right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(IF_INTEGER_NOT_EQUAL_RI)
+		{
+			MidoriInteger left = ReadRegister().GetInteger();
+			MidoriInteger right = ReadIntegerImmediate();
+			int offset = ReadShort();
+
+			if (!(left != right))
+			{
+				m_instruction_pointer += offset;
+			}
+			VM_DISPATCH();
+		}
+		VM_CASE(POP)
+		{
+			--m_value_stack_pointer;
+			VM_DISPATCH();
+		}
+		VM_CASE(DUP)
+		{
+			Push(Peek());
+			VM_DISPATCH();
+		}
+		VM_CASE(POP_SCOPE)
+		{
+			// on scope exit, promote the cells of the slots being popped to heap
+			m_value_stack_pointer -= static_cast<int>(ReadByte());
+			PromoteCells(m_value_stack_pointer);
+			VM_DISPATCH();
+		}
+		VM_CASE(POP_MULTIPLE)
+		{
+			m_value_stack_pointer -= static_cast<int>(ReadByte());
+			VM_DISPATCH();
+		}
+		VM_CASE(RETURN)
+		{
+			ReturnFromCall();
+#ifdef MIDORI_NAN_BOXING
+			CollectGarbage();
+#endif
+#ifdef MIDORI_JIT
+			if (m_call_stack_pointer == m_jit_return_boundary) [[unlikely]]
+			{
+				return;
+			}
+#endif
+			VM_DISPATCH();
+		}
+		VM_CASE(HALT)
+		{
+			return;
+		}
+		default:
+		{
 #ifdef _MSC_VER
-					__assume(0);
+			__assume(0);
 #else
-					__builtin_unreachable();
+			__builtin_unreachable();
+#endif
+		}
+		}
+	}
+
+#ifdef MIDORI_USE_COMPUTED_GOTO
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
 #endif
-				}
-				}
-			}
 }
\ No newline at end of file
@@ -5,76 +5,154 @@
 #include "Common/Value/Value.h"
 #include "Common/Executable/Executable.h"
 #include "Interpreter/GarbageCollector/GarbageCollector.h"
+#include "Interpreter/VirtualMachine/GrowableStack.h"
+#include "Interpreter/JitCompiler/JitCompiler.h"
+#include "Interpreter/TraceCompiler/TraceCompiler.h"
+#include "Library/MidoriPrelude.h"
 
-#include <array>
 #include <functional>
 #include <unordered_map>
 
 // handle std library
+#ifndef MIDORI_STATIC_PRELUDE
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
 #else
 #include <dlfcn.h>
 #endif
+#endif
 
 class VirtualMachine
 {
 
 public:
 
+	// the most the stacks may grow to, only the part in use is backed by memory
+	struct StackLimits
+	{
+		size_t m_max_value_stack_size = 1u << 24u;
+		size_t m_max_call_depth = 1u << 20u;
+	};
+
 	VirtualMachine(MidoriExecutable&& executable) noexcept;
 
+	VirtualMachine(MidoriExecutable&& executable, StackLimits stack_limits) noexcept;
+
 	~VirtualMachine();
 
 private:
 
-	static constexpr int s_value_stack_max = 30000;
-	static constexpr int s_call_stack_max = 10001; // sentinel closure
+	static constexpr size_t s_initial_value_stack_size = 4096u;
+	static constexpr size_t s_initial_call_stack_size = 256u;
+#ifdef MIDORI_JIT
+	static constexpr int s_max_native_nesting_depth = 4096;
+#endif
 	static constexpr int s_garbage_collection_threshold = 1024;
+	static constexpr OpCode s_host_return_instruction = OpCode::HALT; // invoked functions return here, handing control back to the host
 
 	using ValueStackPointer = MidoriValue*;
 	using InstructionPointer = const OpCode*;
 	using GlobalVariables = std::vector<MidoriValue>;
+	using ForeignFunction = void(*)(MidoriValue* args, MidoriValue* ret);
+	using ForeignFunctions = std::vector<ForeignFunction>;
 
 	struct CallFrame
 	{
 		ValueStackPointer  m_return_bp = nullptr;
 		ValueStackPointer  m_return_sp = nullptr;
 		InstructionPointer m_return_ip = nullptr;
-		MidoriTraceable*   m_closure = nullptr;
+		MidoriTraceable*   m_closure = nullptr; // nullptr for direct calls, the callee captures nothing and is kept alive by its global
+		const MidoriClosure::Environment* m_environment = nullptr;
+#ifdef MIDORI_JIT
+		int m_proc_index = 0;
+#endif
 	};
 
 	using CallStackPointer = CallFrame*;
 
-	std::array<MidoriCellValue*, 256> m_cells_to_promote;
+	std::vector<MidoriTraceable*> m_cells_to_promote; // cells that still refer to a value stack slot
 	MidoriExecutable m_executable;
 	GlobalVariables m_global_vars;
+	ForeignFunctions m_foreign_functions; // indexed like the foreign function table of the executable, nullptr if unresolved
 	GarbageCollector m_garbage_collector;
-	std::unique_ptr<std::array<MidoriValue, s_value_stack_max>> m_value_stack{ std::make_unique<std::array<MidoriValue, s_value_stack_max>>() };
-	std::unique_ptr<std::array<CallFrame, s_call_stack_max>> m_call_stack{ std::make_unique<std::array<CallFrame, s_call_stack_max>>() };
-	MidoriClosure::Environment* m_curr_environment{ nullptr };
+	GrowableStack<MidoriValue> m_value_stack;
+	GrowableStack<CallFrame> m_call_stack; // the first frame belongs to the sentinel closure
+	std::vector<InstructionPointer> m_procedure_entry_points;
+	MidoriClosure::Environment m_empty_environment;
+	const MidoriClosure::Environment* m_curr_environment{ nullptr };
 	InstructionPointer m_instruction_pointer{ nullptr };
-	ValueStackPointer m_value_stack_base_pointer = &(*m_value_stack)[0u];
-	ValueStackPointer m_value_stack_pointer = &(*m_value_stack)[0u];
-	ValueStackPointer m_value_stack_begin = &(*m_value_stack)[0u];
-	ValueStackPointer m_value_stack_end = &(*m_value_stack)[static_cast<size_t>(s_value_stack_max) - 1u];
-	CallStackPointer m_call_stack_pointer = &(*m_call_stack)[1u];
-	CallStackPointer m_call_stack_begin = &(*m_call_stack)[1u];
-	CallStackPointer m_call_stack_end = &(*m_call_stack)[static_cast<size_t>(s_call_stack_max) - 1u];
-	size_t m_cell_promotion_count{ 0u };
+	InstructionPointer m_main_call_address{ nullptr }; // where the startup procedure calls main, set once the globals are defined
+	MidoriValue m_host_result; // the result of the last invocation, rooted until the next one returns
+	ValueStackPointer m_value_stack_base_pointer = m_value_stack.GetBase();
+	ValueStackPointer m_value_stack_pointer = m_value_stack.GetBase();
+	ValueStackPointer m_value_stack_begin = m_value_stack.GetBase();
+	ValueStackPointer m_value_stack_end = m_value_stack.GetCommittedEnd() - 1; // last committed slot, moves as the stack grows
+	CallStackPointer m_call_stack_pointer = m_call_stack.GetBase() + 1;
+	CallStackPointer m_call_stack_begin = m_call_stack.GetBase() + 1;
+	CallStackPointer m_call_stack_end = m_call_stack.GetCommittedEnd() - 1;
+
+#ifdef MIDORI_JIT
+	JitCompiler m_jit_compiler{ m_executable, m_global_vars, JitCompiler::RuntimeHelpers{ &JitCall, &JitCallDirect, &JitReturn, &JitGetCell, &JitPromoteCells } };
+	CallStackPointer m_jit_return_boundary = nullptr; // a nested interpreter loop returns once the call stack unwinds to here
+	int m_curr_procedure_index = 0;
+	int m_native_nesting_depth = 0; // native calls recurse on the machine stack, deeper calls are interpreted
+#endif
+
+#ifdef MIDORI_TRACING_JIT
+	TraceCompiler m_trace_compiler{ m_global_vars };
+#endif
 
+#ifndef MIDORI_STATIC_PRELUDE
 #ifdef _WIN32
 	HMODULE m_library_handle = nullptr;
 #else
 	void* m_library_handle = nullptr;
 #endif
+#endif
 
 public:
 
+	// defines the globals of the program and runs main
 	void Execute() noexcept;
 
+	// Host API: the globals are defined once, after which any global function can be invoked as often as needed
+	// while the stacks, the heap and the resolved foreign functions stay warm.
+	//
+	//	std::optional<int> add = virtual_machine.FindGlobal("Add");
+	//	virtual_machine.PushArgument(MidoriInteger{ 1 });
+	//	virtual_machine.PushArgument(MidoriInteger{ 2 });
+	//	std::optional<MidoriValue> sum = virtual_machine.Invoke(add.value(), 2);
+	//
+	// The last result stays rooted, a result that points into the heap is valid until the next invocation returns.
+
+	// defines the globals of the program without running main, does nothing the second time
+	void Initialize() noexcept;
+
+	// the handle of a global function for Invoke, std::nullopt if the program defines no such global or it holds no function
+	std::optional<int> FindGlobal(std::string_view name) noexcept;
+
+	// may collect garbage like PushTextArgument, a wide integer is boxed on the heap of the executable
+	template<typename... Args>
+		requires MidoriValueConstructible<Args...>
+	void PushArgument(Args&&... args) noexcept
+	{
+		MidoriHeap::Scope heap_scope(m_executable.GetHeap());
+		Push(std::forward<Args>(args)...);
+		CollectGarbage();
+	}
+
+	// may collect garbage, except for the arguments pushed so far and the last result
+	void PushTextArgument(std::string_view text) noexcept;
+
+	// calls the function held by the global with the top arity arguments and pops them,
+	// std::nullopt if the global holds no function taking arity arguments, the arguments are dropped all the same
+	std::optional<MidoriValue> Invoke(int global_index, int arity) noexcept;
+
 private:
 
+	// the dispatch loop, returns on HALT
+	void Interpret() noexcept;
+
 	void TerminateExecution(std::string_view message) noexcept;
 
 	// only used for error reporting, efficiency is not a concern
@@ -88,6 +166,10 @@ private:
 
 	MidoriInteger ReadIntegerConstant() noexcept;
 
+	MidoriInteger ReadIntegerImmediate() noexcept;
+
+	MidoriValue& ReadRegister() noexcept;
+
 	MidoriFraction ReadFractionConstant() noexcept;
 
 	const MidoriValue& ReadConstant(OpCode operand_length) noexcept;
@@ -96,13 +178,49 @@ private:
 
 	std::string GenerateRuntimeError(std::string_view message, int line) noexcept;
 
-	void PushCallFrame(ValueStackPointer return_bp, ValueStackPointer return_sp, InstructionPointer return_ip, MidoriTraceable* closure_ptr) noexcept;
+	void LoadForeignFunctions() noexcept;
+
+	// the number of parameters of the function a global holds, std::nullopt if it holds no function
+	std::optional<int> GetGlobalFunctionArity(int global_index) const noexcept;
+
+	// the arguments are the top arity values of the value stack, they are replaced by the result
+	void CallForeignFunction(int foreign_index, int arity) noexcept;
+
+	// commits the value stack up to required_end, false once that exceeds the stack limit
+	bool GrowValueStack(ValueStackPointer required_end) noexcept;
+
+	bool GrowCallStack() noexcept;
+
+	void PushCallFrame(ValueStackPointer return_bp, ValueStackPointer return_sp, InstructionPointer return_ip, MidoriTraceable* closure_ptr, const MidoriClosure::Environment* environment) noexcept;
+
+	void CallClosure(MidoriTraceable* closure_ptr, int arity) noexcept;
+
+	// calls a procedure that captures nothing without going through its closure
+	void CallDirect(int proc_index, int arity) noexcept;
+
+	// reuses the current call frame: the arguments slide down to the base pointer and the callee returns to our caller
+	void TailCallClosure(MidoriTraceable* closure_ptr, int arity) noexcept;
+
+	void ReturnFromCall() noexcept;
+
+	// restores the caller's state from the top call frame
+	void PopCallFrame() noexcept;
 
 	MidoriValue& Peek() noexcept;
 
 	MidoriValue& Pop() noexcept;
 
-	void PromoteCells() noexcept;
+	// closes over the captured locals from scope_begin up, the cells of the slots below stay pending
+	void PromoteCells(ValueStackPointer scope_begin) noexcept;
+
+	// whether a captured local of the current frame still lives on the value stack
+	bool HasPendingCellsInFrame() noexcept;
+
+	// closes over the captured locals of a yielding generator frame until it resumes
+	void SuspendCells() noexcept;
+
+	// hands the captured locals of a resumed generator frame back to its stack slots
+	void ResumeCells() noexcept;
 
 	void CheckIndexBounds(const MidoriValue& index, MidoriInteger size) noexcept;
 
@@ -110,19 +228,45 @@ private:
 
 	void CheckArrayPopResult(const std::optional<MidoriValue>& result) noexcept;
 
-	MidoriTraceable::GarbageCollectionRoots GetValueStackGarbageCollectionRoots() const noexcept;
-
-	MidoriTraceable::GarbageCollectionRoots GetGlobalTableGarbageCollectionRoots() const noexcept;
+	// reuses an equal text that is already allocated when the build interns texts
+	MidoriTraceable* AllocateText(MidoriText&& text) noexcept;
 
-	MidoriTraceable::GarbageCollectionRoots GetGarbageCollectionRoots() const noexcept;
+	// pushes the live values of the stacks and the global table straight onto the collector's mark worklist
+	void MarkGarbageCollectionRoots() noexcept;
 
 	void CollectGarbage() noexcept;
 
+#ifdef DEBUG
+	void PrintExecutionTrace() noexcept;
+#endif
+
+#ifdef MIDORI_JIT
+	// false if the value stack has no room for the native frame, in which case the interpreter carries on
+	bool TryEnterNativeCode(const JitCompiler::NativeProcedure& native_procedure, int bytecode_offset) noexcept;
+
+	void InterpretUntilReturn(CallStackPointer boundary) noexcept;
+
+	static MidoriValue* JitCall(VirtualMachine* virtual_machine, MidoriValue* stack_pointer, InstructionPointer return_address, MidoriTraceable* closure_ptr, int arity) noexcept;
+
+	static MidoriValue* JitCallDirect(VirtualMachine* virtual_machine, MidoriValue* stack_pointer, InstructionPointer return_address, int proc_index, int arity) noexcept;
+
+	static void JitReturn(VirtualMachine* virtual_machine, MidoriValue* stack_pointer) noexcept;
+
+	static MidoriValue* JitGetCell(VirtualMachine* virtual_machine, int index) noexcept;
+
+	static void JitPromoteCells(VirtualMachine* virtual_machine, MidoriValue* scope_begin) noexcept;
+#endif
+
+#ifdef MIDORI_TRACING_JIT
+	// leaves the interpreter state at the side exit the trace took, or untouched if the trace cannot run here
+	void RunTrace(TraceCompiler::Trace& trace) noexcept;
+#endif
+
 	template<typename... Args>
 		requires MidoriValueConstructible<Args...>
 	void Push(Args&&... args) noexcept
 	{
-		if (m_value_stack_pointer <= m_value_stack_end) [[likely]]
+		if (m_value_stack_pointer <= m_value_stack_end || GrowValueStack(m_value_stack_pointer + 1)) [[likely]]
 		{
 			std::construct_at(m_value_stack_pointer, std::forward<Args>(args)...);
 			++m_value_stack_pointer;
@@ -1,7 +1,10 @@
 #include "Common/Value/Value.h"
+#include "Library/MidoriPrelude.h"
 
+#include <array>
 #include <chrono>
 #include <fstream>
+#include <utility>
 
 #if defined(_WIN32) || defined(_WIN64)
 #define MIDORI_API __declspec(dllexport)
@@ -77,3 +80,26 @@ extern "C"
 		new (ret) MidoriValue(static_cast<MidoriFraction>(duration.count()));
 	}
 }
+
+#ifdef MIDORI_STATIC_PRELUDE
+MidoriPreludeFunction FindPreludeFunction(std::string_view name) noexcept
+{
+	static constexpr std::array<std::pair<std::string_view, MidoriPreludeFunction>, 4u> prelude_functions =
+	{
+		std::make_pair("Print", &Print),
+		std::make_pair("OverwriteToFile", &OverwriteToFile),
+		std::make_pair("AppendToFile", &AppendToFile),
+		std::make_pair("GetTime", &GetTime),
+	};
+
+	for (const std::pair<std::string_view, MidoriPreludeFunction>& prelude_function : prelude_functions)
+	{
+		if (prelude_function.first == name)
+		{
+			return prelude_function.second;
+		}
+	}
+
+	return nullptr;
+}
+#endif
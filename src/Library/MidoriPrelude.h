@@ -0,0 +1,12 @@
+#ifdef MIDORI_STATIC_PRELUDE
+#pragma once
+
+#include "Common/Value/Value.h"
+
+#include <string_view>
+
+using MidoriPreludeFunction = void(*)(MidoriValue* args, MidoriValue* ret);
+
+// the prelude is linked into the interpreter, nullptr if no prelude function has the given name
+MidoriPreludeFunction FindPreludeFunction(std::string_view name) noexcept;
+#endif
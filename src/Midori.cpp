@@ -1,4 +1,5 @@
 ﻿#include <algorithm>
+#include <charconv>
 #include <fstream>
 #include <sstream>
 
@@ -26,17 +27,48 @@ std::string ReadFile(const char* filename)
 	return buffer.str();
 }
 
+// --max-stack-size=<values> and --max-call-depth=<frames>
+VirtualMachine::StackLimits ParseStackLimits(int argc, char* argv[])
+{
+	VirtualMachine::StackLimits stack_limits;
+
+	for (int i = 1; i < argc; i += 1)
+	{
+		std::string_view argument = argv[i];
+		size_t* limit = argument.starts_with("--max-stack-size=")
+			? &stack_limits.m_max_value_stack_size
+			: argument.starts_with("--max-call-depth=")
+			? &stack_limits.m_max_call_depth
+			: nullptr;
+		if (limit == nullptr)
+		{
+			continue;
+		}
+
+		std::string_view value = argument.substr(argument.find('=') + 1u);
+		std::from_chars_result result = std::from_chars(value.data(), value.data() + value.size(), *limit);
+		if (result.ec != std::errc{} || result.ptr != value.data() + value.size() || *limit == 0u)
+		{
+			Printer::Print<Printer::Color::RED>(std::format("Invalid stack limit: {}\n", argument));
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	return stack_limits;
+}
+
 int main(int argc, char* argv[])
 {
 	std::string file_name = "C:\\Users\\jk381\\source\\repos\\chwwhc\\Midori\\test\\test.mdr"s;
 	std::string file_content = ReadFile(file_name.data());
+	VirtualMachine::StackLimits stack_limits = ParseStackLimits(argc, argv);
 
 	return Compiler::Compile(std::move(file_content), std::move(file_name))
 		.and_then
 		(
-			[](MidoriExecutable&& executable)
+			[stack_limits](MidoriExecutable&& executable)
 			{
-				VirtualMachine virtual_machine(std::move(executable));
+				VirtualMachine virtual_machine(std::move(executable), stack_limits);
 				virtual_machine.Execute();
 				return std::expected<int, std::string>(0);
 			}
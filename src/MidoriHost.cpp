@@ -0,0 +1,137 @@
+#include <fstream>
+#include <sstream>
+
+#include "Common/Printer/Printer.h"
+#include "Compiler/Compiler.h"
+#include "Interpreter/VirtualMachine/VirtualMachine.h"
+
+// An example of the host API of the virtual machine, built with -DMIDORI_BUILD_HOST_TEST=ON: test/embedding/host.mdr
+// is compiled once and its globals are invoked repeatedly on the same virtual machine.
+// Exits with EXIT_FAILURE at the first unexpected result.
+
+namespace
+{
+	constexpr int s_repetitions = 1000;
+
+	std::string ReadFile(const char* filename)
+	{
+		std::ifstream file(filename);
+		if (!file.is_open())
+		{
+			Printer::Print<Printer::Color::RED>(std::format("Could not open file: {}\n", filename));
+			std::exit(EXIT_FAILURE);
+		}
+
+		std::ostringstream buffer;
+		buffer << file.rdbuf();
+		return buffer.str();
+	}
+
+	void Check(bool condition, std::string_view description)
+	{
+		if (!condition)
+		{
+			Printer::Print<Printer::Color::RED>(std::format("Host check failed: {}\n", description));
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	int FindGlobalOrFail(VirtualMachine& virtual_machine, std::string_view name)
+	{
+		std::optional<int> global_index = virtual_machine.FindGlobal(name);
+		Check(global_index.has_value(), std::format("{} is a global function", name));
+		return global_index.value();
+	}
+
+	void RunHostChecks(VirtualMachine& virtual_machine)
+	{
+		Check(!virtual_machine.FindGlobal("call_count").has_value(), "a global holding no function cannot be invoked");
+		Check(!virtual_machine.FindGlobal("Missing").has_value(), "an undefined global cannot be found");
+
+		int add = FindGlobalOrFail(virtual_machine, "Add");
+		int call_count = FindGlobalOrFail(virtual_machine, "CallCount");
+		int greet = FindGlobalOrFail(virtual_machine, "Greet");
+		int get_time = FindGlobalOrFail(virtual_machine, "GetTime");
+		int print = FindGlobalOrFail(virtual_machine, "Print");
+
+		// the globals stay defined between invocations
+		for (int i = 0; i < s_repetitions; i += 1)
+		{
+			virtual_machine.PushArgument(MidoriInteger{ i });
+			virtual_machine.PushArgument(MidoriInteger{ i + 1 });
+			std::optional<MidoriValue> sum = virtual_machine.Invoke(add, 2);
+			Check(sum.has_value() && sum->IsInteger() && sum->GetInteger() == 2 * i + 1, "Add returns the sum of its arguments");
+		}
+
+		std::optional<MidoriValue> count = virtual_machine.Invoke(call_count, 0);
+		Check(count.has_value() && count->GetInteger() == s_repetitions, "Add updates its global on every invocation");
+
+		// too wide to be stored inline with NaN-boxing
+		constexpr MidoriInteger wide_integer = MidoriInteger{ 1 } << 60;
+		virtual_machine.PushArgument(wide_integer);
+		virtual_machine.PushArgument(MidoriInteger{ 1 });
+		std::optional<MidoriValue> wide_sum = virtual_machine.Invoke(add, 2);
+		Check(wide_sum.has_value() && wide_sum->GetInteger() == wide_integer + 1, "Add handles wide integers");
+
+		// a mismatched arity drops the arguments: a single argument afterwards is not enough for Add
+		virtual_machine.PushArgument(MidoriInteger{ 1 });
+		Check(!virtual_machine.Invoke(add, 1).has_value(), "Add cannot be invoked with one argument");
+		virtual_machine.PushArgument(MidoriInteger{ 1 });
+		Check(!virtual_machine.Invoke(add, 2).has_value(), "the arguments of a failed invocation are not left on the stack");
+		Check(!virtual_machine.Invoke(-1, 0).has_value(), "an invalid global cannot be invoked");
+
+		for (int i = 0; i < s_repetitions; i += 1)
+		{
+			virtual_machine.PushTextArgument("host");
+			std::optional<MidoriValue> greeting = virtual_machine.Invoke(greet, 1);
+			Check(greeting.has_value() && greeting->IsPointer() && std::string_view(greeting->GetPointer()->GetText().GetCString()) == "Hello, host", "Greet concatenates texts");
+		}
+
+		// foreign globals run in place
+		for (int i = 0; i < s_repetitions; i += 1)
+		{
+			std::optional<MidoriValue> time = virtual_machine.Invoke(get_time, 0);
+			Check(time.has_value() && time->IsFraction() && time->GetFraction() > 0.0, "GetTime returns the current time");
+		}
+
+		virtual_machine.PushArgument(MidoriInteger{ 1 });
+		virtual_machine.PushArgument(MidoriInteger{ 2 });
+		Check(!virtual_machine.Invoke(print, 2).has_value(), "Print cannot be invoked with two arguments");
+		virtual_machine.PushTextArgument("");
+		std::optional<MidoriValue> printed = virtual_machine.Invoke(print, 1);
+		Check(printed.has_value() && printed->IsUnit(), "Print returns unit");
+
+		virtual_machine.PushArgument(MidoriInteger{ 20 });
+		virtual_machine.PushArgument(MidoriInteger{ 22 });
+		std::optional<MidoriValue> last_sum = virtual_machine.Invoke(add, 2);
+		Check(last_sum.has_value() && last_sum->GetInteger() == 42, "Add still works after failed invocations");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string file_name = argc > 1 ? argv[1] : "test/embedding/host.mdr";
+	std::string file_content = ReadFile(file_name.data());
+
+	return Compiler::Compile(std::move(file_content), std::move(file_name))
+		.and_then
+		(
+			[](MidoriExecutable&& executable)
+			{
+				VirtualMachine virtual_machine(std::move(executable));
+				RunHostChecks(virtual_machine);
+				Printer::Print<Printer::Color::GREEN>("All host checks passed.\n");
+				return std::expected<int, std::string>(0);
+			}
+		)
+		.or_else
+		(
+			[](std::string&& compilation_error)
+			{
+				Printer::Print<Printer::Color::RED>("Compilation failed :( \n");
+				Printer::Print<Printer::Color::RED>(std::format("{}\n", compilation_error));
+				return std::expected<int, std::string>(EXIT_FAILURE);
+			}
+		)
+		.value();
+}
@@ -113,6 +113,17 @@ void PrintAbstractSyntaxTree::operator()(const For& for_stmt, int depth) const
 	PrintWithIndentation(depth + 1, "}");
 }
 
+void PrintAbstractSyntaxTree::operator()(const ForEach& for_each, int depth) const
+{
+	PrintWithIndentation(depth, "ForEach {");
+	PrintWithIndentation(depth + 1, "Name: " + for_each.m_name.m_lexeme);
+	PrintWithIndentation(depth + 1, "Generator: ");
+	std::visit([depth, this](auto&& arg) { (*this)(arg, depth + 2); }, *for_each.m_generator);
+	PrintWithIndentation(depth + 1, "Body: ");
+	std::visit([depth, this](auto&& arg) { (*this)(arg, depth + 2); }, *for_each.m_body);
+	PrintWithIndentation(depth, "}");
+}
+
 void PrintAbstractSyntaxTree::operator()(const Break&, int depth) const
 {
 	PrintWithIndentation(depth, "Break");
@@ -131,6 +142,14 @@ void PrintAbstractSyntaxTree::operator()(const Return& return_stmt, int depth) c
 	PrintWithIndentation(depth, "}");
 }
 
+void PrintAbstractSyntaxTree::operator()(const Yield& yield_stmt, int depth) const
+{
+	PrintWithIndentation(depth, "Yield {");
+	PrintWithIndentation(depth + 1, "Value: ");
+	std::visit([depth, this](auto&& arg) { (*this)(arg, depth + 2); }, *yield_stmt.m_value);
+	PrintWithIndentation(depth, "}");
+}
+
 void PrintAbstractSyntaxTree::operator()(const Foreign& foreign, int depth) const
 {
 	PrintWithIndentation(depth, "ForeignFunctionInterface {");
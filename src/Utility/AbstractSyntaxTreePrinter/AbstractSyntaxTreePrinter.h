@@ -21,12 +21,16 @@ struct PrintAbstractSyntaxTree
 
 	void operator()(const For& for_stmt, int depth = 0) const;
 
+	void operator()(const ForEach& for_each, int depth = 0) const;
+
 	void operator()(const Break&, int depth = 0) const;
 
 	void operator()(const Continue&, int depth = 0) const;
 
 	void operator()(const Return& return_stmt, int depth = 0) const;
 
+	void operator()(const Yield& yield_stmt, int depth = 0) const;
+
 	void operator()(const Foreign& foreign, int depth = 0) const;
 
 	void operator()(const Struct& struct_stmt, int depth = 0) const;
@@ -145,12 +145,13 @@ namespace
 		int operand = static_cast<int>(executable.ReadByteCode(offset + 1, proc_index)) |
 			(static_cast<int>(executable.ReadByteCode(offset + 2, proc_index)) << 8) |
 			(static_cast<int>(executable.ReadByteCode(offset + 3, proc_index)) << 16);
-		offset += 4;
+		int packing = static_cast<int>(executable.ReadByteCode(offset + 4, proc_index));
+		offset += 5;
 		std::ostringstream formated_str;
 
 		formated_str << std::left << std::setw(instr_width) << name;
-		formated_str << ' ' << std::dec << operand;
-		formated_str << two_tabs << std::setw(comment_width) << " // array length: " << std::dec << operand << std::setfill(' ') << '\n';
+		formated_str << ' ' << std::dec << operand << ' ' << packing;
+		formated_str << two_tabs << std::setw(comment_width) << " // array length: " << std::dec << operand << ", packing: " << packing << std::setfill(' ') << '\n';
 		Printer::Print(formated_str.str());
 	}
 
@@ -190,6 +191,36 @@ namespace
 		Printer::Print(formated_str.str());
 	}
 
+	void CallVariableInstruction(std::string_view name, const MidoriExecutable& executable, int proc_index, int& offset)
+	{
+		int callee = static_cast<int>(executable.ReadByteCode(offset + 1, proc_index));
+		int arity = static_cast<int>(executable.ReadByteCode(offset + 2, proc_index));
+		offset += 3;
+		std::ostringstream formated_str;
+
+		formated_str << std::left << std::setw(instr_width) << name;
+		formated_str << ' ' << std::dec << callee << ' ' << arity;
+		formated_str << two_tabs << std::setw(comment_width) << " // callee: ";
+		if (name == "CALL_GLOBAL")
+		{
+			formated_str << executable.GetGlobalVariable(callee).GetCString();
+		}
+		else if (name == "CALL_FOREIGN_INDEXED")
+		{
+			formated_str << executable.GetForeignFunction(callee).GetCString();
+		}
+		else if (name == "CALL_DIRECT")
+		{
+			formated_str << "procedure " << std::dec << callee;
+		}
+		else
+		{
+			formated_str << std::dec << callee;
+		}
+		formated_str << ", number of parameters: " << std::dec << arity << std::setfill(' ') << '\n';
+		Printer::Print(formated_str.str());
+	}
+
 	void MemberInstruction(std::string_view name, const MidoriExecutable& executable, int proc_index, int& offset)
 	{
 		int operand = static_cast<int>(executable.ReadByteCode(offset + 1, proc_index));
@@ -214,6 +245,31 @@ namespace
 		Printer::Print(formated_str.str());
 	}
 
+	void SwitchTableInstruction(std::string_view name, const MidoriExecutable& executable, int proc_index, int& offset)
+	{
+		auto read_short = [&executable, proc_index](int index)
+			{
+				return static_cast<int>(executable.ReadByteCode(index, proc_index)) |
+					(static_cast<int>(executable.ReadByteCode(index + 1, proc_index)) << 8);
+			};
+
+		int entry_count = read_short(offset + 1);
+		int table_end = offset + 5 + entry_count * 2;
+		std::ostringstream formated_str;
+
+		formated_str << std::left << std::setw(instr_width) << name;
+		formated_str << ' ' << std::dec << entry_count;
+		formated_str << two_tabs << std::setw(comment_width) << " // default: " << '[' << std::right << std::setfill('0') << std::setw(address_width) << std::hex << (table_end + read_short(offset + 3)) << ']' << std::setfill(' ') << '\n';
+		for (int tag = 0; tag < entry_count; tag += 1)
+		{
+			// lines up with the operand column of the instruction above
+			formated_str << std::string(static_cast<size_t>(address_width * 2 + 4), ' ') << std::left << std::setw(instr_width) << "" << ' ' << std::dec << tag;
+			formated_str << two_tabs << std::setw(comment_width) << " // destination: " << '[' << std::right << std::setfill('0') << std::setw(address_width) << std::hex << (table_end + read_short(offset + 5 + tag * 2)) << ']' << std::setfill(' ') << '\n';
+		}
+		offset = table_end;
+		Printer::Print(formated_str.str());
+	}
+
 	void SetTagInstruction(std::string_view name, const MidoriExecutable& executable, int proc_index, int& offset)
 	{
 		int operand = static_cast<int>(executable.ReadByteCode(offset + 1, proc_index));
@@ -237,6 +293,43 @@ namespace
 		formated_str << two_tabs << std::setw(comment_width) << " // slots to drop: " << std::dec << operand << std::setfill(' ') << '\n';
 		Printer::Print(formated_str.str());
 	}
+
+	void RegisterInstruction(std::string_view name, int register_count, bool has_immediate, bool has_jump, const MidoriExecutable& executable, int proc_index, int& offset)
+	{
+		std::ostringstream formated_str;
+		formated_str << std::left << std::setw(instr_width) << name;
+
+		int operand_offset = offset + 1;
+		for (int i = 0; i < register_count; i += 1)
+		{
+			int reg = static_cast<int>(executable.ReadByteCode(operand_offset, proc_index));
+			formated_str << (i == 0 ? " r" : ", r") << std::dec << reg;
+			operand_offset += 1;
+		}
+
+		if (has_immediate)
+		{
+			uint32_t bits = 0u;
+			for (int i = 0; i < 4; i += 1)
+			{
+				bits |= static_cast<uint32_t>(executable.ReadByteCode(operand_offset + i, proc_index)) << (8 * i);
+			}
+			formated_str << ", #" << std::dec << static_cast<int32_t>(bits);
+			operand_offset += 4;
+		}
+
+		if (has_jump)
+		{
+			int jump = static_cast<int>(executable.ReadByteCode(operand_offset, proc_index)) |
+				(static_cast<int>(executable.ReadByteCode(operand_offset + 1, proc_index)) << 8);
+			operand_offset += 2;
+			formated_str << two_tabs << std::setw(comment_width) << " // destination: " << '[' << std::right << std::setfill('0') << std::setw(address_width) << std::hex << (operand_offset + jump) << ']' << std::setfill(' ');
+		}
+
+		offset = operand_offset;
+		formated_str << '\n';
+		Printer::Print(formated_str.str());
+	}
 }
 
 namespace Disassembler
@@ -308,6 +401,30 @@ namespace Disassembler
 		case OpCode::SET_ARRAY:
 			ArrayInstruction("SET_ARRAY", executable, proc_index, offset);
 			break;
+		case OpCode::GET_ARRAY_ELEMENT:
+			SimpleInstruction("GET_ARRAY_ELEMENT", offset);
+			break;
+		case OpCode::SET_ARRAY_ELEMENT:
+			SimpleInstruction("SET_ARRAY_ELEMENT", offset);
+			break;
+		case OpCode::GET_ARRAY_ELEMENT_INTEGER:
+			SimpleInstruction("GET_ARRAY_ELEMENT_INTEGER", offset);
+			break;
+		case OpCode::GET_ARRAY_ELEMENT_FRACTION:
+			SimpleInstruction("GET_ARRAY_ELEMENT_FRACTION", offset);
+			break;
+		case OpCode::GET_ARRAY_ELEMENT_BOOL:
+			SimpleInstruction("GET_ARRAY_ELEMENT_BOOL", offset);
+			break;
+		case OpCode::SET_ARRAY_ELEMENT_INTEGER:
+			SimpleInstruction("SET_ARRAY_ELEMENT_INTEGER", offset);
+			break;
+		case OpCode::SET_ARRAY_ELEMENT_FRACTION:
+			SimpleInstruction("SET_ARRAY_ELEMENT_FRACTION", offset);
+			break;
+		case OpCode::SET_ARRAY_ELEMENT_BOOL:
+			SimpleInstruction("SET_ARRAY_ELEMENT_BOOL", offset);
+			break;
 		case OpCode::DUP_ARRAY:
 			SimpleInstruction("DUP_ARRAY", offset);
 			break;
@@ -482,8 +599,8 @@ namespace Disassembler
 		case OpCode::IF_FRACTION_NOT_EQUAL:
 			JumpInstruction("IF_FRACTION_NOT_EQUAL", 1, executable, proc_index, offset);
 			break;
-		case OpCode::LOAD_TAG:
-			SimpleInstruction("LOAD_TAG", offset);
+		case OpCode::SWITCH_TABLE:
+			SwitchTableInstruction("SWITCH_TABLE", executable, proc_index, offset);
 			break;
 		case OpCode::SET_TAG:
 			SetTagInstruction("SET_TAG", executable, proc_index, offset);
@@ -491,15 +608,45 @@ namespace Disassembler
 		case OpCode::CALL_FOREIGN:
 			CallInstruction("CALL_FOREIGN", executable, proc_index, offset);
 			break;
+		case OpCode::CALL_FOREIGN_INDEXED:
+			CallVariableInstruction("CALL_FOREIGN_INDEXED", executable, proc_index, offset);
+			break;
 		case OpCode::CALL_DEFINED:
 			CallInstruction("CALL_DEFINED", executable, proc_index, offset);
 			break;
+		case OpCode::CALL_GLOBAL:
+			CallVariableInstruction("CALL_GLOBAL", executable, proc_index, offset);
+			break;
+		case OpCode::CALL_LOCAL:
+			CallVariableInstruction("CALL_LOCAL", executable, proc_index, offset);
+			break;
+		case OpCode::CALL_CELL:
+			CallVariableInstruction("CALL_CELL", executable, proc_index, offset);
+			break;
+		case OpCode::CALL_DIRECT:
+			CallVariableInstruction("CALL_DIRECT", executable, proc_index, offset);
+			break;
+		case OpCode::TAIL_CALL:
+			CallInstruction("TAIL_CALL", executable, proc_index, offset);
+			break;
 		case OpCode::CONSTRUCT_STRUCT:
 			DataInstruction("CONSTRUCT_STRUCT", executable, proc_index, offset);
 			break;
 		case OpCode::CONSTRUCT_UNION:
 			DataInstruction("CONSTRUCT_UNION", executable, proc_index, offset);
 			break;
+		case OpCode::CREATE_GENERATOR:
+			SimpleInstruction("CREATE_GENERATOR", offset);
+			break;
+		case OpCode::RESUME_GENERATOR:
+			SimpleInstruction("RESUME_GENERATOR", offset);
+			break;
+		case OpCode::YIELD:
+			SimpleInstruction("YIELD", offset);
+			break;
+		case OpCode::FINISH_GENERATOR:
+			SimpleInstruction("FINISH_GENERATOR", offset);
+			break;
 		case OpCode::ALLOCATE_CLOSURE:
 			AllocateClosureInstruction("ALLOCATE_CLOSURE", executable, proc_index, offset);
 			break;
@@ -533,6 +680,78 @@ namespace Disassembler
 		case OpCode::SET_MEMBER:
 			MemberInstruction("SET_MEMBER", executable, proc_index, offset);
 			break;
+		case OpCode::ADD_INTEGER_RR:
+			RegisterInstruction("ADD_INTEGER_RR", 2, false, false, executable, proc_index, offset);
+			break;
+		case OpCode::ADD_INTEGER_RI:
+			RegisterInstruction("ADD_INTEGER_RI", 1, true, false, executable, proc_index, offset);
+			break;
+		case OpCode::SUBTRACT_INTEGER_RR:
+			RegisterInstruction("SUBTRACT_INTEGER_RR", 2, false, false, executable, proc_index, offset);
+			break;
+		case OpCode::SUBTRACT_INTEGER_RI:
+			RegisterInstruction("SUBTRACT_INTEGER_RI", 1, true, false, executable, proc_index, offset);
+			break;
+		case OpCode::MULTIPLY_INTEGER_RR:
+			RegisterInstruction("MULTIPLY_INTEGER_RR", 2, false, false, executable, proc_index, offset);
+			break;
+		case OpCode::MULTIPLY_INTEGER_RI:
+			RegisterInstruction("MULTIPLY_INTEGER_RI", 1, true, false, executable, proc_index, offset);
+			break;
+		case OpCode::MODULO_INTEGER_RR:
+			RegisterInstruction("MODULO_INTEGER_RR", 2, false, false, executable, proc_index, offset);
+			break;
+		case OpCode::MODULO_INTEGER_RI:
+			RegisterInstruction("MODULO_INTEGER_RI", 1, true, false, executable, proc_index, offset);
+			break;
+		case OpCode::ADD_INTEGER_RRR:
+			RegisterInstruction("ADD_INTEGER_RRR", 3, false, false, executable, proc_index, offset);
+			break;
+		case OpCode::ADD_INTEGER_RRI:
+			RegisterInstruction("ADD_INTEGER_RRI", 2, true, false, executable, proc_index, offset);
+			break;
+		case OpCode::SUBTRACT_INTEGER_RRR:
+			RegisterInstruction("SUBTRACT_INTEGER_RRR", 3, false, false, executable, proc_index, offset);
+			break;
+		case OpCode::SUBTRACT_INTEGER_RRI:
+			RegisterInstruction("SUBTRACT_INTEGER_RRI", 2, true, false, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_LESS_RR:
+			RegisterInstruction("IF_INTEGER_LESS_RR", 2, false, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_LESS_RI:
+			RegisterInstruction("IF_INTEGER_LESS_RI", 1, true, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_LESS_EQUAL_RR:
+			RegisterInstruction("IF_INTEGER_LESS_EQUAL_RR", 2, false, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_LESS_EQUAL_RI:
+			RegisterInstruction("IF_INTEGER_LESS_EQUAL_RI", 1, true, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_GREATER_RR:
+			RegisterInstruction("IF_INTEGER_GREATER_RR", 2, false, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_GREATER_RI:
+			RegisterInstruction("IF_INTEGER_GREATER_RI", 1, true, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RR:
+			RegisterInstruction("IF_INTEGER_GREATER_EQUAL_RR", 2, false, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_GREATER_EQUAL_RI:
+			RegisterInstruction("IF_INTEGER_GREATER_EQUAL_RI", 1, true, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_EQUAL_RR:
+			RegisterInstruction("IF_INTEGER_EQUAL_RR", 2, false, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_EQUAL_RI:
+			RegisterInstruction("IF_INTEGER_EQUAL_RI", 1, true, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_NOT_EQUAL_RR:
+			RegisterInstruction("IF_INTEGER_NOT_EQUAL_RR", 2, false, true, executable, proc_index, offset);
+			break;
+		case OpCode::IF_INTEGER_NOT_EQUAL_RI:
+			RegisterInstruction("IF_INTEGER_NOT_EQUAL_RI", 1, true, true, executable, proc_index, offset);
+			break;
 		case OpCode::POP:
 			SimpleInstruction("POP", offset);
 			break;